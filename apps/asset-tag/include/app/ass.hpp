@@ -16,6 +16,13 @@
 #include <bluetooth/uuid.h>
 #include <bluetooth/gatt.h>
 
+#include <app/bulk.hpp>
+#include <app/history.hpp>
+#include <app/link.hpp>
+#include <app/persist.hpp>
+#include <app/profile.hpp>
+#include <app/shared_buffer.hpp>
+#include <app/trace.hpp>
 #include <app/version.hpp>
 
 // 96f062c4-b99e-4141-9439-c4f9db977899
@@ -34,6 +41,15 @@
 // 9787a554-76cc-4d02-99bb-aa7d5a4f4a99
 #define BT_UUID_ASS_DATA BT_UUID_DECLARE_128(0x99, 0x4a, 0x4f, 0x5a, 0x7d, 0xaa, 0xbb, 0x99, 0x02, 0x4d, 0xcc, 0x76, 0x54, 0xa5, 0x87, 0x97)
 
+// a1c0e1d2-27c5-4d34-9936-d4cc6188ee99
+#define BT_UUID_ASS_STREAM BT_UUID_DECLARE_128(0x99, 0xee, 0x88, 0x61, 0xcc, 0xd4, 0x36, 0x99, 0x34, 0x4d, 0xc5, 0x27, 0xd2, 0xe1, 0xc0, 0xa1)
+
+// 5f3a7c10-27c5-4d34-9936-d4cc6188ee99
+#define BT_UUID_ASS_PROFILE BT_UUID_DECLARE_128(0x99, 0xee, 0x88, 0x61, 0xcc, 0xd4, 0x36, 0x99, 0x34, 0x4d, 0xc5, 0x27, 0x10, 0x7c, 0x3a, 0x5f)
+
+// 6b2e9d47-27c5-4d34-9936-d4cc6188ee99
+#define BT_UUID_ASS_SUMMARY BT_UUID_DECLARE_128(0x99, 0xee, 0x88, 0x61, 0xcc, 0xd4, 0x36, 0x99, 0x34, 0x4d, 0xc5, 0x27, 0x47, 0x9d, 0x2e, 0x6b)
+
 /** @brief Notify temperature of NTC that may be heated.
  *
  * This will send a GATT notification to all current subscribers.
@@ -45,61 +61,138 @@
 int ass_temp0_notify(float temp0_celcius);
 
 
-static uint8_t ass_updated = 0;
-static char ass_value[128] = {0};
-static char ass_version[sizeof(VERSION)] = {0};
-static char ass_error[128] = {0};
-static char ass_data[128] = {0};
+// Characteristic values are double buffered so BT RX thread reads never see a torn write
+using ass_buffer_t = app::shared_buffer_t<128>;
+static ass_buffer_t ass_value;
+static ass_buffer_t ass_error;
+static ass_buffer_t ass_data;
 
-// Readable Characteristic Handlers
+// Writable characteristics are persisted through a coalescing scheduler
+enum ass_region_e : size_t {
+	ASS_REGION_VALUE = 0,
+	ASS_REGION_DATA = 1,
+	ASS_NUM_REGIONS
+};
 
-static ssize_t read_ass_value(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t len, uint16_t offset) {
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, attr->user_data, strlen(ass_value));
-}
+static constexpr int64_t ASS_PERSIST_WINDOW_MS = 2000;
+static app::persist_t<ASS_NUM_REGIONS, ass_buffer_t> ass_persist({ &ass_value, &ass_data }, ASS_PERSIST_WINDOW_MS);
 
-static ssize_t read_ass_version(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t len, uint16_t offset) {
-	memcpy(ass_version, VERSION, sizeof(VERSION));
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, attr->user_data, strlen(ass_version));
-}
+// Bulk data (history) is pushed as notifications after a range request
+static app::bulk_transfer_t<> ass_bulk;
+
+// History aggregates, set while history is kept
+static app::bulk_source_t* ass_summary = nullptr;
+
+// Readable Characteristic Handlers
 
-static ssize_t read_ass_error(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t len, uint16_t offset) {
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, attr->user_data, strlen(ass_error));
+static ssize_t read_ass_buffer(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t len, uint16_t offset) {
+	const ass_buffer_t* buffer = reinterpret_cast<const ass_buffer_t*>(attr->user_data);
+	return buffer->read([&](const uint8_t* data, size_t data_len) {
+		return bt_gatt_attr_read(conn, attr, buf, len, offset, data, data_len);
+	});
 }
 
-static ssize_t read_ass_data(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t len, uint16_t offset) {
-	return bt_gatt_attr_read(conn, attr, buf, len, offset, attr->user_data, strlen(ass_data));
+// The version is constant, serve it straight from flash
+static ssize_t read_ass_version(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t len, uint16_t offset) {
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, VERSION, sizeof(VERSION) - 1);
 }
 
 // Writable Characteristic Handlers
 
 static ssize_t write_ass_value(bt_conn* conn, const bt_gatt_attr* attr, const void* buf, uint16_t len, uint16_t offset, uint8_t flags) {
-	uint8_t* value = reinterpret_cast<uint8_t*>(attr->user_data);
-	if(offset + len > sizeof(ass_value)) {
+	if(!ass_persist.write(ASS_REGION_VALUE, buf, offset, len)) {
 			return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
 	}
 
-	memcpy(value + offset, buf, len);
-
-	ass_updated |= BIT(0);
-	LOG_INF("Wrote ass_value(%d, %d), ass_updated: 0x%01x", (int) offset, (int) len, (int) ass_updated);
+	app::link_manager.activity(conn);
+	APP_TRACE("Wrote ass_value(%d, %d)", (int) offset, (int) len);
 
 	return len;
 }
 
 static ssize_t write_ass_data(bt_conn* conn, const bt_gatt_attr* attr, const void* buf, uint16_t len, uint16_t offset, uint8_t flags) {
-	uint8_t* value = reinterpret_cast<uint8_t*>(attr->user_data);
-	if(offset + len > sizeof(ass_data)) {
+	if(!ass_persist.write(ASS_REGION_DATA, buf, offset, len)) {
 			return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
 	}
 
-	memcpy(value + offset, buf, len);
+	app::link_manager.activity(conn);
+	APP_TRACE("Wrote ass_data(%d, %d)", (int) offset, (int) len);
+
+	return len;
+}
 
-	ass_updated |= BIT(1);
-	LOG_INF("Wrote ass_data(%d, %d), ass_updated: 0x%01x", (int) offset, (int) len, (int) ass_updated);
+// Streaming Characteristic Handlers
+
+// Reads the cursor as little endian (offset, end, size, first) so a client can resume
+static ssize_t read_ass_stream(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t len, uint16_t offset) {
+	const auto cursor = ass_bulk.cursor();
+	uint8_t value[16];
+	sys_put_le32(cursor.offset, value);
+	sys_put_le32(cursor.end, value + 4);
+	sys_put_le32(cursor.size, value + 8);
+	sys_put_le32(cursor.first, value + 12);
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, value, sizeof(value));
+}
+
+// Requests little endian (offset) or (offset, length) to be notified
+static ssize_t write_ass_stream(bt_conn* conn, const bt_gatt_attr* attr, const void* buf, uint16_t len, uint16_t offset, uint8_t flags) {
+	if(offset != 0 || (len != 4 && len != 8)) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+	}
+	if(!bt_gatt_is_subscribed(conn, attr, BT_GATT_CCC_NOTIFY)) {
+		return BT_GATT_ERR(BT_ATT_ERR_CCC_IMPROPER_CONF);
+	}
+
+	const uint8_t* request = reinterpret_cast<const uint8_t*>(buf);
+	const uint32_t start = sys_get_le32(request);
+	const uint32_t length = len == 8 ? sys_get_le32(request + 4) : UINT32_MAX;
+	app::link_manager.activity(conn);
+	const int err = ass_bulk.request(conn, attr, start, length);
+	if(err == -ERANGE) {
+		// Dropped since, the client reads the stream cursor for what is left
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+	if(err) {
+		LOG_ERR("Failed to start bulk transfer: %d", err);
+		return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+	}
 
 	return len;
 }
 
+static void ass_stream_ccc_changed(const bt_gatt_attr* attr, uint16_t value) {
+	LOG_INF("ass_stream notifications %s", value == BT_GATT_CCC_NOTIFY ? "enabled" : "disabled");
+}
+
+// Profiling Characteristic Handlers
+
+// Reads the stage profile dump, snapshotted at the start of a long read so it stays consistent
+static ssize_t read_ass_profile(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t len, uint16_t offset) {
+	static uint8_t dump[decltype(app::profile)::DUMP_SIZE];
+	static size_t dump_len = 0;
+	if(offset == 0) {
+		dump_len = app::profile.dump(dump);
+	}
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, dump, dump_len);
+}
+
+// History Characteristic Handlers
+
+// Reads the history summary, computed at the start of a long read so it stays consistent
+static ssize_t read_ass_summary(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t len, uint16_t offset) {
+	static uint8_t summary[app::history_t<>::SUMMARY_SIZE];
+	static ssize_t summary_len = 0;
+	if(offset == 0) {
+		app::bulk_source_t* source = ass_summary;
+		summary_len = source ? source->read(0, summary, sizeof(summary)) : 0;
+		if(summary_len < 0) {
+			summary_len = 0;
+			return BT_GATT_ERR(BT_ATT_ERR_UNLIKELY);
+		}
+	}
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, summary, summary_len);
+}
+
 // GATT uses ATT, so the attrs index has other entries than the high level macros
 // Read this guide and use gdb for more details
 // https://www.novelbits.io/bluetooth-gatt-services-characteristics/
@@ -109,55 +202,56 @@ BT_GATT_SERVICE_DEFINE(ass_svc,
     BT_GATT_CHARACTERISTIC(BT_UUID_ASS_VALUE,
             BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
             BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-            read_ass_value, write_ass_value, ass_value),
+            read_ass_buffer, write_ass_value, &ass_value),
 	BT_GATT_CHARACTERISTIC(BT_UUID_ASS_ERROR,
 		BT_GATT_CHRC_READ,
 		BT_GATT_PERM_READ,
-		read_ass_error, NULL, ass_error),
+		read_ass_buffer, NULL, &ass_error),
     BT_GATT_CHARACTERISTIC(BT_UUID_ASS_VERSION,
 		BT_GATT_CHRC_READ,
 		BT_GATT_PERM_READ,
-		read_ass_version, NULL, ass_version),
+		read_ass_version, NULL, NULL),
 	BT_GATT_CHARACTERISTIC(BT_UUID_ASS_DATA,
 		BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE,
 		BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
-		read_ass_data, write_ass_data, ass_data),
+		read_ass_buffer, write_ass_data, &ass_data),
+	BT_GATT_CHARACTERISTIC(BT_UUID_ASS_STREAM,
+		BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE | BT_GATT_CHRC_NOTIFY,
+		BT_GATT_PERM_READ | BT_GATT_PERM_WRITE,
+		read_ass_stream, write_ass_stream, NULL),
+	BT_GATT_CCC(ass_stream_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_ASS_PROFILE,
+		BT_GATT_CHRC_READ,
+		BT_GATT_PERM_READ,
+		read_ass_profile, NULL, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_ASS_SUMMARY,
+		BT_GATT_CHRC_READ,
+		BT_GATT_PERM_READ,
+		read_ass_summary, NULL, NULL),
 );
 
 static int ass_init(const device* dev) {
 	ARG_UNUSED(dev);
 
-	memset(ass_value, 0, sizeof(ass_value));
-	memset(ass_data, 0, sizeof(ass_data));
-	ass_updated = 0;
-
+	// The buffers start zeroed, restored contents are assigned once storage is mounted
 	return 0;
 }
 
-int ass_value_write(std::string_view data) {
-	size_t message_length = std::min(size_t{data.size()}, size_t{sizeof(ass_value) - 1});
-	memcpy(ass_value, data.data(), message_length);
-	ass_value[message_length] = '\0';
-	LOG_INF("Copied %d bytes of message to ass_value", message_length);
-	LOG_INF("ass_value: %s", log_strdup(reinterpret_cast<char*>(ass_value)));
+inline int ass_value_write(std::string_view data) {
+	ass_value.assign(data.data(), data.size());
+	APP_TRACE("Copied %d bytes of message to ass_value", (int) data.size());
 	return 0;
 }
 
-int ass_error_write(std::string_view data) {
-	size_t message_length = std::min(size_t{data.size()}, size_t{sizeof(ass_error) - 1});
-	memcpy(ass_error, data.data(), message_length);
-	ass_error[message_length] = '\0';
-	LOG_INF("Copied %d bytes of message to ass_error", message_length);
-	LOG_INF("ass_error: %s", log_strdup(reinterpret_cast<char*>(ass_error)));
+inline int ass_error_write(std::string_view data) {
+	ass_error.assign(data.data(), data.size());
+	APP_TRACE("Copied %d bytes of message to ass_error", (int) data.size());
 	return 0;
 }
 
-int ass_data_write(std::string_view data) {
-	size_t message_length = std::min(size_t{data.size()}, size_t{sizeof(ass_data) - 1});
-	memcpy(ass_data, data.data(), message_length);
-	ass_data[message_length] = '\0';
-	LOG_INF("Copied %d bytes of message to ass_data", message_length);
-	LOG_INF("ass_data: %s", log_strdup(reinterpret_cast<char*>(ass_data)));
+inline int ass_data_write(std::string_view data) {
+	ass_data.assign(data.data(), data.size());
+	APP_TRACE("Copied %d bytes of message to ass_data", (int) data.size());
 	return 0;
 }
 
@@ -0,0 +1,85 @@
+#ifndef APP_INCLUDE_APP_BROADCAST_HPP
+#define APP_INCLUDE_APP_BROADCAST_HPP
+
+#include <zephyr.h>
+#include <spinlock.h>
+#include <sys/byteorder.h>
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+namespace app {
+
+// Tag state bits in the broadcast flags byte
+enum broadcast_flag_e : uint8_t {
+    BROADCAST_LOW_BATTERY = BIT(0),
+    BROADCAST_ERROR       = BIT(1),
+    BROADCAST_FAULTS      = BIT(2),
+    BROADCAST_SAFE_MODE   = BIT(3),
+};
+
+// Tag state carried in advertising manufacturer data, so scanners learn it without connecting
+//
+// Layout, little endian: u16 company id, u8 version, u8 battery %, u8 flags, u8 change
+// counter, u16 CRC-16/CCITT of ass_value. The counter moves whenever any other field
+// changes, so a gateway can skip tags it has already seen in this state.
+struct broadcast_t {
+    // Bluetooth SIG value reserved for tags without an assigned company identifier
+    static constexpr uint16_t COMPANY_ID = 0xffff;
+    static constexpr uint8_t VERSION = 1;
+    static constexpr size_t SIZE = 8;
+
+private:
+    k_spinlock m_lock = {};
+    std::array<uint8_t, SIZE> m_payload = {
+        COMPANY_ID & 0xff, COMPANY_ID >> 8, VERSION, 100, 0, 0, 0, 0
+    };
+
+    // Caller holds m_lock
+    bool apply(uint8_t battery_pct, uint8_t flags, uint16_t value_hash) {
+        if(m_payload[3] == battery_pct && m_payload[4] == flags && sys_get_le16(&m_payload[6]) == value_hash) {
+            return false;
+        }
+        m_payload[3] = battery_pct;
+        m_payload[4] = flags;
+        m_payload[5]++;
+        sys_put_le16(value_hash, &m_payload[6]);
+        return true;
+    }
+
+public:
+    // Rebuilds the payload, returns true when it changed
+    bool update(uint8_t battery_pct, uint8_t flags, uint16_t value_hash) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        const bool changed = apply(battery_pct, flags, value_hash);
+        k_spin_unlock(&m_lock, key);
+        return changed;
+    }
+
+    // Sets or clears flag bits, keeping the other fields
+    bool set_flags(uint8_t mask, bool on) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        const uint8_t flags = on ? m_payload[4] | mask : m_payload[4] & ~mask;
+        const bool changed = apply(m_payload[3], flags, sys_get_le16(&m_payload[6]));
+        k_spin_unlock(&m_lock, key);
+        return changed;
+    }
+
+    uint8_t flags() const {
+        return m_payload[4];
+    }
+
+    // Copies a consistent snapshot of the payload into dst of SIZE bytes
+    void copy(uint8_t* dst) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        std::memcpy(dst, m_payload.data(), SIZE);
+        k_spin_unlock(&m_lock, key);
+    }
+};
+
+static broadcast_t broadcast;
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef APP_INCLUDE_APP_BULK_HPP
+#define APP_INCLUDE_APP_BULK_HPP
+
+#include <app_log.hpp>
+
+#include <app/profile.hpp>
+#include <app/trace.hpp>
+#include <app/work.hpp>
+
+#include <zephyr.h>
+#include <sys/atomic.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace app {
+
+// Bytes served by a bulk transfer, addressed by offset
+//
+// A source that drops its oldest bytes keeps the offsets of the rest, so [first(), size())
+// is what is still readable and an offset names the same bytes for as long as it is.
+struct bulk_source_t {
+    virtual uint32_t size() = 0;
+    virtual ssize_t read(uint32_t offset, uint8_t* dst, size_t len) = 0;
+
+    // Oldest offset still readable, the bytes before it were dropped
+    virtual uint32_t first() {
+        return 0;
+    }
+};
+
+// Streams a range of a source to one subscriber as back-to-back notifications
+//
+// Each notification carries as much as the negotiated ATT MTU allows. At most
+// MAX_IN_FLIGHT notifications are queued in the stack at a time, and the pump is
+// resubmitted from the sent callback as buffers free up. The cursor survives a
+// disconnect, so a client can resume from it after reconnecting. A request from an
+// offset the source has dropped since is refused instead of served from other bytes.
+template<size_t MAX_CHUNK = CONFIG_BT_L2CAP_TX_MTU - 3, size_t MAX_IN_FLIGHT = 4>
+struct bulk_transfer_t : counter_source_t {
+    struct cursor_t {
+        uint32_t offset;
+        uint32_t end;
+        uint32_t size;
+        uint32_t first;
+    };
+
+    struct stats_t {
+        uint32_t bytes = 0;
+        uint32_t notifications = 0;
+        uint32_t stalls = 0;
+        uint32_t transfers = 0;
+    };
+
+private:
+    k_mutex m_lock;
+    bulk_source_t* m_source = nullptr;
+    bt_conn* m_conn = nullptr;
+    const bt_gatt_attr* m_attr = nullptr;
+    uint32_t m_offset = 0;
+    uint32_t m_end = 0;
+    atomic_t m_in_flight = ATOMIC_INIT(0);
+    work_t<> m_pump;
+    uint8_t m_chunk[MAX_CHUNK];
+    stats_t m_stats = {};
+
+    static void on_sent(bt_conn* conn, void* user_data) {
+        auto* self = static_cast<bulk_transfer_t*>(user_data);
+        atomic_dec(&self->m_in_flight);
+        self->m_pump.submit();
+    }
+
+    void release() {
+        if(m_conn) {
+            bt_conn_unref(m_conn);
+            m_conn = nullptr;
+        }
+    }
+
+    void pump() {
+        k_mutex_lock(&m_lock, K_FOREVER);
+        if(!m_conn || !m_source) {
+            k_mutex_unlock(&m_lock);
+            return;
+        }
+
+        const size_t chunk_size = std::min<size_t>(bt_gatt_get_mtu(m_conn) - 3, MAX_CHUNK);
+        while(m_offset < m_end && atomic_get(&m_in_flight) < static_cast<atomic_val_t>(MAX_IN_FLIGHT)) {
+            const size_t len = std::min<size_t>(chunk_size, m_end - m_offset);
+            const ssize_t count = m_source->read(m_offset, m_chunk, len);
+            if(count <= 0) {
+                LOG_ERR("Bulk source read failed at %u: %d", m_offset, (int) count);
+                m_end = m_offset;
+                break;
+            }
+
+            bt_gatt_notify_params params = {};
+            params.attr = m_attr;
+            params.data = m_chunk;
+            params.len = static_cast<uint16_t>(count);
+            params.func = on_sent;
+            params.user_data = this;
+
+            atomic_inc(&m_in_flight);
+            const int err = bt_gatt_notify_cb(m_conn, &params);
+            if(err) {
+                atomic_dec(&m_in_flight);
+                if(err == -ENOMEM) {
+                    // Out of TX buffers, resume from the sent callback or shortly after
+                    m_stats.stalls++;
+                    if(atomic_get(&m_in_flight) == 0) {
+                        m_pump.schedule(K_MSEC(10));
+                    }
+                } else {
+                    LOG_ERR("Bulk notify failed: %d", err);
+                    release();
+                }
+                break;
+            }
+
+            m_offset += count;
+            m_stats.bytes += count;
+            m_stats.notifications++;
+        }
+
+        if(m_offset >= m_end && atomic_get(&m_in_flight) == 0) {
+            release();
+        }
+        k_mutex_unlock(&m_lock);
+    }
+
+public:
+    bulk_transfer_t() : m_pump([this]() { pump(); }) {
+        k_mutex_init(&m_lock);
+    }
+
+    bulk_transfer_t(const bulk_transfer_t&) = delete;
+
+    void set_source(bulk_source_t* source) {
+        k_mutex_lock(&m_lock, K_FOREVER);
+        m_source = source;
+        k_mutex_unlock(&m_lock);
+    }
+
+    // Starts streaming [offset, offset + length) of the source to conn through attr,
+    // -ERANGE when offset was dropped
+    int request(bt_conn* conn, const bt_gatt_attr* attr, uint32_t offset, uint32_t length) {
+        k_mutex_lock(&m_lock, K_FOREVER);
+        if(!m_source) {
+            k_mutex_unlock(&m_lock);
+            return -ENODEV;
+        }
+        if(m_conn && m_conn != conn) {
+            k_mutex_unlock(&m_lock);
+            return -EBUSY;
+        }
+
+        const uint32_t size = m_source->size();
+        if(offset < m_source->first()) {
+            k_mutex_unlock(&m_lock);
+            return -ERANGE;
+        }
+        if(!m_conn) {
+            m_conn = bt_conn_ref(conn);
+            atomic_clear(&m_in_flight);
+        }
+        m_attr = attr;
+        m_offset = std::min(offset, size);
+        m_end = length > size - m_offset ? size : m_offset + length;
+        m_stats.transfers++;
+        APP_TRACE("Bulk transfer %u..%u of %u", m_offset, m_end, size);
+        k_mutex_unlock(&m_lock);
+
+        m_pump.submit();
+        return 0;
+    }
+
+    // Stops pushing to conn, keeping the cursor for a later resume
+    void disconnected(bt_conn* conn) {
+        k_mutex_lock(&m_lock, K_FOREVER);
+        if(m_conn == conn) {
+            release();
+            atomic_clear(&m_in_flight);
+        }
+        k_mutex_unlock(&m_lock);
+    }
+
+    cursor_t cursor() {
+        k_mutex_lock(&m_lock, K_FOREVER);
+        const cursor_t cursor = { m_offset, m_end, m_source ? m_source->size() : 0, m_source ? m_source->first() : 0 };
+        k_mutex_unlock(&m_lock);
+        return cursor;
+    }
+
+    const stats_t& stats() const {
+        return m_stats;
+    }
+
+    // Counter group BULK of the profile dump
+    size_t read(uint32_t* dst) override {
+        k_mutex_lock(&m_lock, K_FOREVER);
+        const stats_t s = m_stats;
+        k_mutex_unlock(&m_lock);
+        return put_counters(dst, s.bytes, s.notifications, s.stalls, s.transfers);
+    }
+};
+
+}
+
+#endif
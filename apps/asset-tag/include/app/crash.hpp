@@ -0,0 +1,72 @@
+#ifndef APP_INCLUDE_APP_CRASH_HPP
+#define APP_INCLUDE_APP_CRASH_HPP
+
+#include <zephyr.h>
+#include <linker/section_tags.h>
+#include <sys/crc.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace app {
+
+// Reasons above the kernel's K_ERR_* codes
+static constexpr uint32_t FAULT_REASON_EXCEPTION = 0x100;
+static constexpr uint32_t FAULT_REASON_INIT = 0x101;
+
+// What was known when the firmware died, kept across the reset in RAM the startup code skips
+struct fault_record_t {
+    uint32_t magic;
+    uint32_t reason;
+    uint32_t pc;
+    uint32_t lr;
+    uint32_t uptime_ms;
+    uint32_t boot_count;
+    char     message[88];
+    uint32_t crc;
+};
+static_assert(sizeof(fault_record_t) == 116, "fault record layout is stored in flash");
+
+static constexpr uint32_t FAULT_MAGIC = 0x464c5431;
+
+// Defined once in src/crash.cpp, every translation unit shares the record
+extern fault_record_t fault_pending;
+extern uint32_t fault_boot_count;
+
+inline uint32_t fault_crc(const fault_record_t& record) {
+    return crc32_ieee(reinterpret_cast<const uint8_t*>(&record), offsetof(fault_record_t, crc));
+}
+
+// Fills the noinit record, only called on the way to a reset
+inline void fault_capture(uint32_t reason, uint32_t pc, uint32_t lr, const char* message) {
+    fault_record_t& record = fault_pending;
+    std::memset(&record, 0, sizeof(record));
+    record.magic = FAULT_MAGIC;
+    record.reason = reason;
+    record.pc = pc;
+    record.lr = lr;
+    record.uptime_ms = k_uptime_get_32();
+    record.boot_count = fault_boot_count;
+    if(message) {
+        strncpy(record.message, message, sizeof(record.message) - 1);
+    }
+    record.crc = fault_crc(record);
+}
+
+// Moves a record left by the previous boot into out, false when it ended cleanly
+inline bool fault_take(fault_record_t* out) {
+    const bool valid = fault_pending.magic == FAULT_MAGIC && fault_pending.crc == fault_crc(fault_pending);
+    if(valid) {
+        *out = fault_pending;
+    }
+    fault_pending.magic = 0;
+    return valid;
+}
+
+}
+
+// Entry point for the C fatal error handler, defined in src/crash.cpp
+extern "C" void app_fault_capture(unsigned int reason, uint32_t pc, uint32_t lr, const char* message);
+
+#endif
@@ -0,0 +1,462 @@
+#ifndef APP_INCLUDE_APP_DELTA_HPP
+#define APP_INCLUDE_APP_DELTA_HPP
+
+#include <app_log.hpp>
+
+#include <app/expected.hpp>
+#include <app/slot.hpp>
+#include <app/trace.hpp>
+
+#include <zephyr.h>
+#include <storage/flash_map.h>
+#include <sys/byteorder.h>
+#include <sys/crc.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace app {
+
+// Rebuilds a new image into the secondary slot from the running image and a delta stream
+//
+// The stream, little endian, is a header of u32 magic, u32 source size, u32 source CRC-32,
+// u32 target size and u32 target CRC-32, followed by operations until target size bytes
+// are produced: u8 COPY, u32 source offset, u32 length takes bytes from the running image
+// and u8 INSERT, u32 length is followed by length literal bytes. With the DLT2 magic,
+// u8 INSERT_LZ4, u32 length is followed by an LZ4 block of length bytes whose matches
+// reach at most WINDOW bytes back into the target. The stream may be cut anywhere between
+// write() calls. The result goes through the slot writer, and MCUboot still validates it
+// before it boots. Generated by scripts/delta_image.py.
+struct delta_patcher_t {
+    static constexpr uint32_t MAGIC = 0x31544c44; // "DLT1"
+    static constexpr uint32_t MAGIC_LZ4 = 0x32544c44; // "DLT2"
+    static constexpr size_t HEADER_SIZE = 5 * 4;
+    // Target bytes kept for LZ4 matches, a power of two
+    static constexpr size_t WINDOW = 1024;
+
+    enum op_e : uint8_t {
+        OP_COPY = 0,
+        OP_INSERT = 1,
+        OP_INSERT_LZ4 = 2
+    };
+
+    struct stats_t {
+        uint32_t copied = 0;
+        uint32_t inserted = 0;
+        // Target bytes produced by LZ4 blocks, from block_bytes of stream
+        uint32_t inflated = 0;
+        uint32_t block_bytes = 0;
+        uint32_t sessions = 0;
+    };
+
+private:
+    enum class state_e : uint8_t {
+        IDLE,
+        HEADER,
+        OP,
+        INSERT,
+        BLOCK,
+        DONE
+    };
+
+    // Position inside an LZ4 sequence: token, literal length bytes, literals, offset, match
+    // length bytes
+    enum class lz4_e : uint8_t {
+        TOKEN,
+        LITERAL_LENGTH,
+        LITERALS,
+        OFFSET,
+        MATCH_LENGTH
+    };
+
+    static constexpr size_t COPY_CHUNK = 256;
+    static constexpr size_t MATCH_CHUNK = 64;
+    static constexpr uint32_t MIN_MATCH = 4;
+
+    slot_writer_t& m_slot;
+    const flash_area* m_source = nullptr;
+    state_e m_state = state_e::IDLE;
+    uint8_t m_pending[HEADER_SIZE];
+    size_t m_pending_len = 0;
+    uint32_t m_source_size = 0;
+    uint32_t m_target_size = 0;
+    uint32_t m_target_crc = 0;
+    uint32_t m_insert_left = 0;
+    bool m_lz4 = false;
+    lz4_e m_lz4_state = lz4_e::TOKEN;
+    uint32_t m_block_left = 0;
+    uint32_t m_literal_left = 0;
+    uint32_t m_match_len = 0;
+    uint8_t m_window[WINDOW];
+    uint32_t m_written = 0;
+    uint32_t m_crc = 0;
+    uint32_t m_consumed = 0;
+    stats_t m_stats = {};
+
+    result_t fail(int err, const char* what) {
+        LOG_ERR("Delta %s: %d", what, err);
+        abort();
+        return unexpected(err);
+    }
+
+    // Appends produced bytes to the secondary slot
+    result_t emit(const uint8_t* data, size_t len) {
+        if(m_written + len > m_target_size) {
+            return fail(-EINVAL, "overruns target");
+        }
+        const auto written = m_slot.write(data, len);
+        if(!written) {
+            return fail(written.error(), "write");
+        }
+        m_crc = crc32_ieee_update(m_crc, data, len);
+        for(size_t i = 0; i < len; i++) {
+            m_window[(m_written + i) & (WINDOW - 1)] = data[i];
+        }
+        m_written += len;
+        return {};
+    }
+
+    // Repeats len target bytes from distance back, which may overlap what it produces
+    result_t match(uint32_t distance, uint32_t len) {
+        if(distance == 0 || distance > WINDOW || distance > m_written) {
+            return fail(-EINVAL, "match outside window");
+        }
+
+        uint8_t chunk[MATCH_CHUNK];
+        while(len > 0) {
+            const size_t n = std::min<size_t>(len, sizeof(chunk));
+            for(size_t i = 0; i < n; i++) {
+                chunk[i] = i >= distance ? chunk[i - distance] : m_window[(m_written - distance + i) & (WINDOW - 1)];
+            }
+            const auto emitted = emit(chunk, n);
+            if(!emitted) {
+                return emitted;
+            }
+            len -= n;
+            m_stats.inflated += n;
+        }
+        return {};
+    }
+
+    // Decodes the next bytes of the LZ4 block of an INSERT_LZ4, returns how many it took
+    expected_t<size_t> inflate(const uint8_t* data, size_t len) {
+        const size_t available = std::min<size_t>(len, m_block_left);
+        size_t used = 0;
+        while(used < available) {
+            switch(m_lz4_state) {
+                case lz4_e::TOKEN: {
+                    const uint8_t token = data[used++];
+                    m_literal_left = token >> 4;
+                    m_match_len = token & 0x0f;
+                    m_lz4_state = m_literal_left == 0x0f ? lz4_e::LITERAL_LENGTH
+                        : m_literal_left ? lz4_e::LITERALS : lz4_e::OFFSET;
+                    break;
+                }
+
+                case lz4_e::LITERAL_LENGTH:
+                    m_literal_left += data[used];
+                    if(data[used++] != 0xff) {
+                        m_lz4_state = lz4_e::LITERALS;
+                    }
+                    break;
+
+                case lz4_e::LITERALS: {
+                    const size_t n = std::min<size_t>(available - used, m_literal_left);
+                    const auto emitted = emit(data + used, n);
+                    if(!emitted) {
+                        return unexpected(emitted.error());
+                    }
+                    used += n;
+                    m_literal_left -= n;
+                    m_stats.inflated += n;
+                    if(m_literal_left == 0) {
+                        m_lz4_state = lz4_e::OFFSET;
+                    }
+                    break;
+                }
+
+                case lz4_e::OFFSET:
+                    used += gather(data + used, available - used, 2);
+                    if(m_pending_len < 2) {
+                        break;
+                    }
+                    m_pending_len = 0;
+                    if(m_match_len == 0x0f) {
+                        m_lz4_state = lz4_e::MATCH_LENGTH;
+                        break;
+                    }
+                    {
+                        const auto matched = match(sys_get_le16(m_pending), m_match_len + MIN_MATCH);
+                        if(!matched) {
+                            return unexpected(matched.error());
+                        }
+                    }
+                    m_lz4_state = lz4_e::TOKEN;
+                    break;
+
+                case lz4_e::MATCH_LENGTH:
+                    m_match_len += data[used];
+                    if(data[used++] != 0xff) {
+                        const auto matched = match(sys_get_le16(m_pending), m_match_len + MIN_MATCH);
+                        if(!matched) {
+                            return unexpected(matched.error());
+                        }
+                        m_lz4_state = lz4_e::TOKEN;
+                    }
+                    break;
+            }
+        }
+
+        m_block_left -= used;
+        m_stats.block_bytes += used;
+        if(m_block_left == 0) {
+            // The last sequence of a block ends after its literals
+            if(m_lz4_state != lz4_e::OFFSET || m_pending_len != 0) {
+                fail(-EINVAL, "truncated block");
+                return unexpected(-EINVAL);
+            }
+            m_state = state_e::OP;
+        }
+        return used;
+    }
+
+    result_t copy(uint32_t offset, uint32_t len) {
+        if(offset > m_source_size || len > m_source_size - offset) {
+            return fail(-EINVAL, "copy outside source");
+        }
+
+        uint8_t chunk[COPY_CHUNK];
+        while(len > 0) {
+            const size_t n = std::min<size_t>(len, sizeof(chunk));
+            const int rc = flash_area_read(m_source, offset, chunk, n);
+            if(rc) {
+                return fail(rc, "read source");
+            }
+            const auto emitted = emit(chunk, n);
+            if(!emitted) {
+                return emitted;
+            }
+            offset += n;
+            len -= n;
+            m_stats.copied += n;
+        }
+        return {};
+    }
+
+    // CRC-32 of the first size bytes of the running image
+    uint32_t source_crc(uint32_t size) {
+        uint8_t chunk[COPY_CHUNK];
+        uint32_t crc = 0;
+        for(uint32_t offset = 0; offset < size; offset += sizeof(chunk)) {
+            const size_t n = std::min<size_t>(size - offset, sizeof(chunk));
+            if(flash_area_read(m_source, offset, chunk, n)) {
+                return ~crc;
+            }
+            crc = crc32_ieee_update(crc, chunk, n);
+        }
+        return crc;
+    }
+
+    result_t start(const uint8_t* header) {
+        const uint32_t magic = sys_get_le32(header);
+        if(magic != MAGIC && magic != MAGIC_LZ4) {
+            // A format this image cannot apply, the client falls back to a full image
+            return fail(-ENOTSUP, "magic");
+        }
+        m_lz4 = magic == MAGIC_LZ4;
+        m_source_size = sys_get_le32(header + 4);
+        const uint32_t expected_source_crc = sys_get_le32(header + 8);
+        m_target_size = sys_get_le32(header + 12);
+        m_target_crc = sys_get_le32(header + 16);
+
+        const int rc = flash_area_open(FLASH_AREA_ID(image_0), &m_source);
+        if(rc) {
+            return fail(rc, "open source");
+        }
+        if(m_source_size > m_source->fa_size) {
+            return fail(-EFBIG, "source size");
+        }
+        // Built against another image than the one running, refuse before touching the slot
+        if(source_crc(m_source_size) != expected_source_crc) {
+            return fail(-ESRCH, "source mismatch");
+        }
+
+        const auto opened = m_slot.open(m_target_size);
+        if(!opened) {
+            return fail(opened.error(), "open target");
+        }
+
+        LOG_INF("Delta update: %u byte source, %u byte target", m_source_size, m_target_size);
+        m_state = state_e::OP;
+        return {};
+    }
+
+    result_t finish() {
+        const auto flushed = m_slot.flush();
+        if(!flushed) {
+            return fail(flushed.error(), "flush");
+        }
+        if(m_crc != m_target_crc) {
+            return fail(-EBADMSG, "target mismatch");
+        }
+
+        LOG_INF("Delta update complete: %u copied, %u inserted, %u inflated", m_stats.copied, m_stats.inserted, m_stats.inflated);
+        flash_area_close(m_source);
+        m_source = nullptr;
+        m_state = state_e::DONE;
+        return {};
+    }
+
+    // Completes the pending header or operation, returns how many of data's bytes it took
+    size_t gather(const uint8_t* data, size_t len, size_t want) {
+        const size_t n = std::min(len, want - m_pending_len);
+        std::memcpy(m_pending + m_pending_len, data, n);
+        m_pending_len += n;
+        return n;
+    }
+
+public:
+    explicit delta_patcher_t(slot_writer_t& slot) : m_slot(slot) {}
+
+    delta_patcher_t(const delta_patcher_t&) = delete;
+
+    // Forgets any session, the partially written slot is left for the next one to erase
+    void abort() {
+        if(active()) {
+            m_slot.close();
+        }
+        if(m_source) {
+            flash_area_close(m_source);
+            m_source = nullptr;
+        }
+        m_state = state_e::IDLE;
+        m_pending_len = 0;
+        m_consumed = 0;
+    }
+
+    void begin() {
+        abort();
+        m_state = state_e::HEADER;
+        m_insert_left = 0;
+        m_block_left = 0;
+        m_lz4 = false;
+        m_written = 0;
+        m_crc = 0;
+        m_stats.sessions++;
+    }
+
+    // Feeds the next bytes of the stream, any failure aborts the session
+    result_t write(const uint8_t* data, size_t len) {
+        while(len > 0) {
+            size_t used = 0;
+            switch(m_state) {
+                case state_e::IDLE:
+                case state_e::DONE:
+                    return fail(-EALREADY, "no session");
+
+                case state_e::HEADER:
+                    used = gather(data, len, HEADER_SIZE);
+                    if(m_pending_len == HEADER_SIZE) {
+                        m_pending_len = 0;
+                        const auto started = start(m_pending);
+                        if(!started) {
+                            return started;
+                        }
+                    }
+                    break;
+
+                case state_e::OP: {
+                    // The operation byte decides how long its arguments are
+                    if(m_pending_len == 0) {
+                        used = gather(data, len, 1);
+                        break;
+                    }
+                    const size_t want = m_pending[0] == OP_COPY ? 9 : 5;
+                    used = gather(data, len, want);
+                    if(m_pending_len < want) {
+                        break;
+                    }
+                    m_pending_len = 0;
+                    if(m_pending[0] == OP_COPY) {
+                        const auto copied = copy(sys_get_le32(m_pending + 1), sys_get_le32(m_pending + 5));
+                        if(!copied) {
+                            return copied;
+                        }
+                    } else if(m_pending[0] == OP_INSERT) {
+                        m_insert_left = sys_get_le32(m_pending + 1);
+                        m_state = m_insert_left ? state_e::INSERT : state_e::OP;
+                    } else if(m_pending[0] == OP_INSERT_LZ4 && m_lz4) {
+                        m_block_left = sys_get_le32(m_pending + 1);
+                        m_lz4_state = lz4_e::TOKEN;
+                        m_state = m_block_left ? state_e::BLOCK : state_e::OP;
+                    } else {
+                        return fail(-EINVAL, "operation");
+                    }
+                    break;
+                }
+
+                case state_e::INSERT: {
+                    used = std::min<size_t>(len, m_insert_left);
+                    const auto emitted = emit(data, used);
+                    if(!emitted) {
+                        return emitted;
+                    }
+                    m_insert_left -= used;
+                    m_stats.inserted += used;
+                    if(m_insert_left == 0) {
+                        m_state = state_e::OP;
+                    }
+                    break;
+                }
+
+                case state_e::BLOCK: {
+                    const auto inflated = inflate(data, len);
+                    if(!inflated) {
+                        return unexpected(inflated.error());
+                    }
+                    used = *inflated;
+                    break;
+                }
+            }
+
+            data += used;
+            len -= used;
+            m_consumed += used;
+
+            if(m_state == state_e::OP && m_pending_len == 0 && m_written == m_target_size) {
+                const auto finished = finish();
+                if(!finished) {
+                    return finished;
+                }
+                if(len) {
+                    return fail(-EINVAL, "trailing data");
+                }
+            }
+        }
+
+        APP_TRACE("Delta: consumed %d produced %d", (int) m_consumed, (int) m_written);
+        return {};
+    }
+
+    // Stream offset the next write() continues from, what an interrupted upload resumes at
+    uint32_t offset() const {
+        return m_consumed;
+    }
+
+    bool active() const {
+        return m_state != state_e::IDLE && m_state != state_e::DONE;
+    }
+
+    bool done() const {
+        return m_state == state_e::DONE;
+    }
+
+    const stats_t& stats() const {
+        return m_stats;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef APP_INCLUDE_APP_EXPECTED_HPP
+#define APP_INCLUDE_APP_EXPECTED_HPP
+
+#include <zephyr.h>
+#include <sys/__assert.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+namespace app {
+
+template<typename E>
+struct unexpected_t {
+    E error;
+};
+
+template<typename E>
+constexpr unexpected_t<E> unexpected(E error) {
+    return unexpected_t<E>{ error };
+}
+
+// A value or the error that prevented it, errors are negative errno codes by default
+//
+// Limited to trivially copyable values so it stays a plain tagged union without
+// exceptions, heap or non-trivial destructors.
+template<typename T, typename E = int>
+struct expected_t {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_copyable_v<E>, "expected_t holds plain values");
+
+private:
+    union {
+        T m_value;
+        E m_error;
+    };
+    bool m_has_value;
+
+public:
+    constexpr expected_t(const T& value) : m_value(value), m_has_value(true) {}
+    constexpr expected_t(unexpected_t<E> error) : m_error(error.error), m_has_value(false) {}
+
+    constexpr bool has_value() const {
+        return m_has_value;
+    }
+
+    constexpr explicit operator bool() const {
+        return m_has_value;
+    }
+
+    const T& value() const {
+        __ASSERT(m_has_value, "value of a failed result");
+        return m_value;
+    }
+
+    const T& operator*() const {
+        return value();
+    }
+
+    const T* operator->() const {
+        return &value();
+    }
+
+    constexpr T value_or(const T& fallback) const {
+        return m_has_value ? m_value : fallback;
+    }
+
+    constexpr E error() const {
+        return m_has_value ? E{} : m_error;
+    }
+};
+
+template<typename E>
+struct expected_t<void, E> {
+private:
+    E m_error;
+    bool m_has_value;
+
+public:
+    constexpr expected_t() : m_error(), m_has_value(true) {}
+    constexpr expected_t(unexpected_t<E> error) : m_error(error.error), m_has_value(false) {}
+
+    constexpr bool has_value() const {
+        return m_has_value;
+    }
+
+    constexpr explicit operator bool() const {
+        return m_has_value;
+    }
+
+    constexpr E error() const {
+        return m_has_value ? E{} : m_error;
+    }
+};
+
+using result_t = expected_t<void, int>;
+
+// Maps a Zephyr style return code (0 or a negative errno) to a result
+static inline result_t check(int err) {
+    if(err) {
+        return unexpected(err);
+    }
+    return {};
+}
+
+// How often and how patiently to retry an operation that failed transiently
+struct backoff_t {
+    uint8_t  attempts;
+    uint16_t initial_ms;
+    uint16_t max_ms;
+};
+
+// The controller runs out of advertising or TX resources for a few connection events
+static constexpr backoff_t RADIO_BACKOFF = { 4, 10, 200 };
+
+// The SAADC is busy while a stream or calibration finishes
+static constexpr backoff_t ADC_BACKOFF = { 3, 2, 20 };
+
+static inline bool transient(int err) {
+    return err == -EAGAIN || err == -EBUSY || err == -ENOMEM || err == -ETIMEDOUT;
+}
+
+// Calls fn() until it succeeds, fails permanently or runs out of attempts, sleeping with
+// exponential backoff in between. Thread context only.
+template<typename TFN>
+auto retry(const backoff_t& policy, TFN&& fn) {
+    uint32_t delay_ms = policy.initial_ms;
+    for(uint8_t attempt = 1; ; attempt++) {
+        auto result = fn();
+        if(result || attempt >= policy.attempts || !transient(result.error())) {
+            return result;
+        }
+        k_sleep(K_MSEC(delay_ms));
+        delay_ms = std::min<uint32_t>(delay_ms * 2, policy.max_ms);
+    }
+}
+
+}
+
+#endif
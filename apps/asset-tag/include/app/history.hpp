@@ -0,0 +1,322 @@
+#ifndef APP_INCLUDE_APP_HISTORY_HPP
+#define APP_INCLUDE_APP_HISTORY_HPP
+
+#include <app_log.hpp>
+
+#include <zephyr.h>
+#include <sys/byteorder.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace app {
+
+// Fixed memory time series of (seconds, value) samples with rolling aggregates
+//
+// Samples are packed into a block as zigzag varint deltas from the previous sample, so a
+// steady 20 s wake with a slowly moving battery voltage costs about two bytes per sample.
+// A full block is handed to a spill sink (flash) and a new block starts from the next
+// sample. Independently, per-window min/max/sum/count buckets cover the last NUM_WINDOWS
+// windows of WINDOW_S seconds without keeping the samples themselves. Percentiles are
+// taken over every stored sample by narrowing the value range over a few decode passes.
+template<size_t BLOCK_SIZE = 128, size_t NUM_WINDOWS = 24, uint32_t WINDOW_S = 3600>
+struct history_t {
+    struct block_header_t {
+        uint32_t boot;
+        uint32_t t0;
+        int32_t  v0;
+        uint16_t count;
+        uint16_t len;
+    };
+    static_assert(sizeof(block_header_t) == 16, "history block header must stay packed");
+    static_assert(BLOCK_SIZE > sizeof(block_header_t) + 10, "history block must fit a sample");
+
+    // Every sample after the first costs at least one byte per delta
+    static constexpr size_t MAX_BLOCK_SAMPLES = (BLOCK_SIZE - sizeof(block_header_t)) / 2 + 1;
+
+    // Value range is split into this many bins per percentile pass
+    static constexpr size_t PERCENTILE_BINS = 32;
+
+    // Summary layout, little endian: u8 version, u8 windows, u16 reserved, u32 window
+    // seconds, then min, max, mean (i32) and count (u32) of the last window and of all
+    // windows, then the 10th, 50th and 90th percentile (i32) of every stored sample
+    static constexpr uint8_t SUMMARY_VERSION = 1;
+    static constexpr size_t SUMMARY_SIZE = 8 + 2 * 16 + 3 * 4;
+
+    struct aggregate_t {
+        int32_t  min = std::numeric_limits<int32_t>::max();
+        int32_t  max = std::numeric_limits<int32_t>::min();
+        int64_t  sum = 0;
+        uint32_t count = 0;
+
+        void add(int32_t value) {
+            min = std::min(min, value);
+            max = std::max(max, value);
+            sum += value;
+            count++;
+        }
+
+        void merge(const aggregate_t& rhs) {
+            min = std::min(min, rhs.min);
+            max = std::max(max, rhs.max);
+            sum += rhs.sum;
+            count += rhs.count;
+        }
+
+        int32_t mean() const {
+            return count ? static_cast<int32_t>(sum / count) : 0;
+        }
+    };
+
+    struct stats_t {
+        uint32_t samples = 0;
+        uint32_t blocks = 0;
+        uint32_t bytes = 0;
+    };
+
+private:
+    struct window_t {
+        uint32_t id = 0;
+        aggregate_t aggregate = {};
+    };
+
+    union {
+        block_header_t m_header;
+        uint8_t m_block[BLOCK_SIZE];
+    };
+    uint32_t m_boot;
+    uint32_t m_last_t = 0;
+    int32_t m_last_v = 0;
+    std::array<window_t, NUM_WINDOWS> m_windows = {};
+    stats_t m_stats = {};
+
+    static uint32_t zigzag(int32_t value) {
+        return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+    }
+
+    static int32_t unzigzag(uint32_t value) {
+        return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+
+    static size_t put_varint(uint8_t* dst, uint32_t value) {
+        size_t len = 0;
+        while(value >= 0x80) {
+            dst[len++] = static_cast<uint8_t>(value) | 0x80;
+            value >>= 7;
+        }
+        dst[len++] = static_cast<uint8_t>(value);
+        return len;
+    }
+
+    static size_t get_varint(const uint8_t* src, size_t len, uint32_t* value) {
+        *value = 0;
+        for(size_t i = 0; i < len && i < 5; i++) {
+            *value |= static_cast<uint32_t>(src[i] & 0x7f) << (7 * i);
+            if(!(src[i] & 0x80)) {
+                return i + 1;
+            }
+        }
+        return 0;
+    }
+
+    void reset_block(uint32_t t, int32_t v) {
+        std::memset(m_block, 0, sizeof(m_block));
+        m_header.boot = m_boot;
+        m_header.t0 = t;
+        m_header.v0 = v;
+        m_header.count = 1;
+        m_header.len = sizeof(block_header_t);
+    }
+
+    // Calls fn(value) for the samples of the spilled blocks, then of the RAM block
+    template<typename TSPILLED, typename TFN>
+    void for_each_value(TSPILLED& spilled, TFN&& fn) const {
+        uint32_t times[MAX_BLOCK_SAMPLES];
+        int32_t values[MAX_BLOCK_SAMPLES];
+        auto visit = [&](const uint8_t* block, size_t len) {
+            const size_t count = decode(block, len, times, values, MAX_BLOCK_SAMPLES);
+            for(size_t i = 0; i < count; i++) {
+                fn(values[i]);
+            }
+        };
+        spilled(visit);
+        visit(m_block, m_header.len);
+    }
+
+    static uint8_t* put_aggregate(uint8_t* dst, const aggregate_t& aggregate) {
+        sys_put_le32(static_cast<uint32_t>(aggregate.count ? aggregate.min : 0), dst);
+        sys_put_le32(static_cast<uint32_t>(aggregate.count ? aggregate.max : 0), dst + 4);
+        sys_put_le32(static_cast<uint32_t>(aggregate.mean()), dst + 8);
+        sys_put_le32(aggregate.count, dst + 12);
+        return dst + 16;
+    }
+
+    void add_to_window(uint32_t t, int32_t v) {
+        const uint32_t id = t / WINDOW_S;
+        window_t& window = m_windows[id % NUM_WINDOWS];
+        if(window.id != id || window.aggregate.count == 0) {
+            window = { id, {} };
+        }
+        window.aggregate.add(v);
+    }
+
+public:
+    explicit history_t(uint32_t boot) : m_block(), m_boot(boot) {
+        m_header.len = sizeof(block_header_t);
+    }
+
+    // Appends a sample, handing the block to spill(data, len) first when it is full
+    template<typename TSPILL>
+    void insert(uint32_t t, int32_t v, TSPILL&& spill) {
+        add_to_window(t, v);
+        m_stats.samples++;
+
+        if(m_header.count == 0) {
+            reset_block(t, v);
+            m_last_t = t;
+            m_last_v = v;
+            return;
+        }
+
+        uint8_t encoded[10];
+        size_t len = put_varint(encoded, t - m_last_t);
+        len += put_varint(encoded + len, zigzag(v - m_last_v));
+
+        if(m_header.len + len > BLOCK_SIZE) {
+            spill(static_cast<const uint8_t*>(m_block), size_t{m_header.len});
+            m_stats.blocks++;
+            m_stats.bytes += m_header.len;
+            reset_block(t, v);
+        } else {
+            std::memcpy(m_block + m_header.len, encoded, len);
+            m_header.len += len;
+            m_header.count++;
+        }
+
+        m_last_t = t;
+        m_last_v = v;
+    }
+
+    // Decodes a block produced by insert() into times and values, returns the sample count
+    static size_t decode(const uint8_t* block, size_t len, uint32_t* times, int32_t* values, size_t max_samples) {
+        if(len < sizeof(block_header_t) || max_samples == 0) {
+            return 0;
+        }
+
+        block_header_t header;
+        std::memcpy(&header, block, sizeof(header));
+        if(header.count == 0) {
+            return 0;
+        }
+        len = std::min(len, size_t{header.len});
+
+        uint32_t t = header.t0;
+        int32_t v = header.v0;
+        times[0] = t;
+        values[0] = v;
+
+        size_t count = 1;
+        size_t offset = sizeof(block_header_t);
+        while(count < header.count && count < max_samples) {
+            uint32_t dt, dv;
+            size_t used = get_varint(block + offset, len - offset, &dt);
+            if(used == 0) {
+                break;
+            }
+            offset += used;
+            used = get_varint(block + offset, len - offset, &dv);
+            if(used == 0) {
+                break;
+            }
+            offset += used;
+
+            t += dt;
+            v += unzigzag(dv);
+            times[count] = t;
+            values[count] = v;
+            count++;
+        }
+        return count;
+    }
+
+    // Combines the most recent windows, up to NUM_WINDOWS
+    aggregate_t aggregate(size_t windows) const {
+        aggregate_t result;
+        const uint32_t current = m_last_t / WINDOW_S;
+        windows = std::min(windows, NUM_WINDOWS);
+        for(const window_t& window : m_windows) {
+            if(window.aggregate.count > 0 && window.id <= current && current - window.id < windows) {
+                result.merge(window.aggregate);
+            }
+        }
+        return result;
+    }
+
+    // Percentile (0-100) over the RAM block and the spilled blocks, which spilled(fn) hands
+    // to fn(block, len) one at a time. Each pass keeps the bin holding the wanted rank, so
+    // no sample buffer is needed and a 16 bit range takes four passes after the first.
+    template<typename TSPILLED>
+    int32_t percentile(uint8_t pct, TSPILLED&& spilled) const {
+        aggregate_t all;
+        for_each_value(spilled, [&](int32_t v) { all.add(v); });
+        if(all.count == 0) {
+            return 0;
+        }
+
+        uint32_t rank = std::min(all.count - 1, static_cast<uint32_t>(uint64_t{all.count} * std::min<uint8_t>(pct, 100) / 100));
+        int64_t lo = all.min;
+        int64_t hi = all.max;
+        while(lo < hi) {
+            std::array<uint32_t, PERCENTILE_BINS> bins = {};
+            const int64_t width = (hi - lo) / PERCENTILE_BINS + 1;
+            for_each_value(spilled, [&](int32_t v) {
+                if(v >= lo && v <= hi) {
+                    bins[(v - lo) / width]++;
+                }
+            });
+
+            size_t bin = 0;
+            while(rank >= bins[bin]) {
+                rank -= bins[bin];
+                bin++;
+            }
+            lo += static_cast<int64_t>(bin) * width;
+            hi = std::min(hi, lo + width - 1);
+        }
+        return static_cast<int32_t>(lo);
+    }
+
+    // Writes SUMMARY_SIZE bytes of aggregates and percentiles, spilled as for percentile()
+    template<typename TSPILLED>
+    void summary(uint8_t* dst, TSPILLED&& spilled) const {
+        dst[0] = SUMMARY_VERSION;
+        dst[1] = static_cast<uint8_t>(NUM_WINDOWS);
+        sys_put_le16(0, dst + 2);
+        sys_put_le32(WINDOW_S, dst + 4);
+        dst = put_aggregate(dst + 8, aggregate(1));
+        dst = put_aggregate(dst, aggregate(NUM_WINDOWS));
+        for(const uint8_t pct : { 10, 50, 90 }) {
+            sys_put_le32(static_cast<uint32_t>(percentile(pct, spilled)), dst);
+            dst += 4;
+        }
+    }
+
+    const uint8_t* block() const {
+        return m_block;
+    }
+
+    size_t block_size() const {
+        return m_header.len;
+    }
+
+    const stats_t& stats() const {
+        return m_stats;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,455 @@
+#ifndef APP_INCLUDE_APP_JOURNAL_HPP
+#define APP_INCLUDE_APP_JOURNAL_HPP
+
+#include <app_log.hpp>
+
+#include <zephyr.h>
+#include <fs/fs.h>
+#include <sys/crc.h>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+namespace app {
+
+// Append-only, CRC protected record log kept in one file
+//
+// Every write appends a versioned record for a key instead of rewriting a file per key.
+// A record patches the bytes [offset, offset + len) of the value and sets its total size,
+// so a small change costs a small record. The current value of every key is kept in a
+// RAM cache built by replaying the log once on open. When the log grows past COMPACT_SIZE
+// the cached values are written as full records into a fresh file that atomically
+// replaces the old one.
+//
+// Patches made between begin() and commit() form a batch: they are written back to back
+// without syncing and closed by one commit marker, so a batch costs a single metadata
+// commit and replay applies either all of its records or none of them.
+template<size_t NUM_KEYS, size_t MAX_RECORD_SIZE = 128, size_t COMPACT_SIZE = 4096>
+struct journal_t {
+    static constexpr uint16_t MAGIC = 0x4a52;
+    static constexpr uint8_t FORMAT_VERSION = 1;
+    static constexpr size_t MAX_PATH_SIZE = 64;
+
+    // Record flags, the commit marker closing a batch has no key and no payload
+    static constexpr uint16_t FLAG_BATCH = 1 << 0;
+    static constexpr uint16_t FLAG_COMMIT = 1 << 1;
+    static constexpr uint8_t COMMIT_KEY = UINT8_MAX;
+
+    struct header_t {
+        uint16_t magic;
+        uint8_t  version;
+        uint8_t  key;
+        uint32_t seq;
+        uint16_t offset;
+        uint16_t len;
+        uint16_t size;
+        uint16_t flags;
+        uint32_t crc;
+    };
+    static_assert(sizeof(header_t) == 20, "journal record header must stay packed");
+    static_assert(NUM_KEYS < COMMIT_KEY, "the last key is reserved for commit markers");
+    static_assert(MAX_RECORD_SIZE <= UINT16_MAX, "record length must fit the header");
+    static_assert(COMPACT_SIZE >= NUM_KEYS * (sizeof(header_t) + MAX_RECORD_SIZE), "live records must fit after compaction");
+
+    struct entry_t {
+        uint32_t seq = 0;
+        uint16_t size = 0;
+        bool     valid = false;
+        std::array<uint8_t, MAX_RECORD_SIZE> value = {};
+    };
+
+    struct stats_t {
+        uint32_t appends = 0;
+        uint32_t skipped = 0;
+        uint32_t bytes_written = 0;
+        uint32_t compactions = 0;
+        uint32_t replayed = 0;
+        uint32_t truncated = 0;
+        uint32_t batches = 0;
+        uint32_t syncs = 0;
+    };
+
+private:
+    fs_file_t m_file;
+    bool m_open = false;
+    off_t m_end = 0;
+    uint32_t m_seq = 0;
+    bool m_batch = false;
+    bool m_batch_failed = false;
+    off_t m_batch_start = 0;
+    char m_path[MAX_PATH_SIZE] = {};
+    std::array<entry_t, NUM_KEYS> m_index = {};
+    stats_t m_stats = {};
+    uint8_t m_scratch[MAX_RECORD_SIZE];
+
+    static uint32_t checksum(const header_t& header, const void* payload) {
+        uint32_t crc = crc32_ieee(reinterpret_cast<const uint8_t*>(&header), offsetof(header_t, crc));
+        return crc32_ieee_update(crc, reinterpret_cast<const uint8_t*>(payload), header.len);
+    }
+
+    static void tmp_path(const char* path, char* dst, size_t len) {
+        snprintf(dst, len, "%s.tmp", path);
+    }
+
+    static void apply(entry_t& entry, const header_t& header, const void* payload) {
+        std::memcpy(entry.value.data() + header.offset, payload, header.len);
+        if(header.size < entry.size) {
+            std::fill(entry.value.begin() + header.size, entry.value.begin() + entry.size, 0);
+        }
+        entry.size = header.size;
+        entry.seq = header.seq;
+        entry.valid = true;
+    }
+
+    // Reads and validates the record at the current position into m_scratch
+    bool read_record(header_t& header) {
+        if(fs_read(&m_file, &header, sizeof(header)) != sizeof(header)) {
+            return false;
+        }
+        const bool marker = header.key == COMMIT_KEY && header.flags == FLAG_COMMIT && header.len == 0;
+        if(header.magic != MAGIC || header.version != FORMAT_VERSION || (!marker && header.key >= NUM_KEYS)
+            || header.size > MAX_RECORD_SIZE || header.offset + header.len > header.size) {
+            return false;
+        }
+        return fs_read(&m_file, m_scratch, header.len) == header.len && checksum(header, m_scratch) == header.crc;
+    }
+
+    // Applies the batch records in [from, to), the file position ends up at to
+    void apply_batch(off_t from, off_t to) {
+        fs_seek(&m_file, from, FS_SEEK_SET);
+        for(off_t offset = from; offset < to; ) {
+            header_t header;
+            if(!read_record(header)) {
+                break;
+            }
+            if(header.flags & FLAG_BATCH) {
+                apply(m_index[header.key], header, m_scratch);
+                m_stats.replayed++;
+            }
+            offset += sizeof(header) + header.len;
+        }
+    }
+
+    // Rebuild the cache from the log, dropping any torn tail left by a reset mid-append and
+    // any batch that was not closed by its commit marker
+    void replay() {
+        m_index = {};
+        m_seq = 0;
+        off_t offset = 0;
+        off_t end = 0;
+
+        fs_seek(&m_file, 0, FS_SEEK_SET);
+        while(true) {
+            header_t header;
+            if(!read_record(header)) {
+                break;
+            }
+
+            end += sizeof(header) + header.len;
+            m_seq = std::max(m_seq, header.seq);
+            if(header.flags & FLAG_BATCH) {
+                // Applied once the commit marker shows the whole batch made it
+                continue;
+            }
+            if(header.flags & FLAG_COMMIT) {
+                apply_batch(offset, end);
+            } else {
+                apply(m_index[header.key], header, m_scratch);
+                m_stats.replayed++;
+            }
+            offset = end;
+        }
+
+        // The open file's own size, fs_stat() only sees what was last synced
+        const off_t size = fs_seek(&m_file, 0, FS_SEEK_END) == 0 ? fs_tell(&m_file) : 0;
+        if(size > offset) {
+            LOG_WRN("Truncating journal tail at %d of %d", (int) offset, (int) size);
+            fs_truncate(&m_file, offset);
+            m_stats.truncated++;
+        }
+
+        m_end = offset;
+        LOG_INF("Replayed %d journal records, %d bytes", (int) m_stats.replayed, (int) m_end);
+    }
+
+    bool write_record(fs_file_t* file, off_t position, const header_t& header, const void* src) {
+        if(fs_seek(file, position, FS_SEEK_SET) < 0) {
+            return false;
+        }
+        if(fs_write(file, &header, sizeof(header)) != sizeof(header)) {
+            return false;
+        }
+        if(header.len > 0 && fs_write(file, src, header.len) != header.len) {
+            return false;
+        }
+
+        m_stats.bytes_written += sizeof(header) + header.len;
+        return true;
+    }
+
+    static header_t make_header(uint8_t key, uint32_t seq, size_t offset, size_t len, size_t size, const void* src,
+            uint16_t flags = 0) {
+        header_t header = {
+            .magic    = MAGIC,
+            .version  = FORMAT_VERSION,
+            .key      = key,
+            .seq      = seq,
+            .offset   = static_cast<uint16_t>(offset),
+            .len      = static_cast<uint16_t>(len),
+            .size     = static_cast<uint16_t>(size),
+            .flags    = flags,
+            .crc      = 0
+        };
+        header.crc = checksum(header, src);
+        return header;
+    }
+
+public:
+    journal_t() {
+        std::memset(&m_file, 0, sizeof(m_file));
+    }
+
+    journal_t(const journal_t&) = delete;
+
+    ~journal_t() {
+        close();
+    }
+
+    bool open(const char* path) {
+        snprintf(m_path, sizeof(m_path), "%s", path);
+
+        // A leftover temporary file means compaction was interrupted before the rename
+        char tmp[MAX_PATH_SIZE + 4];
+        tmp_path(m_path, tmp, sizeof(tmp));
+        fs_dirent dirent;
+        if(fs_stat(tmp, &dirent) == 0) {
+            LOG_WRN("Removing interrupted journal compaction");
+            fs_unlink(tmp);
+        }
+
+        std::memset(&m_file, 0, sizeof(m_file));
+        int rc = fs_open(&m_file, m_path, FS_O_CREATE | FS_O_RDWR);
+        if(rc < 0) {
+            LOG_ERR("FAIL: open journal %s: %d", log_strdup(m_path), rc);
+            return false;
+        }
+        m_open = true;
+
+        replay();
+        return true;
+    }
+
+    // Starts a batch, the following patches only take effect together at commit()
+    bool begin() {
+        if(!m_open || m_batch) {
+            return false;
+        }
+        m_batch = true;
+        m_batch_failed = false;
+        m_batch_start = m_end;
+        return true;
+    }
+
+    // Closes the batch with a commit marker and a single sync
+    bool commit() {
+        if(!m_batch) {
+            return false;
+        }
+        if(m_batch_failed) {
+            abort();
+            return false;
+        }
+
+        m_batch = false;
+        if(m_end == m_batch_start) {
+            return true;
+        }
+
+        const header_t marker = make_header(COMMIT_KEY, m_seq + 1, 0, 0, 0, nullptr, FLAG_COMMIT);
+        if(!write_record(&m_file, m_end, marker, nullptr) || fs_sync(&m_file) < 0) {
+            LOG_ERR("Failed to commit journal batch");
+            m_batch = true;
+            abort();
+            return false;
+        }
+
+        m_seq = marker.seq;
+        m_end += sizeof(header_t);
+        m_stats.batches++;
+        m_stats.syncs++;
+        if(m_end > static_cast<off_t>(COMPACT_SIZE)) {
+            compact();
+        }
+        return true;
+    }
+
+    // Drops the batch, the cache is rebuilt from the log which no longer has its records
+    void abort() {
+        if(!m_batch) {
+            return;
+        }
+        m_batch = false;
+        if(m_end != m_batch_start || m_batch_failed) {
+            replay();
+        }
+    }
+
+    void close() {
+        if(m_open) {
+            fs_close(&m_file);
+            m_open = false;
+        }
+    }
+
+    // Copies the current value for key into dst, returning the number of bytes or negative on error
+    ssize_t read(uint8_t key, void* dst, size_t len) const {
+        if(key >= NUM_KEYS || !m_index[key].valid) {
+            return -ENOENT;
+        }
+
+        const entry_t& entry = m_index[key];
+        const size_t count = std::min(len, size_t{entry.size});
+        std::memcpy(dst, entry.value.data(), count);
+        return count;
+    }
+
+    // Replaces the whole value for key
+    bool append(uint8_t key, const void* src, size_t len) {
+        return patch(key, 0, src, len, len);
+    }
+
+    // Writes [offset, offset + len) of the value for key and sets its size
+    //
+    // Only the bytes that differ from the stored value are appended, and nothing is
+    // written when the stored value already matches.
+    bool patch(uint8_t key, size_t offset, const void* src, size_t len, size_t size) {
+        if(!m_open || key >= NUM_KEYS || size > MAX_RECORD_SIZE || offset + len > size) {
+            return false;
+        }
+
+        const entry_t& entry = m_index[key];
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(src);
+        if(entry.valid && entry.size == size) {
+            while(len > 0 && bytes[0] == entry.value[offset]) {
+                bytes++;
+                offset++;
+                len--;
+            }
+            while(len > 0 && bytes[len - 1] == entry.value[offset + len - 1]) {
+                len--;
+            }
+            if(len == 0) {
+                m_stats.skipped++;
+                return true;
+            }
+        }
+
+        // A batch may run past COMPACT_SIZE, compaction would write its records unclosed
+        if(!m_batch && m_end + sizeof(header_t) + len > COMPACT_SIZE && !compact()) {
+            return false;
+        }
+
+        const header_t header = make_header(key, m_seq + 1, offset, len, size, bytes, m_batch ? FLAG_BATCH : 0);
+        if(!write_record(&m_file, m_end, header, bytes) || (!m_batch && fs_sync(&m_file) < 0)) {
+            LOG_ERR("Failed to append journal record %d", (int) key);
+            m_batch_failed = m_batch;
+            return false;
+        }
+        m_stats.syncs += m_batch ? 0 : 1;
+
+        m_seq = header.seq;
+        apply(m_index[key], header, bytes);
+        m_end += sizeof(header_t) + len;
+        m_stats.appends++;
+        return true;
+    }
+
+    // Writes the cached values as full records into a new log and atomically swaps it in
+    bool compact() {
+        if(m_batch) {
+            return false;
+        }
+
+        char tmp[MAX_PATH_SIZE + 4];
+        tmp_path(m_path, tmp, sizeof(tmp));
+
+        fs_file_t file;
+        std::memset(&file, 0, sizeof(file));
+        int rc = fs_open(&file, tmp, FS_O_CREATE | FS_O_RDWR);
+        if(rc < 0) {
+            LOG_ERR("FAIL: open %s: %d", log_strdup(tmp), rc);
+            return false;
+        }
+
+        off_t offset = 0;
+        bool ok = true;
+        for(size_t key = 0; key < NUM_KEYS && ok; key++) {
+            const entry_t& entry = m_index[key];
+            if(!entry.valid) {
+                continue;
+            }
+
+            const header_t header = make_header(key, entry.seq, 0, entry.size, entry.size, entry.value.data());
+            ok = write_record(&file, offset, header, entry.value.data());
+            offset += sizeof(header_t) + entry.size;
+        }
+        fs_close(&file);
+
+        if(!ok) {
+            LOG_ERR("Failed to compact journal");
+            fs_unlink(tmp);
+            return false;
+        }
+
+        close();
+        rc = fs_rename(tmp, m_path);
+        if(rc < 0) {
+            LOG_ERR("FAIL: rename %s: %d", log_strdup(tmp), rc);
+        }
+
+        std::memset(&m_file, 0, sizeof(m_file));
+        if(fs_open(&m_file, m_path, FS_O_CREATE | FS_O_RDWR) < 0) {
+            return false;
+        }
+        m_open = true;
+
+        if(rc < 0) {
+            replay();
+            return false;
+        }
+
+        m_end = offset;
+        m_stats.compactions++;
+        LOG_INF("Compacted journal to %d bytes", (int) m_end);
+        return true;
+    }
+
+    // Calls fn(key, data, len) for every key with a value, straight from the cache
+    template<typename TFN>
+    void for_each(TFN&& fn) const {
+        for(size_t key = 0; key < NUM_KEYS; key++) {
+            if(m_index[key].valid) {
+                fn(static_cast<uint8_t>(key), m_index[key].value.data(), size_t{m_index[key].size});
+            }
+        }
+    }
+
+    bool contains(uint8_t key) const {
+        return key < NUM_KEYS && m_index[key].valid;
+    }
+
+    const stats_t& stats() const {
+        return m_stats;
+    }
+
+    off_t size() const {
+        return m_end;
+    }
+};
+
+}
+
+#endif
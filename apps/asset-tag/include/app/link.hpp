@@ -0,0 +1,299 @@
+#ifndef APP_INCLUDE_APP_LINK_HPP
+#define APP_INCLUDE_APP_LINK_HPP
+
+#include <app_log.hpp>
+
+#include <app/profile.hpp>
+#include <app/trace.hpp>
+#include <app/work.hpp>
+
+#include <zephyr.h>
+#include <spinlock.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace app {
+
+enum class link_mode_e : uint8_t {
+    IDLE = 0,
+    FAST = 1
+};
+
+// Connection parameters per link_mode_e, intervals in 1.25 ms units and timeouts in 10 ms units
+static const bt_le_conn_param link_params[] = {
+    // 400-500 ms, skip up to 4 events, 6 s supervision timeout
+    BT_LE_CONN_PARAM_INIT(320, 400, 4, 600),
+    // 7.5-15 ms, no latency, 4 s supervision timeout
+    BT_LE_CONN_PARAM_INIT(6, 12, 0, 400),
+};
+
+// Negotiates fast parameters while a link carries traffic and slow ones when it goes quiet
+//
+// Activity (GATT writes, bulk transfers, SMP commands) moves a link to short intervals,
+// 2M PHY and maximum data length. After IDLE_TIMEOUT_MS without activity it falls back
+// to long intervals with slave latency. Requests run on the system work queue because
+// PHY and data length updates wait on HCI command completion. A link only changes mode
+// once the stack accepted the parameter request, a refused one is retried after
+// RETRY_MS.
+template<size_t MAX_LINKS = CONFIG_BT_MAX_CONN, int64_t IDLE_TIMEOUT_MS = 5000, int64_t RETRY_MS = 1000>
+struct link_manager_t : counter_source_t {
+    struct link_t {
+        bt_conn*    conn = nullptr;
+        link_mode_e mode = link_mode_e::IDLE;
+        link_mode_e requested = link_mode_e::IDLE;
+        int64_t     last_activity = 0;
+
+        // Parameters reported by the controller
+        uint16_t interval = 0;
+        uint16_t latency = 0;
+        uint16_t timeout = 0;
+        uint8_t  tx_phy = 0;
+        uint8_t  rx_phy = 0;
+        uint16_t tx_max_len = 0;
+        uint16_t rx_max_len = 0;
+
+        uint32_t renegotiations = 0;
+        uint32_t request_failures = 0;
+        uint32_t param_updates = 0;
+        uint32_t phy_updates = 0;
+        uint32_t data_len_updates = 0;
+    };
+
+    // Totals over every link since boot and the parameters last reported on any link
+    struct stats_t {
+        uint32_t renegotiations = 0;
+        uint32_t request_failures = 0;
+        uint32_t param_updates = 0;
+        uint32_t phy_updates = 0;
+        uint32_t data_len_updates = 0;
+        uint16_t interval = 0;
+        uint16_t latency = 0;
+        uint16_t timeout = 0;
+        uint8_t  tx_phy = 0;
+        uint8_t  rx_phy = 0;
+        uint16_t tx_max_len = 0;
+        uint16_t rx_max_len = 0;
+    };
+
+private:
+    k_spinlock m_lock = {};
+    std::array<link_t, MAX_LINKS> m_links = {};
+    stats_t m_stats = {};
+    work_t<> m_negotiate;
+
+    link_t* find(bt_conn* conn) {
+        for(link_t& link : m_links) {
+            if(link.conn == conn) {
+                return &link;
+            }
+        }
+        return nullptr;
+    }
+
+    // Asks for the parameters of mode, false when the stack refused them
+    bool request(bt_conn* conn, link_t& link, link_mode_e mode) {
+        const int err = bt_conn_le_param_update(conn, &link_params[static_cast<size_t>(mode)]);
+        if(err && err != -EALREADY) {
+            LOG_WRN("Connection parameter request failed: %d", err);
+            k_spinlock_key_t key = k_spin_lock(&m_lock);
+            link.request_failures++;
+            m_stats.request_failures++;
+            k_spin_unlock(&m_lock, key);
+            return false;
+        }
+
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+        if(mode == link_mode_e::FAST && link.tx_phy != BT_GAP_LE_PHY_2M) {
+            const int phy_err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+            if(phy_err) {
+                LOG_WRN("PHY update request failed: %d", phy_err);
+            }
+        }
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+        if(mode == link_mode_e::FAST && link.tx_max_len < BT_GAP_DATA_LEN_MAX) {
+            const int len_err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+            if(len_err) {
+                LOG_WRN("Data length update request failed: %d", len_err);
+            }
+        }
+#endif
+
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        link.mode = mode;
+        link.renegotiations++;
+        m_stats.renegotiations++;
+        k_spin_unlock(&m_lock, key);
+        APP_TRACE("Requested %s link parameters", mode == link_mode_e::FAST ? "fast" : "idle");
+        return true;
+    }
+
+    // Moves every link to the mode its activity calls for, rechecking while any is fast
+    void negotiate() {
+        const int64_t now = k_uptime_get();
+        int64_t next_idle = INT64_MAX;
+
+        for(link_t& link : m_links) {
+            k_spinlock_key_t key = k_spin_lock(&m_lock);
+            bt_conn* conn = link.conn ? bt_conn_ref(link.conn) : nullptr;
+            const int64_t quiet = now - link.last_activity;
+            link.requested = quiet < IDLE_TIMEOUT_MS ? link_mode_e::FAST : link_mode_e::IDLE;
+            k_spin_unlock(&m_lock, key);
+
+            if(!conn) {
+                continue;
+            }
+            if(link.requested != link.mode && !request(conn, link, link.requested)) {
+                next_idle = std::min(next_idle, RETRY_MS);
+            } else if(link.mode == link_mode_e::FAST) {
+                next_idle = std::min(next_idle, IDLE_TIMEOUT_MS - quiet);
+            }
+            bt_conn_unref(conn);
+        }
+
+        if(next_idle != INT64_MAX) {
+            m_negotiate.schedule(K_MSEC(std::max<int64_t>(next_idle, 0)));
+        }
+    }
+
+public:
+    link_manager_t() : m_negotiate([this]() { negotiate(); }) {}
+
+    link_manager_t(const link_manager_t&) = delete;
+
+    void connected(bt_conn* conn) {
+        bt_conn_info info;
+        const bool has_info = bt_conn_get_info(conn, &info) == 0;
+
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        link_t* link = find(nullptr);
+        if(link) {
+            *link = link_t{};
+            link->conn = bt_conn_ref(conn);
+            link->last_activity = k_uptime_get();
+            if(has_info) {
+                link->interval = info.le.interval;
+                link->latency = info.le.latency;
+                link->timeout = info.le.timeout;
+                m_stats.interval = info.le.interval;
+                m_stats.latency = info.le.latency;
+                m_stats.timeout = info.le.timeout;
+            }
+        }
+        k_spin_unlock(&m_lock, key);
+
+        // Service discovery follows a connection, start fast
+        if(link) {
+            m_negotiate.submit();
+        }
+    }
+
+    void disconnected(bt_conn* conn) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        link_t* link = find(conn);
+        bt_conn* released = link ? link->conn : nullptr;
+        if(link) {
+            link->conn = nullptr;
+        }
+        k_spin_unlock(&m_lock, key);
+
+        if(released) {
+            bt_conn_unref(released);
+        }
+    }
+
+    // Marks traffic on conn, or on every link when conn is null
+    void activity(bt_conn* conn) {
+        bool changed = false;
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        const int64_t now = k_uptime_get();
+        for(link_t& link : m_links) {
+            if(link.conn && (conn == nullptr || link.conn == conn)) {
+                link.last_activity = now;
+                changed |= link.mode != link_mode_e::FAST;
+            }
+        }
+        k_spin_unlock(&m_lock, key);
+
+        if(changed) {
+            m_negotiate.submit();
+        }
+    }
+
+    void param_updated(bt_conn* conn, uint16_t interval, uint16_t latency, uint16_t timeout) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        if(link_t* link = find(conn)) {
+            link->interval = interval;
+            link->latency = latency;
+            link->timeout = timeout;
+            link->param_updates++;
+        }
+        m_stats.interval = interval;
+        m_stats.latency = latency;
+        m_stats.timeout = timeout;
+        m_stats.param_updates++;
+        k_spin_unlock(&m_lock, key);
+        APP_TRACE("Connection parameters: interval %d latency %d timeout %d", interval, latency, timeout);
+    }
+
+    void phy_updated(bt_conn* conn, uint8_t tx_phy, uint8_t rx_phy) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        if(link_t* link = find(conn)) {
+            link->tx_phy = tx_phy;
+            link->rx_phy = rx_phy;
+            link->phy_updates++;
+        }
+        m_stats.tx_phy = tx_phy;
+        m_stats.rx_phy = rx_phy;
+        m_stats.phy_updates++;
+        k_spin_unlock(&m_lock, key);
+        APP_TRACE("PHY: tx %d rx %d", tx_phy, rx_phy);
+    }
+
+    void data_len_updated(bt_conn* conn, uint16_t tx_max_len, uint16_t rx_max_len) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        if(link_t* link = find(conn)) {
+            link->tx_max_len = tx_max_len;
+            link->rx_max_len = rx_max_len;
+            link->data_len_updates++;
+        }
+        m_stats.tx_max_len = tx_max_len;
+        m_stats.rx_max_len = rx_max_len;
+        m_stats.data_len_updates++;
+        k_spin_unlock(&m_lock, key);
+        APP_TRACE("Data length: tx %d rx %d", tx_max_len, rx_max_len);
+    }
+
+    // Copy of the state for conn, empty when it is not tracked
+    link_t state(bt_conn* conn) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        const link_t* found = find(conn);
+        const link_t copy = found ? *found : link_t{};
+        k_spin_unlock(&m_lock, key);
+        return copy;
+    }
+
+    stats_t stats() {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        const stats_t copy = m_stats;
+        k_spin_unlock(&m_lock, key);
+        return copy;
+    }
+
+    // Counter group LINK of the profile dump, see scripts/profile_report.py
+    size_t read(uint32_t* dst) override {
+        const stats_t s = stats();
+        return put_counters(dst, s.renegotiations, s.request_failures, s.param_updates, s.phy_updates,
+            s.data_len_updates, s.interval, s.latency, s.timeout, s.tx_phy, s.rx_phy, s.tx_max_len, s.rx_max_len);
+    }
+};
+
+static link_manager_t<> link_manager;
+
+}
+
+#endif
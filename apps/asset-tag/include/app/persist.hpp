@@ -0,0 +1,192 @@
+#ifndef APP_INCLUDE_APP_PERSIST_HPP
+#define APP_INCLUDE_APP_PERSIST_HPP
+
+#include <app_log.hpp>
+
+#include <app/profile.hpp>
+#include <app/trace.hpp>
+
+#include <zephyr.h>
+#include <spinlock.h>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+namespace app {
+
+// What a flush sink did with a range, a sink returning bool reports true as WRITTEN
+enum class flush_e : uint8_t {
+    FAILED = 0,
+    // The stored bytes already matched, nothing reached flash
+    SKIPPED,
+    WRITTEN
+};
+
+// Tracks which bytes of RAM buffers were written and when, so they are persisted once
+//
+// TBUFFER provides write(offset, src, len), copy(offset, dst, len) and a static size().
+// Writes land in the buffer immediately and widen the region's dirty range. A region is
+// only handed to the flush sink after no write has touched it for the coalescing window,
+// so a burst of writes from a phone becomes a single flush of the changed bytes.
+template<size_t NUM_REGIONS, typename TBUFFER>
+struct persist_t : counter_source_t {
+    static constexpr size_t SIZE = TBUFFER::size();
+
+    struct stats_t {
+        uint32_t writes_received = 0;
+        uint32_t writes_coalesced = 0;
+        // Committed ranges the sink wrote, and ranges it found already stored
+        uint32_t flushes = 0;
+        uint32_t skipped = 0;
+    };
+
+private:
+    struct region_t {
+        TBUFFER* buffer;
+        uint16_t lo = SIZE;
+        uint16_t hi = 0;
+        int64_t  last_write = 0;
+
+        bool dirty() const { return lo < hi; }
+    };
+
+    k_spinlock m_lock = {};
+    std::array<region_t, NUM_REGIONS> m_regions;
+    int64_t m_window_ms;
+    stats_t m_stats = {};
+
+    void redirty(region_t& r, uint16_t lo, uint16_t hi) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        r.lo = std::min(r.lo, lo);
+        r.hi = std::max(r.hi, hi);
+        k_spin_unlock(&m_lock, key);
+    }
+
+    template<typename TRESULT>
+    static flush_e outcome(TRESULT result) {
+        if constexpr (std::is_same_v<TRESULT, flush_e>) {
+            return result;
+        } else {
+            return result ? flush_e::WRITTEN : flush_e::FAILED;
+        }
+    }
+
+public:
+    persist_t(std::array<TBUFFER*, NUM_REGIONS> buffers, int64_t window_ms)
+        : m_regions(), m_window_ms(window_ms) {
+        for(size_t i = 0; i < NUM_REGIONS; i++) {
+            m_regions[i].buffer = buffers[i];
+        }
+    }
+
+    persist_t(const persist_t&) = delete;
+
+    // Copies into the buffer and records the range, returns false when it does not fit
+    bool write(size_t region, const void* src, size_t offset, size_t len) {
+        if(region >= NUM_REGIONS || !m_regions[region].buffer->write(offset, src, len)) {
+            return false;
+        }
+
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        region_t& r = m_regions[region];
+
+        m_stats.writes_received++;
+        if(r.dirty()) {
+            m_stats.writes_coalesced++;
+        }
+        r.lo = std::min(r.lo, static_cast<uint16_t>(offset));
+        r.hi = std::max(r.hi, static_cast<uint16_t>(offset + len));
+        r.last_write = k_uptime_get();
+        k_spin_unlock(&m_lock, key);
+
+        return true;
+    }
+
+    bool dirty() {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        const bool any = std::any_of(m_regions.begin(), m_regions.end(), [](const region_t& r) { return r.dirty(); });
+        k_spin_unlock(&m_lock, key);
+        return any;
+    }
+
+    // Hands each settled dirty range to sink(region, offset, data, len, size)
+    //
+    // The range is copied out of the buffer after it is claimed, so a write racing the flush
+    // is either in the snapshot or marks the range dirty again. When the sink fails the
+    // range is kept dirty and retried on the next flush. The sink returns bool or flush_e,
+    // only committed WRITTEN ranges count as flushes. Returns the number of regions handed over.
+    template<typename TSINK>
+    size_t flush(TSINK&& sink, bool force = false) {
+        return flush(sink, []() { return true; }, force);
+    }
+
+    // Like flush(), but the sink only stages the regions and commit() makes them durable
+    // together. When commit() fails every staged range is marked dirty again.
+    template<typename TSINK, typename TCOMMIT>
+    size_t flush(TSINK&& sink, TCOMMIT&& commit, bool force) {
+        std::array<std::pair<uint16_t, uint16_t>, NUM_REGIONS> staged = {};
+        size_t flushed = 0;
+        uint32_t written = 0;
+        uint32_t skipped = 0;
+        for(size_t i = 0; i < NUM_REGIONS; i++) {
+            uint8_t snapshot[SIZE];
+            k_spinlock_key_t key = k_spin_lock(&m_lock);
+            region_t& r = m_regions[i];
+            const bool settled = force || k_uptime_get() - r.last_write >= m_window_ms;
+            if(!r.dirty() || !settled) {
+                k_spin_unlock(&m_lock, key);
+                continue;
+            }
+            const uint16_t lo = r.lo;
+            const uint16_t hi = r.hi;
+            r.lo = SIZE;
+            r.hi = 0;
+            k_spin_unlock(&m_lock, key);
+
+            r.buffer->copy(lo, snapshot + lo, hi - lo);
+
+            const flush_e result = outcome(sink(i, size_t{lo}, snapshot + lo, static_cast<size_t>(hi - lo), SIZE));
+            if(result == flush_e::FAILED) {
+                redirty(r, lo, hi);
+                continue;
+            }
+
+            written += result == flush_e::WRITTEN ? 1 : 0;
+            skipped += result == flush_e::SKIPPED ? 1 : 0;
+            staged[i] = { lo, hi };
+            flushed++;
+        }
+
+        if(flushed && !commit()) {
+            for(size_t i = 0; i < NUM_REGIONS; i++) {
+                if(staged[i].first < staged[i].second) {
+                    redirty(m_regions[i], staged[i].first, staged[i].second);
+                }
+            }
+            flushed = 0;
+        } else {
+            m_stats.flushes += written;
+            m_stats.skipped += skipped;
+        }
+
+        APP_TRACE("Persist: received %d coalesced %d flushes %d skipped %d", (int) m_stats.writes_received,
+            (int) m_stats.writes_coalesced, (int) m_stats.flushes, (int) m_stats.skipped);
+        return flushed;
+    }
+
+    const stats_t& stats() const {
+        return m_stats;
+    }
+
+    // Counter group PERSIST of the profile dump
+    size_t read(uint32_t* dst) override {
+        return put_counters(dst, m_stats.writes_received, m_stats.writes_coalesced, m_stats.flushes, m_stats.skipped);
+    }
+};
+
+}
+
+#endif
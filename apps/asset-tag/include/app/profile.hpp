@@ -0,0 +1,255 @@
+#ifndef APP_INCLUDE_APP_PROFILE_HPP
+#define APP_INCLUDE_APP_PROFILE_HPP
+
+#include <zephyr.h>
+#include <spinlock.h>
+#include <sys/byteorder.h>
+
+#if defined(CONFIG_CPU_CORTEX_M)
+#include <soc.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace app {
+
+// Timed stages, keep in sync with STAGES in scripts/profile_report.py
+enum class stage_e : uint8_t {
+    BLE_INIT = 0,
+    LFS_INIT,
+    SAADC_INIT,
+    WAKE,
+    PERSIST,
+    MEASURE,
+    BATTERY_LEVEL,
+    HISTORY,
+    SET_NAME,
+    ADV_START,
+    DFU_CHUNK,
+    DFU_WRITE,
+    DFU_ERASE,
+    NUM_STAGES
+};
+
+// Counter groups appended to the dump, keep in sync with GROUPS in scripts/profile_report.py
+enum class counter_group_e : uint8_t {
+    LINK = 0,
+    PERSIST,
+    BULK,
+    TRACE,
+    WORK,
+    JOURNAL,
+    NUM_GROUPS
+};
+
+// Counters a module reports next to the stage timings, read when a dump is taken
+struct counter_source_t {
+    // Writes up to MAX_GROUP_COUNTERS values into dst, returns how many
+    virtual size_t read(uint32_t* dst) = 0;
+};
+
+static constexpr size_t MAX_GROUP_COUNTERS = 12;
+
+// Adapts fn(dst) to counter_source_t, e.g. with put_counters()
+template<typename TFN>
+struct counters_t : counter_source_t {
+    TFN m_fn;
+
+    explicit counters_t(TFN fn) : m_fn(fn) {}
+
+    size_t read(uint32_t* dst) override {
+        return m_fn(dst);
+    }
+};
+
+// Writes values to dst in order, returns how many
+template<typename... TVALUES>
+size_t put_counters(uint32_t* dst, TVALUES... values) {
+    static_assert(sizeof...(values) <= MAX_GROUP_COUNTERS, "counter group too large");
+    size_t count = 0;
+    ((dst[count++] = static_cast<uint32_t>(values)), ...);
+    return count;
+}
+
+// Per-stage cycle statistics with a coarse duration histogram
+//
+// Cycles come from DWT CYCCNT on Cortex-M and from the kernel cycle counter elsewhere.
+// CYCCNT stops while the core sleeps, so for stages that block on flash or the radio the
+// cycle figures are CPU time and the wall clock sum shows the time actually waited.
+// Bucket b counts durations below 16 << (2 * b) us, the last bucket everything above.
+template<size_t NUM_STAGES = static_cast<size_t>(stage_e::NUM_STAGES), size_t NUM_BUCKETS = 8>
+struct profile_t {
+    struct stage_t {
+        uint32_t count = 0;
+        uint32_t min = UINT32_MAX;
+        uint32_t max = 0;
+        uint64_t sum = 0;
+        uint64_t wall_us = 0;
+        std::array<uint16_t, NUM_BUCKETS> buckets = {};
+    };
+
+    // Records the time between construction and stop() or destruction
+    struct scope_t {
+        profile_t* m_profile;
+        size_t     m_stage;
+        uint32_t   m_start;
+        uint32_t   m_wall_start;
+
+        scope_t(profile_t* profile, size_t stage)
+            : m_profile(profile), m_stage(stage), m_start(cycles()), m_wall_start(k_cycle_get_32()) {}
+
+        scope_t(const scope_t&) = delete;
+
+        ~scope_t() {
+            stop();
+        }
+
+        void stop() {
+            if(m_profile) {
+                m_profile->record(m_stage, cycles() - m_start, k_cycle_get_32() - m_wall_start);
+                m_profile = nullptr;
+            }
+        }
+    };
+
+    // Dump layout, little endian: u8 version, u8 stages, u8 buckets, u8 counter groups,
+    // u32 cycle frequency, then per stage u32 count, min, max, u64 sum, wall us and
+    // NUM_BUCKETS x u16, then per registered group u8 counter_group_e, u8 count and
+    // count x u32
+    static constexpr uint8_t DUMP_VERSION = 2;
+    static constexpr size_t STAGE_DUMP_SIZE = 3 * 4 + 2 * 8 + NUM_BUCKETS * 2;
+    static constexpr size_t NUM_GROUPS = static_cast<size_t>(counter_group_e::NUM_GROUPS);
+    static constexpr size_t DUMP_SIZE = 8 + NUM_STAGES * STAGE_DUMP_SIZE + NUM_GROUPS * (2 + 4 * MAX_GROUP_COUNTERS);
+
+private:
+    k_spinlock m_lock = {};
+    std::array<stage_t, NUM_STAGES> m_stages = {};
+    std::array<counter_source_t*, NUM_GROUPS> m_counters = {};
+
+    static size_t bucket(uint32_t us) {
+        if(us < 16) {
+            return 0;
+        }
+        const size_t log2 = 31 - __builtin_clz(us);
+        return std::min((log2 - 2) / 2, NUM_BUCKETS - 1);
+    }
+
+public:
+    profile_t() {
+#if defined(DWT)
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CYCCNT = 0;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    }
+
+    profile_t(const profile_t&) = delete;
+
+    static uint32_t cycles() {
+#if defined(DWT)
+        return DWT->CYCCNT;
+#else
+        return k_cycle_get_32();
+#endif
+    }
+
+    static uint32_t cycles_per_sec() {
+#if defined(DWT)
+        return SystemCoreClock;
+#else
+        return sys_clock_hw_cycles_per_sec();
+#endif
+    }
+
+    scope_t scope(stage_e stage) {
+        return scope_t(this, static_cast<size_t>(stage));
+    }
+
+    void record(size_t stage, uint32_t cycles, uint32_t wall_cycles) {
+        if(stage >= NUM_STAGES) {
+            return;
+        }
+
+        const uint32_t us = static_cast<uint32_t>(uint64_t{cycles} * 1000000 / cycles_per_sec());
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        stage_t& s = m_stages[stage];
+        s.count++;
+        s.min = std::min(s.min, cycles);
+        s.max = std::max(s.max, cycles);
+        s.sum += cycles;
+        s.wall_us += k_cyc_to_us_floor64(wall_cycles);
+        uint16_t& count = s.buckets[bucket(us)];
+        count = count == UINT16_MAX ? count : count + 1;
+        k_spin_unlock(&m_lock, key);
+    }
+
+    // Reports source under group in every dump from now on, null stops it
+    void counters(counter_group_e group, counter_source_t* source) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        m_counters[static_cast<size_t>(group)] = source;
+        k_spin_unlock(&m_lock, key);
+    }
+
+    stage_t stage(stage_e stage) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        const stage_t copy = m_stages[static_cast<size_t>(stage)];
+        k_spin_unlock(&m_lock, key);
+        return copy;
+    }
+
+    // Serializes every stage and counter group into dst of DUMP_SIZE bytes for
+    // scripts/profile_report.py, returns the bytes used
+    size_t dump(uint8_t* dst) {
+        std::array<stage_t, NUM_STAGES> stages;
+        std::array<counter_source_t*, NUM_GROUPS> sources;
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        stages = m_stages;
+        sources = m_counters;
+        k_spin_unlock(&m_lock, key);
+
+        dst[0] = DUMP_VERSION;
+        dst[1] = static_cast<uint8_t>(NUM_STAGES);
+        dst[2] = static_cast<uint8_t>(NUM_BUCKETS);
+        dst[3] = 0;
+        sys_put_le32(cycles_per_sec(), dst + 4);
+
+        uint8_t* p = dst + 8;
+        for(const stage_t& s : stages) {
+            sys_put_le32(s.count, p);
+            sys_put_le32(s.count ? s.min : 0, p + 4);
+            sys_put_le32(s.max, p + 8);
+            sys_put_le64(s.sum, p + 12);
+            sys_put_le64(s.wall_us, p + 20);
+            for(size_t i = 0; i < NUM_BUCKETS; i++) {
+                sys_put_le16(s.buckets[i], p + 28 + 2 * i);
+            }
+            p += STAGE_DUMP_SIZE;
+        }
+
+        // Sources read their counters outside the lock, they take their own
+        for(size_t group = 0; group < NUM_GROUPS; group++) {
+            if(!sources[group]) {
+                continue;
+            }
+            uint32_t values[MAX_GROUP_COUNTERS];
+            const size_t count = std::min(sources[group]->read(values), MAX_GROUP_COUNTERS);
+            p[0] = static_cast<uint8_t>(group);
+            p[1] = static_cast<uint8_t>(count);
+            p += 2;
+            for(size_t i = 0; i < count; i++) {
+                sys_put_le32(values[i], p);
+                p += 4;
+            }
+            dst[3]++;
+        }
+        return p - dst;
+    }
+};
+
+static profile_t<> profile;
+
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef APP_INCLUDE_APP_READY_HPP
+#define APP_INCLUDE_APP_READY_HPP
+
+#include <app/expected.hpp>
+
+#include <zephyr.h>
+
+namespace app {
+
+// How long boot waits on an init stage running elsewhere before treating it as failed
+static constexpr int32_t BOOT_STAGE_TIMEOUT_MS = 5000;
+
+// One-shot readiness signal carrying the outcome of an init stage that runs on another
+// thread or completes from a callback
+struct ready_t {
+private:
+    k_sem m_sem;
+    result_t m_result;
+
+public:
+    ready_t() {
+        k_sem_init(&m_sem, 0, 1);
+    }
+
+    ready_t(const ready_t&) = delete;
+
+    // Callable from ISRs and callbacks
+    void signal(const result_t& result) {
+        m_result = result;
+        k_sem_give(&m_sem);
+    }
+
+    // Forgets the signal, for a stage that starts again
+    void reset() {
+        k_sem_reset(&m_sem);
+    }
+
+    // Blocks until signal(), every later wait returns the same result at once
+    result_t wait(k_timeout_t timeout = K_MSEC(BOOT_STAGE_TIMEOUT_MS)) {
+        if(k_sem_take(&m_sem, timeout)) {
+            return unexpected(-ETIMEDOUT);
+        }
+        k_sem_give(&m_sem);
+        return m_result;
+    }
+};
+
+}
+
+#endif
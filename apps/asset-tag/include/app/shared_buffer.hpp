@@ -0,0 +1,119 @@
+#ifndef APP_INCLUDE_APP_SHARED_BUFFER_HPP
+#define APP_INCLUDE_APP_SHARED_BUFFER_HPP
+
+#include <zephyr.h>
+#include <spinlock.h>
+#include <sys/atomic.h>
+
+#include <algorithm>
+#include <cstring>
+
+namespace app {
+
+// Fixed size, length-prefixed buffer that readers never see torn
+//
+// Writers copy the published slot into the other slot, apply their change, cache the
+// string length and publish the new slot with one atomic store. Readers use the
+// published slot directly without locking and retry only if its sequence number moved,
+// which needs a second write to land while the read is in progress.
+template<size_t SIZE>
+struct shared_buffer_t {
+    static_assert(SIZE <= UINT16_MAX, "length must fit the prefix");
+
+private:
+    struct slot_t {
+        atomic_t seq;
+        uint16_t len;
+        uint8_t  data[SIZE];
+    };
+
+    slot_t m_slots[2] = {};
+    atomic_t m_front = ATOMIC_INIT(0);
+    k_spinlock m_lock = {};
+
+    template<typename TFN>
+    void update(TFN&& fn) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        const atomic_val_t front = atomic_get(&m_front);
+        const slot_t& current = m_slots[front];
+        slot_t& next = m_slots[1 - front];
+
+        atomic_inc(&next.seq);
+        std::memcpy(next.data, current.data, SIZE);
+        fn(next.data);
+        next.len = static_cast<uint16_t>(strnlen(reinterpret_cast<const char*>(next.data), SIZE));
+        atomic_inc(&next.seq);
+
+        atomic_set(&m_front, 1 - front);
+        k_spin_unlock(&m_lock, key);
+    }
+
+public:
+    // Patches [offset, offset + len), returns false when it does not fit
+    bool write(size_t offset, const void* src, size_t len) {
+        if(offset + len > SIZE) {
+            return false;
+        }
+        update([&](uint8_t* data) { std::memcpy(data + offset, src, len); });
+        return true;
+    }
+
+    // Replaces the contents, zero filling the rest so the cached length ends at len
+    void assign(const void* src, size_t len) {
+        len = std::min(len, SIZE);
+        update([&](uint8_t* data) {
+            std::memcpy(data, src, len);
+            std::memset(data + len, 0, SIZE - len);
+        });
+    }
+
+    // Calls fn(data, len) on a stable published slot and returns its result
+    template<typename TFN>
+    auto read(TFN&& fn) const {
+        while(true) {
+            const slot_t& slot = m_slots[atomic_get(&m_front)];
+            const atomic_val_t seq = atomic_get(&slot.seq);
+            if(seq & 1) {
+                continue;
+            }
+
+            auto result = fn(static_cast<const uint8_t*>(slot.data), size_t{slot.len});
+            if(atomic_get(&slot.seq) == seq) {
+                return result;
+            }
+        }
+    }
+
+    // Copies up to len raw bytes from offset, returns the count copied
+    size_t copy(size_t offset, void* dst, size_t len) const {
+        if(offset >= SIZE) {
+            return 0;
+        }
+        len = std::min(len, SIZE - offset);
+        return read([&](const uint8_t* data, size_t) {
+            std::memcpy(dst, data + offset, len);
+            return len;
+        });
+    }
+
+    // Copies the string contents and a terminator into dst of at least SIZE + 1 bytes
+    size_t copy_string(char* dst) const {
+        return read([&](const uint8_t* data, size_t len) {
+            std::memcpy(dst, data, len);
+            dst[len] = '\0';
+            return len;
+        });
+    }
+
+    size_t length() const {
+        return read([](const uint8_t*, size_t len) { return len; });
+    }
+
+    static constexpr size_t size() {
+        return SIZE;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,224 @@
+#ifndef APP_INCLUDE_APP_SLOT_HPP
+#define APP_INCLUDE_APP_SLOT_HPP
+
+#include <app_log.hpp>
+
+#include <app/expected.hpp>
+
+#include <zephyr.h>
+#include <storage/flash_map.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace app {
+
+// Writes an image into the secondary slot front to back, one whole flash page at a time
+//
+// Bytes are gathered in a page buffer and each full page is programmed with one write.
+// erase_next() erases the slot page by page ahead of the write pointer, the upload thread
+// calls it whenever it has nothing else to do, so a page is only erased inline when the
+// writes caught up with the erasing. Pages erased but not written since, e.g. after
+// erase(), are not erased again by the next open(). The last page holds the MCUboot
+// trailer, open() erases it first so a magic or image-ok of an earlier image never
+// survives into the new one.
+struct slot_writer_t {
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    struct stats_t {
+        uint32_t pages_written = 0;
+        uint32_t erased_ahead = 0;
+        uint32_t erased_inline = 0;
+    };
+
+private:
+    const flash_area* m_area = nullptr;
+    uint8_t m_page[PAGE_SIZE];
+    size_t m_fill = 0;
+    // Start of the page being gathered, pages from there up to m_erased are erased
+    uint32_t m_page_off = 0;
+    uint32_t m_erased = 0;
+    // erase_next() stops here, the end of the session rounded up to a page
+    uint32_t m_end = 0;
+    // The trailer page is past m_end and still to be erased
+    bool m_trailer = false;
+    uint32_t m_written = 0;
+    bool m_dirty = false;
+    stats_t m_stats = {};
+
+    result_t attach() {
+        if(m_area) {
+            return {};
+        }
+        const int rc = flash_area_open(FLASH_AREA_ID(image_1), &m_area);
+        if(rc) {
+            LOG_ERR("Slot open: %d", rc);
+            m_area = nullptr;
+            return unexpected(rc);
+        }
+        return {};
+    }
+
+    uint32_t trailer_off() const {
+        return m_area->fa_size - PAGE_SIZE;
+    }
+
+    result_t erase_trailer() {
+        const int rc = flash_area_erase(m_area, trailer_off(), PAGE_SIZE);
+        if(rc) {
+            LOG_ERR("Slot trailer erase: %d", rc);
+            return unexpected(rc);
+        }
+        m_trailer = false;
+        return {};
+    }
+
+    result_t program(size_t len) {
+        if(m_erased <= m_page_off) {
+            const int rc = flash_area_erase(m_area, m_page_off, PAGE_SIZE);
+            if(rc) {
+                LOG_ERR("Slot erase at %u: %d", (unsigned) m_page_off, rc);
+                return unexpected(rc);
+            }
+            m_erased = m_page_off + PAGE_SIZE;
+            m_stats.erased_inline++;
+        }
+
+        // Only the last page is short, padded with erased bytes to the write alignment
+        const size_t align = flash_area_align(m_area);
+        const size_t padded = ROUND_UP(len, align);
+        std::memset(m_page + len, 0xff, padded - len);
+        m_dirty = true;
+        const int rc = flash_area_write(m_area, m_page_off, m_page, padded);
+        if(rc) {
+            LOG_ERR("Slot write at %u: %d", (unsigned) m_page_off, rc);
+            return unexpected(rc);
+        }
+        m_stats.pages_written++;
+        m_page_off += PAGE_SIZE;
+        m_fill = 0;
+        return {};
+    }
+
+public:
+    slot_writer_t() = default;
+    slot_writer_t(const slot_writer_t&) = delete;
+
+    // Starts writing size bytes from the start of the slot
+    result_t open(uint32_t size) {
+        const auto attached = attach();
+        if(!attached) {
+            return attached;
+        }
+        if(size > m_area->fa_size) {
+            return unexpected(-EFBIG);
+        }
+        if(m_dirty) {
+            m_erased = 0;
+            m_dirty = false;
+        }
+        m_page_off = 0;
+        m_fill = 0;
+        m_written = 0;
+        m_end = ROUND_UP(size, PAGE_SIZE);
+        m_trailer = m_end <= trailer_off() && m_erased <= trailer_off();
+        return {};
+    }
+
+    // Stops erasing ahead, what was buffered is dropped
+    void close() {
+        m_end = 0;
+        m_trailer = false;
+        m_fill = 0;
+    }
+
+    // Schedules the whole slot for erase_next()
+    result_t erase() {
+        const auto attached = attach();
+        if(!attached) {
+            return attached;
+        }
+        return open(m_area->fa_size);
+    }
+
+    result_t write(const uint8_t* data, size_t len) {
+        if(!m_area || m_page_off + m_fill + len > m_area->fa_size) {
+            return unexpected(-EFBIG);
+        }
+        while(len > 0) {
+            const size_t n = std::min(len, PAGE_SIZE - m_fill);
+            std::memcpy(m_page + m_fill, data, n);
+            m_fill += n;
+            m_written += n;
+            data += n;
+            len -= n;
+            if(m_fill == PAGE_SIZE) {
+                const auto programmed = program(PAGE_SIZE);
+                if(!programmed) {
+                    return programmed;
+                }
+            }
+        }
+        return {};
+    }
+
+    // Programs the partial last page and ends the session
+    result_t flush() {
+        if(m_fill) {
+            const auto programmed = program(m_fill);
+            if(!programmed) {
+                return programmed;
+            }
+        }
+        if(m_trailer) {
+            const auto erased = erase_trailer();
+            if(!erased) {
+                return erased;
+            }
+            m_stats.erased_inline++;
+        }
+        close();
+        return {};
+    }
+
+    bool erase_pending() const {
+        return m_area && (m_trailer || std::max(m_erased, m_page_off) < m_end);
+    }
+
+    // Erases the trailer, then the first page past the write pointer not erased yet
+    result_t erase_next() {
+        if(!erase_pending()) {
+            return {};
+        }
+        if(m_trailer) {
+            const auto erased = erase_trailer();
+            if(erased) {
+                m_stats.erased_ahead++;
+            }
+            return erased;
+        }
+        const uint32_t off = std::max(m_erased, m_page_off);
+        const int rc = flash_area_erase(m_area, off, PAGE_SIZE);
+        if(rc) {
+            LOG_ERR("Slot erase at %u: %d", (unsigned) off, rc);
+            return unexpected(rc);
+        }
+        m_erased = off + PAGE_SIZE;
+        m_stats.erased_ahead++;
+        return {};
+    }
+
+    // Bytes taken by write() since open()
+    uint32_t written() const {
+        return m_written;
+    }
+
+    const stats_t& stats() const {
+        return m_stats;
+    }
+};
+
+}
+
+#endif
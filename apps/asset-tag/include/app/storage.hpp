@@ -0,0 +1,72 @@
+#ifndef APP_INCLUDE_APP_STORAGE_HPP
+#define APP_INCLUDE_APP_STORAGE_HPP
+
+#include <zephyr.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace app {
+
+// LittleFS geometry and wear leveling, picked per deployment with -DSTORAGE_PROFILE_*
+//
+// The nRF52832 erases 4 KiB pages and programs 32 bit words. Caches are sized in whole
+// reads and programs and divide the page, lookahead covers 8 blocks per byte and
+// block_cycles is how many erases a metadata block takes before LittleFS moves it.
+struct storage_profile_t {
+    uint16_t read_size;
+    uint16_t prog_size;
+    uint16_t cache_size;
+    uint16_t lookahead_size;
+    int32_t  block_cycles;
+
+    // Static RAM: read and prog caches plus the lookahead bitmap
+    constexpr size_t ram() const {
+        return 2 * cache_size + lookahead_size;
+    }
+};
+
+// The Zephyr Kconfig defaults
+static constexpr storage_profile_t STORAGE_KCONFIG = { CONFIG_FS_LITTLEFS_READ_SIZE, CONFIG_FS_LITTLEFS_PROG_SIZE,
+    CONFIG_FS_LITTLEFS_CACHE_SIZE, CONFIG_FS_LITTLEFS_LOOKAHEAD_SIZE, CONFIG_FS_LITTLEFS_BLOCK_CYCLES };
+
+// Journal records and ring slots fit one cache line, a lookahead byte covers the whole
+// storage partition
+static constexpr storage_profile_t STORAGE_SMALL_FILES = { 16, 16, 128, 8, 512 };
+
+// Smallest caches, more flash reads per record
+static constexpr storage_profile_t STORAGE_LOW_RAM = { 16, 16, 32, 8, 512 };
+
+// There is no lower block_cycles profile: bench_storage wears the blocks the same at 64 as
+// at 512, nearly all erases come from copy-on-write file blocks, not the metadata pair
+
+#if defined(STORAGE_PROFILE_KCONFIG)
+static constexpr storage_profile_t storage_profile = STORAGE_KCONFIG;
+#elif defined(STORAGE_PROFILE_LOW_RAM)
+static constexpr storage_profile_t storage_profile = STORAGE_LOW_RAM;
+#else
+static constexpr storage_profile_t storage_profile = STORAGE_SMALL_FILES;
+#endif
+
+static constexpr size_t STORAGE_BLOCK_SIZE = 4096;
+static_assert(storage_profile.prog_size % 4 == 0, "flash programs whole words");
+static_assert(storage_profile.cache_size % storage_profile.read_size == 0
+    && storage_profile.cache_size % storage_profile.prog_size == 0, "cache holds whole reads and programs");
+static_assert(STORAGE_BLOCK_SIZE % storage_profile.cache_size == 0, "cache must divide the flash page");
+static_assert(storage_profile.lookahead_size % 8 == 0, "lookahead is a multiple of 8 bytes");
+
+// Open files take their cache from a k_mem_pool of NUM_BLOCKS blocks of MAX_SIZE, which
+// splits blocks in quarters down to MIN_SIZE
+static constexpr bool quarters_down_to(size_t max, size_t min) {
+    return max == min || (max > min && max % 4 == 0 && quarters_down_to(max / 4, min));
+}
+
+static constexpr size_t FILE_CACHE_POOL_SIZE =
+    CONFIG_FS_LITTLEFS_FC_MEM_POOL_MAX_SIZE * CONFIG_FS_LITTLEFS_FC_MEM_POOL_NUM_BLOCKS;
+static_assert(quarters_down_to(CONFIG_FS_LITTLEFS_FC_MEM_POOL_MAX_SIZE, CONFIG_FS_LITTLEFS_FC_MEM_POOL_MIN_SIZE),
+    "file cache pool MAX_SIZE must be MIN_SIZE times a power of 4");
+static_assert(storage_profile.cache_size <= CONFIG_FS_LITTLEFS_FC_MEM_POOL_MAX_SIZE, "open file caches come from the static pool");
+
+}
+
+#endif
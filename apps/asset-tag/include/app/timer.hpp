@@ -1,12 +1,13 @@
 #ifndef APP_INCLUDE_APP_TIMER_HPP
 #define APP_INCLUDE_APP_TIMER_HPP
 
-#include "zephyr.h"
+#include <app_log.hpp>
 
-#include <array>
-#include <functional>
-#include <memory>
-#include <tuple>
+#include <zephyr.h>
+#include <sys/atomic.h>
+
+#include <cstddef>
+#include <new>
 #include <type_traits>
 
 namespace app {
@@ -27,142 +28,80 @@ template<size_t USEC>
 struct usec_delay_t { constexpr static size_t value = USEC; };
 
 
-// Support timer registration and lookup
-static constexpr int32_t NUM_TIMERS = 5;
-static int32_t TIMER_REGISTRATION_INDEX = 0;
-static std::array<std::tuple<k_timer*, std::function<void()>>,NUM_TIMERS> handlers;
-
-void timer_handler(k_timer* timer) {
-    for(const auto & [registered_timer, handler] : handlers) {
-        if(registered_timer == timer) {
-            handler();
-        }
-    }
-}
-
-// Accept work as a labmda, providing static callbacks and holding references in RAII fashion
-template<size_t I = 0>
-struct lambda_work_t {
-private:
-	static std::function<void()> s_work;
-
-public:
-    struct inner_t {
-        bool m_destruct;
-        constexpr inner_t(std::function<void()>&& f, bool destruct) : m_destruct(destruct) {
-            LOG_DBG("Called inner %d ctr", (int) I);
-            s_work = std::move(f);
-        }
-
-        constexpr inner_t(inner_t&& rhs) : m_destruct(true) {
-            rhs.m_destruct = false;
-        }
-
-        inner_t(const inner_t&) = delete;
-        inner_t() = delete;
-
-        ~inner_t() {
-            LOG_DBG("Called inner %d dtr", (int) I);
-            if(m_destruct) {
-                s_work = [](){ LOG_DBG("Called inner %d after destruction", (int) I); };
-            }
-        }
-    };
-    static_assert(!std::is_copy_constructible<inner_t>::value, "not copyable");
-
-	static void submit() {
-		k_work_init(&work, lambda_work_handler);
-        // Submit to system or app work queue
-        if (work_q == nullptr) {
-            LOG_DBG("Submitting work to system workqueue");
-            k_work_submit(&work);
-        } else {
-            LOG_DBG("Submitting work to special workqueue: %p", work_q.get());
-            k_work_submit_to_queue(work_q.get(), &work);
-        }
-	}
-
-	static void lambda_work_handler(k_work* item) {
-		s_work();
-	}
+// Bound the number of live timers, slots are returned when a timer is destroyed
+static constexpr atomic_val_t NUM_TIMERS = 5;
+inline atomic_t timers_registered = ATOMIC_INIT(0);
 
-    static k_work work;
-    static std::shared_ptr<k_work_q> work_q;
-
-private:
-    inner_t m_inner;
-
-public:
-    constexpr lambda_work_t(inner_t&& inner) : m_inner(std::move(inner)) {}
-    constexpr lambda_work_t(lambda_work_t&& rhs) : m_inner(std::move(rhs.m_inner)) {}
-    lambda_work_t(const lambda_work_t&) = delete;
-};
-
-// Registers a timer and and calls handlers in RAII fashion
-template<typename THZ, typename TSCALER = scale_t<1>>
-struct timer_t {
-private:
+// Holds a timer and the work it submits inline, without heap or handler table
+//
+// The timer's user data points back at this container, so expiry finds the work in O(1)
+// from ISR context. The work is any type with a submit() that fits STORAGE_SIZE. When all
+// NUM_TIMERS slots are taken the timer is left invalid and never started.
+template<size_t STORAGE_SIZE = 32>
+struct inline_timer_t {
+protected:
     k_timer m_timer;
     bool m_stopped;
+    bool m_valid;
+    alignas(std::max_align_t) uint8_t m_storage[STORAGE_SIZE];
+    void (*m_submit)(void*);
+    void (*m_destroy)(void*);
+
+    static void timer_handler(k_timer* timer) {
+        auto* self = static_cast<inline_timer_t*>(k_timer_user_data_get(timer));
+        self->m_submit(self->m_storage);
+    }
 
-public:
     template<typename TLAMBDA>
-    timer_t(TLAMBDA&& work)
+    inline_timer_t(TLAMBDA&& work)
         : m_timer(),
-          m_stopped(true) {
-
-        if (TIMER_REGISTRATION_INDEX == NUM_TIMERS) {
-            throw new std::logic_error("Too many registered timers");
+          m_stopped(true),
+          m_valid(false),
+          m_submit(nullptr),
+          m_destroy(nullptr) {
+        using work_t = std::remove_reference_t<TLAMBDA>;
+        static_assert(sizeof(work_t) <= STORAGE_SIZE, "work does not fit in the timer storage");
+        static_assert(alignof(work_t) <= alignof(std::max_align_t), "work is over-aligned for the timer storage");
+
+        const atomic_val_t index = atomic_inc(&timers_registered);
+        if (index >= NUM_TIMERS) {
+            atomic_dec(&timers_registered);
+            LOG_ERR("Too many registered timers");
+            return;
         }
+        LOG_INF("Registering timer %d", (int) index);
 
-        LOG_INF("Registering timer %d", (int) TIMER_REGISTRATION_INDEX);
-        const auto lambda_work = std::make_shared<TLAMBDA>(std::move(work));
-        handlers[TIMER_REGISTRATION_INDEX++] = std::make_tuple<k_timer*, std::function<void()>>(&m_timer, [lambda_work]() { TLAMBDA::submit(); });
+        new (m_storage) work_t(std::move(work));
+        m_submit = [](void* storage) { static_cast<work_t*>(storage)->submit(); };
+        m_destroy = [](void* storage) { static_cast<work_t*>(storage)->~work_t(); };
 
         k_timer_init(&m_timer, timer_handler, NULL);
-        k_timer_start(&m_timer, K_USEC(1'000'000 / THZ::value), K_USEC(TSCALER::value * 1'000'000 / THZ::value));
-        m_stopped = false;
+        k_timer_user_data_set(&m_timer, this);
+        m_valid = true;
     }
 
-    ~timer_t() {
+    ~inline_timer_t() {
+        if(!m_valid) {
+            return;
+        }
         stop();
+        m_destroy(m_storage);
+        atomic_dec(&timers_registered);
     }
 
-    void stop() {
-        if(!m_stopped) {
-            k_timer_stop(&m_timer);
-            m_stopped = true;
+    void start(k_timeout_t duration, k_timeout_t period) {
+        if(m_valid) {
+            k_timer_start(&m_timer, duration, period);
+            m_stopped = false;
         }
     }
-};
-
-// Registers a one shot timer and and calls handlers in RAII fashion
-template<typename TDELAY>
-struct one_shot_timer_t {
-private:
-    k_timer m_timer;
-    bool m_stopped;
 
 public:
-    template<typename TLAMBDA>
-    one_shot_timer_t(TLAMBDA&& work)
-        : m_timer(),
-          m_stopped(true) {
-
-        if (TIMER_REGISTRATION_INDEX == NUM_TIMERS) {
-            throw new std::logic_error("Too many registered timers");
-        }
-        LOG_INF("Registering timer %d", (int) TIMER_REGISTRATION_INDEX);
-        const auto lambda_work = std::make_shared<TLAMBDA>(std::move(work));
-        handlers[TIMER_REGISTRATION_INDEX++] = std::make_tuple<k_timer*, std::function<void()>>( &m_timer, [lambda_work]() { TLAMBDA::submit(); });
-
-        k_timer_init(&m_timer, timer_handler, NULL);
-        k_timer_start(&m_timer, K_USEC(TDELAY::value), K_SECONDS(0));
-        m_stopped = false;
-    }
+    inline_timer_t(const inline_timer_t&) = delete;
+    inline_timer_t(inline_timer_t&&) = delete;
 
-    ~one_shot_timer_t() {
-        stop();
+    bool valid() const {
+        return m_valid;
     }
 
     void stop() {
@@ -173,6 +112,26 @@ public:
     }
 };
 
+// Registers a timer and and calls handlers in RAII fashion
+template<typename THZ, typename TSCALER = scale_t<1>>
+struct timer_t : inline_timer_t<> {
+    template<typename TLAMBDA>
+    timer_t(TLAMBDA&& work)
+        : inline_timer_t(std::move(work)) {
+        start(K_USEC(1'000'000 / THZ::value), K_USEC(TSCALER::value * 1'000'000 / THZ::value));
+    }
+};
+
+// Registers a one shot timer and and calls handlers in RAII fashion
+template<typename TDELAY>
+struct one_shot_timer_t : inline_timer_t<> {
+    template<typename TLAMBDA>
+    one_shot_timer_t(TLAMBDA&& work)
+        : inline_timer_t(std::move(work)) {
+        start(K_USEC(TDELAY::value), K_SECONDS(0));
+    }
+};
+
 
 }
 
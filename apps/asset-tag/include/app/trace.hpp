@@ -0,0 +1,243 @@
+#ifndef APP_INCLUDE_APP_TRACE_HPP
+#define APP_INCLUDE_APP_TRACE_HPP
+
+#include <app/profile.hpp>
+#include <app/work.hpp>
+
+#include <zephyr.h>
+#include <sys/atomic.h>
+
+#if defined(CONFIG_USE_SEGGER_RTT)
+#include <SEGGER_RTT.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace app {
+
+// Wire format of one drained record, little endian:
+//   u8 magic, u8 nargs, u16 dropped, u32 format address, u32 cycles, nargs x u32
+static constexpr uint8_t TRACE_MAGIC = 0xa5;
+static constexpr size_t TRACE_HEADER_SIZE = 12;
+
+template<typename T>
+static inline uint32_t trace_arg(T value) {
+    using arg_t = std::decay_t<T>;
+    if constexpr (std::is_pointer_v<arg_t>) {
+        return static_cast<uint32_t>(reinterpret_cast<uintptr_t>(value));
+    } else if constexpr (std::is_floating_point_v<arg_t>) {
+        const float f = static_cast<float>(value);
+        uint32_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        return bits;
+    } else {
+        static_assert(std::is_integral_v<arg_t> || std::is_enum_v<arg_t>, "trace arguments are integers, floats or pointers");
+        static_assert(sizeof(arg_t) <= sizeof(uint32_t), "trace arguments are at most 32 bits");
+        return static_cast<uint32_t>(value);
+    }
+}
+
+// Deferred binary log, formatted on the host from the firmware ELF
+//
+// A call stores the address of its format string, a cycle stamp and the raw arguments in
+// a bounded lock-free queue, which is safe from threads and ISRs. Nothing is formatted or
+// copied as a string on the device. A work item drains the queue in batches to the sink
+// shortly after the first record lands. When the queue is full new records are dropped
+// and the count rides along with the next drained record. %s arguments are sent as
+// addresses, so only strings in flash can be resolved by the decoder.
+template<size_t NUM_RECORDS = 64, size_t MAX_ARGS = 4>
+struct trace_t : counter_source_t {
+    static_assert((NUM_RECORDS & (NUM_RECORDS - 1)) == 0, "trace queue size must be a power of two");
+
+    using sink_t = size_t (*)(const uint8_t* data, size_t len);
+
+    struct stats_t {
+        uint32_t records;
+        uint32_t dropped;
+        uint32_t drains;
+    };
+
+private:
+    struct record_t {
+        const char* fmt;
+        uint32_t    cycles;
+        uint8_t     nargs;
+        uint32_t    args[MAX_ARGS];
+    };
+
+    struct cell_t {
+        atomic_t seq;
+        record_t record;
+    };
+
+    static constexpr size_t MASK = NUM_RECORDS - 1;
+    static constexpr size_t MAX_RECORD_SIZE = TRACE_HEADER_SIZE + MAX_ARGS * sizeof(uint32_t);
+
+    cell_t m_cells[NUM_RECORDS];
+    atomic_t m_enqueue = ATOMIC_INIT(0);
+    uint32_t m_dequeue = 0;
+    atomic_t m_pending = ATOMIC_INIT(0);
+    atomic_t m_records = ATOMIC_INIT(0);
+    atomic_t m_dropped = ATOMIC_INIT(0);
+    atomic_t m_dropped_total = ATOMIC_INIT(0);
+    uint32_t m_drains = 0;
+    sink_t m_sink;
+    work_t<> m_drain;
+
+    static void put_u16(uint8_t* dst, uint16_t value) {
+        dst[0] = static_cast<uint8_t>(value);
+        dst[1] = static_cast<uint8_t>(value >> 8);
+    }
+
+    static void put_u32(uint8_t* dst, uint32_t value) {
+        put_u16(dst, static_cast<uint16_t>(value));
+        put_u16(dst + 2, static_cast<uint16_t>(value >> 16));
+    }
+
+    // Claims the next free cell, null when the consumer is a full queue behind
+    cell_t* claim(uint32_t* pos) {
+        *pos = static_cast<uint32_t>(atomic_get(&m_enqueue));
+        while(true) {
+            cell_t& cell = m_cells[*pos & MASK];
+            const int32_t diff = static_cast<int32_t>(static_cast<uint32_t>(atomic_get(&cell.seq)) - *pos);
+            if(diff == 0) {
+                if(atomic_cas(&m_enqueue, static_cast<atomic_val_t>(*pos), static_cast<atomic_val_t>(*pos + 1))) {
+                    return &cell;
+                }
+            } else if(diff < 0) {
+                return nullptr;
+            }
+            *pos = static_cast<uint32_t>(atomic_get(&m_enqueue));
+        }
+    }
+
+    void drain() {
+        atomic_clear(&m_pending);
+        m_drains++;
+
+        uint8_t chunk[4 * MAX_RECORD_SIZE];
+        size_t used = 0;
+        while(true) {
+            cell_t& cell = m_cells[m_dequeue & MASK];
+            if(static_cast<int32_t>(static_cast<uint32_t>(atomic_get(&cell.seq)) - (m_dequeue + 1)) < 0) {
+                break;
+            }
+
+            if(used + MAX_RECORD_SIZE > sizeof(chunk)) {
+                flush(chunk, used);
+                used = 0;
+            }
+
+            const record_t& record = cell.record;
+            const uint32_t dropped = static_cast<uint32_t>(atomic_clear(&m_dropped));
+            uint8_t* dst = chunk + used;
+            dst[0] = TRACE_MAGIC;
+            dst[1] = record.nargs;
+            put_u16(dst + 2, static_cast<uint16_t>(MIN(dropped, UINT16_MAX)));
+            put_u32(dst + 4, static_cast<uint32_t>(reinterpret_cast<uintptr_t>(record.fmt)));
+            put_u32(dst + 8, record.cycles);
+            for(size_t i = 0; i < record.nargs; i++) {
+                put_u32(dst + TRACE_HEADER_SIZE + i * sizeof(uint32_t), record.args[i]);
+            }
+            used += TRACE_HEADER_SIZE + record.nargs * sizeof(uint32_t);
+
+            atomic_set(&cell.seq, static_cast<atomic_val_t>(m_dequeue + NUM_RECORDS));
+            m_dequeue++;
+        }
+
+        if(used) {
+            flush(chunk, used);
+        }
+    }
+
+    void flush(const uint8_t* data, size_t len) {
+        if(m_sink(data, len) < len) {
+            atomic_inc(&m_dropped_total);
+        }
+    }
+
+public:
+    explicit trace_t(sink_t sink) : m_sink(sink), m_drain([this]() { drain(); }) {
+        for(size_t i = 0; i < NUM_RECORDS; i++) {
+            atomic_set(&m_cells[i].seq, static_cast<atomic_val_t>(i));
+        }
+    }
+
+    trace_t(const trace_t&) = delete;
+
+    template<typename ... T>
+    void write(const char* fmt, T ... args) {
+        static_assert(sizeof...(T) <= MAX_ARGS, "too many trace arguments");
+
+        uint32_t pos;
+        cell_t* cell = claim(&pos);
+        if(!cell) {
+            atomic_inc(&m_dropped);
+            atomic_inc(&m_dropped_total);
+            return;
+        }
+
+        record_t& record = cell->record;
+        record.fmt = fmt;
+        record.cycles = k_cycle_get_32();
+        record.nargs = sizeof...(T);
+        size_t i = 0;
+        ((record.args[i++] = trace_arg(args)), ...);
+        (void) i;
+        atomic_set(&cell->seq, static_cast<atomic_val_t>(pos + 1));
+        atomic_inc(&m_records);
+
+        // Let a burst collect before draining it in one pass
+        if(!atomic_set(&m_pending, 1)) {
+            m_drain.schedule(K_MSEC(50));
+        }
+    }
+
+    stats_t stats() const {
+        return stats_t{
+            .records = static_cast<uint32_t>(atomic_get(&m_records)),
+            .dropped = static_cast<uint32_t>(atomic_get(&m_dropped_total)),
+            .drains  = m_drains
+        };
+    }
+
+    // Counter group TRACE of the profile dump
+    size_t read(uint32_t* dst) override {
+        const stats_t s = stats();
+        return put_counters(dst, s.records, s.dropped, s.drains);
+    }
+};
+
+template<typename ... T>
+static inline void trace_discard(const char*, T ...) {}
+
+#if defined(CONFIG_USE_SEGGER_RTT)
+
+// RTT up channel read by JLinkRTTLogger, 0 is the console and 1 is used by SystemView
+static constexpr unsigned TRACE_RTT_CHANNEL = 2;
+
+static size_t trace_rtt_sink(const uint8_t* data, size_t len) {
+    static uint8_t buffer[1024];
+    static bool configured = false;
+    if(!configured) {
+        SEGGER_RTT_ConfigUpBuffer(TRACE_RTT_CHANNEL, "trace", buffer, sizeof(buffer), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+        configured = true;
+    }
+    return SEGGER_RTT_Write(TRACE_RTT_CHANNEL, data, len);
+}
+
+static trace_t<> trace(trace_rtt_sink);
+
+#define APP_TRACE(fmt, ...) ::app::trace.write(fmt, ##__VA_ARGS__)
+
+#else
+
+#define APP_TRACE(fmt, ...) do { if(0) { ::app::trace_discard(fmt, ##__VA_ARGS__); } } while(0)
+
+#endif
+
+}
+
+#endif
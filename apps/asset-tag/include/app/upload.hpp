@@ -0,0 +1,338 @@
+#ifndef APP_INCLUDE_APP_UPLOAD_HPP
+#define APP_INCLUDE_APP_UPLOAD_HPP
+
+#include <app_log.hpp>
+
+#include <app/delta.hpp>
+#include <app/expected.hpp>
+#include <app/profile.hpp>
+#include <app/slot.hpp>
+
+#include <zephyr.h>
+#include <sys/atomic.h>
+#include <sys/byteorder.h>
+
+#include <cstdint>
+#include <cstring>
+
+namespace app {
+
+// Image uploads handed from the SMP handlers to the thread that owns the secondary slot
+//
+// offer() runs on the SMP thread and never waits. A chunk at the expected offset is copied
+// into the queue and acknowledged, and when the queue is full the reply repeats that offset
+// so the client sends the chunk again. service() runs on the upload thread: it writes raw
+// images through the slot writer or rebuilds delta images through the patcher, and while
+// no chunk is waiting it erases the slot ahead of the write pointer.
+//
+// Replies carry the upload thread's state too. A failure in the background is answered
+// with its error and offset 0, where the client starts over, and the offset only reaches
+// the length of the upload once the image is written and checked.
+struct upload_t {
+    // Largest data field of one request
+    static constexpr size_t CHUNK_MAX = 512;
+    // Chunks accepted but not yet in flash, what a client can keep in flight
+    static constexpr size_t QUEUE_DEPTH = 4;
+    // First word of an MCUboot image header
+    static constexpr uint32_t IMAGE_MAGIC = 0x96f3b83d;
+
+    enum class kind_e : uint8_t {
+        IMAGE,
+        DELTA,
+        ERASE
+    };
+
+    struct reply_t {
+        int rc;
+        uint32_t off;
+        bool done;
+    };
+
+    struct stats_t {
+        uint32_t accepted = 0;
+        uint32_t busy = 0;
+        uint32_t sessions = 0;
+    };
+
+private:
+    enum flags_e : uint8_t {
+        FIRST = 1,
+        LAST = 2
+    };
+
+    struct chunk_t {
+        uint16_t session;
+        kind_e   kind;
+        uint8_t  flags;
+        uint16_t len;
+        uint32_t off;
+        uint32_t total;
+        uint8_t  data[CHUNK_MAX];
+    };
+
+    // Queue between the two sides
+    alignas(4) char m_buffer[sizeof(chunk_t) * QUEUE_DEPTH];
+    k_msgq m_queue;
+    // Session id in the upper and the negated error in the lower half
+    atomic_t m_failure = ATOMIC_INIT(0);
+    // Last session the upload thread completed
+    atomic_t m_finished = ATOMIC_INIT(0);
+    k_sem m_settled;
+
+    // SMP side
+    chunk_t m_staging;
+    uint16_t m_session = 0;
+    kind_e m_kind = kind_e::IMAGE;
+    uint32_t m_total = 0;
+    uint32_t m_staged = 0;
+    uint32_t m_last_off = 0;
+    stats_t m_stats = {};
+
+    // Upload thread side
+    chunk_t m_chunk;
+    uint16_t m_current = 0;
+    bool m_failed = false;
+    slot_writer_t m_slot;
+    delta_patcher_t m_patcher{ m_slot };
+
+    bool enqueue(uint16_t session, kind_e kind, uint8_t flags, uint32_t off, const uint8_t* data, size_t len,
+            uint32_t total) {
+        m_staging.session = session;
+        m_staging.kind = kind;
+        m_staging.flags = flags;
+        m_staging.len = static_cast<uint16_t>(len);
+        m_staging.off = off;
+        m_staging.total = total;
+        if(len) {
+            std::memcpy(m_staging.data, data, len);
+        }
+        if(k_msgq_put(&m_queue, &m_staging, K_NO_WAIT) != 0) {
+            m_stats.busy++;
+            return false;
+        }
+        m_stats.accepted++;
+        return true;
+    }
+
+    uint16_t next_session() const {
+        return m_session == UINT16_MAX ? 1 : m_session + 1;
+    }
+
+    int failure() const {
+        const auto value = static_cast<uint32_t>(atomic_get(&m_failure));
+        return (value >> 16) == m_session ? -static_cast<int>(value & 0xffff) : 0;
+    }
+
+    bool finished() const {
+        return static_cast<uint16_t>(atomic_get(&m_finished)) == m_session;
+    }
+
+    void settle(int err) {
+        if(err) {
+            LOG_ERR("Upload failed at %u: %d", (unsigned) m_chunk.off, err);
+            m_failed = true;
+            atomic_set(&m_failure, static_cast<atomic_val_t>((uint32_t{m_current} << 16) | (-err & 0xffff)));
+        } else {
+            atomic_set(&m_finished, m_current);
+        }
+        k_sem_give(&m_settled);
+    }
+
+    int begin() {
+        m_current = m_chunk.session;
+        m_failed = false;
+        m_patcher.abort();
+        m_slot.close();
+        switch(m_chunk.kind) {
+            case kind_e::IMAGE:
+                return m_slot.open(m_chunk.total).error();
+            case kind_e::DELTA:
+                m_patcher.begin();
+                return 0;
+            case kind_e::ERASE:
+                return m_slot.erase().error();
+        }
+        return -EINVAL;
+    }
+
+    void process() {
+        if(m_chunk.flags & FIRST) {
+            const int err = begin();
+            if(err || m_chunk.kind == kind_e::ERASE) {
+                settle(err);
+                return;
+            }
+        } else if(m_chunk.session != m_current || m_failed) {
+            // The rest of a session that failed or was replaced
+            return;
+        }
+
+        int err = m_chunk.kind == kind_e::DELTA
+            ? m_patcher.write(m_chunk.data, m_chunk.len).error()
+            : m_slot.write(m_chunk.data, m_chunk.len).error();
+        if(err) {
+            settle(err);
+            return;
+        }
+        if(m_chunk.flags & LAST) {
+            if(m_chunk.kind == kind_e::DELTA) {
+                // The stream ended before the image did
+                err = m_patcher.done() ? 0 : -ENODATA;
+            } else {
+                err = m_slot.flush().error();
+            }
+            settle(err);
+        }
+    }
+
+public:
+    upload_t() {
+        k_msgq_init(&m_queue, m_buffer, sizeof(chunk_t), QUEUE_DEPTH);
+        k_sem_init(&m_settled, 0, 1);
+    }
+
+    upload_t(const upload_t&) = delete;
+
+    // Stages the chunk at off of an upload of total bytes, total is only read with off 0
+    reply_t offer(kind_e kind, uint32_t off, const uint8_t* data, size_t len, uint32_t total) {
+        if(len > CHUNK_MAX) {
+            return { -EMSGSIZE, 0, false };
+        }
+
+        if(off == 0) {
+            if(len == 0 || len > total) {
+                return { -EINVAL, 0, false };
+            }
+            // Refuse anything but an MCUboot image before the slot is touched, as img_mgmt does
+            if(kind == kind_e::IMAGE && (len < 4 || sys_get_le32(data) != IMAGE_MAGIC)) {
+                return { -EINVAL, 0, false };
+            }
+            // A session only starts once its first chunk is queued
+            const uint16_t session = next_session();
+            k_sem_reset(&m_settled);
+            if(!enqueue(session, kind, FIRST | (len == total ? LAST : 0), off, data, len, total)) {
+                return { 0, 0, false };
+            }
+            m_session = session;
+            m_kind = kind;
+            m_total = total;
+            m_staged = len;
+            m_last_off = 0;
+            m_stats.sessions++;
+            return status();
+        }
+
+        // Without a session of this kind the client starts over
+        if(m_total == 0 || kind != m_kind) {
+            return { 0, 0, false };
+        }
+        if(failure()) {
+            return status();
+        }
+        // Anything but the expected offset is answered with it, so the client can seek
+        if(off == m_staged && m_staged < m_total) {
+            if(len == 0 || len > m_total - m_staged) {
+                return { -EINVAL, m_staged, false };
+            }
+            const uint8_t flags = off + len == m_total ? LAST : 0;
+            if(enqueue(m_session, kind, flags, off, data, len, m_total)) {
+                m_last_off = off;
+                m_staged += len;
+            }
+        }
+        return status();
+    }
+
+    // Starts erasing the whole slot in the background, ending any upload
+    int erase() {
+        const uint16_t session = next_session();
+        if(!enqueue(session, kind_e::ERASE, FIRST, 0, nullptr, 0, 0)) {
+            return -EBUSY;
+        }
+        m_session = session;
+        m_kind = kind_e::ERASE;
+        m_total = 0;
+        m_staged = 0;
+        return 0;
+    }
+
+    // What the reply to a request carries now
+    reply_t status() const {
+        if(m_total == 0) {
+            return { 0, 0, false };
+        }
+        const int err = failure();
+        if(err) {
+            return { err, 0, false };
+        }
+        if(m_staged < m_total) {
+            return { 0, m_staged, false };
+        }
+        if(finished()) {
+            return { 0, m_total, true };
+        }
+        // Holds back the last chunk until the image is complete, the client sends it again
+        return { 0, m_last_off, false };
+    }
+
+    // Everything is queued and the upload thread has yet to finish the image
+    bool settling() const {
+        return m_total != 0 && m_staged == m_total && !finished() && !failure();
+    }
+
+    // Waits until the upload thread finished or failed a session
+    int wait(k_timeout_t timeout) {
+        return k_sem_take(&m_settled, timeout);
+    }
+
+    uint32_t staged() const {
+        return m_staged;
+    }
+
+    uint32_t total() const {
+        return m_total;
+    }
+
+    kind_e kind() const {
+        return m_kind;
+    }
+
+    const stats_t& stats() const {
+        return m_stats;
+    }
+
+    // Upload thread: handles the next chunk, waiting up to timeout for one. While part of
+    // the slot ahead of the write pointer is not erased, a page is erased instead of
+    // waiting. Returns whether there was anything to do.
+    bool service(k_timeout_t timeout) {
+        const bool erasing = m_slot.erase_pending() && !m_failed;
+        if(k_msgq_get(&m_queue, &m_chunk, erasing ? K_NO_WAIT : timeout) != 0) {
+            if(!erasing) {
+                return false;
+            }
+            auto erase_scope = profile.scope(stage_e::DFU_ERASE);
+            const auto erased = m_slot.erase_next();
+            if(!erased) {
+                m_slot.close();
+                settle(erased.error());
+            }
+            return true;
+        }
+
+        auto write_scope = profile.scope(stage_e::DFU_WRITE);
+        process();
+        return true;
+    }
+
+    const slot_writer_t& slot() const {
+        return m_slot;
+    }
+
+    const delta_patcher_t& patcher() const {
+        return m_patcher;
+    }
+};
+
+}
+
+#endif
@@ -1,16 +1,159 @@
 #ifndef APP_INCLUDE_APP_WORK_HPP
 #define APP_INCLUDE_APP_WORK_HPP
 
+#include <app/profile.hpp>
 #include <app/timer.hpp>
 
-using base_work_t = app::lambda_work_t<0>;
-template<> std::function<void()> base_work_t::s_work = [](){ LOG_DBG("base_work_t::s_work init"); };
-template<> k_work base_work_t::work = k_work();
-template<> std::shared_ptr<k_work_q> base_work_t::work_q = nullptr;
+#include <zephyr.h>
+#include <spinlock.h>
+#include <sys/atomic.h>
 
-using wake_work_t = app::lambda_work_t<1>;
-template<> std::function<void()> wake_work_t::s_work = [](){ LOG_DBG("wake_work_t::s_work init"); };
-template<> k_work wake_work_t::work = k_work();
-template<> std::shared_ptr<k_work_q> wake_work_t::work_q = nullptr;
+#include <cstddef>
+#include <new>
+#include <type_traits>
 
-#endif
\ No newline at end of file
+namespace app {
+
+struct no_payload_t {};
+
+// Submissions, coalesced submissions and runs summed over every work item
+struct work_stats_t : counter_source_t {
+    atomic_t submitted = ATOMIC_INIT(0);
+    atomic_t coalesced = ATOMIC_INIT(0);
+    atomic_t executed = ATOMIC_INIT(0);
+
+    // Counter group WORK of the profile dump
+    size_t read(uint32_t* dst) override {
+        return put_counters(dst, atomic_get(&submitted), atomic_get(&coalesced), atomic_get(&executed));
+    }
+};
+
+static work_stats_t work_stats;
+
+// A work item owning its callable inline, with the latest payload handed to each run
+//
+// Every instance has its own k_delayed_work, initialized once, so many independent items
+// can target any queue. Submitting while the item is already pending is safe and
+// coalesces into the pending run, which sees the most recent payload. The callable may
+// take the payload by const reference or take nothing.
+template<typename TPAYLOAD = no_payload_t, size_t STORAGE_SIZE = 16>
+struct work_t {
+    // Handle with a static-looking submit() for timers, which store their work inline
+    struct submitter_t {
+        work_t* m_work;
+        void submit() { m_work->submit(); }
+    };
+
+private:
+    struct item_t {
+        k_delayed_work work;
+        work_t* owner;
+    };
+
+    item_t m_item;
+    k_work_q* m_work_q;
+    k_spinlock m_lock = {};
+    TPAYLOAD m_payload = {};
+    alignas(std::max_align_t) uint8_t m_storage[STORAGE_SIZE];
+    void (*m_invoke)(void*, const TPAYLOAD&);
+    void (*m_destroy)(void*);
+
+    static void work_handler(k_work* work) {
+        item_t* item = CONTAINER_OF(work, item_t, work.work);
+        item->owner->run();
+    }
+
+    void run() {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        const TPAYLOAD payload = m_payload;
+        k_spin_unlock(&m_lock, key);
+
+        atomic_inc(&work_stats.executed);
+        m_invoke(m_storage, payload);
+    }
+
+    bool pending() {
+        return k_work_pending(&m_item.work.work) || k_delayed_work_remaining_get(&m_item.work) > 0;
+    }
+
+    void count_submission() {
+        atomic_inc(&work_stats.submitted);
+        if(pending()) {
+            atomic_inc(&work_stats.coalesced);
+        }
+    }
+
+public:
+    template<typename TLAMBDA>
+    explicit work_t(TLAMBDA&& f, k_work_q* work_q = &k_sys_work_q)
+        : m_item(), m_work_q(work_q) {
+        using fn_t = std::remove_reference_t<TLAMBDA>;
+        static_assert(sizeof(fn_t) <= STORAGE_SIZE, "callable does not fit in the work storage");
+        static_assert(alignof(fn_t) <= alignof(std::max_align_t), "callable is over-aligned for the work storage");
+
+        new (m_storage) fn_t(std::move(f));
+        m_invoke = [](void* storage, const TPAYLOAD& payload) {
+            if constexpr (std::is_invocable_v<fn_t&, const TPAYLOAD&>) {
+                (*static_cast<fn_t*>(storage))(payload);
+            } else {
+                (*static_cast<fn_t*>(storage))();
+            }
+        };
+        m_destroy = [](void* storage) { static_cast<fn_t*>(storage)->~fn_t(); };
+
+        m_item.owner = this;
+        k_delayed_work_init(&m_item.work, work_handler);
+    }
+
+    work_t(const work_t&) = delete;
+    work_t(work_t&&) = delete;
+
+    ~work_t() {
+        cancel();
+        m_destroy(m_storage);
+    }
+
+    // Queue a run now, joining a run that is already queued and moving one still waiting
+    // on a schedule() delay forward, callable from ISRs
+    void submit() {
+        count_submission();
+        k_delayed_work_submit_to_queue(m_work_q, &m_item.work, K_NO_WAIT);
+    }
+
+    void submit(const TPAYLOAD& payload) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        m_payload = payload;
+        k_spin_unlock(&m_lock, key);
+        submit();
+    }
+
+    // Queue a run after delay, pushing back a run that is still waiting on its delay. A run
+    // already due, e.g. from submit(), keeps its place and is never postponed.
+    void schedule(k_timeout_t delay) {
+        count_submission();
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        if(!k_work_pending(&m_item.work.work)) {
+            k_delayed_work_submit_to_queue(m_work_q, &m_item.work, delay);
+        }
+        k_spin_unlock(&m_lock, key);
+    }
+
+    void schedule(k_timeout_t delay, const TPAYLOAD& payload) {
+        k_spinlock_key_t key = k_spin_lock(&m_lock);
+        m_payload = payload;
+        k_spin_unlock(&m_lock, key);
+        schedule(delay);
+    }
+
+    void cancel() {
+        k_delayed_work_cancel(&m_item.work);
+    }
+
+    submitter_t submitter() {
+        return submitter_t{ this };
+    }
+};
+
+}
+
+#endif
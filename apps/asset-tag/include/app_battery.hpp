@@ -1,11 +1,15 @@
 #ifndef APP_INCLUDE_APP_BATTERY_HPP
 #define APP_INCLUDE_APP_BATTERY_HPP
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
 
 /** A point in a battery discharge curve sequence.
  *
  * A discharge curve is defined as a sequence of these points, where
- * the first point has #lvl_pct set to 10000 and the last point has
+ * the first point has #lvl_pct set to 100 and the last point has
  * #lvl_pct set to zero.  Both #lvl_pct and #lvl_mV should be
  * monotonic decreasing within the sequence.
  */
@@ -17,26 +21,65 @@ struct battery_level_point {
         uint16_t lvl_mV;
 };
 
-/** A discharge curve specific to the power source. */
-static constexpr battery_level_point levels[] = {
-        /* Linear from maximum voltage to minimum voltage. */
+/** Bench supply, linear from maximum voltage to minimum voltage. */
+static constexpr std::array<battery_level_point, 3> bench_levels = {{
         { 100, 3300 },
-		{ 50, 3200},
+        { 50, 3200 },
         { 0, 2600 }, // Powered by mac gives 2.8V
-};
+}};
 
-/** Calculate the estimated battery level based on a measured voltage.
+/** CR2032 coin cell at light load, flat plateau then a steep knee. */
+static constexpr std::array<battery_level_point, 6> cr2032_levels = {{
+        { 100, 3000 },
+        { 90, 2900 },
+        { 70, 2800 },
+        { 40, 2700 },
+        { 10, 2500 },
+        { 0, 2000 },
+}};
+
+/** Single cell Li-ion/LiPo pack. */
+static constexpr std::array<battery_level_point, 9> li_ion_levels = {{
+        { 100, 4200 },
+        { 90, 4060 },
+        { 80, 3980 },
+        { 60, 3840 },
+        { 40, 3770 },
+        { 20, 3690 },
+        { 10, 3610 },
+        { 5, 3500 },
+        { 0, 3000 },
+}};
+
+/** Shift a curve by the voltage drop under load and away from 25 C.
+ *
+ * Measurements taken while the radio draws current read lower than the
+ * open circuit curve, by roughly the load current times the internal
+ * resistance. Cold cells read lower still, by @p mV_per_C per degree.
+ */
+template<size_t N>
+constexpr std::array<battery_level_point, N> battery_compensate(const std::array<battery_level_point, N>& curve,
+		unsigned int load_uA, unsigned int resistance_mohm, int temperature_C = 25, int mV_per_C = 0) {
+	const int drop = static_cast<int>(load_uA * resistance_mohm / 1000000) + (25 - temperature_C) * mV_per_C;
+	std::array<battery_level_point, N> shifted = curve;
+	for (auto& point : shifted) {
+		point.lvl_mV = static_cast<uint16_t>(static_cast<int>(point.lvl_mV) - drop);
+	}
+	return shifted;
+}
+
+/** Interpolate the remaining capacity on a discharge curve.
  *
  * @param batt_mV a measured battery voltage level.
  *
  * @param curve the discharge curve for the type of battery installed
  * on the system.
  *
- * @return the estimated remaining capacity in parts per ten
- * thousand.
+ * @return the estimated remaining capacity in percent.
  */
-constexpr unsigned int battery_level_pct(unsigned int batt_mV) {
-	const battery_level_point *pb = levels;
+template<size_t N>
+constexpr unsigned int battery_interpolate(const std::array<battery_level_point, N>& curve, unsigned int batt_mV) {
+	const battery_level_point *pb = curve.data();
 
 	if (batt_mV >= pb->lvl_mV) {
 		/* Measured voltage above highest point, cap at maximum. */
@@ -58,4 +101,128 @@ constexpr unsigned int battery_level_pct(unsigned int batt_mV) {
 	return pb->lvl_pct + ((pa->lvl_pct - pb->lvl_pct) * (batt_mV - pb->lvl_mV) / (pa->lvl_mV - pb->lvl_mV));
 }
 
-#endif
\ No newline at end of file
+/** Dense lookup table of a curve, one entry per STEP_mV bucket.
+ *
+ * Generated at compile time from the interpolated curve, so a
+ * conversion is a clamp and a single load. The checks below prove the
+ * table is monotonic and matches the curve at every point.
+ */
+template<const auto& CURVE, unsigned int STEP_mV = 10>
+struct battery_lut_t {
+	static constexpr unsigned int MAX_mV = CURVE.front().lvl_mV;
+	static constexpr unsigned int MIN_mV = CURVE.back().lvl_mV;
+	static constexpr size_t SIZE = (MAX_mV - MIN_mV) / STEP_mV + 1;
+	static_assert((MAX_mV - MIN_mV) % STEP_mV == 0, "curve range must be a whole number of buckets");
+
+	static constexpr std::array<uint8_t, SIZE> generate() {
+		std::array<uint8_t, SIZE> table = {};
+		for (size_t i = 0; i < SIZE; i++) {
+			table[i] = static_cast<uint8_t>(battery_interpolate(CURVE, MIN_mV + i * STEP_mV));
+		}
+		return table;
+	}
+
+	static constexpr std::array<uint8_t, SIZE> table = generate();
+
+	static constexpr unsigned int lookup(unsigned int batt_mV) {
+		if (batt_mV >= MAX_mV) {
+			return table[SIZE - 1];
+		}
+		if (batt_mV <= MIN_mV) {
+			return table[0];
+		}
+		return table[(batt_mV - MIN_mV) / STEP_mV];
+	}
+
+	static constexpr bool monotonic() {
+		for (size_t i = 1; i < SIZE; i++) {
+			if (table[i] < table[i - 1]) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/* Exact at the curve points that fall on a bucket boundary, within
+	 * one bucket's worth of the curve everywhere else. */
+	static constexpr bool accurate() {
+		for (const auto& point : CURVE) {
+			if ((point.lvl_mV - MIN_mV) % STEP_mV == 0 && lookup(point.lvl_mV) != point.lvl_pct) {
+				return false;
+			}
+		}
+		for (unsigned int mV = MIN_mV; mV <= MAX_mV; mV++) {
+			const unsigned int lo = battery_interpolate(CURVE, mV - (mV - MIN_mV) % STEP_mV);
+			const unsigned int hi = battery_interpolate(CURVE, mV);
+			if (lookup(mV) != lo || hi < lo) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+/* The installed power source, selected with -DBATTERY_CURVE_* (see CMakeLists.txt). */
+#if defined(BATTERY_CURVE_CR2032)
+/* Sampled right after the wake measurement with the radio idle, 15 ohm cell */
+static constexpr auto levels = battery_compensate(cr2032_levels, 500, 15000);
+#elif defined(BATTERY_CURVE_LI_ION)
+static constexpr auto levels = li_ion_levels;
+#else
+static constexpr auto levels = bench_levels;
+#endif
+
+using battery_lut = battery_lut_t<levels>;
+static_assert(battery_lut::monotonic(), "battery table must not decrease with voltage");
+static_assert(battery_lut::accurate(), "battery table must match its curve");
+
+/** Calculate the estimated battery level based on a measured voltage.
+ *
+ * @param batt_mV a measured battery voltage level.
+ *
+ * @return the estimated remaining capacity in percent.
+ */
+constexpr unsigned int battery_level_pct(unsigned int batt_mV) {
+	return battery_lut::lookup(batt_mV);
+}
+
+/** Smooths battery readings so reported levels do not jitter.
+ *
+ * Voltages are averaged with an exponential moving average (1/4 weight
+ * for each new sample), and the reported level only moves once the
+ * average crosses HYSTERESIS_PCT away from it.
+ */
+template<unsigned int HYSTERESIS_PCT = 2>
+struct battery_filter_t {
+	uint32_t average_mV_x4 = 0;
+	uint8_t reported_pct = 0;
+	bool primed = false;
+
+	/* Adds a sample, returns true when the reported level changed. */
+	bool update(unsigned int batt_mV) {
+		if (!primed) {
+			average_mV_x4 = batt_mV * 4;
+			reported_pct = static_cast<uint8_t>(battery_level_pct(batt_mV));
+			primed = true;
+			return true;
+		}
+
+		average_mV_x4 = average_mV_x4 - average_mV_x4 / 4 + batt_mV;
+		const unsigned int pct = battery_level_pct(average_mV_x4 / 4);
+		const unsigned int delta = pct > reported_pct ? pct - reported_pct : reported_pct - pct;
+		if (delta < HYSTERESIS_PCT && pct != 0 && pct != 100) {
+			return false;
+		}
+		if (pct == reported_pct) {
+			return false;
+		}
+		reported_pct = static_cast<uint8_t>(pct);
+		return true;
+	}
+
+	uint8_t pct() const {
+		return reported_pct;
+	}
+};
+
+#endif
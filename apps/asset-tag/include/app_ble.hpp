@@ -7,6 +7,12 @@
 #endif
 
 #include <app/ass.hpp>
+#include <app/broadcast.hpp>
+#include <app/expected.hpp>
+#include <app/link.hpp>
+#include <app/profile.hpp>
+#include <app/ready.hpp>
+#include <app/trace.hpp>
 
 #include <zephyr.h>
 #include <bluetooth/bluetooth.h>
@@ -16,65 +22,196 @@
 #include <bluetooth/gatt.h>
 #include <bluetooth/services/bas.h>
 
-#include <stdexcept>
+#include <algorithm>
+#include <cstring>
 
 namespace app_ble {
 
+    // Encoded copies of the dynamic AD fields, the stack copies them on bt_le_ext_adv_set_data()
+    static uint8_t broadcast_encoded[app::broadcast_t::SIZE];
+    static char name_encoded[ass_buffer_t::size() + 1];
+
+    // The battery level travels in the manufacturer data, which leaves no room in the 31
+    // bytes for the BAS UUID16. The service itself is still served over GATT.
 #ifdef CONFIG_MCUMGR_SMP_BT
-    static constexpr bt_data advertisement_data[] = {
+    static const bt_data advertisement_data[] = {
         BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
-        BT_DATA_BYTES(BT_DATA_UUID16_ALL, 0x0f, 0x18),
-        BT_DATA_BYTES(BT_DATA_UUID128_SOME, BT_UUID_ASS_DATA_BYTES)
+        BT_DATA_BYTES(BT_DATA_UUID128_SOME, BT_UUID_ASS_DATA_BYTES),
+        BT_DATA(BT_DATA_MANUFACTURER_DATA, broadcast_encoded, sizeof(broadcast_encoded))
     };
 
-    static const bt_data scan_response_data[] = {
-        BT_DATA_BYTES(BT_DATA_UUID128_SOME, BT_UUID_SMP_DATA_BYTES)
+    // The name is encoded here rather than with BT_LE_ADV_OPT_USE_NAME so it can change
+    // through bt_le_ext_adv_set_data(), it is always the last entry
+    static bt_data scan_response_data[] = {
+        BT_DATA_BYTES(BT_DATA_UUID128_SOME, BT_UUID_SMP_DATA_BYTES),
+        BT_DATA(BT_DATA_NAME_COMPLETE, name_encoded, 0)
     };
+    static constexpr size_t NAME_AD_MAX = BT_GAP_ADV_MAX_ADV_DATA_LEN - 2 - (2 + 16);
 #else
-    static constexpr bt_data advertisement_data[] = {
+    static const bt_data advertisement_data[] = {
         BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
-        BT_DATA_BYTES(BT_DATA_UUID16_ALL, 0x0f, 0x18),
-        BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_ASS_DATA_BYTES)
+        BT_DATA_BYTES(BT_DATA_UUID128_ALL, BT_UUID_ASS_DATA_BYTES),
+        BT_DATA(BT_DATA_MANUFACTURER_DATA, broadcast_encoded, sizeof(broadcast_encoded))
+    };
+
+    static bt_data scan_response_data[] = {
+        BT_DATA(BT_DATA_NAME_COMPLETE, name_encoded, 0)
     };
+    static constexpr size_t NAME_AD_MAX = BT_GAP_ADV_MAX_ADV_DATA_LEN - 2;
 #endif
 
+    // Advertising intervals are in units of 0.625 ms, indexed by adv_mode_e
+    enum class adv_mode_e : uint8_t {
+        FAST = 0,
+        SLOW = 1
+    };
+
+    static constexpr uint16_t adv_interval_min[] = { BT_GAP_ADV_FAST_INT_MIN_2, BT_GAP_ADV_SLOW_INT_MIN };
+    static constexpr uint16_t adv_interval_max[] = { BT_GAP_ADV_FAST_INT_MAX_2, BT_GAP_ADV_SLOW_INT_MAX };
+
     static bt_le_adv_param adv_params[] = {
         BT_LE_ADV_PARAM_INIT(
-            BT_LE_ADV_OPT_CONNECTABLE |  BT_LE_ADV_OPT_USE_NAME,
-            BT_GAP_ADV_FAST_INT_MIN_2,
-            BT_GAP_ADV_FAST_INT_MAX_2,
+            BT_LE_ADV_OPT_CONNECTABLE,
+            adv_interval_min[0],
+            adv_interval_max[0],
+            NULL),
+        BT_LE_ADV_PARAM_INIT(
+            BT_LE_ADV_OPT_CONNECTABLE,
+            adv_interval_min[1],
+            adv_interval_max[1],
             NULL)
         };
 
     struct static_manager_t {
-        static void bt_adv_start() {
-            bt_le_adv_stop();
-            bt_set_name(ass_data);
-#ifdef CONFIG_MCUMGR_SMP_BT
-            const auto err = bt_le_adv_start(
-                adv_params,
-                advertisement_data,
-                ARRAY_SIZE(advertisement_data),
-                scan_response_data,
-                ARRAY_SIZE(scan_response_data));
-#else
-            const auto err = bt_le_adv_start(
-                adv_params,
-                advertisement_data,
-                ARRAY_SIZE(advertisement_data),
-                NULL,
-                0);
-#endif
-            if (err) {
-                LOG_ERR("Advertising failed to start (err %d)", err);
-                throw std::runtime_error("Failed to start advertising");
+        static inline app::ready_t enabled;
+
+        static void bt_ready(int err) {
+            enabled.signal(app::check(err));
+        }
+
+        // One set for the life of the stack, created by ready() with the FAST parameters
+        static inline bt_le_ext_adv* adv_set = nullptr;
+        static inline bt_le_ext_adv_start_param adv_start_param = BT_LE_EXT_ADV_START_PARAM_INIT(0, 0);
+        static inline bool advertising = false;
+        static inline adv_mode_e advertising_mode = adv_mode_e::FAST;
+        // The set holds no data yet, or data that failed to go out
+        static inline bool data_stale = true;
+
+        // Re-encodes the name from ass_data, returns true when it differs from the last one.
+        // Only a changed name goes to bt_set_name(), which may also persist it. Without a
+        // name in ass_data the tag falls back to the one it was built with, not to whatever
+        // bt_get_name() last had set.
+        static bool encode_name() {
+            char name[sizeof(name_encoded)];
+            size_t len = ass_data.copy_string(name);
+            if(len == 0) {
+                len = std::min(sizeof(CONFIG_BT_DEVICE_NAME) - 1, sizeof(name) - 1);
+                std::memcpy(name, CONFIG_BT_DEVICE_NAME, len);
+                name[len] = '\0';
+            }
+            if(std::strcmp(name, name_encoded) == 0) {
+                return false;
+            }
+
+            std::memcpy(name_encoded, name, len + 1);
+            bt_data& entry = scan_response_data[ARRAY_SIZE(scan_response_data) - 1];
+            entry.type = len > NAME_AD_MAX ? BT_DATA_NAME_SHORTENED : BT_DATA_NAME_COMPLETE;
+            entry.data_len = static_cast<uint8_t>(std::min(len, NAME_AD_MAX));
+
+            name[std::min<size_t>(len, CONFIG_BT_DEVICE_NAME_MAX)] = '\0';
+            bt_set_name(name);
+            return true;
+        }
+
+        static bool encode_broadcast() {
+            uint8_t payload[sizeof(broadcast_encoded)];
+            app::broadcast.copy(payload);
+            if(std::memcmp(payload, broadcast_encoded, sizeof(payload)) == 0) {
+                return false;
+            }
+            std::memcpy(broadcast_encoded, payload, sizeof(payload));
+            return true;
+        }
+
+        // Once per bt_enable(), the set starts out stopped and empty
+        static app::result_t bt_adv_create() {
+            const auto created = app::check(bt_le_ext_adv_create(
+                &adv_params[static_cast<size_t>(adv_mode_e::FAST)], nullptr, &adv_set));
+            if(!created) {
+                adv_set = nullptr;
+                return created;
+            }
+            advertising = false;
+            advertising_mode = adv_mode_e::FAST;
+            data_stale = true;
+            return created;
+        }
+
+        // Advertises in mode. Changed contents go to the set in place whether it runs or
+        // not. A new mode pauses the set only for the parameter update, which HCI refuses
+        // for an enabled set, and starts it again with the data it already holds. Starting
+        // retries while the controller is short on resources.
+        static app::result_t bt_adv_start(adv_mode_e mode) {
+            if(!adv_set) {
+                return app::unexpected(-EAGAIN);
             }
 
+            auto name_scope = app::profile.scope(app::stage_e::SET_NAME);
+            const bool name_changed = encode_name();
+            const bool broadcast_changed = encode_broadcast();
+            name_scope.stop();
+
+            auto adv_scope = app::profile.scope(app::stage_e::ADV_START);
+            if(name_changed || broadcast_changed || data_stale) {
+                const auto updated = app::check(bt_le_ext_adv_set_data(
+                    adv_set,
+                    advertisement_data,
+                    ARRAY_SIZE(advertisement_data),
+                    scan_response_data,
+                    ARRAY_SIZE(scan_response_data)));
+                data_stale = !updated;
+                if(!updated) {
+                    LOG_ERR("Advertising data failed to update (err %d)", updated.error());
+                    return updated;
+                }
+                APP_TRACE("Advertising data updated in place");
+            }
+
+            if(advertising_mode != mode) {
+                if(advertising) {
+                    bt_le_ext_adv_stop(adv_set);
+                    advertising = false;
+                }
+                const auto updated = app::check(bt_le_ext_adv_update_param(
+                    adv_set, &adv_params[static_cast<size_t>(mode)]));
+                if(!updated) {
+                    LOG_ERR("Advertising parameters failed to update (err %d)", updated.error());
+                    return updated;
+                }
+                advertising_mode = mode;
+            }
+
+            if(advertising) {
+                return {};
+            }
+            const auto result = app::retry(app::RADIO_BACKOFF, [&]() {
+                return app::check(bt_le_ext_adv_start(adv_set, &adv_start_param));
+            });
+            if (!result) {
+                LOG_ERR("Advertising failed to start (err %d)", result.error());
+                return result;
+            }
+
+            advertising = true;
             LOG_DBG("Advertising successfully started");
+            return result;
         }
 
         static void bt_adv_stop() {
-            bt_le_adv_stop();
+            advertising = false;
+            if(adv_set) {
+                bt_le_ext_adv_stop(adv_set);
+            }
         }
 
         static void connected(bt_conn *conn, uint8_t err) {
@@ -82,36 +219,87 @@ namespace app_ble {
                 LOG_INF("Connection failed (err 0x%02x)", err);
             } else {
                 LOG_INF("Connected");
+                // Connectable advertising ends with the connection
+                advertising = false;
+                app::link_manager.connected(conn);
             }
         }
 
         static void disconnected(bt_conn *conn, uint8_t reason) {
             LOG_INF("Disconnected (reason 0x%02x)", reason);
+            ass_bulk.disconnected(conn);
+            app::link_manager.disconnected(conn);
+        }
+
+        static void le_param_updated(bt_conn* conn, uint16_t interval, uint16_t latency, uint16_t timeout) {
+            app::link_manager.param_updated(conn, interval, latency, timeout);
+        }
+
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+        static void le_phy_updated(bt_conn* conn, bt_conn_le_phy_info* param) {
+            app::link_manager.phy_updated(conn, param->tx_phy, param->rx_phy);
         }
+#endif
+
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+        static void le_data_len_updated(bt_conn* conn, bt_conn_le_data_len_info* info) {
+            app::link_manager.data_len_updated(conn, info->tx_max_len, info->rx_max_len);
+        }
+#endif
+
+#ifdef CONFIG_MCUMGR
+        // Any SMP command keeps the links fast, DFU uploads are long runs of them
+        static void mgmt_event(uint8_t opcode, uint16_t group, uint8_t id, void* arg) {
+            if(opcode == MGMT_EVT_OP_CMD_RECV) {
+                app::link_manager.activity(nullptr);
+            }
+        }
+#endif
     };
 
     static bt_conn_cb conn_callbacks = {
         .connected = static_manager_t::connected,
         .disconnected = static_manager_t::disconnected,
+        .le_param_updated = static_manager_t::le_param_updated,
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+        .le_phy_updated = static_manager_t::le_phy_updated,
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+        .le_data_len_updated = static_manager_t::le_data_len_updated,
+#endif
     };
 
     struct manager_t {
-        manager_t() {
+        // Starts enabling the stack in the background, once before ready()
+        app::result_t init() {
             int ret;
 
             // Register the built-in mcumgr command handlers before advertising */
             #ifdef CONFIG_MCUMGR_CMD_OS_MGMT
                 os_mgmt_register_group();
             #endif
-            #ifdef CONFIG_MCUMGR_CMD_IMG_MGMT
-                img_mgmt_register_group();
+            // The image group is registered by app_dfu, which stages uploads on its own thread
+            #ifdef CONFIG_MCUMGR
+                mgmt_register_evt_cb(static_manager_t::mgmt_event);
             #endif
 
-            // Prepare kernel structures
-            ret = bt_enable(NULL);
+            // Prepare kernel structures, the controller comes up while the caller continues.
+            // ready() waits for this bt_enable(), not the signal of an earlier one.
+            static_manager_t::enabled.reset();
+            ret = bt_enable(static_manager_t::bt_ready);
             if(ret) {
                 LOG_ERR("Failed to enable bluetooth: %d", ret);
-                throw std::runtime_error("Failed to enable bluetooth");
+                return app::unexpected(ret);
+            }
+            return {};
+        }
+
+        // Waits for the stack started by init() and registers the callbacks, once before start()
+        app::result_t ready() {
+            const auto enabled = static_manager_t::enabled.wait();
+            if(!enabled) {
+                LOG_ERR("Failed to enable bluetooth: %d", enabled.error());
+                return enabled;
             }
             LOG_DBG("Bluetooth initialized");
 
@@ -120,10 +308,11 @@ namespace app_ble {
             #ifdef CONFIG_MCUMGR_SMP_BT
             smp_bt_register();
             #endif
+            return static_manager_t::bt_adv_create();
         }
 
-        void start() {
-            static_manager_t::bt_adv_start();
+        app::result_t start(adv_mode_e mode = adv_mode_e::FAST) {
+            return static_manager_t::bt_adv_start(mode);
         }
 
         void stop() {
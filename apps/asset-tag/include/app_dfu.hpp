@@ -0,0 +1,214 @@
+#ifndef APP_INCLUDE_APP_DFU_HPP
+#define APP_INCLUDE_APP_DFU_HPP
+
+#include <app_log.hpp>
+
+#include <app/profile.hpp>
+#include <app/upload.hpp>
+
+#include <zephyr.h>
+
+#ifdef CONFIG_MCUMGR
+#include <mgmt/mgmt.h>
+#include <cborattr/cborattr.h>
+#include <tinycbor/cbor.h>
+#endif
+#ifdef CONFIG_MCUMGR_CMD_IMG_MGMT
+#include <img_mgmt/img_mgmt.h>
+#endif
+
+#include <cstring>
+
+namespace app_dfu {
+
+#ifdef CONFIG_MCUMGR
+// Next to the fault group of app_fault.hpp
+static constexpr uint16_t MGMT_GROUP_ID_DFU = MGMT_GROUP_ID_PERUSER + 1;
+
+enum mgmt_id_e : uint8_t {
+    MGMT_ID_DELTA_UPLOAD = 0
+};
+
+// How long the reply to the last chunk waits for the image to be finished before it tells
+// the client to send that chunk again
+static constexpr int32_t FINISH_WAIT_MS = 200;
+
+static K_THREAD_STACK_DEFINE(upload_stack, 1536);
+#endif
+
+static app::upload_t upload;
+
+// Accepts full and delta images over SMP and writes them into the secondary slot
+//
+// The image group of img_mgmt is registered here instead of by app_ble, with its state
+// commands and our own upload and erase, so both kinds of image take the same pipeline
+// through app::upload_t. Delta requests mirror img_mgmt upload: a map of off, data and,
+// with off 0, len, the size of the whole delta. Each response carries rc, the offset the
+// next chunk goes at and done, so a client that lost its connection resumes from there.
+// Once the image is complete it is listed by img_mgmt and goes through the usual test,
+// reset and confirm steps.
+//
+// A request is answered as soon as its chunk is queued, or right away with the same offset
+// when the queue is full. A failure on the upload thread is answered on the next request
+// of the session with its rc and offset 0, where the client starts over. The reply to the
+// last chunk waits up to FINISH_WAIT_MS for the image to be written and checked, and only
+// then reports the full length.
+struct manager_t {
+private:
+#ifdef CONFIG_MCUMGR
+    static inline k_thread s_upload_thread;
+    static inline uint8_t s_data[app::upload_t::CHUNK_MAX];
+
+    static void upload_thread(void*, void*, void*) {
+        while(true) {
+            upload.service(K_FOREVER);
+        }
+    }
+
+    static int mgmt_rc(int err) {
+        switch(err) {
+            case 0:
+                return MGMT_ERR_EOK;
+            case -ESRCH:
+                // A delta built against another image than the running one
+                return MGMT_ERR_EBADSTATE;
+            case -ENOTSUP:
+                // A delta format this image cannot apply
+                return MGMT_ERR_ENOTSUP;
+            case -ENOMEM:
+                return MGMT_ERR_ENOMEM;
+            case -EMSGSIZE:
+                return MGMT_ERR_EMSGSIZE;
+            default:
+                return MGMT_ERR_EINVAL;
+        }
+    }
+
+    static int encode(mgmt_ctxt* ctxt, const app::upload_t::reply_t& reply) {
+        CborError err = cbor_encode_text_stringz(&ctxt->encoder, "rc");
+        err |= cbor_encode_int(&ctxt->encoder, mgmt_rc(reply.rc));
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+        err |= cbor_encode_uint(&ctxt->encoder, reply.off);
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "done");
+        err |= cbor_encode_boolean(&ctxt->encoder, reply.done);
+        return err ? MGMT_ERR_ENOMEM : 0;
+    }
+
+    static int mgmt_upload(mgmt_ctxt* ctxt, app::upload_t::kind_e kind) {
+        auto chunk_scope = app::profile.scope(app::stage_e::DFU_CHUNK);
+        unsigned long long off = UINT64_MAX;
+        unsigned long long len = 0;
+        size_t data_len = 0;
+
+        cbor_attr_t attrs[4];
+        std::memset(attrs, 0, sizeof(attrs));
+        attrs[0].attribute = "off";
+        attrs[0].type = CborAttrUnsignedIntegerType;
+        attrs[0].addr.uinteger = &off;
+        attrs[0].nodefault = true;
+        attrs[1].attribute = "data";
+        attrs[1].type = CborAttrByteStringType;
+        attrs[1].addr.bytestring.data = s_data;
+        attrs[1].addr.bytestring.len = &data_len;
+        attrs[1].len = sizeof(s_data);
+        attrs[2].attribute = "len";
+        attrs[2].type = CborAttrUnsignedIntegerType;
+        attrs[2].addr.uinteger = &len;
+        attrs[2].nodefault = true;
+
+        if(cbor_read_object(&ctxt->it, attrs) || off > UINT32_MAX || len > UINT32_MAX) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        auto reply = upload.offer(kind, static_cast<uint32_t>(off), s_data, data_len, static_cast<uint32_t>(len));
+        if(upload.settling()) {
+            chunk_scope.stop();
+            upload.wait(K_MSEC(FINISH_WAIT_MS));
+            reply = upload.status();
+        }
+        return encode(ctxt, reply);
+    }
+
+    static int mgmt_delta_upload(mgmt_ctxt* ctxt) {
+        return mgmt_upload(ctxt, app::upload_t::kind_e::DELTA);
+    }
+
+    // Read: where the current upload stands without sending data, for a client to resume it
+    static int mgmt_delta_state(mgmt_ctxt* ctxt) {
+        const auto reply = upload.status();
+        CborError err = cbor_encode_text_stringz(&ctxt->encoder, "rc");
+        err |= cbor_encode_int(&ctxt->encoder, mgmt_rc(reply.rc));
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+        err |= cbor_encode_uint(&ctxt->encoder, reply.off);
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "staged");
+        err |= cbor_encode_uint(&ctxt->encoder, upload.staged());
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+        err |= cbor_encode_uint(&ctxt->encoder, upload.total());
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "delta");
+        err |= cbor_encode_boolean(&ctxt->encoder, upload.kind() == app::upload_t::kind_e::DELTA);
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "done");
+        err |= cbor_encode_boolean(&ctxt->encoder, reply.done);
+        return err ? MGMT_ERR_ENOMEM : 0;
+    }
+
+    static inline const mgmt_handler s_handlers[] = {
+        { mgmt_delta_state, mgmt_delta_upload }
+    };
+    static inline mgmt_group s_group = {};
+
+#ifdef CONFIG_MCUMGR_CMD_IMG_MGMT
+    static int mgmt_image_upload(mgmt_ctxt* ctxt) {
+        return mgmt_upload(ctxt, app::upload_t::kind_e::IMAGE);
+    }
+
+    static int mgmt_image_erase(mgmt_ctxt* ctxt) {
+        CborError err = cbor_encode_text_stringz(&ctxt->encoder, "rc");
+        err |= cbor_encode_int(&ctxt->encoder, upload.erase() ? MGMT_ERR_EBADSTATE : MGMT_ERR_EOK);
+        return err ? MGMT_ERR_ENOMEM : 0;
+    }
+
+    static_assert(IMG_MGMT_ID_STATE == 0 && IMG_MGMT_ID_UPLOAD == 1 && IMG_MGMT_ID_ERASE == 5,
+        "handlers are indexed by command id");
+
+    // State, test and confirm stay with img_mgmt, file and core commands are not built
+    static inline const mgmt_handler s_image_handlers[] = {
+        { img_mgmt_state_read, img_mgmt_state_write },
+        { nullptr, mgmt_image_upload },
+        { nullptr, nullptr },
+        { nullptr, nullptr },
+        { nullptr, nullptr },
+        { nullptr, mgmt_image_erase }
+    };
+    static inline mgmt_group s_image_group = {};
+#endif
+#endif
+
+public:
+    manager_t() {
+#ifdef CONFIG_MCUMGR
+        static bool registered = false;
+        if(!registered) {
+            s_group.mg_handlers = s_handlers;
+            s_group.mg_handlers_count = ARRAY_SIZE(s_handlers);
+            s_group.mg_group_id = MGMT_GROUP_ID_DFU;
+            mgmt_register_group(&s_group);
+#ifdef CONFIG_MCUMGR_CMD_IMG_MGMT
+            s_image_group.mg_handlers = s_image_handlers;
+            s_image_group.mg_handlers_count = ARRAY_SIZE(s_image_handlers);
+            s_image_group.mg_group_id = MGMT_GROUP_ID_IMAGE;
+            mgmt_register_group(&s_image_group);
+#endif
+            k_thread_create(&s_upload_thread, upload_stack, K_THREAD_STACK_SIZEOF(upload_stack),
+                upload_thread, nullptr, nullptr, nullptr, K_PRIO_PREEMPT(5), 0, K_NO_WAIT);
+            k_thread_name_set(&s_upload_thread, "dfu_upload");
+            registered = true;
+        }
+#endif
+    }
+
+    manager_t(const manager_t&) = delete;
+};
+
+}
+
+#endif
@@ -3,11 +3,30 @@
 
 #include <app_log.hpp>
 
+#include <app/crash.hpp>
+
 #include <zephyr.h>
 
+#include <exception>
 #include <stdexcept>
 
 [[noreturn]] void terminate() noexcept {
+	const uint32_t lr = reinterpret_cast<uintptr_t>(__builtin_return_address(0));
+#if defined(CONFIG_EXCEPTIONS)
+	try {
+		if(std::exception_ptr exception = std::current_exception()) {
+			std::rethrow_exception(exception);
+		}
+		app::fault_capture(app::FAULT_REASON_EXCEPTION, 0, lr, "terminate");
+	} catch(const std::exception& e) {
+		app::fault_capture(app::FAULT_REASON_EXCEPTION, 0, lr, e.what());
+	} catch(...) {
+		app::fault_capture(app::FAULT_REASON_EXCEPTION, 0, lr, "unknown exception");
+	}
+#else
+	app::fault_capture(app::FAULT_REASON_EXCEPTION, 0, lr, "terminate");
+#endif
+
 	LOG_PANIC();
 	LOG_ERR("Failed with exception. Resetting system");
 	NVIC_SystemReset();
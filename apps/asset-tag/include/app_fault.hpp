@@ -0,0 +1,147 @@
+#ifndef APP_INCLUDE_APP_FAULT_HPP
+#define APP_INCLUDE_APP_FAULT_HPP
+
+#include <app_log.hpp>
+#include <app_lfs.hpp>
+
+#include <app/ass.hpp>
+#include <app/crash.hpp>
+
+#include <zephyr.h>
+
+#ifdef CONFIG_MCUMGR
+#include <mgmt/mgmt.h>
+#include <tinycbor/cbor.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <string_view>
+
+namespace app_fault {
+
+// Boots that reset before clear_boot_streak() in a row before falling back to safe mode
+static constexpr uint32_t BOOT_LOOP_LIMIT = 5;
+
+// How long safe mode stays reachable over BLE
+static constexpr int32_t SAFE_MODE_S = 10 * 60;
+
+// How long safe mode then idles with the radio off before a reset retries a normal boot.
+// System off would never come back, no wake pin is armed.
+static constexpr int32_t SAFE_MODE_BACKOFF_S = 60 * 60;
+
+#ifdef CONFIG_MCUMGR
+static constexpr uint16_t MGMT_GROUP_ID_FAULT = MGMT_GROUP_ID_PERUSER;
+
+enum mgmt_id_e : uint8_t {
+    MGMT_ID_FAULTS = 0
+};
+#endif
+
+struct manager_t {
+    uint32_t streak = 0;
+
+private:
+    static inline app_lfs::manager_t* s_lfs = nullptr;
+
+#ifdef CONFIG_MCUMGR
+    // Read: every stored fault, most recent first
+    static int mgmt_faults_read(mgmt_ctxt* ctxt) {
+        CborEncoder faults;
+        CborError err = cbor_encode_text_stringz(&ctxt->encoder, "faults");
+        err |= cbor_encoder_create_array(&ctxt->encoder, &faults, CborIndefiniteLength);
+
+        app::fault_record_t record;
+        for(uint32_t age = 0; s_lfs && s_lfs->read_fault(age, &record, sizeof(record)); age++) {
+            record.message[sizeof(record.message) - 1] = '\0';
+
+            CborEncoder fault;
+            err |= cbor_encoder_create_map(&faults, &fault, CborIndefiniteLength);
+            err |= cbor_encode_text_stringz(&fault, "reason");
+            err |= cbor_encode_uint(&fault, record.reason);
+            err |= cbor_encode_text_stringz(&fault, "pc");
+            err |= cbor_encode_uint(&fault, record.pc);
+            err |= cbor_encode_text_stringz(&fault, "lr");
+            err |= cbor_encode_uint(&fault, record.lr);
+            err |= cbor_encode_text_stringz(&fault, "uptime");
+            err |= cbor_encode_uint(&fault, record.uptime_ms);
+            err |= cbor_encode_text_stringz(&fault, "boot");
+            err |= cbor_encode_uint(&fault, record.boot_count);
+            err |= cbor_encode_text_stringz(&fault, "msg");
+            err |= cbor_encode_text_stringz(&fault, record.message);
+            err |= cbor_encoder_close_container(&faults, &fault);
+        }
+
+        err |= cbor_encoder_close_container(&ctxt->encoder, &faults);
+        return err ? MGMT_ERR_ENOMEM : 0;
+    }
+
+    // Write: forget the stored faults
+    static int mgmt_faults_clear(mgmt_ctxt* ctxt) {
+        ARG_UNUSED(ctxt);
+        return s_lfs && s_lfs->clear_faults() ? 0 : MGMT_ERR_EUNKNOWN;
+    }
+
+    static inline const mgmt_handler s_handlers[] = {
+        { mgmt_faults_read, mgmt_faults_clear }
+    };
+    static inline mgmt_group s_group = {};
+#endif
+
+public:
+    // Commits the record a crash left in noinit RAM and counts the boot towards a loop
+    explicit manager_t(app_lfs::manager_t& lfs) {
+        s_lfs = &lfs;
+        app::fault_boot_count = lfs.boot_count;
+
+        app::fault_record_t record;
+        if(app::fault_take(&record)) {
+            record.message[sizeof(record.message) - 1] = '\0';
+            LOG_ERR("Previous boot %u faulted: reason %u pc 0x%08x lr 0x%08x", record.boot_count,
+                record.reason, record.pc, record.lr);
+            if(!lfs.write_fault(&record, sizeof(record))) {
+                LOG_ERR("Failed to store fault record");
+            }
+
+            char summary[ass_buffer_t::size()];
+            const int len = snprintf(summary, sizeof(summary), "fault %u pc %08x lr %08x at %u ms boot %u: %s",
+                (unsigned) record.reason, (unsigned) record.pc, (unsigned) record.lr,
+                (unsigned) record.uptime_ms, (unsigned) record.boot_count, record.message);
+            ass_error_write(std::string_view{summary, std::min(static_cast<size_t>(std::max(len, 0)), sizeof(summary) - 1)});
+        }
+
+        streak = lfs.update_boot_streak();
+        if(streak > 1) {
+            LOG_WRN("Boot %u of a streak without a completed wake", streak);
+        }
+
+#ifdef CONFIG_MCUMGR
+        static bool registered = false;
+        if(!registered) {
+            s_group.mg_handlers = s_handlers;
+            s_group.mg_handlers_count = ARRAY_SIZE(s_handlers);
+            s_group.mg_group_id = MGMT_GROUP_ID_FAULT;
+            mgmt_register_group(&s_group);
+            registered = true;
+        }
+#endif
+    }
+
+    manager_t(const manager_t&) = delete;
+
+    bool boot_loop() const {
+        return streak >= BOOT_LOOP_LIMIT;
+    }
+
+    // Marks this boot healthy, cheap to call on every wake
+    void clear_boot_streak() {
+        if(streak) {
+            streak = 0;
+            s_lfs->clear_boot_streak();
+        }
+    }
+};
+
+}
+
+#endif
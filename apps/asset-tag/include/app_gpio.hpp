@@ -3,14 +3,16 @@
 
 #include <app_log.hpp>
 
+#include <app/expected.hpp>
+#include <app/timer.hpp>
+
 #include <zephyr.h>
 #include <device.h>
 #include <devicetree.h>
 #include <drivers/gpio.h>
 
 #include <array>
-#include <cstring>
-#include <stdexcept>
+#include <cstdint>
 #include <string_view>
 #include <tuple>
 
@@ -22,24 +24,19 @@ struct pin_t {
     int32_t flags;
     const device*  device_binding;
 
-    explicit constexpr pin_t(bool status_okay, std::string_view label, int32_t pin, int32_t flags)
-    : label(label), pin(pin), flags(flags), device_binding(nullptr) {
-        if(!status_okay) {
-            std::string_view message_begin = "Invalid label: ";
-            char message[message_begin.size() + label.size()] = {};
-            std::memcpy(message, message_begin.begin(), message_begin.size());
-            std::memcpy(message + message_begin.size(), label.begin(), label.size());
-            throw std::logic_error(message);
-        }
-
-    }
+    // PREPARE_GPIO rejects aliases without an okay status at compile time
+    explicit constexpr pin_t(std::string_view label, int32_t pin, int32_t flags)
+    : label(label), pin(pin), flags(flags), device_binding(nullptr) {}
 
-    void configure(int32_t extra_flags) {
+    app::result_t configure(int32_t extra_flags) {
         LOG_DBG("Configuring %s on %d", label.data(), pin);
-        device_binding = device_get_binding(label.data());
-        if(gpio_pin_configure(device_binding, pin, extra_flags | flags)) {
-            throw std::runtime_error("Failed to configure gpio");
+        if(!device_binding) {
+            device_binding = device_get_binding(label.data());
+        }
+        if(!device_binding) {
+            return app::unexpected(-ENODEV);
         }
+        return app::check(gpio_pin_configure(device_binding, pin, extra_flags | flags));
     }
 
     void set(int value) {
@@ -52,10 +49,18 @@ struct manager_t {
     std::array<std::tuple<pin_t&, int32_t>, sizeof...(T)> pins;
 
     explicit constexpr manager_t(T&& ... pin_conf_args)
-        : pins(std::array{pin_conf_args...}) {
+        : pins(std::array{pin_conf_args...}) {}
+
+    // Configures every pin, stopping at the first failure
+    app::result_t init() {
         for(auto & [pin, flags] : pins) {
-            pin.configure(flags);
+            const auto result = pin.configure(flags);
+            if(!result) {
+                LOG_ERR("Failed to configure %s: %d", pin.label.data(), result.error());
+                return result;
+            }
         }
+        return {};
     }
 
     void all(bool state) {
@@ -65,19 +70,170 @@ struct manager_t {
     }
 };
 
+namespace detail {
+
+// Port of each pin, numbered in order of first appearance of its controller label
+template<size_t N>
+constexpr std::array<uint8_t, N> port_indices(const std::array<std::string_view, N>& labels) {
+    std::array<uint8_t, N> indices = {};
+    uint8_t ports = 0;
+    for(size_t i = 0; i < N; i++) {
+        indices[i] = ports;
+        for(size_t j = 0; j < i; j++) {
+            if(labels[j] == labels[i]) {
+                indices[i] = indices[j];
+                break;
+            }
+        }
+        if(indices[i] == ports) {
+            ports++;
+        }
+    }
+    return indices;
+}
+
+template<size_t N>
+constexpr size_t count_ports(const std::array<uint8_t, N>& indices) {
+    size_t ports = 0;
+    for(const uint8_t index : indices) {
+        ports = index + 1u > ports ? index + 1u : ports;
+    }
+    return ports;
+}
+
+template<size_t NUM_PORTS, size_t N>
+constexpr std::array<gpio_port_pins_t, NUM_PORTS> port_masks(const std::array<uint8_t, N>& indices,
+        const std::array<gpio_pin_t, N>& pins) {
+    std::array<gpio_port_pins_t, NUM_PORTS> masks = {};
+    for(size_t i = 0; i < N; i++) {
+        masks[indices[i]] |= BIT(pins[i]);
+    }
+    return masks;
+}
+
+}
+
+// Pins known at compile time from PREPARE_GPIO bindings, driven with one write per port
+//
+// Pins sharing a controller are collapsed into a single masked port write, and each
+// controller is bound once in init(). Levels are logical, so active low pins from
+// devicetree read the same as the rest. Bit i of a state is the i-th binding.
+template<typename ... TBINDINGS>
+struct group_t {
+    static constexpr size_t NUM_PINS = sizeof...(TBINDINGS);
+    static_assert(NUM_PINS > 0 && NUM_PINS <= 32, "a group state is one bit per pin in a u32");
+
+private:
+    static constexpr std::array<std::string_view, NUM_PINS> s_labels = { TBINDINGS::controller... };
+    static constexpr std::array<gpio_pin_t, NUM_PINS> s_pins = { static_cast<gpio_pin_t>(TBINDINGS::pin)... };
+    static constexpr std::array<gpio_flags_t, NUM_PINS> s_flags = { static_cast<gpio_flags_t>(TBINDINGS::flags)... };
+    static constexpr std::array<uint8_t, NUM_PINS> s_port_of = detail::port_indices(s_labels);
+
+public:
+    static constexpr size_t NUM_PORTS = detail::count_ports(s_port_of);
+
+private:
+    static constexpr std::array<gpio_port_pins_t, NUM_PORTS> s_masks = detail::port_masks<NUM_PORTS>(s_port_of, s_pins);
+
+    std::array<const device*, NUM_PORTS> m_ports = {};
+
+    // Port bits for the group state, folds to shifts and ors for a constant state
+    static gpio_port_value_t port_value(size_t port, uint32_t state) {
+        gpio_port_value_t value = 0;
+        for(size_t i = 0; i < NUM_PINS; i++) {
+            if(s_port_of[i] == port && (state >> i) & 1) {
+                value |= BIT(s_pins[i]);
+            }
+        }
+        return value;
+    }
+
+public:
+    // Binds each controller once and configures every pin, stopping at the first failure
+    app::result_t init(gpio_flags_t extra_flags = GPIO_OUTPUT_INACTIVE) {
+        for(size_t i = 0; i < NUM_PINS; i++) {
+            const device*& port = m_ports[s_port_of[i]];
+            if(!port) {
+                port = device_get_binding(s_labels[i].data());
+            }
+            if(!port) {
+                LOG_ERR("No GPIO controller %s", s_labels[i].data());
+                return app::unexpected(-ENODEV);
+            }
+
+            const auto result = app::check(gpio_pin_configure(port, s_pins[i], extra_flags | s_flags[i]));
+            if(!result) {
+                LOG_ERR("Failed to configure %s pin %d: %d", s_labels[i].data(), s_pins[i], result.error());
+                return result;
+            }
+        }
+        return {};
+    }
+
+    // Sets every pin to bit i of state, callable from ISRs
+    void write(uint32_t state) {
+        for(size_t port = 0; port < NUM_PORTS; port++) {
+            gpio_port_set_masked(m_ports[port], s_masks[port], port_value(port, state));
+        }
+    }
+
+    void all(bool state) {
+        for(size_t port = 0; port < NUM_PORTS; port++) {
+            gpio_port_set_masked(m_ports[port], s_masks[port], state ? s_masks[port] : 0);
+        }
+    }
+};
+
+// Plays group states from a timer interrupt, one state per tick at THZ, looping until
+// destroyed, when every pin is cleared
+template<typename TGROUP, typename THZ, size_t NUM_STEPS>
+struct pattern_t {
+private:
+    struct step_t {
+        pattern_t* m_pattern;
+        void submit() { m_pattern->step(); }
+    };
+
+    TGROUP& m_group;
+    const std::array<uint32_t, NUM_STEPS> m_states;
+    size_t m_index = 0;
+    app::timer_t<THZ> m_timer;
+
+    void step() {
+        m_group.write(m_states[m_index]);
+        m_index = m_index + 1 < NUM_STEPS ? m_index + 1 : 0;
+    }
+
+public:
+    pattern_t(TGROUP& group, const std::array<uint32_t, NUM_STEPS>& states)
+        : m_group(group), m_states(states), m_timer(step_t{ this }) {}
+
+    pattern_t(const pattern_t&) = delete;
+
+    ~pattern_t() {
+        m_timer.stop();
+        m_group.all(false);
+    }
+
+    bool valid() const {
+        return m_timer.valid();
+    }
+};
+
 using namespace std::literals;
 
-#define PREPARE_GPIO(label) struct label ## _binding_t { \
-    static constexpr bool             status_okay = bool{DT_NODE_HAS_STATUS(DT_ALIAS(label), okay)}; \
-    static constexpr std::string_view label       = std::string_view{DT_GPIO_LABEL(DT_ALIAS(label), gpios) "\0"}; \
-    static constexpr const int32_t   pin          = int32_t{DT_GPIO_PIN(DT_ALIAS(label), gpios)}; \
-    static constexpr const int32_t   flags        = int32_t{DT_GPIO_FLAGS(DT_ALIAS(label), gpios)}; \
+// Binding type alias##_binding_t and pin alias##_gpio for a devicetree alias with an okay status
+#define PREPARE_GPIO(alias) struct alias ## _binding_t { \
+    static constexpr bool             status_okay = bool{DT_NODE_HAS_STATUS(DT_ALIAS(alias), okay)}; \
+    static constexpr std::string_view controller  = std::string_view{DT_GPIO_LABEL(DT_ALIAS(alias), gpios) "\0"}; \
+    static constexpr const int32_t   pin          = int32_t{DT_GPIO_PIN(DT_ALIAS(alias), gpios)}; \
+    static constexpr const int32_t   flags        = int32_t{DT_GPIO_FLAGS(DT_ALIAS(alias), gpios)}; \
 }; \
-app_gpio::pin_t label ## _gpio( \
-    label ## _binding_t::status_okay, \
-    label ## _binding_t::label, \
-    label ## _binding_t::pin, \
-    label ## _binding_t::flags);
+static_assert(alias ## _binding_t::status_okay, "Invalid alias: " #alias); \
+app_gpio::pin_t alias ## _gpio( \
+    alias ## _binding_t::controller, \
+    alias ## _binding_t::pin, \
+    alias ## _binding_t::flags);
 
 }
 
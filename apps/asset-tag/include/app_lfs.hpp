@@ -1,8 +1,16 @@
 #ifndef APP_INCLUDE_APP_LFS_HPP
 #define APP_INCLUDE_APP_LFS_HPP
 
+#include <app/expected.hpp>
+#include <app/journal.hpp>
+#include <app/profile.hpp>
+#include <app/storage.hpp>
+#include <app/trace.hpp>
+
+#include <algorithm>
 #include <cstring>
 #include <string>
+#include <string_view>
 
 #include <fs/fs.h>
 #include <fs/littlefs.h>
@@ -13,7 +21,32 @@ namespace app_lfs {
 
 #define MAX_PATH_LEN 255
 
-FS_LITTLEFS_DECLARE_DEFAULT_CONFIG(storage);
+// Keys of the records persisted in the storage journal
+enum class key_e : uint8_t {
+    BOOT_COUNT = 0,
+    VALUE = 1,
+    DATA = 2,
+    HISTORY_HEAD = 3,
+    FAULT_HEAD = 4,
+    BOOT_STREAK = 5,
+    NUM_KEYS
+};
+
+static constexpr size_t MAX_RECORD_SIZE = 128;
+using journal_t = app::journal_t<static_cast<size_t>(key_e::NUM_KEYS), MAX_RECORD_SIZE>;
+
+// History blocks are kept in a fixed ring of slots in one file, the next slot is journaled
+static constexpr size_t HISTORY_BLOCK_SIZE = 128;
+static constexpr uint32_t HISTORY_BLOCKS = 32;
+
+// Fault records use the same scheme with fewer, smaller slots
+static constexpr size_t FAULT_SLOT_SIZE = 128;
+static constexpr uint32_t FAULT_SLOTS = 8;
+static_assert(HISTORY_BLOCK_SIZE <= MAX_RECORD_SIZE && FAULT_SLOT_SIZE <= MAX_RECORD_SIZE, "ring slots are staged in a record buffer");
+
+// Caches and lookahead are static buffers sized by the profile, no heap involved
+FS_LITTLEFS_DECLARE_CUSTOM_CONFIG(storage, app::storage_profile.read_size, app::storage_profile.prog_size,
+    app::storage_profile.cache_size, app::storage_profile.lookahead_size);
 static fs_mount_t lfs_storage_mnt = {
 	.type = FS_LITTLEFS,
 	.mnt_point = "/lfs",
@@ -21,37 +54,79 @@ static fs_mount_t lfs_storage_mnt = {
 	.storage_dev = (void *)FLASH_AREA_ID(storage),
 };
 
-struct manager_t {
+struct manager_t : app::counter_source_t {
     fs_mount_t *mp = &lfs_storage_mnt;
-
-    manager_t() {
-        int rc;
-
-        if(fs_mount(mp) < 0) {
-            throw std::runtime_error("Failed to mount");
+    uint32_t boot_count = 0;
+    // Blocks written and committed, readers never see a block of an open batch
+    uint32_t history_head = 0;
+    uint32_t fault_head = 0;
+
+private:
+    journal_t m_journal;
+    bool m_batch = false;
+    // history_head once the open batch commits
+    uint32_t m_history_next = 0;
+    bool m_mounted = false;
+    bool m_statvfs_valid = false;
+    uint32_t m_statvfs_written = 0;
+    struct fs_statvfs m_statvfs = {};
+
+public:
+    // Mounts storage, replays the journal and counts the boot
+    app::result_t init() {
+        if(!m_mounted) {
+            storage.cfg.block_cycles = app::storage_profile.block_cycles;
+            const int rc = fs_mount(mp);
+            if(rc < 0 && rc != -EBUSY) {
+                LOG_ERR("FAIL: mount: %d", rc);
+                return app::unexpected(rc);
+            }
+            m_mounted = true;
         }
 
-        struct fs_statvfs sbuf;
-        rc = fs_statvfs(mp->mnt_point, &sbuf);
-        if (rc < 0) {
-            LOG_ERR("FAIL: statvfs: %d", rc);
-            throw std::runtime_error("statvfs barf");
+        LOG_INF("%s: cache = %u ; lookahead = %u ; block_cycles = %d ; ram = %u",
+            log_strdup(mp->mnt_point), app::storage_profile.cache_size, app::storage_profile.lookahead_size,
+            (int) app::storage_profile.block_cycles, (unsigned) app::storage_profile.ram());
+
+        char fname[MAX_PATH_LEN];
+        snprintf(fname, sizeof(fname), "%s/journal", mp->mnt_point);
+        if(!m_journal.open(fname)) {
+            return app::unexpected(-EIO);
         }
 
-        LOG_INF("%s: bsize = %lu ; frsize = %lu ;"
-            " blocks = %lu ; bfree = %lu",
-            log_strdup(mp->mnt_point),
-            sbuf.f_bsize, sbuf.f_frsize,
-            sbuf.f_blocks, sbuf.f_bfree);
+        migrate(key_e::BOOT_COUNT, "%s/boot_count");
+        migrate(key_e::VALUE, "%s/value");
+        migrate(key_e::DATA, "%s/data");
 
         update_boot_count();
+        m_journal.read(static_cast<uint8_t>(key_e::HISTORY_HEAD), &history_head, sizeof(history_head));
+        m_history_next = history_head;
+        m_journal.read(static_cast<uint8_t>(key_e::FAULT_HEAD), &fault_head, sizeof(fault_head));
+        return {};
     }
 
-    void try_wipe() {
+    // Filesystem usage, computed on first use and again only after writes (statvfs walks
+    // every allocated block)
+    app::expected_t<struct fs_statvfs> statvfs() {
+        if(!m_statvfs_valid || m_statvfs_written != m_journal.stats().bytes_written) {
+            const int rc = fs_statvfs(mp->mnt_point, &m_statvfs);
+            if(rc < 0) {
+                LOG_ERR("FAIL: statvfs: %d", rc);
+                return app::unexpected(rc);
+            }
+            m_statvfs_valid = true;
+            m_statvfs_written = m_journal.stats().bytes_written;
+        }
+        return m_statvfs;
+    }
+
+    app::result_t try_wipe() {
         const flash_area* pfa;
         unsigned int id = (uintptr_t)mp->storage_dev; // WTF Zephyr
-        if(flash_area_open(static_cast<uint8_t>(id), &pfa) < 0) {
-            throw std::runtime_error("Failed to open lfs flash area");
+        const int rc = flash_area_open(static_cast<uint8_t>(id), &pfa);
+        if(rc < 0) {
+            LOG_ERR("Failed to open lfs flash area: %d", rc);
+            return app::unexpected(rc);
         }
 
         // Optionally wipe the filesystem
@@ -60,161 +135,244 @@ struct manager_t {
         }
 
         flash_area_close(pfa);
+        return {};
     }
 
-    void update_boot_count() {
-        int rc;
+    // Moves a value from the per-key files used before the journal, then removes the old file
+    void migrate(key_e key, const char* fname_template) {
+        if(m_journal.contains(static_cast<uint8_t>(key))) {
+            return;
+        }
+
         char fname[MAX_PATH_LEN];
-        snprintf(fname, sizeof(fname), "%s/boot_count", mp->mnt_point);
+        snprintf(fname, sizeof(fname), fname_template, mp->mnt_point);
 
         fs_dirent dirent;
-        rc = fs_stat(fname, &dirent);
-        LOG_INF("%s stat: %d", log_strdup(fname), rc);
-        if (rc >= 0) {
-            LOG_INF("\tfn '%s' siz %u", log_strdup(dirent.name), dirent.size);
+        if(fs_stat(fname, &dirent) < 0) {
+            return;
         }
 
         fs_file_t file;
         std::memset(&file, 0, sizeof(file));
-
-        rc = fs_open(&file, fname, FS_O_CREATE | FS_O_RDWR);
-        if (rc < 0) {
-            LOG_ERR("FAIL: open %s: %d", log_strdup(fname), rc);
-            throw std::runtime_error("Failed to open boot count file");
+        if(fs_open(&file, fname, FS_O_READ) < 0) {
+            return;
         }
 
-        uint32_t boot_count = 0;
+        uint8_t buffer[MAX_RECORD_SIZE];
+        const ssize_t rc = fs_read(&file, buffer, sizeof(buffer));
+        fs_close(&file);
 
-        if (rc >= 0) {
-            rc = fs_read(&file, &boot_count, sizeof(boot_count));
-            LOG_INF("%s read count %u: %d", log_strdup(fname), boot_count, rc);
-            rc = fs_seek(&file, 0, FS_SEEK_SET);
-            LOG_INF("%s seek start: %d", log_strdup(fname), rc);
+        if(rc > 0 && m_journal.append(static_cast<uint8_t>(key), buffer, rc)) {
+            LOG_INF("Migrated %s into journal", log_strdup(fname));
+            fs_unlink(fname);
         }
+    }
+
+    void update_boot_count() {
+        boot_count = 0;
+        m_journal.read(static_cast<uint8_t>(key_e::BOOT_COUNT), &boot_count, sizeof(boot_count));
 
         boot_count += 1;
-        rc = fs_write(&file, &boot_count, sizeof(boot_count));
-        LOG_INF("%s write new boot count %u: %d", log_strdup(fname),
-            boot_count, rc);
+        if(!m_journal.append(static_cast<uint8_t>(key_e::BOOT_COUNT), &boot_count, sizeof(boot_count))) {
+            LOG_ERR("Failed to persist boot count %u", boot_count);
+        }
+        LOG_INF("Boot count: %u", boot_count);
+    }
 
-        rc = fs_close(&file);
-        LOG_INF("%s close: %d", log_strdup(fname), rc);
-        while(log_process(false));
+    bool read(key_e key, char* dst, size_t len) {
+        const ssize_t rc = m_journal.read(static_cast<uint8_t>(key), dst, len);
+        APP_TRACE("Read key %d: %d", (int) key, (int) rc);
+        return rc >= 0;
     }
 
-    bool read(const char* fname_template, char* dst, size_t len) {
-        int rc;
-        char fname[MAX_PATH_LEN];
-        snprintf(fname, sizeof(fname), fname_template, mp->mnt_point);
+    bool write(key_e key, std::string_view value) {
+        const bool ok = m_journal.append(static_cast<uint8_t>(key), value.data(), value.size());
+        APP_TRACE("Wrote key %d (%d bytes): %d", (int) key, (int) value.size(), (int) ok);
+        return ok;
+    }
 
-        fs_dirent dirent;
-        rc = fs_stat(fname, &dirent);
-        LOG_INF("%s stat: %d", log_strdup(fname), rc);
-        if (rc >= 0) {
-            LOG_INF("\tfn '%s' siz %u", log_strdup(dirent.name), dirent.size);
-        }
-        while(log_process(false));
+    bool patch(key_e key, size_t offset, const uint8_t* data, size_t len, size_t size) {
+        const bool ok = m_journal.patch(static_cast<uint8_t>(key), offset, data, len, size);
+        APP_TRACE("Patched key %d (%d bytes at %d): %d", (int) key, (int) len, (int) offset, (int) ok);
+        return ok;
+    }
 
-        fs_file_t file;
-        std::memset(&file, 0, sizeof(file));
+    // Calls fn(key, data, len) for every stored key, init() already read them all in one pass
+    template<typename TFN>
+    void read_all(TFN&& fn) const {
+        m_journal.for_each([&](uint8_t key, const uint8_t* data, size_t len) {
+            fn(static_cast<key_e>(key), data, len);
+        });
+    }
 
-        rc = fs_open(&file, fname, FS_O_CREATE | FS_O_RDWR);
-        if (rc < 0) {
-            LOG_ERR("FAIL: open %s: %d", log_strdup(fname), rc);
-            return false;
-        }
+    // Groups the following writes and patches into one atomic journal commit
+    bool begin() {
+        m_batch = m_journal.begin();
+        return m_batch;
+    }
 
-        if (rc >= 0) {
-            rc = fs_read(&file, dst, len);
-            LOG_INF("%s read '%s': %d", log_strdup(fname), log_strdup(dst), rc);
-            rc = fs_seek(&file, 0, FS_SEEK_SET);
-            LOG_INF("%s seek start: %d", log_strdup(fname), rc);
+    bool commit() {
+        const bool ok = m_journal.commit();
+        APP_TRACE("Committed batch: %d", (int) ok);
+        if(m_batch) {
+            // A failed batch is dropped, its history blocks are written over next time
+            if(ok) {
+                history_head = m_history_next;
+            } else {
+                m_history_next = history_head;
+            }
         }
-        while(log_process(false));
+        m_batch = false;
+        return ok;
+    }
 
-        rc = fs_close(&file);
-        LOG_INF("%s close: %d", log_strdup(fname), rc);
-        while(log_process(false));
-        return rc >= 0;
+    void abort() {
+        m_journal.abort();
+        m_history_next = history_head;
+        m_batch = false;
     }
 
     bool write_value(std::string_view value) {
-        int rc;
-        char fname[MAX_PATH_LEN];
-        snprintf(fname, sizeof(fname), "%s/value", mp->mnt_point);
+        return write(key_e::VALUE, value);
+    }
 
-        fs_dirent dirent;
-        rc = fs_stat(fname, &dirent);
-        LOG_INF("%s stat: %d", log_strdup(fname), rc);
-        if (rc >= 0) {
-            LOG_INF("\tfn '%s' siz %u", log_strdup(dirent.name), dirent.size);
-        }
+    bool write_data(std::string_view value) {
+        return write(key_e::DATA, value);
+    }
+
+    // Writes slot index of a ring file made of fixed size slots
+    bool write_slot(const char* name, uint32_t index, size_t slot_size, const void* data, size_t len) {
+        m_statvfs_valid = false;
+
+        char fname[MAX_PATH_LEN];
+        snprintf(fname, sizeof(fname), "%s/%s", mp->mnt_point, name);
 
         fs_file_t file;
         std::memset(&file, 0, sizeof(file));
-
-        rc = fs_open(&file, fname, FS_O_CREATE | FS_O_RDWR);
-        if (rc < 0) {
+        int rc = fs_open(&file, fname, FS_O_CREATE | FS_O_RDWR);
+        if(rc < 0) {
             LOG_ERR("FAIL: open %s: %d", log_strdup(fname), rc);
             return false;
         }
 
-        char prev_value[sizeof(ass_value) + 1] = {0};
+        uint8_t slot[MAX_RECORD_SIZE] = {};
+        slot_size = std::min(slot_size, sizeof(slot));
+        std::memcpy(slot, data, std::min(len, slot_size));
 
-        if (rc >= 0) {
-            rc = fs_read(&file, prev_value, sizeof(prev_value));
-            LOG_INF("%s read value '%s': %d", log_strdup(fname), log_strdup(prev_value), rc);
-            rc = fs_seek(&file, 0, FS_SEEK_SET);
-            LOG_INF("%s seek start: %d", log_strdup(fname), rc);
+        rc = fs_seek(&file, index * slot_size, FS_SEEK_SET);
+        if(rc >= 0) {
+            rc = fs_write(&file, slot, slot_size);
+        }
+        fs_close(&file);
+        if(rc < 0) {
+            LOG_ERR("FAIL: write %s slot %d: %d", log_strdup(name), (int) index, rc);
+            return false;
         }
-
-        rc = fs_write(&file, value.data(), value.size());
-        LOG_INF("%s write value '%s': %d", log_strdup(fname), log_strdup(value.data()), rc);
-
-        rc = fs_close(&file);
-        LOG_INF("%s close: %d", log_strdup(fname), rc);
         return true;
     }
 
-    bool write_data(std::string_view value) {
-        int rc;
+    bool read_slot(const char* name, uint32_t index, size_t slot_size, void* dst, size_t len) {
         char fname[MAX_PATH_LEN];
-        snprintf(fname, sizeof(fname), "%s/data", mp->mnt_point);
-
-        fs_dirent dirent;
-        rc = fs_stat(fname, &dirent);
-        LOG_INF("%s stat: %d", log_strdup(fname), rc);
-        if (rc >= 0) {
-            LOG_INF("\tfn '%s' siz %u", log_strdup(dirent.name), dirent.size);
-        }
+        snprintf(fname, sizeof(fname), "%s/%s", mp->mnt_point, name);
 
         fs_file_t file;
         std::memset(&file, 0, sizeof(file));
+        if(fs_open(&file, fname, FS_O_READ) < 0) {
+            return false;
+        }
 
-        rc = fs_open(&file, fname, FS_O_CREATE | FS_O_RDWR);
-        if (rc < 0) {
-            LOG_ERR("FAIL: open %s: %d", log_strdup(fname), rc);
+        ssize_t rc = fs_seek(&file, index * slot_size, FS_SEEK_SET);
+        if(rc >= 0) {
+            rc = fs_read(&file, dst, std::min(len, slot_size));
+        }
+        fs_close(&file);
+        return rc > 0;
+    }
+
+    // Writes the next history block slot, overwriting the oldest once the ring is full. In
+    // a batch the block only counts once commit() succeeds.
+    bool write_history(const uint8_t* block, size_t len) {
+        if(!write_slot("history", m_history_next % HISTORY_BLOCKS, HISTORY_BLOCK_SIZE, block, len)) {
             return false;
         }
 
-        char prev_value[sizeof(ass_data) + 1] = {0};
+        const uint32_t next = m_history_next + 1;
+        if(!m_journal.append(static_cast<uint8_t>(key_e::HISTORY_HEAD), &next, sizeof(next))) {
+            return false;
+        }
+        m_history_next = next;
+        if(!m_batch) {
+            history_head = next;
+        }
+        return true;
+    }
 
-        if (rc >= 0) {
-            rc = fs_read(&file, prev_value, sizeof(prev_value));
-            LOG_INF("%s read data '%s': %d", log_strdup(fname), log_strdup(prev_value), rc);
-            rc = fs_seek(&file, 0, FS_SEEK_SET);
-            LOG_INF("%s seek start: %d", log_strdup(fname), rc);
+    // Reads the history block written age blocks ago (0 is the most recent)
+    bool read_history(uint32_t age, uint8_t* dst, size_t len) {
+        if(age >= std::min(history_head, HISTORY_BLOCKS)) {
+            return false;
         }
+        return read_slot("history", (history_head - 1 - age) % HISTORY_BLOCKS, HISTORY_BLOCK_SIZE, dst, len);
+    }
 
-        rc = fs_write(&file, value.data(), value.size());
-        LOG_INF("%s write data '%s': %d", log_strdup(fname), log_strdup(value.data()), rc);
+    // Appends a fault record, overwriting the oldest once FAULT_SLOTS are kept. The record
+    // only counts once the new head is journaled.
+    bool write_fault(const void* record, size_t len) {
+        if(!write_slot("faults", fault_head % FAULT_SLOTS, FAULT_SLOT_SIZE, record, len)) {
+            return false;
+        }
 
-        rc = fs_close(&file);
-        LOG_INF("%s close: %d", log_strdup(fname), rc);
+        const uint32_t next = fault_head + 1;
+        if(!m_journal.append(static_cast<uint8_t>(key_e::FAULT_HEAD), &next, sizeof(next))) {
+            return false;
+        }
+        fault_head = next;
         return true;
     }
 
+    // Reads the fault recorded age faults ago (0 is the most recent)
+    bool read_fault(uint32_t age, void* dst, size_t len) {
+        if(age >= std::min(fault_head, FAULT_SLOTS)) {
+            return false;
+        }
+        return read_slot("faults", (fault_head - 1 - age) % FAULT_SLOTS, FAULT_SLOT_SIZE, dst, len);
+    }
+
+    uint32_t fault_count() const {
+        return std::min(fault_head, FAULT_SLOTS);
+    }
+
+    bool clear_faults() {
+        fault_head = 0;
+        return m_journal.append(static_cast<uint8_t>(key_e::FAULT_HEAD), &fault_head, sizeof(fault_head));
+    }
+
+    // Counts boots that ended before clear_boot_streak(), returns the new streak
+    uint32_t update_boot_streak() {
+        uint32_t streak = 0;
+        m_journal.read(static_cast<uint8_t>(key_e::BOOT_STREAK), &streak, sizeof(streak));
+        streak += 1;
+        if(!m_journal.append(static_cast<uint8_t>(key_e::BOOT_STREAK), &streak, sizeof(streak))) {
+            LOG_ERR("Failed to persist boot streak %u", streak);
+        }
+        return streak;
+    }
 
+    void clear_boot_streak() {
+        const uint32_t streak = 0;
+        m_journal.append(static_cast<uint8_t>(key_e::BOOT_STREAK), &streak, sizeof(streak));
+    }
+
+    const journal_t::stats_t& stats() const {
+        return m_journal.stats();
+    }
+
+    // Counter group JOURNAL of the profile dump
+    size_t read(uint32_t* dst) override {
+        const journal_t::stats_t& s = m_journal.stats();
+        return app::put_counters(dst, s.appends, s.skipped, s.bytes_written, s.compactions,
+            s.replayed, s.truncated, s.batches, s.syncs);
+    }
 };
 
 }
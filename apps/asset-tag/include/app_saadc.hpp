@@ -4,65 +4,151 @@
 #include <app_battery.hpp>
 #include <app_log.hpp>
 
+#include <app/expected.hpp>
 #include <app/measure.hpp>
+#include <app/trace.hpp>
 
 #include <zephyr.h>
 #include <device.h>
+#include <devicetree.h>
 #include <drivers/adc.h>
 #include <drivers/sensor.h>
+#include <sys/atomic.h>
+#include <sys/ring_buffer.h>
 
+#include <hal/nrf_egu.h>
 #include <hal/nrf_gpio.h>
+#include <hal/nrf_rtc.h>
 #include <hal/nrf_saadc.h>
+#include <nrfx_ppi.h>
 
+#include <algorithm>
 #include <array>
 #include <cstring>
-#include <stdexcept>
 
 namespace app_saadc {
 
+	static constexpr int64_t CALIBRATION_PERIOD_MS = 60 * 60 * 1000;
+
+	inline const device* adc_binding() {
+		static const device* adc_device = device_get_binding(DT_LABEL(DT_INST(0, nordic_nrf_saadc)));
+		return adc_device;
+	}
+
+	// Remembers the last configuration applied to each SAADC channel so it is only set up once
+	struct channels_t {
+		static constexpr size_t MAX_CHANNELS = 8;
+		std::array<adc_channel_cfg, MAX_CHANNELS> configured = {};
+		uint8_t valid = 0;
+
+		// Field by field, the bitfields leave padding that memcmp would compare
+		static bool same(const adc_channel_cfg& a, const adc_channel_cfg& b) {
+			return a.gain == b.gain
+				&& a.reference == b.reference
+				&& a.acquisition_time == b.acquisition_time
+				&& a.channel_id == b.channel_id
+				&& a.differential == b.differential
+				&& a.input_positive == b.input_positive
+				&& a.input_negative == b.input_negative;
+		}
+
+		app::result_t setup(const device* adc_device, const adc_channel_cfg* config) {
+			const uint8_t id = config->channel_id;
+			if(id >= MAX_CHANNELS) {
+				LOG_ERR("No SAADC channel %d", (int) id);
+				return app::unexpected(-EINVAL);
+			}
+			if((valid & BIT(id)) && same(configured[id], *config)) {
+				return {};
+			}
+
+			LOG_DBG("Channel: %d on PinP: %d PinN: %d", (int32_t) id, (int32_t) config->input_positive, (int32_t) config->input_negative);
+			const int ret = adc_channel_setup(adc_device, config);
+			if(ret) {
+				LOG_ERR("Failed to register channel config for %d: %d", (int) id, ret);
+				return app::unexpected(ret);
+			}
+			configured[id] = *config;
+			valid |= BIT(id);
+			return {};
+		}
+	};
+
+	static channels_t channels;
+
+	// Set while a one-shot measurement or a stream has the SAADC, the other gets -EBUSY
+	static atomic_t held = ATOMIC_INIT(0);
+
 	template<size_t NUM_CHANNELS = app::adc_t::NUM_CHANNELS>
 	struct manager_t {
 		int16_t sample_buffer[NUM_CHANNELS];
+		int64_t last_calibration;
 
-		constexpr manager_t() : sample_buffer() {
+		manager_t() : sample_buffer(), last_calibration(0) {
 			memset(sample_buffer, 0, sizeof(sample_buffer));
+		}
+
+		// Calibrates once before the first measurement
+		app::result_t init() {
+			if(!adc_binding()) {
+				LOG_ERR("No SAADC device");
+				return app::unexpected(-ENODEV);
+			}
 
-			// Calibration on construction
 			const app::adc_t adc_confs;
-			measure(std::array{ &adc_confs.vdd_channel_cfg, }, true);
+			const auto calibration = measure(std::array{ &adc_confs.vdd_channel_cfg, }, true);
+			if(!calibration) {
+				return app::unexpected(calibration.error());
+			}
+			return {};
+		}
+
+		bool calibration_due() const {
+			return k_uptime_get() - last_calibration >= CALIBRATION_PERIOD_MS;
 		}
 
-		// One-shot measurements
+		// One-shot measurements, calibrating when forced or once per CALIBRATION_PERIOD_MS.
+		// A SAADC still held by a stream or calibration is retried with ADC_BACKOFF.
 		template<size_t SAMPLES>
-		std::array<int32_t, SAMPLES> measure(std::array<const adc_channel_cfg*, SAMPLES>&& configs, bool calibrate) {
-			const device* adc_device = device_get_binding(DT_LABEL(DT_INST(0, nordic_nrf_saadc)));
+		app::expected_t<std::array<int32_t, SAMPLES>> measure(std::array<const adc_channel_cfg*, SAMPLES>&& configs, bool calibrate = false) {
+			const device* adc_device = adc_binding();
 
-			uint8_t channels = 0;
+			uint8_t channel_mask = 0;
 			int ret;
 			for(int i = 0; i < (int) SAMPLES; i++) {
-				LOG_DBG("Channel: %d on PinP: %d PinN: %d", (int32_t) configs[i]->channel_id, (int32_t) configs[i]->input_positive, (int32_t) configs[i]->input_negative);
-				channels |= BIT(configs[i]->channel_id);
-				ret = adc_channel_setup(adc_device, configs[i]);
-				if(ret) {
-					LOG_ERR("Failed to register channel config for %d", i);
-					throw std::runtime_error("Failed to register channel");
+				channel_mask |= BIT(configs[i]->channel_id);
+				const auto setup = channels.setup(adc_device, configs[i]);
+				if(!setup) {
+					return app::unexpected(setup.error());
 				}
 			}
 
+			calibrate = calibrate || calibration_due();
+
 			// Initiate the saadc sequence
 			memset(sample_buffer, 0, sizeof(sample_buffer));
 			const adc_sequence sequence = {
-				.channels     = channels,
+				.channels     = channel_mask,
 				.buffer       = sample_buffer,
 				.buffer_size  = sizeof(sample_buffer),
-				.resolution   = configs.size() == 1 ? 14 : 12,
-				.oversampling = configs.size() == 1 ? 4 : 0,
+				.resolution   = static_cast<uint8_t>(configs.size() == 1 ? 14 : 12),
+				.oversampling = static_cast<uint8_t>(configs.size() == 1 ? 4 : 0),
 				.calibrate    = calibrate
 			};
-			ret = adc_read(adc_device, &sequence);
-			if(ret) {
-				LOG_ERR("Failed to do an adc_read: %d", ret);
-				throw std::runtime_error("Failed to do adc_read");
+			const auto read = app::retry(app::ADC_BACKOFF, [&]() {
+				if(!atomic_cas(&held, 0, 1)) {
+					return app::result_t(app::unexpected(-EBUSY));
+				}
+				const auto result = app::check(adc_read(adc_device, &sequence));
+				atomic_clear(&held);
+				return result;
+			});
+			if(!read) {
+				LOG_ERR("Failed to do an adc_read: %d", read.error());
+				return app::unexpected(read.error());
+			}
+			if(calibrate) {
+				last_calibration = k_uptime_get();
 			}
 
 			// Convert the samples to meaningful scale (mV)
@@ -73,16 +159,254 @@ namespace app_saadc {
 									configs[i]->gain,
 									sequence.resolution - configs[i]->differential,
 									&measurements[i]);
-				LOG_DBG("Channel: %" PRId32" Before: %" PRId32 " After: %" PRId32, configs[i]->channel_id, (int) sample_buffer[i], (int) measurements[i]);
+				APP_TRACE("Channel: %d Before: %d After: %d", (int) configs[i]->channel_id, (int) sample_buffer[i], (int) measurements[i]);
 				if (ret) {
 					LOG_ERR("Failed to convert adc raw to millivolts: ret %d", ret);
-					throw std::runtime_error("Failed to convert adc");
+					return app::unexpected(ret);
 				}
 			}
 
 			return measurements;
 		}
 	};
+
+	// Priority of the EGU interrupt that hands finished blocks to a stream, below the radio
+	static constexpr uint8_t BLOCK_IRQ_PRIORITY = 5;
+
+	// Set by the running stream, called from the EGU3 interrupt for every finished block
+	static void (*block_handler)() = nullptr;
+
+	static void block_isr(const void*) {
+		nrf_egu_event_clear(NRF_EGU3, NRF_EGU_EVENT_TRIGGERED0);
+		if(block_handler) {
+			block_handler();
+		}
+	}
+
+	// Continuous sampling paced in hardware into double-buffered EasyDMA, drained through a
+	// ring buffer
+	//
+	// RTC2 COMPARE0 triggers SAADC SAMPLE through PPI and clears the RTC on the fork, so the
+	// CPU and HFCLK stay off between samples. SAADC END starts the SAADC again through PPI
+	// into the other half of the buffer, whose pointer was latched after the last STARTED,
+	// and triggers EGU3 on the fork. Its interrupt publishes the finished half into the ring
+	// buffer and queues that half to follow the one filling. Consumers call read() from
+	// thread context. Blocks that do not fit in the ring buffer are dropped and counted as
+	// overruns. The stream holds the SAADC until stop(), one-shot measurements get -EBUSY
+	// and retry with ADC_BACKOFF meanwhile. The END interrupt of the Zephyr driver is masked
+	// while the stream runs, so its ISR does not take the SAADC back.
+	template<size_t NUM_CHANNELS, size_t BLOCK_SAMPLES = 16, size_t RING_BLOCKS = 4>
+	struct stream_t {
+		static constexpr size_t BLOCK_SIZE = BLOCK_SAMPLES * NUM_CHANNELS;
+		static constexpr uint32_t RTC_HZ = 32768;
+
+		struct stats_t {
+			uint32_t blocks;
+			uint32_t samples;
+			uint32_t overruns;
+		};
+
+	private:
+		static inline stream_t* s_instance = nullptr;
+
+		int16_t m_buffer[2 * BLOCK_SIZE];
+		uint8_t m_ring_data[RING_BLOCKS * BLOCK_SIZE * sizeof(int16_t)];
+		ring_buf m_ring;
+		std::array<nrf_saadc_input_t, channels_t::MAX_CHANNELS> m_inputs;
+		nrf_saadc_resolution_t m_resolution;
+		uint32_t m_ticks;
+		nrf_ppi_channel_t m_sample_ppi;
+		nrf_ppi_channel_t m_restart_ppi;
+		uint8_t m_ppi_allocated = 0;
+		// Half of m_buffer the SAADC fills now
+		size_t m_filling = 0;
+		int m_error = 0;
+		stats_t m_stats = {};
+
+		void publish(const int16_t* block) {
+			const uint32_t bytes = BLOCK_SIZE * sizeof(int16_t);
+			if(ring_buf_space_get(&m_ring) < bytes) {
+				m_stats.overruns++;
+				return;
+			}
+			ring_buf_put(&m_ring, reinterpret_cast<const uint8_t*>(block), bytes);
+			m_stats.blocks++;
+			m_stats.samples += BLOCK_SAMPLES;
+		}
+
+		// The SAADC moved on to the other half, which leaves this one to read and queue
+		static void on_block() {
+			stream_t* self = s_instance;
+			int16_t* done = self->m_buffer + self->m_filling * BLOCK_SIZE;
+			self->m_filling ^= 1;
+			self->publish(done);
+			nrf_saadc_buffer_init(NRF_SAADC, done, BLOCK_SIZE);
+		}
+
+		static nrf_saadc_resolution_t resolution_of(uint8_t bits) {
+			switch(bits) {
+				case 8:
+					return NRF_SAADC_RESOLUTION_8BIT;
+				case 10:
+					return NRF_SAADC_RESOLUTION_10BIT;
+				case 14:
+					return NRF_SAADC_RESOLUTION_14BIT;
+				default:
+					return NRF_SAADC_RESOLUTION_12BIT;
+			}
+		}
+
+		// Allocates and wires the two PPI channels once, they stay disabled until start()
+		int wire() {
+			if(nrfx_ppi_channel_alloc(&m_sample_ppi) != NRFX_SUCCESS) {
+				return -ENOMEM;
+			}
+			m_ppi_allocated++;
+			if(nrfx_ppi_channel_alloc(&m_restart_ppi) != NRFX_SUCCESS) {
+				return -ENOMEM;
+			}
+			m_ppi_allocated++;
+
+			nrfx_ppi_channel_assign(m_sample_ppi,
+				nrf_rtc_event_address_get(NRF_RTC2, NRF_RTC_EVENT_COMPARE_0),
+				nrf_saadc_task_address_get(NRF_SAADC, NRF_SAADC_TASK_SAMPLE));
+			nrfx_ppi_channel_fork_assign(m_sample_ppi, nrf_rtc_task_address_get(NRF_RTC2, NRF_RTC_TASK_CLEAR));
+			nrfx_ppi_channel_assign(m_restart_ppi,
+				nrf_saadc_event_address_get(NRF_SAADC, NRF_SAADC_EVENT_END),
+				nrf_saadc_task_address_get(NRF_SAADC, NRF_SAADC_TASK_START));
+			nrfx_ppi_channel_fork_assign(m_restart_ppi, nrf_egu_task_address_get(NRF_EGU3, NRF_EGU_TASK_TRIGGER0));
+			return 0;
+		}
+
+	public:
+		// Configures the channels and PPI once, sampling every interval_us after start(),
+		// rounded to the 30.5 us RTC ticks. A failure here is returned by start().
+		stream_t(std::array<const adc_channel_cfg*, NUM_CHANNELS>&& configs, uint32_t interval_us, uint8_t resolution = 12)
+			: m_buffer(), m_ring_data(), m_inputs(), m_resolution(resolution_of(resolution)),
+			  m_ticks(std::max<uint32_t>(2, (uint64_t{interval_us} * RTC_HZ + 500'000) / 1'000'000)) {
+			ring_buf_init(&m_ring, sizeof(m_ring_data), m_ring_data);
+			m_inputs.fill(NRF_SAADC_INPUT_DISABLED);
+
+			const device* adc_device = adc_binding();
+			for(const adc_channel_cfg* config : configs) {
+				const auto setup = channels.setup(adc_device, config);
+				if(!setup) {
+					LOG_ERR("Failed to set up stream channel %d: %d", (int) config->channel_id, setup.error());
+					m_error = setup.error();
+					return;
+				}
+				m_inputs[config->channel_id] = static_cast<nrf_saadc_input_t>(config->input_positive);
+			}
+
+			m_error = wire();
+			if(m_error) {
+				LOG_ERR("No PPI channels for the stream: %d", m_error);
+				return;
+			}
+			IRQ_CONNECT(SWI3_EGU3_IRQn, BLOCK_IRQ_PRIORITY, block_isr, NULL, 0);
+		}
+
+		stream_t(const stream_t&) = delete;
+
+		~stream_t() {
+			stop();
+			if(m_ppi_allocated > 1) {
+				nrfx_ppi_channel_free(m_restart_ppi);
+			}
+			if(m_ppi_allocated > 0) {
+				nrfx_ppi_channel_free(m_sample_ppi);
+			}
+		}
+
+		app::result_t start() {
+			if(m_error) {
+				return app::unexpected(m_error);
+			}
+			if(s_instance == this) {
+				return {};
+			}
+			if(!atomic_cas(&held, 0, 1)) {
+				return app::unexpected(-EBUSY);
+			}
+			s_instance = this;
+			block_handler = on_block;
+			m_filling = 0;
+
+			nrf_saadc_int_disable(NRF_SAADC, NRF_SAADC_INT_END);
+			nrf_saadc_resolution_set(NRF_SAADC, m_resolution);
+			nrf_saadc_oversample_set(NRF_SAADC, NRF_SAADC_OVERSAMPLE_DISABLED);
+			for(uint8_t channel = 0; channel < channels_t::MAX_CHANNELS; channel++) {
+				nrf_saadc_channel_pos_input_set(NRF_SAADC, channel, m_inputs[channel]);
+			}
+			nrf_saadc_event_clear(NRF_SAADC, NRF_SAADC_EVENT_STARTED);
+			nrf_saadc_event_clear(NRF_SAADC, NRF_SAADC_EVENT_END);
+			nrf_saadc_event_clear(NRF_SAADC, NRF_SAADC_EVENT_STOPPED);
+			nrf_saadc_enable(NRF_SAADC);
+
+			// The first half goes to the SAADC now, the second is latched by the first restart
+			nrf_saadc_buffer_init(NRF_SAADC, m_buffer, BLOCK_SIZE);
+			nrf_saadc_task_trigger(NRF_SAADC, NRF_SAADC_TASK_START);
+			while(!nrf_saadc_event_check(NRF_SAADC, NRF_SAADC_EVENT_STARTED)) {}
+			nrf_saadc_event_clear(NRF_SAADC, NRF_SAADC_EVENT_STARTED);
+			nrf_saadc_buffer_init(NRF_SAADC, m_buffer + BLOCK_SIZE, BLOCK_SIZE);
+
+			nrf_egu_event_clear(NRF_EGU3, NRF_EGU_EVENT_TRIGGERED0);
+			nrf_egu_int_enable(NRF_EGU3, NRF_EGU_INT_TRIGGERED0);
+			irq_enable(SWI3_EGU3_IRQn);
+			nrfx_ppi_channel_enable(m_restart_ppi);
+			nrfx_ppi_channel_enable(m_sample_ppi);
+
+			// The PPI clear lands a tick after the compare, CC is one short of the interval
+			nrf_rtc_prescaler_set(NRF_RTC2, 0);
+			nrf_rtc_cc_set(NRF_RTC2, 0, m_ticks - 1);
+			nrf_rtc_event_enable(NRF_RTC2, NRF_RTC_INT_COMPARE0_MASK);
+			nrf_rtc_task_trigger(NRF_RTC2, NRF_RTC_TASK_CLEAR);
+			nrf_rtc_task_trigger(NRF_RTC2, NRF_RTC_TASK_START);
+			APP_TRACE("ADC stream started, %d ticks", (int) m_ticks);
+			return {};
+		}
+
+		// Stops pacing and the SAADC and hands it back to the driver, the half being filled
+		// is dropped
+		void stop() {
+			if(s_instance != this) {
+				return;
+			}
+			nrf_rtc_task_trigger(NRF_RTC2, NRF_RTC_TASK_STOP);
+			nrf_rtc_event_disable(NRF_RTC2, NRF_RTC_INT_COMPARE0_MASK);
+			nrfx_ppi_channel_disable(m_sample_ppi);
+			nrfx_ppi_channel_disable(m_restart_ppi);
+			irq_disable(SWI3_EGU3_IRQn);
+			nrf_egu_int_disable(NRF_EGU3, NRF_EGU_INT_TRIGGERED0);
+
+			nrf_saadc_task_trigger(NRF_SAADC, NRF_SAADC_TASK_STOP);
+			while(!nrf_saadc_event_check(NRF_SAADC, NRF_SAADC_EVENT_STOPPED)) {}
+			nrf_saadc_event_clear(NRF_SAADC, NRF_SAADC_EVENT_STOPPED);
+			nrf_saadc_event_clear(NRF_SAADC, NRF_SAADC_EVENT_END);
+			nrf_saadc_disable(NRF_SAADC);
+			nrf_saadc_int_enable(NRF_SAADC, NRF_SAADC_INT_END);
+
+			block_handler = nullptr;
+			s_instance = nullptr;
+			atomic_clear(&held);
+		}
+
+		// Copies up to max_samples raw samples, interleaved in channel id order, returns the
+		// count copied
+		size_t read(int16_t* dst, size_t max_samples) {
+			const uint32_t bytes = ring_buf_get(&m_ring, reinterpret_cast<uint8_t*>(dst), max_samples * sizeof(int16_t));
+			return bytes / sizeof(int16_t);
+		}
+
+		// Sampling interval in RTC ticks
+		uint32_t ticks() const {
+			return m_ticks;
+		}
+
+		const stats_t& stats() const {
+			return m_stats;
+		}
+	};
 }
 
 #endif
@@ -0,0 +1,260 @@
+#ifndef APP_INCLUDE_APP_SCHEDULER_HPP
+#define APP_INCLUDE_APP_SCHEDULER_HPP
+
+#include <app_ble.hpp>
+#include <app_log.hpp>
+
+#include <app/trace.hpp>
+#include <app/work.hpp>
+
+#include <zephyr.h>
+#include <sys/atomic.h>
+#include <bluetooth/conn.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+
+namespace app_scheduler {
+
+enum class state_e : uint8_t {
+    IDLE = 0,
+    FAST = 1,
+    SLOW = 2,
+    CONNECTED = 3
+};
+
+// Timing of one wake cycle: a measurement, fast advertising, slow advertising, then idle
+struct config_t {
+    uint32_t period_ms = 20'000;
+    uint32_t fast_duration_ms = 4'000;
+    uint32_t slow_duration_ms = 12'000;
+
+    // Below low_battery_pct the period is multiplied by low_battery_stretch
+    uint8_t low_battery_pct = 20;
+    uint8_t low_battery_stretch = 3;
+
+    // Within recent_connection_ms of a connection the period is divided by recent_connection_shrink
+    uint32_t recent_connection_ms = 120'000;
+    uint8_t recent_connection_shrink = 2;
+};
+
+// Drives the wake cycle from a delayed work item instead of blocking sleeps
+//
+// Every transition runs from one work item on the supplied queue. Connection callbacks from
+// the BT RX thread only count the link and submit the work item immediately, so all state
+// changes happen on one thread. The state is CONNECTED while any link is up, during which
+// wakes keep running every period. The main thread blocks in wait() until stop(). TWAKE
+// measures and returns the battery percentage as an app::expected_t<uint8_t>.
+template<typename TWAKE>
+struct manager_t {
+    struct stats_t {
+        uint32_t wakes = 0;
+        uint32_t failed_wakes = 0;
+        uint32_t failed_adv = 0;
+        uint32_t connections = 0;
+        uint32_t period_ms = 0;
+    };
+
+private:
+    static inline manager_t* s_instance = nullptr;
+    static inline bool s_registered = false;
+
+    static void on_connected(bt_conn* conn, uint8_t err) {
+        if(!err && s_instance) {
+            atomic_inc(&s_instance->m_links);
+            atomic_inc(&s_instance->m_connects);
+            s_instance->m_work.submit();
+        }
+    }
+
+    static void on_disconnected(bt_conn* conn, uint8_t reason) {
+        if(s_instance) {
+            atomic_dec(&s_instance->m_links);
+            atomic_set(&s_instance->m_disconnected, 1);
+            s_instance->m_work.submit();
+        }
+    }
+
+    static inline bt_conn_cb s_conn_callbacks = {
+        .connected = on_connected,
+        .disconnected = on_disconnected,
+    };
+
+    app_ble::manager_t& m_ble;
+    TWAKE m_wake;
+    config_t m_config;
+    app::work_t<> m_work;
+    k_sem m_exit;
+    atomic_t m_links = ATOMIC_INIT(0);
+    atomic_t m_connects = ATOMIC_INIT(0);
+    atomic_t m_disconnected = ATOMIC_INIT(0);
+    state_e m_state = state_e::IDLE;
+    uint8_t m_battery_pct = 100;
+    bool m_connected_once = false;
+    int64_t m_last_connection = 0;
+    int64_t m_last_wake = 0;
+    int64_t m_deadline = 0;
+    stats_t m_stats = {};
+
+    // The timer of the current state, a submit from a callback displaces it
+    void schedule(uint32_t ms) {
+        m_deadline = k_uptime_get() + ms;
+        m_work.schedule(K_MSEC(ms));
+    }
+
+    // A window that fails to advertise is skipped, the next one tries again
+    void advertise(app_ble::adv_mode_e mode) {
+        if(!m_ble.start(mode)) {
+            m_stats.failed_adv++;
+        }
+    }
+
+    // A failed measurement keeps the last battery level for the next period
+    void wake() {
+        m_last_wake = k_uptime_get();
+        const auto battery_pct = m_wake();
+        if(battery_pct) {
+            m_battery_pct = *battery_pct;
+        } else {
+            m_stats.failed_wakes++;
+        }
+        m_stats.wakes++;
+    }
+
+    void enter(state_e state) {
+        APP_TRACE("Scheduler state %d -> %d", (int) m_state, (int) state);
+        m_state = state;
+
+        switch(state) {
+            case state_e::FAST:
+                advertise(app_ble::adv_mode_e::FAST);
+                schedule(m_config.fast_duration_ms);
+                break;
+            case state_e::SLOW:
+                advertise(app_ble::adv_mode_e::SLOW);
+                schedule(m_config.slow_duration_ms);
+                break;
+            case state_e::IDLE:
+                m_ble.stop();
+                schedule(idle_ms());
+                break;
+            case state_e::CONNECTED: {
+                // Advertising stopped with the connection, measuring and flushing carry on
+                const int64_t next = m_last_wake + period_ms() - k_uptime_get();
+                schedule(static_cast<uint32_t>(std::max<int64_t>(next, 0)));
+                break;
+            }
+        }
+    }
+
+    void step() {
+        const int64_t now = k_uptime_get();
+        const atomic_val_t connects = atomic_clear(&m_connects);
+        const atomic_val_t disconnected = atomic_clear(&m_disconnected);
+        if(connects) {
+            m_connected_once = true;
+            m_stats.connections += connects;
+        }
+        if(connects || disconnected) {
+            m_last_connection = now;
+        }
+
+        // A disconnect with another link still up stays connected
+        const bool linked = atomic_get(&m_links) > 0;
+        if(linked != (m_state == state_e::CONNECTED)) {
+            enter(linked ? state_e::CONNECTED : state_e::FAST);
+            return;
+        }
+
+        // Woken by a callback before the state's timer, put the timer back
+        if(now < m_deadline) {
+            m_work.schedule(K_MSEC(m_deadline - now));
+            return;
+        }
+
+        switch(m_state) {
+            case state_e::IDLE:
+                wake();
+                enter(state_e::FAST);
+                break;
+            case state_e::FAST:
+                enter(state_e::SLOW);
+                break;
+            case state_e::SLOW:
+                enter(state_e::IDLE);
+                break;
+            case state_e::CONNECTED:
+                wake();
+                schedule(period_ms());
+                break;
+        }
+    }
+
+    uint32_t period_ms() {
+        uint32_t period = m_config.period_ms;
+        if(m_battery_pct < m_config.low_battery_pct) {
+            period *= m_config.low_battery_stretch;
+        }
+        if(m_connected_once && k_uptime_get() - m_last_connection < m_config.recent_connection_ms) {
+            period /= m_config.recent_connection_shrink;
+        }
+        m_stats.period_ms = period;
+        return period;
+    }
+
+    uint32_t idle_ms() {
+        const uint32_t period = period_ms();
+        const uint32_t active = m_config.fast_duration_ms + m_config.slow_duration_ms;
+        return period > active ? period - active : 0;
+    }
+
+public:
+    manager_t(app_ble::manager_t& ble, TWAKE&& wake, k_work_q* work_q, const config_t& config = {})
+        : m_ble(ble), m_wake(std::move(wake)), m_config(config), m_work([this]() { step(); }, work_q) {
+        k_sem_init(&m_exit, 0, 1);
+    }
+
+    manager_t(const manager_t&) = delete;
+
+    ~manager_t() {
+        stop();
+        s_instance = nullptr;
+    }
+
+    // Begins the first wake immediately on the work queue
+    void start() {
+        if(!s_registered) {
+            bt_conn_cb_register(&s_conn_callbacks);
+            s_registered = true;
+        }
+        s_instance = this;
+        m_state = state_e::IDLE;
+
+        LOG_INF("Scheduling wakes every %d ms", (int) m_config.period_ms);
+        schedule(0);
+    }
+
+    void stop() {
+        m_work.cancel();
+        m_ble.stop();
+        k_sem_give(&m_exit);
+    }
+
+    // Blocks the caller until stop()
+    void wait() {
+        k_sem_take(&m_exit, K_FOREVER);
+    }
+
+    state_e state() const {
+        return m_state;
+    }
+
+    const stats_t& stats() const {
+        return m_stats;
+    }
+};
+
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <stats/stats.h>
 #include <mgmt/mcumgr/buf.h>
+#include <mgmt/mgmt.h>
 
 #ifdef CONFIG_MCUMGR_CMD_OS_MGMT
 #include "os_mgmt/os_mgmt.h"
@@ -27,7 +27,8 @@ static int disable_ds_1(const struct device *dev)
 SYS_INIT(disable_ds_1, PRE_KERNEL_2, 0);
 
 int power_off() {
-	LOG_WRN("Press the gpio button to wakeup");
+	// No GPIO sense is armed, see main(), only a reset or power cycle wakes the tag
+	LOG_WRN("Powering off until reset");
 
 	/* Above we disabled entry to deep sleep based on duration of
 	 * controlled delay.  Here we need to override that, then
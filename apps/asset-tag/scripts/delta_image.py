@@ -0,0 +1,253 @@
+#!/usr/bin/env python3
+"""Build a delta image that app::delta_patcher_t turns from the running image into a new one.
+
+The base must be the signed image the tag runs now, as reported by `image list`. Pass
+that hash with --expect-hash to refuse a delta against the wrong base.
+
+    python3 delta_image.py old/zephyr.signed.bin build_app/zephyr/zephyr.signed.bin out.delta
+"""
+
+import argparse
+import binascii
+import struct
+import sys
+
+MAGIC = 0x31544C44
+# A stream that uses OP_INSERT_LZ4, which tags running an older patcher refuse up front
+MAGIC_LZ4 = 0x32544C44
+OP_COPY = 0
+OP_INSERT = 1
+OP_INSERT_LZ4 = 2
+
+# Matches shorter than this cost more as a COPY than as literal bytes
+BLOCK = 16
+# Bounds the flash work the device does for a single operation
+MAX_COPY = 4096
+# Candidate source offsets remembered per block, newest first
+MAX_CANDIDATES = 8
+# Target bytes the patcher keeps for LZ4 matches, delta_patcher_t::WINDOW
+WINDOW = 1024
+MIN_MATCH = 4
+
+IMAGE_MAGIC = 0x96F3B83D
+TLV_INFO_MAGIC = 0x6907
+TLV_PROT_INFO_MAGIC = 0x6908
+TLV_SHA256 = 0x10
+
+
+def image_hash(image):
+    """SHA256 TLV of an MCUboot image, the hash `image list` prints."""
+    magic, _, hdr_size, _, img_size = struct.unpack_from("<IIHHI", image, 0)
+    if magic != IMAGE_MAGIC:
+        return None
+    offset = hdr_size + img_size
+    while offset + 4 <= len(image):
+        info_magic, total = struct.unpack_from("<HH", image, offset)
+        if info_magic not in (TLV_INFO_MAGIC, TLV_PROT_INFO_MAGIC):
+            return None
+        end = offset + total
+        offset += 4
+        while offset + 4 <= end:
+            kind, length = struct.unpack_from("<HH", image, offset)
+            if kind & 0xFF == TLV_SHA256:
+                return image[offset + 4:offset + 4 + length].hex()
+            offset += 4 + length
+        offset = end
+    return None
+
+
+def index(source):
+    blocks = {}
+    for offset in range(len(source) - BLOCK + 1):
+        candidates = blocks.setdefault(source[offset:offset + BLOCK], [])
+        if len(candidates) < MAX_CANDIDATES:
+            candidates.append(offset)
+    return blocks
+
+
+def operations(source, target):
+    """Greedy longest match against every block of the source."""
+    blocks = index(source)
+    literal = bytearray()
+    position = 0
+    while position < len(target):
+        best_offset, best_length = 0, 0
+        for offset in blocks.get(target[position:position + BLOCK], ()):
+            length = BLOCK
+            while (position + length < len(target) and offset + length < len(source)
+                   and target[position + length] == source[offset + length]):
+                length += 1
+            if length > best_length:
+                best_offset, best_length = offset, length
+
+        if best_length < BLOCK:
+            literal.append(target[position])
+            position += 1
+            continue
+
+        if literal:
+            yield OP_INSERT, bytes(literal)
+            literal = bytearray()
+        for start in range(0, best_length, MAX_COPY):
+            yield OP_COPY, (best_offset + start, min(MAX_COPY, best_length - start))
+        position += best_length
+
+    if literal:
+        yield OP_INSERT, bytes(literal)
+
+
+def lz4_length(out, n):
+    while n >= 255:
+        out.append(255)
+        n -= 255
+    out.append(n)
+
+
+def lz4_sequence(out, literal, distance=0, length=0):
+    extra = length - MIN_MATCH if distance else 0
+    out.append(min(len(literal), 15) << 4 | min(extra, 15))
+    if len(literal) >= 15:
+        lz4_length(out, len(literal) - 15)
+    out += literal
+    if distance:
+        out += struct.pack("<H", distance)
+        if extra >= 15:
+            lz4_length(out, extra - 15)
+
+
+def lz4_block(target, start, end):
+    """LZ4 block of target[start:end], matches reach back at most WINDOW bytes into the
+    target produced so far, including what COPY operations took from the source."""
+    out = bytearray()
+    table = {}
+    for position in range(max(0, start - WINDOW), start):
+        table[target[position:position + MIN_MATCH]] = position
+    anchor = position = start
+    while position + MIN_MATCH <= end:
+        key = target[position:position + MIN_MATCH]
+        candidate = table.get(key)
+        table[key] = position
+        if candidate is None or position - candidate > WINDOW:
+            position += 1
+            continue
+        length = MIN_MATCH
+        while position + length < end and target[candidate + length] == target[position + length]:
+            length += 1
+        lz4_sequence(out, target[anchor:position], position - candidate, length)
+        for skipped in range(position + 1, min(position + length, end - MIN_MATCH + 1)):
+            table[target[skipped:skipped + MIN_MATCH]] = skipped
+        position += length
+        anchor = position
+    lz4_sequence(out, target[anchor:end])
+    return bytes(out)
+
+
+def encode(source, target, compress=True):
+    ops = bytearray()
+    copied = 0
+    compressed = False
+    position = 0
+    for op, argument in operations(source, target):
+        if op == OP_COPY:
+            ops += struct.pack("<BII", OP_COPY, *argument)
+            copied += argument[1]
+            position += argument[1]
+            continue
+        block = lz4_block(target, position, position + len(argument)) if compress else None
+        if block is not None and len(block) < len(argument):
+            ops += struct.pack("<BI", OP_INSERT_LZ4, len(block)) + block
+            compressed = True
+        else:
+            ops += struct.pack("<BI", OP_INSERT, len(argument)) + argument
+        position += len(argument)
+    header = struct.pack("<IIIII", MAGIC_LZ4 if compressed else MAGIC, len(source),
+                         binascii.crc32(source), len(target), binascii.crc32(target))
+    return header + bytes(ops), copied
+
+
+def lz4_inflate(target, block):
+    offset = 0
+    while True:
+        token = block[offset]
+        offset += 1
+        literal, extra = token >> 4, token & 0x0F
+        if literal == 15:
+            while True:
+                literal += block[offset]
+                offset += 1
+                if block[offset - 1] != 255:
+                    break
+        target += block[offset:offset + literal]
+        offset += literal
+        if offset == len(block):
+            return
+        (distance,) = struct.unpack_from("<H", block, offset)
+        offset += 2
+        if extra == 15:
+            while True:
+                extra += block[offset]
+                offset += 1
+                if block[offset - 1] != 255:
+                    break
+        assert 0 < distance <= min(WINDOW, len(target))
+        for _ in range(extra + MIN_MATCH):
+            target.append(target[-distance])
+
+
+def apply(source, delta):
+    """Reference patcher used to check every delta before it is written."""
+    magic, source_size, source_crc, target_size, target_crc = struct.unpack_from("<IIIII", delta, 0)
+    assert magic in (MAGIC, MAGIC_LZ4) and source_size == len(source) and source_crc == binascii.crc32(source)
+    target = bytearray()
+    offset = 20
+    while len(target) < target_size:
+        op = delta[offset]
+        if op == OP_COPY:
+            start, length = struct.unpack_from("<II", delta, offset + 1)
+            target += source[start:start + length]
+            offset += 9
+        elif op == OP_INSERT_LZ4:
+            assert magic == MAGIC_LZ4
+            (length,) = struct.unpack_from("<I", delta, offset + 1)
+            lz4_inflate(target, delta[offset + 5:offset + 5 + length])
+            offset += 5 + length
+        else:
+            (length,) = struct.unpack_from("<I", delta, offset + 1)
+            target += delta[offset + 5:offset + 5 + length]
+            offset += 5 + length
+    assert offset == len(delta) and binascii.crc32(target) == target_crc
+    return bytes(target)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("base", help="signed image running on the tag")
+    parser.add_argument("image", help="new signed image")
+    parser.add_argument("output", help="delta file to write")
+    parser.add_argument("--expect-hash", help="hash of the running image from `image list`")
+    parser.add_argument("--no-compress", action="store_true",
+                        help="plain literals, for a base whose patcher predates LZ4 blocks")
+    args = parser.parse_args()
+
+    with open(args.base, "rb") as f:
+        source = f.read()
+    with open(args.image, "rb") as f:
+        target = f.read()
+
+    if args.expect_hash:
+        found = image_hash(source)
+        if found != args.expect_hash.lower():
+            sys.exit("base image hash %s does not match the running image %s" % (found, args.expect_hash))
+
+    delta, copied = encode(source, target, not args.no_compress)
+    if apply(source, delta) != target:
+        sys.exit("delta does not reproduce the image")
+
+    with open(args.output, "wb") as f:
+        f.write(delta)
+    print("%s: %d bytes, %.1f%% of the %d byte image, %d bytes copied from the base" % (
+        args.output, len(delta), 100.0 * len(delta) / max(len(target), 1), len(target), copied))
+
+
+if __name__ == "__main__":
+    main()
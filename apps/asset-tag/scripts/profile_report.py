@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Print a per-stage breakdown and the module counters of the ass_profile characteristic.
+
+Pass the value as read by a BLE client, either as hex (spaces, dashes and a 0x prefix
+are ignored) or as a path to a file with the raw bytes.
+
+    python3 profile_report.py 0x01-0A-08-00-...
+    python3 profile_report.py profile.bin
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+# Keep in sync with app::stage_e in include/app/profile.hpp
+STAGES = [
+    "ble_init",
+    "lfs_init",
+    "saadc_init",
+    "wake",
+    "persist",
+    "measure",
+    "battery_level",
+    "history",
+    "set_name",
+    "adv_start",
+    "dfu_chunk",
+    "dfu_write",
+    "dfu_erase",
+]
+
+# Keep in sync with app::counter_group_e and the counter_source_t of each group
+GROUPS = {
+    0: ("link", ["renegotiations", "request_failures", "param_updates", "phy_updates",
+                 "data_len_updates", "interval", "latency", "timeout", "tx_phy", "rx_phy",
+                 "tx_max_len", "rx_max_len"]),
+    1: ("persist", ["writes_received", "writes_coalesced", "flushes", "skipped"]),
+    2: ("bulk", ["bytes", "notifications", "stalls", "transfers"]),
+    3: ("trace", ["records", "dropped", "drains"]),
+    4: ("work", ["submitted", "coalesced", "executed"]),
+    5: ("journal", ["appends", "skipped", "bytes_written", "compactions", "replayed",
+                    "truncated", "batches", "syncs"]),
+}
+
+HEADER = struct.Struct("<BBBBI")
+STAGE = struct.Struct("<IIIQQ")
+
+
+def bucket_label(index, count):
+    upper = 16 << (2 * index)
+    if index == count - 1:
+        return ">=%s" % duration(upper >> 2)
+    return "<%s" % duration(upper)
+
+
+def duration(us):
+    if us >= 1000000:
+        return "%gs" % (us / 1000000)
+    if us >= 1000:
+        return "%gms" % (us / 1000)
+    return "%gus" % us
+
+
+def load(value):
+    if os.path.isfile(value):
+        with open(value, "rb") as f:
+            return f.read()
+    return bytes.fromhex(re.sub(r"0x|[\s:-]", "", value))
+
+
+def parse(data):
+    """Returns the stage rows and the counter groups as (name, [(counter, value)])"""
+    version, stages, buckets, groups, hz = HEADER.unpack_from(data, 0)
+    if version not in (1, 2):
+        sys.exit("unsupported profile dump version %d" % version)
+
+    rows = []
+    offset = HEADER.size
+    for index in range(stages):
+        count, low, high, total, wall_us = STAGE.unpack_from(data, offset)
+        histogram = struct.unpack_from("<%dH" % buckets, data, offset + STAGE.size)
+        offset += STAGE.size + 2 * buckets
+        name = STAGES[index] if index < len(STAGES) else "stage_%d" % index
+        rows.append((name, count, low, high, total, wall_us, histogram, hz))
+
+    counters = []
+    for _ in range(groups if version >= 2 else 0):
+        group, count = struct.unpack_from("<BB", data, offset)
+        values = struct.unpack_from("<%dI" % count, data, offset + 2)
+        offset += 2 + 4 * count
+        name, names = GROUPS.get(group, ("group_%d" % group, []))
+        names = names + ["counter_%d" % i for i in range(len(names), count)]
+        counters.append((name, list(zip(names, values))))
+    return rows, counters
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("value", help="hex dump or file with the characteristic value")
+    args = parser.parse_args()
+
+    rows, counters = parse(load(args.value))
+    # Cycle columns are CPU time, wall is the mean elapsed time including sleeps
+    print("%-14s %8s %10s %10s %10s %10s %12s" % ("stage", "count", "min us", "mean us", "max us", "wall us", "total cpu ms"))
+    for name, count, low, high, total, wall_us, histogram, hz in rows:
+        if count == 0:
+            print("%-14s %8d" % (name, 0))
+            continue
+        us = lambda cycles: cycles * 1e6 / hz
+        print("%-14s %8d %10.1f %10.1f %10.1f %10.1f %12.3f" % (
+            name, count, us(low), us(total / count), us(high), wall_us / count, us(total) / 1000))
+
+    print()
+    for name, count, _, _, _, _, histogram, _ in rows:
+        if count == 0:
+            continue
+        buckets = ["%s:%d" % (bucket_label(i, len(histogram)), n) for i, n in enumerate(histogram) if n]
+        print("%-14s %s" % (name, " ".join(buckets)))
+
+    for name, values in counters:
+        print()
+        print(name)
+        for counter, value in values:
+            print("  %-20s %10d" % (counter, value))
+
+
+if __name__ == "__main__":
+    main()
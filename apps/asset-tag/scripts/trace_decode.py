@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+"""Decode the binary trace stream written by app::trace_t.
+
+Format strings never leave the firmware image, so each record carries the address of
+its format string. This looks the address up in the loaded segments of the ELF that was
+flashed, formats the raw arguments and prints one line per record.
+
+    python3 trace_decode.py build_app/zephyr/zephyr.elf trace.bin
+"""
+
+import argparse
+import re
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+MAGIC = 0xA5
+HEADER = struct.Struct("<BBHII")
+CONVERSION = re.compile(r"%(?:%|[-+ #0]*\d*(?:\.\d+)?(?:hh|h|ll|l|z|j|t)?([diouxXcspfeEgG]))")
+
+
+class Image:
+    def __init__(self, path):
+        self.segments = []
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            for segment in elf.iter_segments():
+                if segment["p_type"] == "PT_LOAD" and segment["p_filesz"]:
+                    self.segments.append((segment["p_vaddr"], segment.data()))
+                    if segment["p_paddr"] != segment["p_vaddr"]:
+                        self.segments.append((segment["p_paddr"], segment.data()))
+
+    def string(self, address):
+        for base, data in self.segments:
+            if base <= address < base + len(data):
+                end = data.find(b"\0", address - base)
+                return data[address - base:end if end >= 0 else len(data)].decode("utf-8", "replace")
+        return None
+
+
+def signed(value):
+    return value - (1 << 32) if value & 0x80000000 else value
+
+
+def render(image, fmt, args):
+    args = list(args)
+    out = []
+    last = 0
+    for match in CONVERSION.finditer(fmt):
+        out.append(fmt[last:match.start()])
+        last = match.end()
+        spec, kind = match.group(0), match.group(1)
+        if spec == "%%":
+            out.append("%")
+            continue
+        value = args.pop(0) if args else 0
+        spec = re.sub(r"(hh|h|ll|l|z|j|t)(?=[a-zA-Z]$)", "", spec)
+        if kind in "di":
+            out.append(spec % signed(value))
+        elif kind in "ouxX":
+            out.append(spec % value)
+        elif kind == "c":
+            out.append(chr(value & 0xFF))
+        elif kind == "s":
+            text = image.string(value)
+            out.append(spec % (text if text is not None else "<0x%08x>" % value))
+        elif kind == "p":
+            out.append("0x%08x" % value)
+        else:
+            out.append(spec % struct.unpack("<f", struct.pack("<I", value))[0])
+    out.append(fmt[last:])
+    return "".join(out)
+
+
+def records(stream):
+    data = stream.read()
+    offset = 0
+    while offset + HEADER.size <= len(data):
+        magic, nargs, dropped, fmt, cycles = HEADER.unpack_from(data, offset)
+        if magic != MAGIC:
+            # Resynchronize after a torn write or a skipped RTT block
+            offset += 1
+            continue
+        end = offset + HEADER.size + 4 * nargs
+        if end > len(data):
+            break
+        args = struct.unpack_from("<%dI" % nargs, data, offset + HEADER.size)
+        yield dropped, fmt, cycles, args
+        offset = end
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("elf", help="firmware image the trace was recorded from")
+    parser.add_argument("trace", nargs="?", help="binary trace, stdin when omitted")
+    parser.add_argument("--hz", type=int, default=32768, help="k_cycle_get_32 frequency")
+    args = parser.parse_args()
+
+    image = Image(args.elf)
+    stream = open(args.trace, "rb") if args.trace else sys.stdin.buffer
+    for dropped, fmt, cycles, values in records(stream):
+        if dropped:
+            print("... %d records dropped" % dropped)
+        text = image.string(fmt)
+        line = render(image, text, values) if text is not None else "<unknown format 0x%08x> %s" % (fmt, values)
+        print("[%12.6f] %s" % (cycles / args.hz, line))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,13 @@
+#include <app/crash.hpp>
+
+namespace app {
+
+fault_record_t fault_pending __noinit;
+uint32_t fault_boot_count = 0;
+
+}
+
+// Called from k_sys_fatal_error_handler() in fatal.c
+extern "C" void app_fault_capture(unsigned int reason, uint32_t pc, uint32_t lr, const char* message) {
+    app::fault_capture(reason, pc, lr, message);
+}
@@ -1,8 +1,24 @@
 #include <zephyr.h>
 #include <fatal.h>
 
+// Defined in crash.cpp, keeps the record in noinit RAM for the next boot
+void app_fault_capture(unsigned int reason, uint32_t pc, uint32_t lr, const char* message);
+
 void k_sys_fatal_error_handler(unsigned int reason, const z_arch_esf_t *esf) {
-    ARG_UNUSED(esf);
+    uint32_t pc = 0;
+    uint32_t lr = 0;
+#if defined(CONFIG_ARM)
+    if(esf) {
+        pc = esf->basic.pc;
+        lr = esf->basic.lr;
+    }
+#endif
+
+    const char* thread = NULL;
+#if defined(CONFIG_THREAD_NAME)
+    thread = k_thread_name_get(k_current_get());
+#endif
+    app_fault_capture(reason, pc, lr, thread);
 
     // LOG_PANIC();
     // LOG_ERR("Resetting system");
@@ -2,95 +2,327 @@
 #include <app_exception.hpp>
 #include <app_gpio.hpp>
 #include <app_ble.hpp>
+#include <app_dfu.hpp>
+#include <app_fault.hpp>
 #include <app_saadc.hpp>
 #include <app_system_off.hpp>
 #include <app_lfs.hpp>
+#include <app_scheduler.hpp>
 
+#include <app/broadcast.hpp>
+#include <app/history.hpp>
+#include <app/profile.hpp>
+#include <app/ready.hpp>
 #include <app/version.hpp>
 #include <app/work.hpp>
 
 #include <algorithm>
 #include <array>
+#include <cstring>
 #include <memory>
 #include <optional>
 #include <numeric>
 #include <tuple>
 
+#include <sys/crc.h>
+
 static K_THREAD_STACK_DEFINE(wake_work_stack, 2048);
 
+// Status LEDs of the nRF52 DK, driven as one port write
+PREPARE_GPIO(led0)
+PREPARE_GPIO(led1)
+using leds_t = app_gpio::group_t<led0_binding_t, led1_binding_t>;
 
-enum class app_state_e {
-	ERROR = 0,
-	OK = 1,
-	DONE = 2
-};
 
 template<typename ... T>
 static void notify_error(const char* msg, const T ... msg_args) {
-	std::string message(128, '\0');
-	size_t message_length = snprintf(message.data(), message.size(), msg, msg_args...);
-	message.resize(message_length + 1);
-	ass_error_write(std::string_view{message});
+	char message[ass_buffer_t::size()];
+	const int message_length = snprintf(message, sizeof(message), msg, msg_args...);
+	ass_error_write(std::string_view{message, std::min(static_cast<size_t>(std::max(message_length, 0)), sizeof(message) - 1)});
+}
+
+// Hardware that fails to come up is recorded as a fault and retried from a reset, which
+// also counts towards the boot loop streak
+static void require(const app::result_t& result, const char* what) {
+	if(!result) {
+		char message[64];
+		snprintf(message, sizeof(message), "init %s: %d", what, result.error());
+		LOG_ERR("Failed to %s", log_strdup(message));
+		app::fault_capture(app::FAULT_REASON_INIT, 0, 0, message);
+		NVIC_SystemReset();
+	}
 }
 
+// Serves the spilled history blocks oldest first, followed by the block still in RAM
+//
+// Block n of all ever spilled starts at offset n * BLOCK_SIZE and the RAM block is block
+// history_head, so an offset keeps naming the same bytes while the ring drops its oldest
+// blocks. The wake thread holds lock from insert() until its batch commits, so a transfer never
+// sees a block spilled to flash but not committed, or the RAM block mid insert.
+template<typename THISTORY>
+struct history_source_t : app::bulk_source_t {
+	static constexpr uint32_t BLOCK_SIZE = app_lfs::HISTORY_BLOCK_SIZE;
+
+	// Aggregates and percentiles of the whole history, see app::history_t::summary()
+	struct summary_t : app::bulk_source_t {
+		history_source_t& source;
+
+		explicit summary_t(history_source_t& source) : source(source) {}
+
+		uint32_t size() override {
+			return THISTORY::SUMMARY_SIZE;
+		}
+
+		ssize_t read(uint32_t offset, uint8_t* dst, size_t len) override {
+			if(offset >= THISTORY::SUMMARY_SIZE) {
+				return 0;
+			}
+			uint8_t summary[THISTORY::SUMMARY_SIZE];
+			k_mutex_lock(&source.lock, K_FOREVER);
+			source.history.summary(summary, [&](auto&& visit) { source.for_each_spilled(visit); });
+			k_mutex_unlock(&source.lock);
+
+			len = std::min<size_t>(len, THISTORY::SUMMARY_SIZE - offset);
+			memcpy(dst, summary + offset, len);
+			return len;
+		}
+	};
+
+	app_lfs::manager_t& lfs_manager;
+	THISTORY& history;
+	k_mutex lock;
+	summary_t summary;
+
+	history_source_t(app_lfs::manager_t& lfs_manager, THISTORY& history)
+		: lfs_manager(lfs_manager), history(history), summary(*this) {
+		k_mutex_init(&lock);
+	}
+
+	uint32_t stored() const {
+		return std::min(lfs_manager.history_head, app_lfs::HISTORY_BLOCKS);
+	}
+
+	// Calls visit(block, len) for the spilled blocks oldest first, skipping unreadable ones
+	template<typename TVISIT>
+	void for_each_spilled(TVISIT&& visit) {
+		uint8_t block[BLOCK_SIZE];
+		for(uint32_t age = stored(); age-- > 0;) {
+			if(lfs_manager.read_history(age, block, sizeof(block))) {
+				visit(static_cast<const uint8_t*>(block), sizeof(block));
+			}
+		}
+	}
+
+	uint32_t size() override {
+		k_mutex_lock(&lock, K_FOREVER);
+		const uint32_t bytes = (lfs_manager.history_head + 1) * BLOCK_SIZE;
+		k_mutex_unlock(&lock);
+		return bytes;
+	}
+
+	uint32_t first() override {
+		k_mutex_lock(&lock, K_FOREVER);
+		const uint32_t bytes = (lfs_manager.history_head - stored()) * BLOCK_SIZE;
+		k_mutex_unlock(&lock);
+		return bytes;
+	}
+
+	ssize_t read(uint32_t offset, uint8_t* dst, size_t len) override {
+		k_mutex_lock(&lock, K_FOREVER);
+		const ssize_t count = read_locked(offset, dst, len);
+		k_mutex_unlock(&lock);
+		return count;
+	}
+
+private:
+	ssize_t read_locked(uint32_t offset, uint8_t* dst, size_t len) {
+		const uint32_t head = lfs_manager.history_head;
+		if(offset / BLOCK_SIZE < head - stored()) {
+			// Spilled over since the transfer started
+			return -ERANGE;
+		}
+		const uint32_t end = (head + 1) * BLOCK_SIZE;
+		size_t count = 0;
+		while(count < len && offset < end) {
+			const uint32_t sequence = offset / BLOCK_SIZE;
+			const uint32_t within = offset % BLOCK_SIZE;
+			const size_t chunk = std::min<size_t>(len - count, BLOCK_SIZE - within);
+
+			uint8_t block[BLOCK_SIZE] = {};
+			if(sequence < head) {
+				if(!lfs_manager.read_history(head - 1 - sequence, block, sizeof(block))) {
+					return -EIO;
+				}
+			} else {
+				memcpy(block, history.block(), history.block_size());
+			}
+
+			memcpy(dst + count, block + within, chunk);
+			count += chunk;
+			offset += chunk;
+		}
+		return count;
+	}
+};
+
 void main() {
 	LOG_INF("Version %s: Beginning main() ...", VERSION);
 
-	// // Enable wake from deep sleep over gpio
+	// // Enable wake from deep sleep over gpio, the board has no button node yet so
+	// // power_off() is only left by a reset
 	// nrf_gpio_cfg_input(DT_GPIO_PIN(DT_NODELABEL(custombutton), gpios), NRF_GPIO_PIN_PULLUP);
 	// nrf_gpio_cfg_sense_set(DT_GPIO_PIN(DT_NODELABEL(custombutton), gpios), NRF_GPIO_PIN_SENSE_LOW);
 
-	// Prepare the rest of the hardware managers
+	// Boot stages overlap: the controller comes up in the background while storage mounts here,
+	// then the SAADC calibrates on the wake queue while state is restored. Each stage is
+	// waited on before first use.
+	k_work_q wake_work_q;
+	k_work_q_start(&wake_work_q, wake_work_stack, K_THREAD_STACK_SIZEOF(wake_work_stack), 1);
+
+	// Module counters go out with the stage timings
+	app::profile.counters(app::counter_group_e::LINK, &app::link_manager);
+	app::profile.counters(app::counter_group_e::PERSIST, &ass_persist);
+	app::profile.counters(app::counter_group_e::BULK, &ass_bulk);
+	app::profile.counters(app::counter_group_e::WORK, &app::work_stats);
+#if defined(CONFIG_USE_SEGGER_RTT)
+	app::profile.counters(app::counter_group_e::TRACE, &app::trace);
+#endif
+
+	auto ble_scope = app::profile.scope(app::stage_e::BLE_INIT);
 	app_ble::manager_t ble_manager;
+	require(ble_manager.init(), "ble");
+
+	// Storage first to record faults of the last boot
+	auto lfs_scope = app::profile.scope(app::stage_e::LFS_INIT);
 	app_lfs::manager_t lfs_manager;
+	require(lfs_manager.init(), "lfs");
+	lfs_scope.stop();
+	app::profile.counters(app::counter_group_e::JOURNAL, &lfs_manager);
+	app_fault::manager_t fault_manager(lfs_manager);
+	app_dfu::manager_t dfu_manager;
+
+	// Only a status indicator, a tag without them still measures
+	leds_t leds;
+	if(!leds.init()) {
+		LOG_WRN("Status LEDs unavailable");
+	}
+
+	// Not in safe mode, where the hardware that keeps resetting stays untouched
 	app_saadc::manager_t saadc_manager;
+	app::ready_t saadc_ready;
+	app::work_t saadc_init([&]() {
+		auto saadc_scope = app::profile.scope(app::stage_e::SAADC_INIT);
+		saadc_ready.signal(saadc_manager.init());
+	}, &wake_work_q);
+	if(!fault_manager.boot_loop()) {
+		saadc_init.submit();
+	}
+
+	lfs_manager.read_all([](app_lfs::key_e key, const uint8_t* data, size_t len) {
+		const size_t restored = strnlen(reinterpret_cast<const char*>(data), std::min(len, ass_buffer_t::size()));
+		if(key == app_lfs::key_e::VALUE) {
+			ass_value.assign(data, restored);
+		} else if(key == app_lfs::key_e::DATA) {
+			ass_data.assign(data, restored);
+		}
+	});
 
-	k_sleep(K_SECONDS(2));
+	require(ble_manager.ready(), "ble");
+	ble_scope.stop();
 
-	lfs_manager.read("%s/value", (char*) ass_value, sizeof(ass_value));
-	lfs_manager.read("%s/data", (char*) ass_data, sizeof(ass_data));
+	// Back off from a boot loop: stay reachable for DFU without measuring, then idle with the
+	// radio off and reset. The streak restarts so the reset retries a normal boot.
+	if(fault_manager.boot_loop()) {
+		notify_error("Safe mode after %u boots without a completed wake", (unsigned) fault_manager.streak);
+		fault_manager.clear_boot_streak();
+		app::broadcast.set_flags(app::BROADCAST_SAFE_MODE, true);
+		ble_manager.start(app_ble::adv_mode_e::SLOW);
+		{
+			// Alternates the LEDs while reachable, cleared when the pattern goes out of scope
+			app_gpio::pattern_t<leds_t, app::hz_t<2>, 2> blink(leds, { 0b01, 0b10 });
+			k_sleep(K_SECONDS(app_fault::SAFE_MODE_S));
+		}
+		ble_manager.stop();
+		LOG_WRN("Safe mode idle, retrying in %d s", (int) app_fault::SAFE_MODE_BACKOFF_S);
+		k_sleep(K_SECONDS(app_fault::SAFE_MODE_BACKOFF_S));
+		NVIC_SystemReset();
+	}
 
-	// Initialize the rest of the shared app state
-	k_work_q _wake_work_q;
-	std::shared_ptr<k_work_q> wake_work_q = std::shared_ptr<k_work_q>(&_wake_work_q, [](k_work_q*){});
-	k_work_q_start(wake_work_q.get(), wake_work_stack, K_THREAD_STACK_SIZEOF(wake_work_stack), 1);
-	app_state_e state = app_state_e::OK;
+	require(saadc_ready.wait(), "saadc");
 
 	// Proceed with measurements
-	constexpr size_t ADV_WAKE_PERIOD = 20;
-	constexpr size_t ADV_WAKE_DUTY_CYCLE = 80;
 	constexpr app::adc_t adc_conf;
+	app::history_t<app_lfs::HISTORY_BLOCK_SIZE> battery_history(lfs_manager.boot_count);
+	history_source_t history_source(lfs_manager, battery_history);
+	battery_filter_t<> battery_filter;
+	ass_bulk.set_source(&history_source);
+	ass_summary = &history_source.summary;
 	{
-		const auto do_wake = [&]() {
-			if(ass_updated) {
-				char value[sizeof(ass_value) + 1];
-				memcpy(value, ass_value, sizeof(ass_value));
-				value[sizeof(ass_value)] = 0;
-				lfs_manager.write_value(std::string_view(value, strlen(value)));
-
-				char data[sizeof(ass_data) + 1];
-				memcpy(data, ass_data, sizeof(ass_data));
-				data[sizeof(ass_data)] = 0;
-				lfs_manager.write_data(std::string_view(data, strlen(data)));
+		const app_scheduler::config_t schedule_conf;
+		auto do_wake = [&]() -> app::expected_t<uint8_t> {
+			auto wake_scope = app::profile.scope(app::stage_e::WAKE);
+
+			auto persist_scope = app::profile.scope(app::stage_e::PERSIST);
+			// Value and data land in one journal commit, or stay dirty together for the next wake
+			lfs_manager.begin();
+			ass_persist.flush([&](size_t region, size_t offset, const uint8_t* data, size_t len, size_t size) {
+				const auto key = region == ASS_REGION_VALUE ? app_lfs::key_e::VALUE : app_lfs::key_e::DATA;
+				const uint32_t skipped = lfs_manager.stats().skipped;
+				if(!lfs_manager.patch(key, offset, data, len, size)) {
+					return app::flush_e::FAILED;
+				}
+				// The journal drops a range that matches what it already stores
+				return lfs_manager.stats().skipped != skipped ? app::flush_e::SKIPPED : app::flush_e::WRITTEN;
+			}, [&]() { return lfs_manager.commit(); }, false);
+			lfs_manager.abort(); // Only drops the batch when nothing was flushed
+			persist_scope.stop();
+
+			auto measure_scope = app::profile.scope(app::stage_e::MEASURE);
+			const auto measured = saadc_manager.measure(std::array{&adc_conf.vdd_channel_cfg});
+			measure_scope.stop();
+			if(!measured) {
+				notify_error("Failed to measure battery: %d", measured.error());
+				app::broadcast.set_flags(app::BROADCAST_ERROR, true);
+				return app::unexpected(measured.error());
 			}
+			const auto& samples = *measured;
+
+			auto battery_scope = app::profile.scope(app::stage_e::BATTERY_LEVEL);
+			if(battery_filter.update(samples[0])) {
+				bt_bas_set_battery_level(battery_filter.pct());
+			}
+			const uint8_t battery_pct = battery_filter.pct();
+			battery_scope.stop();
+
+			// Picked up by the next advertising window
+			const uint16_t value_hash = ass_value.read([](const uint8_t* data, size_t len) {
+				return crc16_ccitt(0xffff, data, len);
+			});
+			uint8_t flags = 0;
+			flags |= battery_pct < schedule_conf.low_battery_pct ? app::BROADCAST_LOW_BATTERY : 0;
+			flags |= lfs_manager.fault_count() ? app::BROADCAST_FAULTS : 0;
+			app::broadcast.update(battery_pct, flags, value_hash);
 
-			const auto samples = saadc_manager.measure(std::array{&adc_conf.vdd_channel_cfg}, true);
-			bt_bas_set_battery_level(battery_level_pct(samples[0]));
+			auto history_scope = app::profile.scope(app::stage_e::HISTORY);
+			k_mutex_lock(&history_source.lock, K_FOREVER);
+			lfs_manager.begin();
+			battery_history.insert(k_uptime_get() / 1000, samples[0], [&](const uint8_t* block, size_t len) {
+				lfs_manager.write_history(block, len);
+			});
+			history_scope.stop();
 
-			LOG_INF("Start advertising");
-			ble_manager.start();
-			k_sleep(K_SECONDS(ADV_WAKE_PERIOD * ADV_WAKE_DUTY_CYCLE / 100));
-			LOG_INF("Stop advertising");
-			ble_manager.stop();
+			fault_manager.clear_boot_streak();
+			lfs_manager.commit();
+			k_mutex_unlock(&history_source.lock);
+			return battery_pct;
 		};
-		wake_work_t wake_work(wake_work_t::inner_t(std::move(do_wake), true));
-		wake_work_t::work_q = wake_work_q;
 
 		// Run app lifecycle
-		const auto wake_timer = app::timer_t<app::hz_t<1>, app::scale_t<ADV_WAKE_PERIOD>>(std::move(wake_work));
+		app_scheduler::manager_t scheduler(ble_manager, std::move(do_wake), &wake_work_q, schedule_conf);
+		scheduler.start();
 
 		// Allow lifecycle to happen
-		while (state == app_state_e::OK) { k_sleep(K_MSEC(100)); }
+		scheduler.wait();
 
 		LOG_DBG("Leaving lifecycle scope");
 
@@ -98,6 +330,9 @@ void main() {
 	}
 
 	LOG_INF("Destroyed destroyed scope");
+	ass_bulk.set_source(nullptr);
+	ass_summary = nullptr;
+	app::profile.counters(app::counter_group_e::JOURNAL, nullptr);
 
 	// Enter deep sleep
 	power_off();
@@ -0,0 +1,99 @@
+#include "bench.hpp"
+
+#include <stub.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace {
+
+struct case_t {
+    const char* name;
+    void (*fn)();
+};
+
+std::vector<case_t>& cases() {
+    static std::vector<case_t> list;
+    return list;
+}
+
+std::atomic<size_t> allocated_count{0};
+std::atomic<size_t> allocated_bytes{0};
+bool quick = false;
+
+}
+
+void* operator new(size_t size) {
+    allocated_count++;
+    allocated_bytes += size;
+    if(void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+
+namespace bench {
+
+bool add(const char* name, void (*fn)()) {
+    cases().push_back({ name, fn });
+    return true;
+}
+
+allocations_t allocations() {
+    return { allocated_count.load(), allocated_bytes.load() };
+}
+
+size_t iterations(size_t n) {
+    return quick ? (n + 99) / 100 : n;
+}
+
+void row(const char* function, size_t n, double ns_per_call, double allocs_per_call, double bytes_per_call) {
+    std::printf("  %-44s %10zu %12.1f %10.2f %10.1f\n", function, n, ns_per_call, allocs_per_call, bytes_per_call);
+}
+
+void metric(const char* name, double value, const char* unit) {
+    std::printf("  %-44s %12.2f %s\n", name, value, unit);
+}
+
+}
+
+// bench [--quick] [filter], filter picks the cases whose name contains it
+int main(int argc, char** argv) {
+    const char* filter = nullptr;
+    for(int i = 1; i < argc; i++) {
+        if(std::strcmp(argv[i], "--quick") == 0) {
+            quick = true;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    std::printf("  %-44s %10s %12s %10s %10s\n", "function", "calls", "ns/call", "allocs", "bytes");
+    for(const case_t& c : cases()) {
+        if(filter && !std::strstr(c.name, filter)) {
+            continue;
+        }
+        std::printf("%s\n", c.name);
+        stub::reset_kernel();
+        stub::fs_reset();
+        stub::flash_reset();
+        stub::gpio_reset();
+        stub::bt_reset();
+        c.fn();
+    }
+
+    std::fflush(stdout);
+    std::_Exit(0);
+}
@@ -0,0 +1,62 @@
+#ifndef TESTS_BENCH_BENCH_HPP
+#define TESTS_BENCH_BENCH_HPP
+
+// Microbenchmark runner: host time per call and heap allocations per call
+//
+// Cases register themselves with BENCH_CASE and report rows through measure() and
+// metric(). `bench --quick` runs every case with a fraction of the iterations, which
+// is what ctest does to keep them building and running.
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace bench {
+
+struct allocations_t {
+    size_t count;
+    size_t bytes;
+};
+
+bool add(const char* name, void (*fn)());
+
+// Heap allocations made through operator new so far
+allocations_t allocations();
+
+// Iterations to run, n or a fraction of it with --quick
+size_t iterations(size_t n);
+
+void row(const char* function, size_t n, double ns_per_call, double allocs_per_call, double bytes_per_call);
+
+// Reports a value that is not a per-call timing, e.g. KB/s or erases per page
+void metric(const char* name, double value, const char* unit);
+
+template<typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Times n calls of fn(i)
+template<typename TFN>
+void measure(const char* function, size_t n, TFN&& fn) {
+    n = iterations(n);
+    const allocations_t before = allocations();
+    const auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < n; i++) {
+        fn(i);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const allocations_t after = allocations();
+
+    const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    row(function, n, ns / n, double(after.count - before.count) / n, double(after.bytes - before.bytes) / n);
+}
+
+}
+
+#define BENCH_CASE(name) \
+    static void bench_##name(); \
+    static const bool bench_registered_##name = ::bench::add(#name, bench_##name); \
+    static void bench_##name()
+
+#endif
@@ -0,0 +1,20 @@
+#include "bench.hpp"
+
+#include <app_battery.hpp>
+
+BENCH_CASE(battery) {
+    unsigned int sum = 0;
+    bench::measure("battery_interpolate li_ion", 1000000, [&](size_t i) {
+        sum += battery_interpolate(li_ion_levels, 2900 + i % 1400);
+    });
+
+    bench::measure("battery_lut_t::lookup li_ion", 1000000, [&](size_t i) {
+        sum += battery_lut_t<li_ion_levels>::lookup(2900 + i % 1400);
+    });
+
+    battery_filter_t<> filter;
+    bench::measure("battery_filter_t::update", 1000000, [&](size_t i) {
+        sum += filter.update(3200 + i % 7);
+    });
+    bench::keep(sum);
+}
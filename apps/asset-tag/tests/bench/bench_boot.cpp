@@ -0,0 +1,210 @@
+#include "bench.hpp"
+#include "lfs_model.hpp"
+
+#include <app_ble.hpp>
+#include <app_fault.hpp>
+#include <app_lfs.hpp>
+#include <app_saadc.hpp>
+#include <app_scheduler.hpp>
+
+#include <app/profile.hpp>
+#include <app/ready.hpp>
+#include <app/work.hpp>
+
+#include <stub.hpp>
+
+#include <array>
+#include <cstdio>
+
+namespace {
+
+// Assumed time from bt_enable() to the ready callback, HCI setup of the controller included
+constexpr uint32_t CONTROLLER_ENABLE_US = 50'000;
+// The fixed sleep of the serial boot before the first wake
+constexpr int64_t SERIAL_SLEEP_MS = 2000;
+// Resolution of the stage timestamps
+constexpr int64_t STEP_US = 100;
+
+// Stage names as scripts/profile_report.py prints them, up to advertising start
+constexpr size_t NUM_BOOT_STAGES = static_cast<size_t>(app::stage_e::ADV_START) + 1;
+constexpr const char* STAGE_NAMES[NUM_BOOT_STAGES] = {
+    "ble_init", "lfs_init", "saadc_init", "wake", "persist", "measure", "battery_level", "history", "set_name", "adv_start",
+};
+
+K_THREAD_STACK_DEFINE(wake_work_stack, 2048);
+
+// When each profile stage of one boot ended, in us of virtual time from the start of main()
+struct timeline_t {
+    std::array<int64_t, NUM_BOOT_STAGES> done_us;
+
+    timeline_t() {
+        done_us.fill(-1);
+    }
+
+    void done(app::stage_e stage, int64_t us = stub::now_us()) {
+        int64_t& at = done_us[static_cast<size_t>(stage)];
+        at = at < 0 ? us : at;
+    }
+};
+
+// Runs the virtual clock while main() blocks, as the kernel would run the controller and the
+// wake queue meanwhile, until done() or BOOT_STAGE_TIMEOUT_MS
+template<typename TDONE>
+bool block_until(TDONE&& done) {
+    const int64_t deadline = stub::now_us() + app::BOOT_STAGE_TIMEOUT_MS * 1000;
+    while(!done()) {
+        if(stub::now_us() >= deadline) {
+            return false;
+        }
+        stub::run_until(stub::now_us() + STEP_US);
+    }
+    return true;
+}
+
+// A storage commit costs the flash time of LittleFS as lfs_model.hpp models it
+void apply_change(const stub::fs_change_t& change, void* ctx) {
+    static_cast<lfs_model::lfs_model_t*>(ctx)->apply({ change.kind, change.path, change.to ? change.to : "", change.size, change.lo, change.hi });
+}
+
+app_ble::manager_t ble;
+timeline_t timeline;
+
+// The wake of main() as far as the first advertisement waits on it: the measurement and the
+// journal commit that ends the boot streak
+template<typename TSAADC>
+struct wake_t {
+    TSAADC* saadc;
+    app_lfs::manager_t* lfs;
+    app_fault::manager_t* fault;
+
+    app::expected_t<uint8_t> operator()() {
+        auto wake_scope = app::profile.scope(app::stage_e::WAKE);
+
+        constexpr app::adc_t adc_conf;
+        auto measure_scope = app::profile.scope(app::stage_e::MEASURE);
+        const auto measured = saadc->measure(std::array{&adc_conf.vdd_channel_cfg});
+        measure_scope.stop();
+        timeline.done(app::stage_e::MEASURE);
+        if(!measured) {
+            return app::unexpected(measured.error());
+        }
+        bt_bas_set_battery_level(80);
+
+        auto history_scope = app::profile.scope(app::stage_e::HISTORY);
+        lfs->begin();
+        fault->clear_boot_streak();
+        lfs->commit();
+        history_scope.stop();
+        timeline.done(app::stage_e::HISTORY);
+
+        timeline.done(app::stage_e::WAKE);
+        return 80;
+    }
+};
+
+// Boots from a reset up to the first advertisement, staged as main() does now or serially with
+// the fixed sleep as it did before. Storage carries over from the previous boot.
+timeline_t boot(bool staged, lfs_model::lfs_model_t& model) {
+    stub::reset_kernel();
+    stub::bt_reset();
+    stub::saadc_reset();
+    app_saadc::channels = app_saadc::channels_t{};
+    ble.stop();
+
+    stub::bt_timing_t timing;
+    timing.enable_us = CONTROLLER_ENABLE_US;
+    stub::bt_set_timing(timing);
+
+    stub::fs_observe(apply_change, &model);
+
+    timeline = timeline_t{};
+    k_work_q wake_work_q;
+    k_work_q_start(&wake_work_q, wake_work_stack, K_THREAD_STACK_SIZEOF(wake_work_stack), 1);
+    const auto enabled = []() { return app_ble::static_manager_t::enabled.wait(K_NO_WAIT).has_value(); };
+
+    auto ble_scope = app::profile.scope(app::stage_e::BLE_INIT);
+    if(staged) {
+        ble.init();
+    }
+
+    auto lfs_scope = app::profile.scope(app::stage_e::LFS_INIT);
+    app_lfs::manager_t lfs;
+    lfs.init();
+    lfs_scope.stop();
+    timeline.done(app::stage_e::LFS_INIT);
+    app_fault::manager_t fault(lfs);
+
+    app_saadc::manager_t saadc;
+    app::ready_t saadc_ready;
+    app::work_t saadc_init([&]() {
+        auto saadc_scope = app::profile.scope(app::stage_e::SAADC_INIT);
+        saadc_ready.signal(saadc.init());
+        saadc_scope.stop();
+        timeline.done(app::stage_e::SAADC_INIT);
+    }, &wake_work_q);
+    if(staged) {
+        saadc_init.submit();
+    }
+
+    size_t restored = 0;
+    lfs.read_all([&](app_lfs::key_e, const uint8_t*, size_t) { restored++; });
+    bench::keep(restored);
+
+    // bt_enable() without a callback blocked until the controller was up
+    if(!staged) {
+        ble.init();
+    }
+    block_until(enabled);
+    ble.ready();
+    ble_scope.stop();
+    timeline.done(app::stage_e::BLE_INIT);
+
+    if(!staged) {
+        saadc_init.submit();
+        stub::drain();
+        k_sleep(K_MSEC(SERIAL_SLEEP_MS));
+    }
+    block_until([&]() { return saadc_ready.wait(K_NO_WAIT).has_value(); });
+
+    using scheduler_t = app_scheduler::manager_t<wake_t<app_saadc::manager_t<>>>;
+    scheduler_t scheduler(ble, { &saadc, &lfs, &fault }, &wake_work_q);
+    scheduler.start();
+    block_until([]() { return stub::bt_advertising(); });
+    // The controller integrates advertising time up to now, the set went up that long ago
+    const int64_t adv_start = stub::now_us() - static_cast<int64_t>(stub::bt_stats().adv_us);
+    timeline.done(app::stage_e::ADV_START, adv_start);
+
+    scheduler.stop();
+    stub::fs_observe(nullptr, nullptr);
+    stub::reset_kernel();
+    return timeline;
+}
+
+// The second boot on a freshly erased storage area, the first one created the journal
+timeline_t warm_boot(bool staged) {
+    stub::fs_reset();
+    stub::flash_reset();
+    lfs_model::lfs_model_t model(app::storage_profile);
+    boot(staged, model);
+    return boot(staged, model);
+}
+
+void report(const char* name, const timeline_t& timeline) {
+    char label[64];
+    for(size_t stage = 0; stage < NUM_BOOT_STAGES; stage++) {
+        if(timeline.done_us[stage] < 0) {
+            continue;
+        }
+        std::snprintf(label, sizeof(label), "%s %s done at", name, STAGE_NAMES[stage]);
+        bench::metric(label, double(timeline.done_us[stage]) / 1000, "ms");
+    }
+}
+
+}
+
+// Time to first advertisement on the virtual clock. Only the controller bring-up and the flash
+// time of the storage commits take time on the stubs, see CONTROLLER_ENABLE_US and lfs_model.hpp.
+BENCH_CASE(boot) {
+    report("serial", warm_boot(false));
+    report("staged", warm_boot(true));
+}
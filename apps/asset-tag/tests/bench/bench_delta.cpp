@@ -0,0 +1,63 @@
+#include "bench.hpp"
+
+#include <stub.hpp>
+
+#include <app/delta.hpp>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+void put_u32(std::vector<uint8_t>& out, uint32_t value) {
+    uint8_t raw[4];
+    sys_put_le32(value, raw);
+    out.insert(out.end(), raw, raw + 4);
+}
+
+}
+
+// A 128 KiB image with one changed byte per 4 KiB, applied from a 1 KiB stream per chunk
+BENCH_CASE(delta) {
+    constexpr size_t SIZE = 128 * 1024;
+    std::vector<uint8_t> source(SIZE);
+    std::mt19937 rng(1);
+    for(auto& b : source) {
+        b = static_cast<uint8_t>(rng());
+    }
+    std::copy(source.begin(), source.end(), stub::flash_contents(FLASH_AREA_ID(image_0)).begin());
+
+    std::vector<uint8_t> target = source;
+    std::vector<uint8_t> ops;
+    for(uint32_t page = 0; page < SIZE; page += 4096) {
+        target[page] ^= 0xff;
+        ops.push_back(app::delta_patcher_t::OP_INSERT);
+        put_u32(ops, 1);
+        ops.push_back(target[page]);
+        ops.push_back(app::delta_patcher_t::OP_COPY);
+        put_u32(ops, page + 1);
+        put_u32(ops, 4095);
+    }
+
+    std::vector<uint8_t> stream;
+    put_u32(stream, app::delta_patcher_t::MAGIC);
+    put_u32(stream, SIZE);
+    put_u32(stream, crc32_ieee(source.data(), SIZE));
+    put_u32(stream, SIZE);
+    put_u32(stream, crc32_ieee(target.data(), SIZE));
+    stream.insert(stream.end(), ops.begin(), ops.end());
+
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    const int64_t start_us = stub::now_us();
+    bench::measure("delta_patcher_t::write 128 KiB image", 20, [&](size_t) {
+        patcher.begin();
+        for(size_t offset = 0; offset < stream.size(); offset += 1024) {
+            patcher.write(stream.data() + offset, std::min<size_t>(1024, stream.size() - offset));
+        }
+    });
+    const auto& flash = stub::flash_stats(FLASH_AREA_ID(image_1));
+    bench::metric("simulated flash time per image", double(stub::now_us() - start_us) / 1000 / bench::iterations(20), "ms");
+    bench::metric("pages erased per image", double(flash.erases) / bench::iterations(20), "");
+    bench::keep(patcher.done());
+}
@@ -0,0 +1,45 @@
+#include "bench.hpp"
+
+#include <app_gpio.hpp>
+
+#include <stub.hpp>
+
+PREPARE_GPIO(led0)
+PREPARE_GPIO(led1)
+PREPARE_GPIO(led2)
+PREPARE_GPIO(led3)
+
+// The four nRF52 DK LEDs through the per-pin manager_t loop and through group_t. Driver
+// calls per toggle are the register writes on target, host ns only rank the two.
+BENCH_CASE(gpio) {
+    using pin_conf_t = std::tuple<app_gpio::pin_t&, int32_t>;
+    app_gpio::manager_t manager(
+        pin_conf_t{ led0_gpio, GPIO_OUTPUT_INACTIVE },
+        pin_conf_t{ led1_gpio, GPIO_OUTPUT_INACTIVE },
+        pin_conf_t{ led2_gpio, GPIO_OUTPUT_INACTIVE },
+        pin_conf_t{ led3_gpio, GPIO_OUTPUT_INACTIVE });
+    app_gpio::group_t<led0_binding_t, led1_binding_t, led2_binding_t, led3_binding_t> group;
+    if(!manager.init() || !group.init()) {
+        return;
+    }
+    stub::gpio_port_t& port = stub::gpio_port(0);
+
+    const size_t n = bench::iterations(1000000);
+    uint32_t writes = port.writes;
+    bench::measure("manager_t::all set/clear", 1000000, [&](size_t i) {
+        manager.all(i & 1);
+    });
+    bench::metric("manager_t::all driver calls", double(port.writes - writes) / n, "per toggle");
+
+    writes = port.writes;
+    bench::measure("group_t::all set/clear", 1000000, [&](size_t i) {
+        group.all(i & 1);
+    });
+    bench::metric("group_t::all driver calls", double(port.writes - writes) / n, "per toggle");
+
+    writes = port.writes;
+    bench::measure("group_t::write", 1000000, [&](size_t i) {
+        group.write(i & 0xf);
+    });
+    bench::metric("group_t::write driver calls", double(port.writes - writes) / n, "per toggle");
+}
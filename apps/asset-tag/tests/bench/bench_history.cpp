@@ -0,0 +1,55 @@
+#include "bench.hpp"
+
+#include <app/history.hpp>
+
+#include <vector>
+
+namespace {
+
+using history = app::history_t<128, 24, 3600>;
+
+}
+
+BENCH_CASE(history) {
+    history h(1);
+    size_t spilled = 0;
+    uint32_t t = 0;
+    bench::measure("history_t::insert steady 20 s wake", 100000, [&](size_t i) {
+        t += 20;
+        h.insert(t, 3000 - static_cast<int32_t>(i / 5000) + static_cast<int32_t>(i % 3), [&](const uint8_t*, size_t len) {
+            spilled += len;
+        });
+    });
+    bench::metric("bytes per sample", double(h.stats().bytes) / std::max<uint32_t>(h.stats().samples - 1, 1), "B");
+
+    uint32_t times[history::MAX_BLOCK_SAMPLES];
+    int32_t values[history::MAX_BLOCK_SAMPLES];
+    bench::measure("history_t::decode RAM block", 100000, [&](size_t) {
+        bench::keep(history::decode(h.block(), h.block_size(), times, values, history::MAX_BLOCK_SAMPLES));
+    });
+
+    bench::measure("history_t::aggregate 24 windows", 100000, [&](size_t) {
+        bench::keep(h.aggregate(24));
+    });
+
+    bench::measure("history_t::percentile 50 RAM block", 100000, [&](size_t) {
+        bench::keep(h.percentile(50, [](auto&&) {}));
+    });
+
+    // A full flash ring of 32 blocks, read back for every pass
+    std::vector<std::vector<uint8_t>> blocks;
+    history ring(1);
+    for(uint32_t i = 0; blocks.size() < 32; i++) {
+        ring.insert(i * 20, 3000 - static_cast<int32_t>(i / 50) + static_cast<int32_t>(i % 7), [&](const uint8_t* block, size_t len) {
+            blocks.emplace_back(block, block + len);
+        });
+    }
+    bench::measure("history_t::percentile 50 over 32 blocks", 1000, [&](size_t) {
+        bench::keep(ring.percentile(50, [&](auto&& visit) {
+            for(const auto& block : blocks) {
+                visit(block.data(), block.size());
+            }
+        }));
+    });
+    bench::keep(spilled);
+}
@@ -0,0 +1,198 @@
+#include "bench.hpp"
+#include "lfs_model.hpp"
+
+#include <stub.hpp>
+
+#include <app/journal.hpp>
+
+#include <fs/fs.h>
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+using journal = app::journal_t<6, 128, 4096>;
+
+}
+
+BENCH_CASE(journal) {
+    journal j;
+    j.open("/lfs/journal");
+    uint8_t value[128] = {};
+
+    bench::measure("journal_t::append 4 changed bytes", 2000, [&](size_t i) {
+        value[i % 32] = static_cast<uint8_t>(i);
+        value[i % 32 + 1] = static_cast<uint8_t>(i >> 8);
+        j.append(1, value, sizeof(value));
+    });
+
+    bench::measure("journal_t::append unchanged", 2000, [&](size_t) {
+        j.append(1, value, sizeof(value));
+    });
+
+    const uint32_t syncs = stub::fs_stats().syncs;
+    bench::measure("journal_t::begin 3 patches commit", 1000, [&](size_t i) {
+        j.begin();
+        for(uint8_t key = 0; key < 3; key++) {
+            value[key] = static_cast<uint8_t>(i + key);
+            j.patch(key, 0, value, 4, 4);
+        }
+        j.commit();
+    });
+    bench::metric("syncs per batch", double(stub::fs_stats().syncs - syncs) / bench::iterations(1000), "");
+
+    bench::measure("journal_t::open replay", 200, [&](size_t) {
+        j.close();
+        j.open("/lfs/journal");
+    });
+    bench::metric("compactions", j.stats().compactions, "");
+}
+
+namespace {
+
+constexpr uint8_t KEY_VALUE = 1;
+constexpr uint8_t KEY_DATA = 2;
+constexpr size_t REGION_SIZE = 128;
+constexpr size_t WAKES = 2000;
+
+// The per-key files app_lfs.hpp kept before the journal: every read and write stats the
+// file, opens it with FS_O_CREATE | FS_O_RDWR, reads the previous contents back and closes it
+namespace per_file {
+
+uint32_t stats = 0;
+
+bool read(const char* path, void* dst, size_t len) {
+    fs_dirent dirent;
+    fs_stat(path, &dirent);
+    stats++;
+
+    fs_file_t file;
+    std::memset(&file, 0, sizeof(file));
+    if(fs_open(&file, path, FS_O_CREATE | FS_O_RDWR) < 0) {
+        return false;
+    }
+    fs_read(&file, dst, len);
+    fs_seek(&file, 0, FS_SEEK_SET);
+    return fs_close(&file) >= 0;
+}
+
+bool write(const char* path, const void* src, size_t len) {
+    char prev[REGION_SIZE + 1];
+    fs_dirent dirent;
+    fs_stat(path, &dirent);
+    stats++;
+
+    fs_file_t file;
+    std::memset(&file, 0, sizeof(file));
+    if(fs_open(&file, path, FS_O_CREATE | FS_O_RDWR) < 0) {
+        return false;
+    }
+    fs_read(&file, prev, sizeof(prev));
+    fs_seek(&file, 0, FS_SEEK_SET);
+    fs_write(&file, src, len);
+    return fs_close(&file) >= 0;
+}
+
+}
+
+// The value and data regions a phone rewrites between wakes, 4 bytes of each change
+struct regions_t {
+    char value[REGION_SIZE] = "{\"t\":21.5,\"rh\":48,\"bat\":3012,\"seq\":1042}";
+    char data[REGION_SIZE] = "site=warehouse-7;rack=14;slot=3;owner=ops";
+
+    size_t change(size_t wake) {
+        const size_t offset = (wake * 4) % 32;
+        std::snprintf(value + offset, 5, "%04u", static_cast<unsigned>(wake % 10000));
+        value[offset + 4] = 'x';
+        data[offset + 4] = static_cast<char>('a' + wake % 26);
+        return offset;
+    }
+};
+
+void apply_change(const stub::fs_change_t& change, void* ctx) {
+    static_cast<lfs_model::lfs_model_t*>(ctx)->apply({ change.kind, change.path, change.to ? change.to : "", change.size, change.lo, change.hi });
+}
+
+// Runs WAKES wakes of persist on LittleFS as lfs_model.hpp models it and reports what each
+// costs in file system calls and flash operations
+template<typename TWAKE>
+void run_wakes(const char* name, TWAKE&& wake) {
+    stub::fs_reset();
+    stub::flash_reset();
+    lfs_model::lfs_model_t lfs(app::storage_profile);
+    stub::fs_observe(apply_change, &lfs);
+
+    regions_t regions;
+    const size_t wakes = bench::iterations(WAKES);
+    // The first wake creates the files
+    wake(regions, 0);
+
+    const stub::flash_stats_t& flash = stub::flash_stats(FLASH_AREA_ID(storage));
+    const stub::fs_stats_t fs = stub::fs_stats();
+    const uint32_t stats = per_file::stats;
+    const uint32_t erases = flash.erases;
+    const uint32_t bytes = flash.bytes_written;
+    const uint64_t busy_us = flash.busy_us;
+    for(size_t i = 1; i <= wakes; i++) {
+        wake(regions, i);
+    }
+    stub::fs_observe(nullptr, nullptr);
+
+    char label[64];
+    std::snprintf(label, sizeof(label), "%s fs_stat and fs_open per wake", name);
+    bench::metric(label, double(per_file::stats - stats + stub::fs_stats().opens - fs.opens) / wakes, "");
+    std::snprintf(label, sizeof(label), "%s metadata commits per wake", name);
+    bench::metric(label, double(stub::fs_stats().syncs - fs.syncs) / wakes, "");
+    std::snprintf(label, sizeof(label), "%s flash bytes written per wake", name);
+    bench::metric(label, double(flash.bytes_written - bytes) / wakes, "B");
+    std::snprintf(label, sizeof(label), "%s flash erases per 1000 wakes", name);
+    bench::metric(label, (flash.erases - erases) * 1000.0 / wakes, "");
+    std::snprintf(label, sizeof(label), "%s flash time per wake", name);
+    bench::metric(label, double(flash.busy_us - busy_us) / 1000 / wakes, "ms");
+}
+
+}
+
+// Persisting value and data on every wake and restoring them at boot, through the per-key
+// files this journal replaced and through one batch and one replay
+BENCH_CASE(journal_wake) {
+    run_wakes("per-key files", [](regions_t& regions, size_t wake) {
+        regions.change(wake);
+        per_file::write("/lfs/value", regions.value, strlen(regions.value));
+        per_file::write("/lfs/data", regions.data, strlen(regions.data));
+    });
+
+    journal j;
+    run_wakes("journal batch", [&](regions_t& regions, size_t wake) {
+        if(wake == 0) {
+            j.close();
+            j.open("/lfs/journal");
+            j.append(KEY_VALUE, regions.value, REGION_SIZE);
+            j.append(KEY_DATA, regions.data, REGION_SIZE);
+            return;
+        }
+        const size_t offset = regions.change(wake);
+        j.begin();
+        j.patch(KEY_VALUE, offset, regions.value + offset, 5, REGION_SIZE);
+        j.patch(KEY_DATA, offset, regions.data + offset, 5, REGION_SIZE);
+        j.commit();
+    });
+
+    // Boot restore after the wakes above, the journal replays its whole log once
+    char value[REGION_SIZE];
+    char data[REGION_SIZE];
+    bench::measure("per-key files read of value and data", 10000, [&](size_t) {
+        per_file::read("/lfs/value", value, sizeof(value));
+        per_file::read("/lfs/data", data, sizeof(data));
+    });
+    const uint32_t replayed = j.stats().replayed;
+    bench::measure("journal_t::open and for_each read-all", 10000, [&](size_t) {
+        j.close();
+        j.open("/lfs/journal");
+        j.for_each([&](uint8_t key, const uint8_t* src, size_t len) {
+            std::memcpy(key == KEY_VALUE ? value : data, src, std::min(len, sizeof(value)));
+        });
+    });
+    bench::metric("journal_t records replayed per read-all", double(j.stats().replayed - replayed) / bench::iterations(10000), "");
+}
@@ -0,0 +1,117 @@
+#include "bench.hpp"
+
+#include <app_scheduler.hpp>
+
+#include <stub.hpp>
+
+#include <cstdio>
+
+namespace {
+
+// Charge per event on the nRF52832 at 0 dBm with the DC/DC on, from the Online Power Profiler
+struct energy_model_t {
+    // System ON with the RTC running and RAM retained
+    double idle_ua = 3.0;
+    // Connectable on three channels, listening for scan requests
+    double adv_event_uc = 11.0;
+    // Empty packets on 1M
+    double conn_event_uc = 4.0;
+    // SAADC, journal commit and the occasional history spill
+    double wake_uc = 50.0;
+};
+
+struct wake_t {
+    uint32_t* count;
+    uint8_t level;
+
+    app::expected_t<uint8_t> operator()() {
+        (*count)++;
+        bt_bas_set_battery_level(level);
+        return level;
+    }
+};
+
+struct scenario_t {
+    const char* name;
+    app_scheduler::config_t config;
+    uint8_t battery_pct;
+    // A central connects this often for hold_s, never when 0
+    uint32_t connect_every_s;
+    uint32_t hold_s;
+};
+
+app_ble::manager_t ble;
+
+// Runs the scheduler and advertising code on the simulated controller for seconds of virtual
+// time and integrates the events it produced. Only the charge per event is modeled.
+void run(const scenario_t& scenario, int64_t seconds, const energy_model_t& model = {}) {
+    stub::reset_kernel();
+    stub::bt_reset();
+    ble.stop();
+    if(!ble.init() || !ble.ready()) {
+        return;
+    }
+
+    uint32_t wakes = 0;
+    app_scheduler::manager_t<wake_t> scheduler(ble, wake_t{ &wakes, scenario.battery_pct }, &k_sys_work_q, scenario.config);
+    scheduler.start();
+
+    const int64_t end_us = seconds * 1'000'000;
+    int64_t next_connect_us = scenario.connect_every_s ? int64_t{scenario.connect_every_s} * 1'000'000 : end_us;
+    while(stub::now_us() < end_us) {
+        if(stub::now_us() < next_connect_us) {
+            stub::run_until(std::min(next_connect_us, end_us));
+            continue;
+        }
+        // The central scans until the tag advertises
+        bt_conn* conn = stub::bt_connect();
+        if(!conn) {
+            stub::run_until(std::min(stub::now_us() + 100'000, end_us));
+            continue;
+        }
+        stub::run_until(std::min(stub::now_us() + int64_t{scenario.hold_s} * 1'000'000, end_us));
+        stub::bt_disconnect(conn);
+        next_connect_us += int64_t{scenario.connect_every_s} * 1'000'000;
+    }
+    scheduler.stop();
+
+    const stub::bt_stats_t& stats = stub::bt_stats();
+    const double charge_uc = model.idle_ua * seconds
+        + model.adv_event_uc * stats.adv_events
+        + model.conn_event_uc * stats.conn_events
+        + model.wake_uc * wakes;
+
+    char label[64];
+    std::snprintf(label, sizeof(label), "%s average", scenario.name);
+    bench::metric(label, charge_uc / seconds, "uA");
+    std::snprintf(label, sizeof(label), "%s wakes", scenario.name);
+    bench::metric(label, wakes * 3600.0 / seconds, "per hour");
+    std::snprintf(label, sizeof(label), "%s advertising", scenario.name);
+    bench::metric(label, stats.adv_us / 1e4 / seconds, "% of the time");
+}
+
+}
+
+// Average current of schedules over a simulated day, so configurations can be compared before
+// flashing. --quick simulates 15 minutes.
+BENCH_CASE(scheduler_energy) {
+    const int64_t seconds = bench::iterations(24 * 3600);
+
+    app_scheduler::config_t relaxed;
+    relaxed.period_ms = 60'000;
+
+    app_scheduler::config_t short_windows;
+    short_windows.fast_duration_ms = 2'000;
+    short_windows.slow_duration_ms = 6'000;
+
+    const scenario_t scenarios[] = {
+        { "default", {}, 80, 0, 0 },
+        { "period 60 s", relaxed, 80, 0, 0 },
+        { "fast 2 s slow 6 s", short_windows, 80, 0, 0 },
+        { "low battery", {}, 10, 0, 0 },
+        { "default, 30 s link every 10 min", {}, 80, 600, 30 },
+    };
+    for(const scenario_t& scenario : scenarios) {
+        run(scenario, seconds);
+    }
+}
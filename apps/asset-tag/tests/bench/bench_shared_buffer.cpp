@@ -0,0 +1,70 @@
+#include "bench.hpp"
+
+#include <stub.hpp>
+
+#include <app/shared_buffer.hpp>
+
+#include <bluetooth/gatt.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+constexpr char VALUE[] = "{\"t\":21.5,\"rh\":48,\"bat\":3012,\"seq\":1042}";
+
+}
+
+// One characteristic read of a 40 character value into a 22 byte ATT payload, as before
+// (strlen of the 128 byte array on every read) and through the cached length
+BENCH_CASE(shared_buffer) {
+    const bt_gatt_attr attr = {};
+    uint8_t att[22];
+
+    char old_value[128] = {};
+    std::memcpy(old_value, VALUE, sizeof(VALUE));
+    bench::measure("char[128] strlen read", 1000000, [&](size_t i) {
+        const uint16_t offset = (i & 1) * sizeof(att);
+        bench::keep(bt_gatt_attr_read(nullptr, &attr, att, sizeof(att), offset, old_value, strlen(old_value)));
+    });
+
+    app::shared_buffer_t<128> buffer;
+    buffer.assign(VALUE, sizeof(VALUE) - 1);
+    bench::measure("shared_buffer_t<128> read", 1000000, [&](size_t i) {
+        const uint16_t offset = (i & 1) * sizeof(att);
+        bench::keep(buffer.read([&](const uint8_t* data, size_t len) {
+            return bt_gatt_attr_read(nullptr, &attr, att, sizeof(att), offset, data, len);
+        }));
+    });
+
+    bench::measure("char[128] memcpy write", 1000000, [&](size_t) {
+        std::memcpy(old_value, VALUE, sizeof(VALUE));
+        bench::keep(old_value);
+    });
+
+    bench::measure("shared_buffer_t<128> assign", 1000000, [&](size_t) {
+        buffer.assign(VALUE, sizeof(VALUE) - 1);
+    });
+
+    bench::measure("shared_buffer_t<128> write 4 bytes", 1000000, [&](size_t i) {
+        buffer.write(i % 32, "1042", 4);
+    });
+
+    // Reads while another thread assigns back to back, each retry shows up as read time
+    std::atomic<bool> done{false};
+    std::thread writer([&]() {
+        while(!done.load()) {
+            buffer.assign(VALUE, sizeof(VALUE) - 1);
+        }
+    });
+    bench::measure("shared_buffer_t<128> read under writes", 1000000, [&](size_t) {
+        bench::keep(buffer.read([&](const uint8_t* data, size_t len) {
+            return bt_gatt_attr_read(nullptr, &attr, att, sizeof(att), 0, data, len);
+        }));
+    });
+    done = true;
+    writer.join();
+
+    bench::metric("shared_buffer_t<128> size", sizeof(buffer), "B");
+}
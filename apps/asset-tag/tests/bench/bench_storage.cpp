@@ -0,0 +1,157 @@
+#include "bench.hpp"
+#include "lfs_model.hpp"
+
+#include <stub.hpp>
+
+#include <app/journal.hpp>
+#include <app/storage.hpp>
+
+#include <fs/fs.h>
+#include <storage/flash_map.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+using lfs_model::NUM_BLOCKS;
+using lfs_model::change_t;
+using lfs_model::lfs_model_t;
+
+// The keys, record and ring sizes of app_lfs.hpp
+using journal = app::journal_t<6, 128>;
+constexpr uint8_t KEY_BOOT_COUNT = 0;
+constexpr uint8_t KEY_VALUE = 1;
+constexpr uint8_t KEY_HISTORY_HEAD = 3;
+constexpr size_t VALUE_SIZE = 64;
+constexpr size_t HISTORY_BLOCK_SIZE = 128;
+constexpr uint32_t HISTORY_BLOCKS = 32;
+
+// A wake spills a history block this often and a reset comes this often
+constexpr size_t WAKES_PER_SPILL = 16;
+constexpr size_t WAKES_PER_BOOT = 500;
+
+// nRF52832 flash endurance
+constexpr double ERASE_CYCLES = 10000;
+
+using wake_t = std::vector<change_t>;
+
+// The slot write of app_lfs::manager_t::write_slot()
+void write_slot(const char* path, uint32_t index, const uint8_t* block) {
+    fs_file_t file;
+    std::memset(&file, 0, sizeof(file));
+    if(fs_open(&file, path, FS_O_CREATE | FS_O_RDWR) < 0) {
+        return;
+    }
+    if(fs_seek(&file, index * HISTORY_BLOCK_SIZE, FS_SEEK_SET) >= 0) {
+        fs_write(&file, block, HISTORY_BLOCK_SIZE);
+    }
+    fs_close(&file);
+}
+
+// Runs the storage writes of the wake loop in main.cpp and records what each wake made durable
+std::vector<wake_t> record(size_t wakes) {
+    std::vector<wake_t> log(wakes);
+    wake_t* current = nullptr;
+    stub::fs_observe([](const stub::fs_change_t& change, void* ctx) {
+        auto* wake = *static_cast<wake_t**>(ctx);
+        if(wake) {
+            wake->push_back({ change.kind, change.path, change.to ? change.to : "", change.size, change.lo, change.hi });
+        }
+    }, &current);
+
+    journal j;
+    uint32_t boot_count = 0;
+    uint32_t history_head = 0;
+    uint8_t value[VALUE_SIZE] = {};
+    uint8_t block[HISTORY_BLOCK_SIZE] = {};
+    for(size_t i = 0; i < wakes; i++) {
+        current = &log[i];
+        if(i % WAKES_PER_BOOT == 0) {
+            j.close();
+            j.open("/lfs/journal");
+            boot_count++;
+            j.append(KEY_BOOT_COUNT, &boot_count, sizeof(boot_count));
+        }
+
+        j.begin();
+        value[i % VALUE_SIZE] = static_cast<uint8_t>(i);
+        const size_t offset = (i % VALUE_SIZE) & ~size_t{3};
+        j.patch(KEY_VALUE, offset, value + offset, 4, VALUE_SIZE);
+        if(i % WAKES_PER_SPILL == WAKES_PER_SPILL - 1) {
+            block[0] = static_cast<uint8_t>(history_head);
+            write_slot("/lfs/history", history_head % HISTORY_BLOCKS, block);
+            history_head++;
+            j.patch(KEY_HISTORY_HEAD, 0, &history_head, sizeof(history_head), sizeof(history_head));
+        }
+        j.commit();
+    }
+    current = nullptr;
+    stub::fs_observe(nullptr, nullptr);
+    return log;
+}
+
+void run(const char* name, const app::storage_profile_t& profile, const std::vector<wake_t>& log) {
+    stub::flash_reset();
+    lfs_model_t lfs(profile);
+    const stub::flash_stats_t& flash = stub::flash_stats(FLASH_AREA_ID(storage));
+    const uint64_t start_us = flash.busy_us;
+    const auto start_erases = flash.page_erases;
+
+    size_t bytes = 0;
+    uint64_t worst_us = 0;
+    for(const wake_t& wake : log) {
+        const uint64_t before_us = flash.busy_us;
+        for(const change_t& change : wake) {
+            lfs.apply(change);
+            bytes += change.hi - change.lo;
+        }
+        worst_us = std::max(worst_us, flash.busy_us - before_us);
+    }
+    const double busy_s = double(flash.busy_us - start_us) / 1e6;
+
+    char label[64];
+    std::snprintf(label, sizeof(label), "%s RAM, caches and lookahead", name);
+    bench::metric(label, profile.ram(), "B");
+    std::snprintf(label, sizeof(label), "%s RAM, two open file caches", name);
+    bench::metric(label, 2 * profile.cache_size, "B");
+    std::snprintf(label, sizeof(label), "%s throughput", name);
+    bench::metric(label, busy_s > 0 ? bytes / 1024.0 / busy_s : 0, "KB/s of flash time");
+    std::snprintf(label, sizeof(label), "%s flash time per wake", name);
+    bench::metric(label, double(flash.busy_us - start_us) / 1000 / log.size(), "ms");
+    std::snprintf(label, sizeof(label), "%s flash time worst wake", name);
+    bench::metric(label, double(worst_us) / 1000, "ms");
+
+    uint32_t most = 0;
+    uint32_t total = 0;
+    for(size_t i = 0; i < NUM_BLOCKS; i++) {
+        const uint32_t erases = flash.page_erases[i] - start_erases[i];
+        std::snprintf(label, sizeof(label), "%s erases block %d", name, (int) i);
+        bench::metric(label, erases * 1000.0 / log.size(), "per 1000 wakes");
+        most = std::max(most, erases);
+        total += erases;
+    }
+    std::snprintf(label, sizeof(label), "%s most worn block over mean", name);
+    bench::metric(label, total ? most * double(NUM_BLOCKS) / total : 0, "");
+    std::snprintf(label, sizeof(label), "%s wakes to wear out", name);
+    bench::metric(label, most ? ERASE_CYCLES * log.size() / most : 0, "");
+    std::snprintf(label, sizeof(label), "%s metadata relocations", name);
+    bench::metric(label, lfs.relocations, "");
+    if(lfs.no_space) {
+        std::snprintf(label, sizeof(label), "%s allocations without a free block", name);
+        bench::metric(label, lfs.no_space, "");
+    }
+}
+
+}
+
+BENCH_CASE(storage) {
+    const std::vector<wake_t> log = record(bench::iterations(20000));
+    run("KCONFIG", app::STORAGE_KCONFIG, log);
+    run("SMALL_FILES", app::STORAGE_SMALL_FILES, log);
+    run("LOW_RAM", app::STORAGE_LOW_RAM, log);
+    bench::metric("file cache pool", app::FILE_CACHE_POOL_SIZE, "B");
+}
@@ -0,0 +1,106 @@
+#include "bench.hpp"
+
+#include <stub.hpp>
+
+#include <app/timer.hpp>
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <tuple>
+
+namespace {
+
+struct counter_work_t {
+    uint32_t* count;
+    void submit() { (*count)++; }
+};
+
+// Exposes the expiry as the kernel calls it from the timer ISR
+struct probe_t : app::inline_timer_t<> {
+    template<typename TLAMBDA>
+    explicit probe_t(TLAMBDA&& work) : inline_timer_t(std::move(work)) {}
+
+    void expire() {
+        m_timer.expiry_fn(&m_timer);
+    }
+};
+
+// The handler table timer.hpp used before: a std::function per timer, found by a linear
+// search of the registered timers on every expiry
+namespace table {
+
+std::array<std::tuple<k_timer*, std::function<void()>>, app::NUM_TIMERS> handlers;
+size_t registered = 0;
+
+void timer_handler(k_timer* timer) {
+    for(const auto& [registered_timer, handler] : handlers) {
+        if(registered_timer == timer) {
+            handler();
+        }
+    }
+}
+
+struct timer_t {
+    k_timer m_timer = {};
+
+    template<typename TLAMBDA>
+    explicit timer_t(TLAMBDA&& work) {
+        const auto shared = std::make_shared<TLAMBDA>(std::move(work));
+        handlers[registered++] = std::make_tuple<k_timer*, std::function<void()>>(&m_timer, [shared]() { shared->submit(); });
+        k_timer_init(&m_timer, timer_handler, nullptr);
+    }
+
+    ~timer_t() {
+        for(auto& entry : handlers) {
+            if(std::get<0>(entry) == &m_timer) {
+                entry = {};
+            }
+        }
+        registered--;
+    }
+};
+
+}
+
+}
+
+BENCH_CASE(timer) {
+    uint32_t count = 0;
+
+    bench::measure("inline_timer_t register and release", 10000, [&](size_t) {
+        probe_t timer(counter_work_t{ &count });
+        bench::keep(timer);
+    });
+
+    bench::measure("std::function table register and release", 10000, [&](size_t) {
+        table::timer_t timer(counter_work_t{ &count });
+        bench::keep(timer);
+    });
+
+    // The fifth timer is the worst case of the table search
+    {
+        std::array<std::unique_ptr<probe_t>, app::NUM_TIMERS> timers;
+        for(auto& timer : timers) {
+            timer = std::make_unique<probe_t>(counter_work_t{ &count });
+        }
+        probe_t& last = *timers.back();
+        bench::measure("inline_timer_t expiry", 1000000, [&](size_t) {
+            last.expire();
+        });
+    }
+    {
+        std::array<std::unique_ptr<table::timer_t>, app::NUM_TIMERS> timers;
+        for(auto& timer : timers) {
+            timer = std::make_unique<table::timer_t>(counter_work_t{ &count });
+        }
+        k_timer* last = &timers.back()->m_timer;
+        bench::measure("std::function table expiry", 1000000, [&](size_t) {
+            last->expiry_fn(last);
+        });
+    }
+    bench::keep(count);
+
+    bench::metric("inline_timer_t size", sizeof(probe_t), "B");
+    bench::metric("std::function table entry and timer size", sizeof(table::handlers[0]) + sizeof(table::timer_t), "B");
+}
@@ -0,0 +1,134 @@
+#include "bench.hpp"
+
+#include <stub.hpp>
+
+#include <app/trace.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+size_t trace_bytes = 0;
+size_t log_bytes = 0;
+size_t log_msgs = 0;
+
+size_t trace_sink(const uint8_t*, size_t len) {
+    trace_bytes += len;
+    return len;
+}
+
+// The deferred LOG_INF path of Zephyr logging v1 that APP_TRACE replaced: a message with the
+// format and raw arguments taken from a pool under a lock, log_strdup() copying RAM strings
+// into one of CONFIG_LOG_STRDUP_BUF_COUNT buffers, and the backend formatting every message
+// into text on the device before it goes out
+namespace log_model {
+
+constexpr size_t NUM_MSGS = 32;
+constexpr size_t STRDUP_MAX_STRING = 32;
+constexpr size_t STRDUP_BUF_COUNT = 32;
+
+struct msg_t {
+    const char* fmt;
+    uint32_t timestamp;
+    uint8_t nargs;
+    uintptr_t args[4];
+};
+
+k_spinlock lock = {};
+msg_t msgs[NUM_MSGS];
+size_t head = 0;
+size_t tail = 0;
+
+char strdup_bufs[STRDUP_BUF_COUNT][STRDUP_MAX_STRING];
+atomic_t strdup_used = ATOMIC_INIT(0);
+
+const char* log_strdup(const char* str) {
+    for(size_t i = 0; i < STRDUP_BUF_COUNT; i++) {
+        if(!atomic_test_and_set_bit(&strdup_used, static_cast<int>(i))) {
+            strncpy(strdup_bufs[i], str, STRDUP_MAX_STRING - 1);
+            strdup_bufs[i][STRDUP_MAX_STRING - 1] = '\0';
+            return strdup_bufs[i];
+        }
+    }
+    return "<log_strdup alloc failed>";
+}
+
+void strdup_free(const char* str) {
+    for(size_t i = 0; i < STRDUP_BUF_COUNT; i++) {
+        if(str == strdup_bufs[i]) {
+            atomic_clear_bit(&strdup_used, static_cast<int>(i));
+        }
+    }
+}
+
+template<typename ... T>
+void log(const char* fmt, T ... args) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    if(head - tail < NUM_MSGS) {
+        msg_t& msg = msgs[head++ % NUM_MSGS];
+        msg.fmt = fmt;
+        msg.timestamp = k_cycle_get_32();
+        msg.nargs = sizeof...(T);
+        size_t i = 0;
+        ((msg.args[i++] = (uintptr_t) args), ...);
+        (void) i;
+    }
+    k_spin_unlock(&lock, key);
+}
+
+// Formats and frees every queued message, as the log thread does
+void process() {
+    char line[128];
+    while(tail != head) {
+        const msg_t& msg = msgs[tail++ % NUM_MSGS];
+        int len = snprintf(line, sizeof(line), "[%08u] <inf> ble_app: ", (unsigned) msg.timestamp);
+        len += snprintf(line + len, sizeof(line) - len, msg.fmt, msg.args[0], msg.args[1], msg.args[2], msg.args[3]);
+        bench::keep(line);
+        log_bytes += static_cast<size_t>(len);
+        log_msgs++;
+        for(size_t i = 0; i < msg.nargs; i++) {
+            strdup_free(reinterpret_cast<const char*>(msg.args[i]));
+        }
+    }
+}
+
+}
+
+}
+
+// Cost per call including the deferred work per record, the drain of the trace queue on the
+// system work queue or the formatting on the log thread, every 16 calls
+BENCH_CASE(trace) {
+    app::trace_t<> trace(trace_sink);
+    constexpr size_t BATCH = 16;
+
+    bench::measure("APP_TRACE 3 args", 1000000, [&](size_t i) {
+        trace.write("Bulk transfer %u..%u of %u", static_cast<uint32_t>(i), 4096u, 8192u);
+        if(i % BATCH == BATCH - 1) {
+            stub::run_until(stub::now_us() + 50'000);
+        }
+    });
+
+    bench::measure("LOG_INF 3 args", 1000000, [&](size_t i) {
+        log_model::log("Bulk transfer %u..%u of %u", static_cast<unsigned>(i), 4096u, 8192u);
+        if(i % BATCH == BATCH - 1) {
+            log_model::process();
+        }
+    });
+
+    char name[] = "/lfs/journal";
+    bench::measure("LOG_INF 2 args with log_strdup", 1000000, [&](size_t i) {
+        log_model::log("Wrote %s (%u bytes)", log_model::log_strdup(name), static_cast<unsigned>(i & 0xff));
+        if(i % BATCH == BATCH - 1) {
+            log_model::process();
+        }
+    });
+
+    stub::run_until(stub::now_us() + 50'000);
+    log_model::process();
+    const auto stats = trace.stats();
+    bench::metric("APP_TRACE bytes per record", stats.records ? double(trace_bytes) / stats.records : 0, "B");
+    bench::metric("APP_TRACE records dropped", stats.dropped, "");
+    bench::metric("LOG_INF bytes per message", log_msgs ? double(log_bytes) / log_msgs : 0, "B");
+}
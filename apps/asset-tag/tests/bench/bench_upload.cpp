@@ -0,0 +1,225 @@
+#include "bench.hpp"
+
+#include <stub.hpp>
+
+#include <app/upload.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace {
+
+// The fast link parameters of app/link.hpp as a phone picks them: 15 ms events, 2M PHY
+// with 251 byte packets. One SMP request of CHUNK data bytes fills one packet.
+struct link_t {
+    int64_t interval_us = 15000;
+    // Packets each way per connection event
+    size_t packets_per_event = 4;
+};
+
+constexpr size_t CHUNK = 220;
+
+// How long the reply to the last chunk waits, FINISH_WAIT_MS of app_dfu.hpp
+constexpr int64_t FINISH_WAIT_US = 200'000;
+
+struct request_t {
+    uint32_t off;
+};
+
+struct response_t {
+    int64_t ready_us;
+    uint32_t off;
+    app::upload_t::reply_t reply;
+};
+
+// Answers a request, stalling the virtual clock for the flash work it does before replying
+struct device_t {
+    virtual ~device_t() = default;
+    virtual app::upload_t::reply_t handle(const std::vector<uint8_t>& image, uint32_t off) = 0;
+    // Background work until until_us
+    virtual void idle(int64_t until_us) = 0;
+};
+
+// Every request writes its chunk before it is answered, erasing each page as the write reaches it
+struct inline_device_t : device_t {
+    app::slot_writer_t slot;
+    uint32_t written = 0;
+
+    app::upload_t::reply_t handle(const std::vector<uint8_t>& image, uint32_t off) override {
+        const size_t len = std::min(CHUNK, image.size() - off);
+        if(off == 0) {
+            slot.open(static_cast<uint32_t>(image.size()));
+            written = 0;
+        }
+        if(off == written) {
+            slot.write(image.data() + off, len);
+            written += len;
+            if(written == image.size()) {
+                slot.flush();
+            }
+        }
+        return { 0, written, written == image.size() };
+    }
+
+    void idle(int64_t) override {}
+};
+
+// app_dfu: chunks are queued for the upload thread, which erases ahead while the queue is empty
+struct pipelined_device_t : device_t {
+    app::upload_t upload;
+
+    app::upload_t::reply_t handle(const std::vector<uint8_t>& image, uint32_t off) override {
+        const size_t len = std::min(CHUNK, image.size() - off);
+        auto reply = upload.offer(app::upload_t::kind_e::IMAGE, off, image.data() + off, len,
+            static_cast<uint32_t>(image.size()));
+        if(upload.settling()) {
+            // The handler waits and the upload thread gets the CPU
+            const int64_t deadline = stub::now_us() + FINISH_WAIT_US;
+            while(upload.settling() && stub::now_us() < deadline && upload.service(K_NO_WAIT)) {
+            }
+            reply = upload.status();
+        }
+        return reply;
+    }
+
+    void idle(int64_t until_us) override {
+        while(stub::now_us() < until_us && upload.service(K_NO_WAIT)) {
+        }
+    }
+};
+
+struct result_t {
+    double kbps;
+    std::vector<double> latency_ms;
+    uint32_t requests;
+};
+
+// A client keeping window requests in flight, going back to the offset a reply asks for
+result_t transfer(device_t& device, const std::vector<uint8_t>& image, size_t window, const link_t& link) {
+    const uint32_t total = static_cast<uint32_t>(image.size());
+    const size_t chunks = (total + CHUNK - 1) / CHUNK;
+    std::vector<int64_t> first_sent(chunks, -1);
+    std::vector<double> latency_ms;
+    latency_ms.reserve(chunks);
+
+    std::deque<request_t> to_device;
+    std::deque<response_t> to_client;
+    uint32_t next = 0;
+    uint32_t acked = 0;
+    size_t in_flight = 0;
+    uint32_t requests = 0;
+    bool done = false;
+
+    const int64_t start_us = stub::now_us();
+    int64_t event_us = start_us;
+    while(!done) {
+        // Replies produced before this connection event reach the client
+        for(size_t n = 0; n < link.packets_per_event && !to_client.empty() && to_client.front().ready_us <= event_us; n++) {
+            const response_t response = to_client.front();
+            to_client.pop_front();
+            in_flight--;
+            if(response.reply.rc) {
+                return { 0, {}, requests };
+            }
+            for(; acked < response.reply.off; acked = std::min<uint32_t>(acked + CHUNK, total)) {
+                latency_ms.push_back(double(event_us - first_sent[acked / CHUNK]) / 1000);
+            }
+            if(response.reply.done) {
+                done = true;
+            } else if(response.reply.off == response.off) {
+                // Busy, or the last chunk held back: send it again
+                next = response.off;
+            }
+        }
+        if(done) {
+            break;
+        }
+
+        while(in_flight < window && next < total) {
+            if(first_sent[next / CHUNK] < 0) {
+                first_sent[next / CHUNK] = event_us;
+            }
+            to_device.push_back({ next });
+            next = std::min<uint32_t>(next + CHUNK, total);
+            in_flight++;
+            requests++;
+        }
+
+        // The device handles what this event carried, then works in the background until the next
+        std::vector<request_t> arrived;
+        for(size_t n = 0; n < link.packets_per_event && !to_device.empty(); n++) {
+            arrived.push_back(to_device.front());
+            to_device.pop_front();
+        }
+        for(const request_t& request : arrived) {
+            const auto reply = device.handle(image, request.off);
+            to_client.push_back({ stub::now_us(), request.off, reply });
+        }
+        const int64_t next_event_us = event_us + link.interval_us;
+        device.idle(next_event_us);
+        if(stub::now_us() < next_event_us) {
+            stub::stall(next_event_us - stub::now_us());
+        }
+        // Events that fell while the CPU was stalled on flash are missed
+        event_us = start_us + ROUND_UP(stub::now_us() - start_us, link.interval_us);
+    }
+
+    const double seconds = double(stub::now_us() - start_us) / 1e6;
+    return { total / 1024.0 / seconds, latency_ms, requests };
+}
+
+double percentile(std::vector<double> values, double p) {
+    if(values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(p * (values.size() - 1))];
+}
+
+void report(const char* name, const result_t& result) {
+    char label[64];
+    std::snprintf(label, sizeof(label), "%s throughput", name);
+    bench::metric(label, result.kbps, "KB/s");
+    for(const auto& [p, what] : { std::pair{ 0.5, "p50" }, std::pair{ 0.9, "p90" }, std::pair{ 0.99, "p99" }, std::pair{ 1.0, "max" } }) {
+        std::snprintf(label, sizeof(label), "%s chunk latency %s", name, what);
+        bench::metric(label, percentile(result.latency_ms, p), "ms");
+    }
+    std::snprintf(label, sizeof(label), "%s requests per chunk", name);
+    bench::metric(label, double(result.requests) / std::max<size_t>(result.latency_ms.size(), 1), "");
+}
+
+}
+
+// A full image over a simulated BLE link, once with every chunk written before its reply and
+// once through the upload thread of app_dfu. Flash stalls the CPU, so connection events that
+// fall in an erase or write are missed. Latency is from the first send of a chunk to the reply
+// that acknowledged it. --quick sends 8 KiB instead of 128 KiB.
+BENCH_CASE(upload) {
+    const size_t size = std::max<size_t>(bench::iterations(128), 8) * 1024;
+    std::vector<uint8_t> image(size);
+    std::mt19937 rng(3);
+    for(auto& b : image) {
+        b = static_cast<uint8_t>(rng());
+    }
+    sys_put_le32(app::upload_t::IMAGE_MAGIC, image.data());
+
+    const link_t link;
+    for(size_t window : { size_t{1}, app::upload_t::QUEUE_DEPTH }) {
+        char name[48];
+        stub::reset_kernel();
+        stub::flash_reset();
+        auto inline_device = std::make_unique<inline_device_t>();
+        std::snprintf(name, sizeof(name), "inline, %zu in flight", window);
+        report(name, transfer(*inline_device, image, window, link));
+
+        stub::reset_kernel();
+        stub::flash_reset();
+        auto pipelined_device = std::make_unique<pipelined_device_t>();
+        std::snprintf(name, sizeof(name), "pipelined, %zu in flight", window);
+        report(name, transfer(*pipelined_device, image, window, link));
+    }
+}
@@ -0,0 +1,205 @@
+#ifndef TESTS_BENCH_LFS_MODEL_HPP
+#define TESTS_BENCH_LFS_MODEL_HPP
+
+#include <stub.hpp>
+
+#include <app/storage.hpp>
+
+#include <storage/flash_map.h>
+
+#include <algorithm>
+#include <array>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace lfs_model {
+
+constexpr size_t BLOCK = app::STORAGE_BLOCK_SIZE;
+constexpr size_t NUM_BLOCKS = stub::FLASH_STORAGE_SIZE / BLOCK;
+
+// A change the stub file system made durable, copied out of its fs_observe() hook
+struct change_t {
+    stub::fs_change_t::kind_e kind;
+    std::string path;
+    std::string to;
+    size_t size;
+    size_t lo;
+    size_t hi;
+};
+
+// LittleFS on the storage area, as far as erases and flash time go
+//
+// Metadata is a log in a pair of blocks: every commit appends an entry, a full block is
+// compacted into its sibling and after block_cycles compactions the pair moves to fresh
+// blocks. Files up to the cache size are inlined in their entry. Larger files are copy on
+// write, a commit rewrites each block from the first changed one into a newly allocated
+// block, as LittleFS does for an append after a sync. Allocation walks the blocks in order
+// from the last one handed out.
+struct lfs_model_t {
+    // Name, struct and tags of a file entry and the CRC closing a commit
+    static constexpr size_t ENTRY_SIZE = 32;
+    static constexpr size_t COMMIT_SIZE = 8;
+
+    struct file_t {
+        size_t size = 0;
+        std::vector<size_t> blocks;
+    };
+
+    app::storage_profile_t profile;
+    const flash_area* fa = nullptr;
+    std::array<bool, NUM_BLOCKS> used = {};
+    std::array<size_t, 2> pair = { 0, 1 };
+    size_t active = 0;
+    size_t log_end = 0;
+    int32_t cycles = 0;
+    size_t cursor = 2;
+    std::map<std::string, file_t> files;
+    uint32_t compactions = 0;
+    uint32_t relocations = 0;
+    uint32_t no_space = 0;
+
+    explicit lfs_model_t(const app::storage_profile_t& profile) : profile(profile) {
+        flash_area_open(FLASH_AREA_ID(storage), &fa);
+        used[0] = used[1] = true;
+        erase(0);
+        erase(1);
+        append(ENTRY_SIZE);
+    }
+
+    size_t inline_max() const {
+        return std::min<size_t>(profile.cache_size, BLOCK / 8);
+    }
+
+    size_t round(size_t len) const {
+        return (len + profile.prog_size - 1) / profile.prog_size * profile.prog_size;
+    }
+
+    void erase(size_t block) {
+        flash_area_erase(fa, static_cast<off_t>(block * BLOCK), BLOCK);
+    }
+
+    // Programs len bytes at off, one flash write per cache line
+    void prog(size_t block, size_t off, size_t len) {
+        static const std::vector<uint8_t> erased(BLOCK, 0xff);
+        for(size_t done = 0; done < len; done += profile.cache_size) {
+            const size_t chunk = std::min<size_t>(profile.cache_size, len - done);
+            flash_area_write(fa, static_cast<off_t>(block * BLOCK + off + done), erased.data(), chunk);
+        }
+    }
+
+    size_t alloc() {
+        for(size_t i = 0; i < NUM_BLOCKS; i++) {
+            const size_t block = (cursor + i) % NUM_BLOCKS;
+            if(!used[block]) {
+                used[block] = true;
+                cursor = block + 1;
+                return block;
+            }
+        }
+        no_space++;
+        return NUM_BLOCKS;
+    }
+
+    void release(file_t& file, size_t from) {
+        for(size_t i = from; i < file.blocks.size(); i++) {
+            if(file.blocks[i] < NUM_BLOCKS) {
+                used[file.blocks[i]] = false;
+            }
+        }
+        file.blocks.resize(std::min(from, file.blocks.size()));
+    }
+
+    size_t live() const {
+        size_t size = ENTRY_SIZE;
+        for(const auto& file : files) {
+            size += ENTRY_SIZE + (file.second.blocks.empty() ? file.second.size : 0);
+        }
+        return round(size);
+    }
+
+    void compact() {
+        compactions++;
+        if(profile.block_cycles > 0 && ++cycles >= profile.block_cycles) {
+            const std::array<size_t, 2> moved = { alloc(), alloc() };
+            if(moved[0] < NUM_BLOCKS && moved[1] < NUM_BLOCKS) {
+                used[pair[0]] = used[pair[1]] = false;
+                pair = moved;
+                erase(pair[1]);
+                relocations++;
+            }
+            cycles = 0;
+        }
+        active ^= 1;
+        erase(pair[active]);
+        prog(pair[active], 0, live());
+        log_end = live();
+    }
+
+    void append(size_t len) {
+        const size_t entry = round(len + COMMIT_SIZE);
+        if(log_end + entry > BLOCK) {
+            compact();
+        }
+        prog(pair[active], log_end, entry);
+        log_end += entry;
+    }
+
+    void commit(const change_t& change) {
+        file_t& file = files[change.path];
+        if(change.size <= inline_max()) {
+            release(file, 0);
+            file.size = change.size;
+            append(ENTRY_SIZE + change.size);
+            return;
+        }
+
+        const size_t count = (change.size + BLOCK - 1) / BLOCK;
+        const size_t first = file.blocks.empty() ? 0 : std::min(change.lo / BLOCK, count - 1);
+        release(file, count);
+        file.blocks.resize(count, NUM_BLOCKS);
+        for(size_t i = first; i < count; i++) {
+            const size_t block = alloc();
+            if(block == NUM_BLOCKS) {
+                break;
+            }
+            erase(block);
+            prog(block, 0, round(std::min(BLOCK, change.size - i * BLOCK)));
+            if(file.blocks[i] < NUM_BLOCKS) {
+                used[file.blocks[i]] = false;
+            }
+            file.blocks[i] = block;
+        }
+        file.size = change.size;
+        append(ENTRY_SIZE);
+    }
+
+    void apply(const change_t& change) {
+        if(change.kind == stub::fs_change_t::COMMIT) {
+            commit(change);
+        } else if(change.kind == stub::fs_change_t::RENAME) {
+            auto to = files.find(change.to);
+            if(to != files.end()) {
+                release(to->second, 0);
+                files.erase(to);
+            }
+            auto from = files.find(change.path);
+            if(from != files.end()) {
+                files[change.to] = from->second;
+                files.erase(from);
+            }
+            append(ENTRY_SIZE);
+        } else {
+            auto it = files.find(change.path);
+            if(it != files.end()) {
+                release(it->second, 0);
+                files.erase(it);
+            }
+            append(0);
+        }
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef STUB_AUTOCONF_H
+#define STUB_AUTOCONF_H
+
+// The prj.conf options the headers under test read, with the same values
+#define CONFIG_BT_L2CAP_TX_MTU 252
+#define CONFIG_BT_USER_PHY_UPDATE 1
+#define CONFIG_BT_USER_DATA_LEN_UPDATE 1
+#define CONFIG_BT_CONN_TX_MAX 24
+#define CONFIG_BT_MAX_CONN 1
+#define CONFIG_BT_DEVICE_NAME "ASS"
+#define CONFIG_BT_DEVICE_NAME_MAX 28
+#define CONFIG_FS_LITTLEFS_FC_MEM_POOL_MIN_SIZE 32
+#define CONFIG_FS_LITTLEFS_FC_MEM_POOL_MAX_SIZE 128
+#define CONFIG_FS_LITTLEFS_FC_MEM_POOL_NUM_BLOCKS 3
+#define CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC 64000000
+#define CONFIG_APPLICATION_INIT_PRIORITY 90
+
+// Kconfig defaults prj.conf leaves alone
+#define CONFIG_FS_LITTLEFS_READ_SIZE 16
+#define CONFIG_FS_LITTLEFS_PROG_SIZE 16
+#define CONFIG_FS_LITTLEFS_CACHE_SIZE 64
+#define CONFIG_FS_LITTLEFS_LOOKAHEAD_SIZE 32
+#define CONFIG_FS_LITTLEFS_BLOCK_CYCLES 512
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef STUB_BLUETOOTH_BLUETOOTH_H
+#define STUB_BLUETOOTH_BLUETOOTH_H
+
+// Zephyr 2.4 advertising API backed by a simulated controller on the virtual clock, see
+// stub.hpp for connecting peers and reading what was advertised
+
+#include <bluetooth/gap.h>
+#include <sys/util.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+struct bt_addr_t {
+    uint8_t val[6];
+};
+
+struct bt_addr_le_t {
+    uint8_t type;
+    bt_addr_t a;
+};
+
+struct bt_data {
+    uint8_t type;
+    uint8_t data_len;
+    const uint8_t* data;
+};
+
+// Static storage for the bytes of a BT_DATA_BYTES entry, C++ has no compound literals
+template<uint8_t ... BYTES>
+struct stub_bt_bytes_t {
+    static constexpr uint8_t data[] = { BYTES... };
+};
+
+#define BT_DATA(_type, _data, _data_len) \
+    { static_cast<uint8_t>(_type), static_cast<uint8_t>(_data_len), reinterpret_cast<const uint8_t*>(_data) }
+
+#define BT_DATA_BYTES(_type, ...) \
+    { static_cast<uint8_t>(_type), sizeof(stub_bt_bytes_t<__VA_ARGS__>::data), stub_bt_bytes_t<__VA_ARGS__>::data }
+
+#define BT_DATA_FLAGS 0x01
+#define BT_DATA_UUID16_SOME 0x02
+#define BT_DATA_UUID16_ALL 0x03
+#define BT_DATA_UUID128_SOME 0x06
+#define BT_DATA_UUID128_ALL 0x07
+#define BT_DATA_NAME_SHORTENED 0x08
+#define BT_DATA_NAME_COMPLETE 0x09
+#define BT_DATA_MANUFACTURER_DATA 0xff
+
+#define BT_LE_AD_LIMITED 0x01
+#define BT_LE_AD_GENERAL 0x02
+#define BT_LE_AD_NO_BREDR 0x04
+
+#define BT_LE_ADV_OPT_NONE 0
+#define BT_LE_ADV_OPT_CONNECTABLE BIT(0)
+#define BT_LE_ADV_OPT_ONE_TIME BIT(1)
+#define BT_LE_ADV_OPT_USE_IDENTITY BIT(2)
+#define BT_LE_ADV_OPT_USE_NAME BIT(3)
+
+struct bt_le_adv_param {
+    uint8_t id;
+    uint8_t sid;
+    uint8_t secondary_max_skip;
+    uint32_t options;
+    uint32_t interval_min;
+    uint32_t interval_max;
+    const bt_addr_le_t* peer;
+};
+
+#define BT_LE_ADV_PARAM_INIT(_options, _int_min, _int_max, _peer) \
+    { 0, 0, 0, (_options), (_int_min), (_int_max), (_peer) }
+
+typedef void (*bt_ready_cb_t)(int err);
+
+// Completes on the calling thread, the controller of the stand-in is always there
+int bt_enable(bt_ready_cb_t cb);
+
+int bt_set_name(const char* name);
+const char* bt_get_name(void);
+
+int bt_le_adv_start(const bt_le_adv_param* param, const bt_data* ad, size_t ad_len,
+        const bt_data* sd, size_t sd_len);
+int bt_le_adv_update_data(const bt_data* ad, size_t ad_len, const bt_data* sd, size_t sd_len);
+int bt_le_adv_stop(void);
+
+// One extended advertising set, CONFIG_BT_EXT_ADV_MAX_ADV_SET=1. Without
+// BT_LE_ADV_OPT_EXT_ADV it sends legacy PDUs like bt_le_adv_start() does.
+struct bt_le_ext_adv;
+struct bt_le_ext_adv_cb;
+
+struct bt_le_ext_adv_start_param {
+    uint16_t timeout;
+    uint8_t num_events;
+};
+
+#define BT_LE_EXT_ADV_START_PARAM_INIT(_timeout, _n_evts) { (_timeout), (_n_evts) }
+
+int bt_le_ext_adv_create(const bt_le_adv_param* param, const bt_le_ext_adv_cb* cb, bt_le_ext_adv** adv);
+int bt_le_ext_adv_start(bt_le_ext_adv* adv, bt_le_ext_adv_start_param* param);
+int bt_le_ext_adv_stop(bt_le_ext_adv* adv);
+// Works on a running set, the controller sends the new data from its next event
+int bt_le_ext_adv_set_data(bt_le_ext_adv* adv, const bt_data* ad, size_t ad_len,
+        const bt_data* sd, size_t sd_len);
+// -EINVAL while the set is running, HCI disallows new parameters for an enabled set
+int bt_le_ext_adv_update_param(bt_le_ext_adv* adv, const bt_le_adv_param* param);
+
+#endif
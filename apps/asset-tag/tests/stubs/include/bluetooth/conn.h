@@ -0,0 +1,100 @@
+#ifndef STUB_BLUETOOTH_CONN_H
+#define STUB_BLUETOOTH_CONN_H
+
+// Connections are made by the test through stub::bt_connect(), parameter, PHY and data
+// length requests complete after stub::bt_timing_t::update_us on the virtual clock
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+
+#include <cstdint>
+
+struct bt_conn;
+
+struct bt_le_conn_param {
+    uint16_t interval_min;
+    uint16_t interval_max;
+    uint16_t latency;
+    uint16_t timeout;
+};
+
+#define BT_LE_CONN_PARAM_INIT(int_min, int_max, lat, to) \
+    { (int_min), (int_max), (lat), (to) }
+
+struct bt_conn_le_phy_info {
+    uint8_t tx_phy;
+    uint8_t rx_phy;
+};
+
+struct bt_conn_le_phy_param {
+    uint16_t options;
+    uint8_t pref_tx_phy;
+    uint8_t pref_rx_phy;
+};
+
+struct bt_conn_le_data_len_info {
+    uint16_t tx_max_len;
+    uint16_t tx_max_time;
+    uint16_t rx_max_len;
+    uint16_t rx_max_time;
+};
+
+struct bt_conn_le_data_len_param {
+    uint16_t tx_max_len;
+    uint16_t tx_max_time;
+};
+
+extern const bt_conn_le_phy_param stub_bt_phy_param_2m;
+extern const bt_conn_le_data_len_param stub_bt_data_len_param_max;
+
+#define BT_CONN_LE_PHY_PARAM_2M (&stub_bt_phy_param_2m)
+#define BT_LE_DATA_LEN_PARAM_MAX (&stub_bt_data_len_param_max)
+
+struct bt_conn_le_info {
+    const bt_addr_le_t* src;
+    const bt_addr_le_t* dst;
+    uint16_t interval;
+    uint16_t latency;
+    uint16_t timeout;
+    const bt_conn_le_phy_info* phy;
+    const bt_conn_le_data_len_info* data_len;
+};
+
+enum {
+    BT_CONN_TYPE_LE = BIT(0),
+};
+
+enum {
+    BT_CONN_ROLE_MASTER,
+    BT_CONN_ROLE_SLAVE,
+};
+
+struct bt_conn_info {
+    uint8_t type;
+    uint8_t role;
+    uint8_t id;
+    bt_conn_le_info le;
+};
+
+struct bt_conn_cb {
+    void (*connected)(bt_conn* conn, uint8_t err);
+    void (*disconnected)(bt_conn* conn, uint8_t reason);
+    bool (*le_param_req)(bt_conn* conn, bt_le_conn_param* param);
+    void (*le_param_updated)(bt_conn* conn, uint16_t interval, uint16_t latency, uint16_t timeout);
+    void (*le_phy_updated)(bt_conn* conn, bt_conn_le_phy_info* param);
+    void (*le_data_len_updated)(bt_conn* conn, bt_conn_le_data_len_info* info);
+    bt_conn_cb* _next;
+};
+
+void bt_conn_cb_register(bt_conn_cb* cb);
+
+bt_conn* bt_conn_ref(bt_conn* conn);
+void bt_conn_unref(bt_conn* conn);
+int bt_conn_get_info(const bt_conn* conn, bt_conn_info* info);
+int bt_conn_disconnect(bt_conn* conn, uint8_t reason);
+
+int bt_conn_le_param_update(bt_conn* conn, const bt_le_conn_param* param);
+int bt_conn_le_phy_update(bt_conn* conn, const bt_conn_le_phy_param* param);
+int bt_conn_le_data_len_update(bt_conn* conn, const bt_conn_le_data_len_param* param);
+
+#endif
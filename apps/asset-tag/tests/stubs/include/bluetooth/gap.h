@@ -0,0 +1,22 @@
+#ifndef STUB_BLUETOOTH_GAP_H
+#define STUB_BLUETOOTH_GAP_H
+
+#define BT_GAP_ADV_FAST_INT_MIN_1 0x0030
+#define BT_GAP_ADV_FAST_INT_MAX_1 0x0060
+#define BT_GAP_ADV_FAST_INT_MIN_2 0x00a0
+#define BT_GAP_ADV_FAST_INT_MAX_2 0x00f0
+#define BT_GAP_ADV_SLOW_INT_MIN 0x0640
+#define BT_GAP_ADV_SLOW_INT_MAX 0x0780
+#define BT_GAP_ADV_MAX_ADV_DATA_LEN 31
+
+#define BT_GAP_LE_PHY_NONE 0
+#define BT_GAP_LE_PHY_1M BIT(0)
+#define BT_GAP_LE_PHY_2M BIT(1)
+#define BT_GAP_LE_PHY_CODED BIT(2)
+
+#define BT_GAP_DATA_LEN_DEFAULT 0x001b
+#define BT_GAP_DATA_LEN_MAX 0x00fb
+#define BT_GAP_DATA_TIME_DEFAULT 0x0148
+#define BT_GAP_DATA_TIME_MAX 0x4290
+
+#endif
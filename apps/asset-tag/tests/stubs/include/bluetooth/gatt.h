@@ -0,0 +1,88 @@
+#ifndef STUB_BLUETOOTH_GATT_H
+#define STUB_BLUETOOTH_GATT_H
+
+// Attribute tables as plain arrays, notifications are sent by the simulated controller and
+// completed on the virtual clock. Subscriptions are set with stub::bt_subscribe().
+
+#include <bluetooth/conn.h>
+#include <bluetooth/uuid.h>
+#include <sys/util.h>
+
+#include <cstdint>
+#include <sys/types.h>
+
+#define BT_ATT_ERR_INVALID_OFFSET 0x07
+#define BT_ATT_ERR_INVALID_ATTRIBUTE_LEN 0x0d
+#define BT_ATT_ERR_UNLIKELY 0x0e
+#define BT_ATT_ERR_CCC_IMPROPER_CONF 0xfd
+
+#define BT_GATT_ERR(_att_err) (-(_att_err))
+
+#define BT_GATT_CHRC_READ 0x02
+#define BT_GATT_CHRC_WRITE_WITHOUT_RESP 0x04
+#define BT_GATT_CHRC_WRITE 0x08
+#define BT_GATT_CHRC_NOTIFY 0x10
+
+#define BT_GATT_PERM_NONE 0
+#define BT_GATT_PERM_READ BIT(0)
+#define BT_GATT_PERM_WRITE BIT(1)
+
+#define BT_GATT_CCC_NOTIFY 0x0001
+
+struct bt_gatt_attr;
+
+typedef ssize_t (*bt_gatt_attr_read_func_t)(bt_conn* conn, const bt_gatt_attr* attr,
+        void* buf, uint16_t len, uint16_t offset);
+typedef ssize_t (*bt_gatt_attr_write_func_t)(bt_conn* conn, const bt_gatt_attr* attr,
+        const void* buf, uint16_t len, uint16_t offset, uint8_t flags);
+typedef void (*bt_gatt_ccc_changed_t)(const bt_gatt_attr* attr, uint16_t value);
+
+struct bt_gatt_attr {
+    const bt_uuid* uuid;
+    bt_gatt_attr_read_func_t read;
+    bt_gatt_attr_write_func_t write;
+    void* user_data;
+    uint16_t handle;
+    uint8_t perm;
+};
+
+struct bt_gatt_service_static {
+    const bt_gatt_attr* attrs;
+    size_t attr_count;
+};
+
+#define BT_GATT_ATTRIBUTE(_uuid, _perm, _read, _write, _value) \
+    { (_uuid), (_read), (_write), (void*) (_value), 0, (_perm) }
+
+#define BT_GATT_PRIMARY_SERVICE(_service) \
+    BT_GATT_ATTRIBUTE(BT_UUID_GATT_PRIMARY, BT_GATT_PERM_READ, nullptr, nullptr, _service)
+
+#define BT_GATT_CHARACTERISTIC(_uuid, _props, _perm, _read, _write, _value) \
+    BT_GATT_ATTRIBUTE(BT_UUID_GATT_CHRC, BT_GATT_PERM_READ, nullptr, nullptr, nullptr), \
+    BT_GATT_ATTRIBUTE(_uuid, _perm, _read, _write, _value)
+
+#define BT_GATT_CCC(_changed, _perm) \
+    BT_GATT_ATTRIBUTE(BT_UUID_GATT_CCC, _perm, nullptr, nullptr, reinterpret_cast<void*>(_changed))
+
+#define BT_GATT_SERVICE_DEFINE(_name, ...) \
+    static bt_gatt_attr attr_##_name[] = { __VA_ARGS__ }; \
+    static const bt_gatt_service_static _name = { attr_##_name, ARRAY_SIZE(attr_##_name) }
+
+typedef void (*bt_gatt_complete_func_t)(bt_conn* conn, void* user_data);
+
+struct bt_gatt_notify_params {
+    const bt_uuid* uuid;
+    const bt_gatt_attr* attr;
+    const void* data;
+    uint16_t len;
+    bt_gatt_complete_func_t func;
+    void* user_data;
+};
+
+ssize_t bt_gatt_attr_read(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t buf_len,
+        uint16_t offset, const void* value, uint16_t value_len);
+int bt_gatt_notify_cb(bt_conn* conn, bt_gatt_notify_params* params);
+uint16_t bt_gatt_get_mtu(bt_conn* conn);
+bool bt_gatt_is_subscribed(bt_conn* conn, const bt_gatt_attr* attr, uint16_t ccc_value);
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef STUB_BLUETOOTH_HCI_H
+#define STUB_BLUETOOTH_HCI_H
+
+#define BT_HCI_ERR_SUCCESS 0x00
+#define BT_HCI_ERR_CONN_TIMEOUT 0x08
+#define BT_HCI_ERR_REMOTE_USER_TERM_CONN 0x13
+#define BT_HCI_ERR_LOCALHOST_TERM_CONN 0x16
+
+#endif
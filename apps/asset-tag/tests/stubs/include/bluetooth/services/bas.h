@@ -0,0 +1,9 @@
+#ifndef STUB_BLUETOOTH_SERVICES_BAS_H
+#define STUB_BLUETOOTH_SERVICES_BAS_H
+
+#include <cstdint>
+
+uint8_t bt_bas_get_battery_level(void);
+int bt_bas_set_battery_level(uint8_t level);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef STUB_BLUETOOTH_UUID_H
+#define STUB_BLUETOOTH_UUID_H
+
+#include <cstdint>
+
+enum {
+    BT_UUID_TYPE_16,
+    BT_UUID_TYPE_32,
+    BT_UUID_TYPE_128,
+};
+
+struct bt_uuid {
+    uint8_t type;
+};
+
+struct bt_uuid_16 {
+    bt_uuid uuid;
+    uint16_t val;
+};
+
+struct bt_uuid_128 {
+    bt_uuid uuid;
+    uint8_t val[16];
+};
+
+// Static storage for declared UUIDs, C++ has no compound literals
+template<uint16_t VALUE>
+struct stub_bt_uuid_16_t {
+    static constexpr bt_uuid_16 uuid = { { BT_UUID_TYPE_16 }, VALUE };
+};
+
+template<uint8_t ... BYTES>
+struct stub_bt_uuid_128_t {
+    static constexpr bt_uuid_128 uuid = { { BT_UUID_TYPE_128 }, { BYTES... } };
+};
+
+#define BT_UUID_DECLARE_16(value) (&stub_bt_uuid_16_t<(value)>::uuid.uuid)
+#define BT_UUID_DECLARE_128(...) (&stub_bt_uuid_128_t<__VA_ARGS__>::uuid.uuid)
+
+#define BT_UUID_GATT_PRIMARY BT_UUID_DECLARE_16(0x2800)
+#define BT_UUID_GATT_CHRC BT_UUID_DECLARE_16(0x2803)
+#define BT_UUID_GATT_CCC BT_UUID_DECLARE_16(0x2902)
+#define BT_UUID_BAS BT_UUID_DECLARE_16(0x180f)
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef STUB_DEVICE_H
+#define STUB_DEVICE_H
+
+// Devices are looked up by label among the stand-in drivers, GPIO_0, GPIO_1 and ADC_0
+
+struct device {
+    const char* name;
+    const void* config;
+    const void* api;
+    void* data;
+};
+
+const device* device_get_binding(const char* name);
+
+#endif
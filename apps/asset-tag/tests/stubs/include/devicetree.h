@@ -0,0 +1,61 @@
+#ifndef STUB_DEVICETREE_H
+#define STUB_DEVICETREE_H
+
+// The nRF52 DK LED and button aliases and the SAADC in the generated devicetree's naming,
+// plus a pin on a second controller so groups spanning ports are covered
+
+#include <drivers/gpio.h>
+
+#define DT_CAT(a, b) DT_CAT_(a, b)
+#define DT_CAT_(a, b) a ## b
+
+#define DT_ALIAS(alias) DT_N_ALIAS_ ## alias
+#define DT_NODELABEL(label) DT_N_NODELABEL_ ## label
+#define DT_NODE_HAS_STATUS(node, status) DT_CAT(node, _STATUS_ ## status)
+#define DT_GPIO_LABEL(node, prop) DT_CAT(node, _P_ ## prop ## _LABEL)
+#define DT_GPIO_PIN(node, prop) DT_CAT(node, _P_ ## prop ## _PIN)
+#define DT_GPIO_FLAGS(node, prop) DT_CAT(node, _P_ ## prop ## _FLAGS)
+#define DT_INST(inst, compat) DT_N_INST_ ## inst ## _ ## compat
+#define DT_LABEL(node) DT_CAT(node, _P_label)
+
+#define DT_N_ALIAS_led0 DT_N_S_leds_S_led_0
+#define DT_N_ALIAS_led1 DT_N_S_leds_S_led_1
+#define DT_N_ALIAS_led2 DT_N_S_leds_S_led_2
+#define DT_N_ALIAS_led3 DT_N_S_leds_S_led_3
+#define DT_N_ALIAS_sw0 DT_N_S_buttons_S_button_0
+#define DT_N_ALIAS_stub1 DT_N_S_stub_S_pin_1
+
+#define DT_N_S_leds_S_led_0_STATUS_okay 1
+#define DT_N_S_leds_S_led_0_P_gpios_LABEL "GPIO_0"
+#define DT_N_S_leds_S_led_0_P_gpios_PIN 17
+#define DT_N_S_leds_S_led_0_P_gpios_FLAGS GPIO_ACTIVE_LOW
+
+#define DT_N_S_leds_S_led_1_STATUS_okay 1
+#define DT_N_S_leds_S_led_1_P_gpios_LABEL "GPIO_0"
+#define DT_N_S_leds_S_led_1_P_gpios_PIN 18
+#define DT_N_S_leds_S_led_1_P_gpios_FLAGS GPIO_ACTIVE_LOW
+
+#define DT_N_S_leds_S_led_2_STATUS_okay 1
+#define DT_N_S_leds_S_led_2_P_gpios_LABEL "GPIO_0"
+#define DT_N_S_leds_S_led_2_P_gpios_PIN 19
+#define DT_N_S_leds_S_led_2_P_gpios_FLAGS GPIO_ACTIVE_LOW
+
+#define DT_N_S_leds_S_led_3_STATUS_okay 1
+#define DT_N_S_leds_S_led_3_P_gpios_LABEL "GPIO_0"
+#define DT_N_S_leds_S_led_3_P_gpios_PIN 20
+#define DT_N_S_leds_S_led_3_P_gpios_FLAGS GPIO_ACTIVE_LOW
+
+#define DT_N_S_buttons_S_button_0_STATUS_okay 1
+#define DT_N_S_buttons_S_button_0_P_gpios_LABEL "GPIO_0"
+#define DT_N_S_buttons_S_button_0_P_gpios_PIN 13
+#define DT_N_S_buttons_S_button_0_P_gpios_FLAGS (GPIO_PULL_UP | GPIO_ACTIVE_LOW)
+
+#define DT_N_INST_0_nordic_nrf_saadc DT_N_S_soc_S_adc_40007000
+#define DT_N_S_soc_S_adc_40007000_P_label "ADC_0"
+
+#define DT_N_S_stub_S_pin_1_STATUS_okay 1
+#define DT_N_S_stub_S_pin_1_P_gpios_LABEL "GPIO_1"
+#define DT_N_S_stub_S_pin_1_P_gpios_PIN 3
+#define DT_N_S_stub_S_pin_1_P_gpios_FLAGS GPIO_ACTIVE_HIGH
+
+#endif
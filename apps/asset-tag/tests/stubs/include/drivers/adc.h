@@ -0,0 +1,83 @@
+#ifndef STUB_DRIVERS_ADC_H
+#define STUB_DRIVERS_ADC_H
+
+// Zephyr 2.4 ADC API as the nRF SAADC driver implements it, on the simulated SAADC of
+// hal/nrf_saadc.h. The device is ADC_0.
+
+#include <device.h>
+#include <hal/nrf_saadc.h>
+#include <sys/util.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+enum adc_gain {
+    ADC_GAIN_1_6,
+    ADC_GAIN_1_5,
+    ADC_GAIN_1_4,
+    ADC_GAIN_1_3,
+    ADC_GAIN_1_2,
+    ADC_GAIN_2_3,
+    ADC_GAIN_1,
+    ADC_GAIN_2,
+    ADC_GAIN_4
+};
+
+enum adc_reference {
+    ADC_REF_VDD_1,
+    ADC_REF_VDD_1_4,
+    ADC_REF_INTERNAL
+};
+
+#define ADC_ACQ_TIME_MICROSECONDS 1u
+#define ADC_ACQ_TIME(unit, value) (((unit) << 14) | ((value) & 0x3fff))
+#define ADC_ACQ_TIME_DEFAULT 0
+
+struct adc_channel_cfg {
+    adc_gain gain;
+    adc_reference reference;
+    uint16_t acquisition_time;
+    uint8_t channel_id : 5;
+    uint8_t differential : 1;
+    uint8_t input_positive;
+    uint8_t input_negative;
+};
+
+struct adc_sequence_options;
+
+struct adc_sequence {
+    const adc_sequence_options* options;
+    uint32_t channels;
+    void* buffer;
+    size_t buffer_size;
+    uint8_t resolution;
+    uint8_t oversampling;
+    bool calibrate;
+};
+
+// Sets the gain, reference and acquisition time of a channel. The positive input is
+// remembered and only connected by adc_read(), for the channels it reads.
+int adc_channel_setup(const device* dev, const adc_channel_cfg* channel_cfg);
+
+// Converts the channels of the sequence once. It takes the SAADC over as the driver does,
+// a read while something else runs it is counted in stub::saadc_stats().collisions.
+int adc_read(const device* dev, const adc_sequence* sequence);
+
+static inline uint16_t adc_ref_internal(const device* dev) {
+    return 600;
+}
+
+static inline int adc_raw_to_millivolts(int32_t ref_mv, adc_gain gain, uint8_t resolution, int32_t* valp) {
+    static constexpr int32_t inverse[][2] = {
+        { 6, 1 }, { 5, 1 }, { 4, 1 }, { 3, 1 }, { 2, 1 }, { 3, 2 }, { 1, 1 }, { 1, 2 }, { 1, 4 }
+    };
+    if(gain < ADC_GAIN_1_6 || gain > ADC_GAIN_4) {
+        return -EINVAL;
+    }
+    const int32_t adc_mv = *valp * ref_mv * inverse[gain][0] / inverse[gain][1];
+    *valp = adc_mv >> resolution;
+    return 0;
+}
+
+#endif
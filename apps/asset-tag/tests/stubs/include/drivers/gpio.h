@@ -0,0 +1,124 @@
+#ifndef STUB_DRIVERS_GPIO_H
+#define STUB_DRIVERS_GPIO_H
+
+// Zephyr 2.4 GPIO API without userspace, the logical to raw inversion happens here and the
+// raw calls go through the driver's function table, as on target. See stub.hpp for the ports.
+
+#include <device.h>
+#include <sys/util.h>
+
+#include <cerrno>
+#include <cstdint>
+
+#define GPIO_ACTIVE_LOW (1U << 0)
+#define GPIO_ACTIVE_HIGH (0U << 0)
+#define GPIO_SINGLE_ENDED (1U << 1)
+#define GPIO_PULL_UP (1U << 4)
+#define GPIO_PULL_DOWN (1U << 5)
+#define GPIO_INPUT (1U << 8)
+#define GPIO_OUTPUT (1U << 9)
+#define GPIO_OUTPUT_INIT_LOW (1U << 10)
+#define GPIO_OUTPUT_INIT_HIGH (1U << 11)
+#define GPIO_OUTPUT_INIT_LOGICAL (1U << 12)
+#define GPIO_OUTPUT_LOW (GPIO_OUTPUT | GPIO_OUTPUT_INIT_LOW)
+#define GPIO_OUTPUT_HIGH (GPIO_OUTPUT | GPIO_OUTPUT_INIT_HIGH)
+#define GPIO_OUTPUT_INACTIVE (GPIO_OUTPUT | GPIO_OUTPUT_INIT_LOW | GPIO_OUTPUT_INIT_LOGICAL)
+#define GPIO_OUTPUT_ACTIVE (GPIO_OUTPUT | GPIO_OUTPUT_INIT_HIGH | GPIO_OUTPUT_INIT_LOGICAL)
+#define GPIO_DISCONNECTED 0
+
+typedef uint8_t gpio_pin_t;
+typedef uint32_t gpio_flags_t;
+typedef uint32_t gpio_port_pins_t;
+typedef uint32_t gpio_port_value_t;
+
+struct gpio_driver_data {
+    gpio_port_pins_t invert;
+};
+
+struct gpio_driver_api {
+    int (*pin_configure)(const device* port, gpio_pin_t pin, gpio_flags_t flags);
+    int (*port_get_raw)(const device* port, gpio_port_value_t* value);
+    int (*port_set_masked_raw)(const device* port, gpio_port_pins_t mask, gpio_port_value_t value);
+    int (*port_set_bits_raw)(const device* port, gpio_port_pins_t pins);
+    int (*port_clear_bits_raw)(const device* port, gpio_port_pins_t pins);
+    int (*port_toggle_bits)(const device* port, gpio_port_pins_t pins);
+};
+
+static inline const gpio_driver_api* gpio_api(const device* port) {
+    return static_cast<const gpio_driver_api*>(port->api);
+}
+
+static inline gpio_driver_data* gpio_data(const device* port) {
+    return static_cast<gpio_driver_data*>(port->data);
+}
+
+static inline int gpio_pin_configure(const device* port, gpio_pin_t pin, gpio_flags_t flags) {
+    gpio_driver_data* data = gpio_data(port);
+    if((flags & GPIO_OUTPUT_INIT_LOGICAL) && (flags & (GPIO_OUTPUT_INIT_LOW | GPIO_OUTPUT_INIT_HIGH))
+            && (flags & GPIO_ACTIVE_LOW)) {
+        flags ^= GPIO_OUTPUT_INIT_LOW | GPIO_OUTPUT_INIT_HIGH;
+    }
+    flags &= ~GPIO_OUTPUT_INIT_LOGICAL;
+    if(flags & GPIO_ACTIVE_LOW) {
+        data->invert |= BIT(pin);
+    } else {
+        data->invert &= ~BIT(pin);
+    }
+    return gpio_api(port)->pin_configure(port, pin, flags);
+}
+
+static inline int gpio_port_get_raw(const device* port, gpio_port_value_t* value) {
+    return gpio_api(port)->port_get_raw(port, value);
+}
+
+static inline int gpio_port_get(const device* port, gpio_port_value_t* value) {
+    const int ret = gpio_port_get_raw(port, value);
+    if(ret == 0) {
+        *value ^= gpio_data(port)->invert;
+    }
+    return ret;
+}
+
+static inline int gpio_port_set_masked_raw(const device* port, gpio_port_pins_t mask, gpio_port_value_t value) {
+    return gpio_api(port)->port_set_masked_raw(port, mask, value);
+}
+
+static inline int gpio_port_set_masked(const device* port, gpio_port_pins_t mask, gpio_port_value_t value) {
+    value ^= gpio_data(port)->invert;
+    return gpio_port_set_masked_raw(port, mask, value);
+}
+
+static inline int gpio_port_set_bits_raw(const device* port, gpio_port_pins_t pins) {
+    return gpio_api(port)->port_set_bits_raw(port, pins);
+}
+
+static inline int gpio_port_clear_bits_raw(const device* port, gpio_port_pins_t pins) {
+    return gpio_api(port)->port_clear_bits_raw(port, pins);
+}
+
+static inline int gpio_port_toggle_bits(const device* port, gpio_port_pins_t pins) {
+    return gpio_api(port)->port_toggle_bits(port, pins);
+}
+
+static inline int gpio_pin_get(const device* port, gpio_pin_t pin) {
+    gpio_port_value_t value;
+    const int ret = gpio_port_get(port, &value);
+    return ret == 0 ? (value & BIT(pin)) != 0 : ret;
+}
+
+static inline int gpio_pin_set_raw(const device* port, gpio_pin_t pin, int value) {
+    return value != 0 ? gpio_port_set_bits_raw(port, BIT(pin)) : gpio_port_clear_bits_raw(port, BIT(pin));
+}
+
+static inline int gpio_pin_set(const device* port, gpio_pin_t pin, int value) {
+    if(gpio_data(port)->invert & BIT(pin)) {
+        value = value != 0 ? 0 : 1;
+    }
+    return gpio_pin_set_raw(port, pin, value);
+}
+
+static inline int gpio_pin_toggle(const device* port, gpio_pin_t pin) {
+    return gpio_port_toggle_bits(port, BIT(pin));
+}
+
+#endif
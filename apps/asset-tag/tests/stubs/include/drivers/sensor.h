@@ -0,0 +1,8 @@
+#ifndef STUB_DRIVERS_SENSOR_H
+#define STUB_DRIVERS_SENSOR_H
+
+// Included by app_saadc.hpp, which uses none of the sensor API
+
+#include <device.h>
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef STUB_FS_FS_H
+#define STUB_FS_FS_H
+
+// In-memory file system with LittleFS commit semantics
+//
+// Every open file writes into its own copy, which becomes the stored contents on
+// fs_sync() or fs_close(). fs_stat() and new opens only see stored contents, and
+// stub::fs_power_cut() drops every copy that was not synced.
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#define MAX_FILE_NAME 255
+
+#define FS_O_READ 0x01
+#define FS_O_WRITE 0x02
+#define FS_O_RDWR (FS_O_READ | FS_O_WRITE)
+#define FS_O_CREATE 0x10
+#define FS_O_APPEND 0x20
+
+#define FS_SEEK_SET 0
+#define FS_SEEK_CUR 1
+#define FS_SEEK_END 2
+
+typedef uint8_t fs_mode_t;
+
+enum fs_dir_entry_type {
+    FS_DIR_ENTRY_FILE = 0,
+    FS_DIR_ENTRY_DIR
+};
+
+enum fs_type {
+    FS_FATFS = 0,
+    FS_LITTLEFS,
+    FS_TYPE_END
+};
+
+struct fs_dirent {
+    fs_dir_entry_type type;
+    char name[MAX_FILE_NAME + 1];
+    size_t size;
+};
+
+struct fs_statvfs {
+    unsigned long f_bsize;
+    unsigned long f_frsize;
+    unsigned long f_blocks;
+    unsigned long f_bfree;
+};
+
+struct fs_mount_t {
+    fs_type type;
+    const char* mnt_point;
+    void* fs_data;
+    void* storage_dev;
+    size_t mountp_len;
+    const void* fs;
+    uint8_t flags;
+};
+
+struct fs_file_t {
+    void* filep;
+    const fs_mount_t* mp;
+};
+
+struct fs_dir_t {
+    void* dirp;
+    const fs_mount_t* mp;
+};
+
+int fs_mount(fs_mount_t* mp);
+int fs_unmount(fs_mount_t* mp);
+int fs_open(fs_file_t* zfp, const char* file_name, fs_mode_t flags);
+int fs_close(fs_file_t* zfp);
+ssize_t fs_read(fs_file_t* zfp, void* ptr, size_t size);
+ssize_t fs_write(fs_file_t* zfp, const void* ptr, size_t size);
+int fs_seek(fs_file_t* zfp, off_t offset, int whence);
+off_t fs_tell(fs_file_t* zfp);
+int fs_truncate(fs_file_t* zfp, off_t length);
+int fs_sync(fs_file_t* zfp);
+int fs_stat(const char* path, fs_dirent* entry);
+int fs_unlink(const char* path);
+int fs_rename(const char* from, const char* to);
+int fs_mkdir(const char* path);
+int fs_statvfs(const char* path, struct fs_statvfs* stat);
+int fs_opendir(fs_dir_t* zdp, const char* path);
+int fs_readdir(fs_dir_t* zdp, fs_dirent* entry);
+int fs_closedir(fs_dir_t* zdp);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef STUB_FS_LITTLEFS_H
+#define STUB_FS_LITTLEFS_H
+
+// The LittleFS mount data fs/fs.h takes, the in-memory file system ignores its geometry
+
+#include <cstdint>
+
+struct lfs_config {
+    uint32_t read_size;
+    uint32_t prog_size;
+    uint32_t cache_size;
+    uint32_t lookahead_size;
+    int32_t block_cycles;
+};
+
+struct fs_littlefs {
+    lfs_config cfg;
+};
+
+#define FS_LITTLEFS_DECLARE_CUSTOM_CONFIG(name, read_sz, prog_sz, cache_sz, lookahead_sz) \
+    static fs_littlefs name = { { (read_sz), (prog_sz), (cache_sz), (lookahead_sz), 0 } }
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef STUB_HAL_NRF_EGU_H
+#define STUB_HAL_NRF_EGU_H
+
+// nrfx 2.3 EGU HAL, TRIGGERED0 raises the SWI3_EGU3 interrupt when it is enabled
+
+#include <nrfx.h>
+
+typedef enum {
+    NRF_EGU_TASK_TRIGGER0 = 0x000
+} nrf_egu_task_t;
+
+typedef enum {
+    NRF_EGU_EVENT_TRIGGERED0 = 0x100
+} nrf_egu_event_t;
+
+typedef enum {
+    NRF_EGU_INT_TRIGGERED0 = 1 << 0
+} nrf_egu_int_mask_t;
+
+uint32_t nrf_egu_task_address_get(NRF_EGU_Type const* p_reg, nrf_egu_task_t task);
+bool nrf_egu_event_check(NRF_EGU_Type const* p_reg, nrf_egu_event_t event);
+void nrf_egu_event_clear(NRF_EGU_Type* p_reg, nrf_egu_event_t event);
+void nrf_egu_int_enable(NRF_EGU_Type* p_reg, uint32_t mask);
+void nrf_egu_int_disable(NRF_EGU_Type* p_reg, uint32_t mask);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef STUB_HAL_NRF_GPIO_H
+#define STUB_HAL_NRF_GPIO_H
+
+// Included for the pin helpers, none of which the headers under test call
+
+#include <nrfx.h>
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef STUB_HAL_NRF_RTC_H
+#define STUB_HAL_NRF_RTC_H
+
+// nrfx 2.3 RTC HAL on the 32768 Hz LFCLK. CLEAR lands on the next tick, so a COMPARE that
+// clears the counter through PPI repeats every CC + 1 ticks.
+
+#include <nrfx.h>
+
+typedef enum {
+    NRF_RTC_TASK_START = 0x000,
+    NRF_RTC_TASK_STOP = 0x004,
+    NRF_RTC_TASK_CLEAR = 0x008
+} nrf_rtc_task_t;
+
+typedef enum {
+    NRF_RTC_EVENT_COMPARE_0 = 0x140
+} nrf_rtc_event_t;
+
+#define NRF_RTC_INT_COMPARE0_MASK (1UL << 16)
+
+void nrf_rtc_prescaler_set(NRF_RTC_Type* p_reg, uint32_t val);
+void nrf_rtc_cc_set(NRF_RTC_Type* p_reg, uint32_t ch, uint32_t cc_val);
+void nrf_rtc_event_enable(NRF_RTC_Type* p_reg, uint32_t mask);
+void nrf_rtc_event_disable(NRF_RTC_Type* p_reg, uint32_t mask);
+void nrf_rtc_task_trigger(NRF_RTC_Type* p_reg, nrf_rtc_task_t task);
+uint32_t nrf_rtc_task_address_get(NRF_RTC_Type const* p_reg, nrf_rtc_task_t task);
+uint32_t nrf_rtc_event_address_get(NRF_RTC_Type const* p_reg, nrf_rtc_event_t event);
+
+#endif
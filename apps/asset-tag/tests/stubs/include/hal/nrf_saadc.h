@@ -0,0 +1,72 @@
+#ifndef STUB_HAL_NRF_SAADC_H
+#define STUB_HAL_NRF_SAADC_H
+
+// nrfx 2.3 SAADC HAL. Tasks act at once: SAMPLE converts every channel with an input in
+// channel order into the EasyDMA buffer latched by START, and END follows the last result.
+
+#include <nrfx.h>
+
+#define NRF_SAADC_CHANNEL_COUNT 8
+
+typedef int16_t nrf_saadc_value_t;
+
+typedef enum {
+    NRF_SAADC_INPUT_DISABLED = 0,
+    NRF_SAADC_INPUT_AIN0 = 1,
+    NRF_SAADC_INPUT_AIN1 = 2,
+    NRF_SAADC_INPUT_AIN2 = 3,
+    NRF_SAADC_INPUT_AIN3 = 4,
+    NRF_SAADC_INPUT_AIN4 = 5,
+    NRF_SAADC_INPUT_AIN5 = 6,
+    NRF_SAADC_INPUT_AIN6 = 7,
+    NRF_SAADC_INPUT_AIN7 = 8,
+    NRF_SAADC_INPUT_VDD = 9
+} nrf_saadc_input_t;
+
+typedef enum {
+    NRF_SAADC_RESOLUTION_8BIT = 0,
+    NRF_SAADC_RESOLUTION_10BIT = 1,
+    NRF_SAADC_RESOLUTION_12BIT = 2,
+    NRF_SAADC_RESOLUTION_14BIT = 3
+} nrf_saadc_resolution_t;
+
+typedef enum {
+    NRF_SAADC_OVERSAMPLE_DISABLED = 0
+} nrf_saadc_oversample_t;
+
+typedef enum {
+    NRF_SAADC_TASK_START = 0x000,
+    NRF_SAADC_TASK_SAMPLE = 0x004,
+    NRF_SAADC_TASK_STOP = 0x008
+} nrf_saadc_task_t;
+
+typedef enum {
+    NRF_SAADC_EVENT_STARTED = 0x100,
+    NRF_SAADC_EVENT_END = 0x104,
+    NRF_SAADC_EVENT_CALIBRATEDONE = 0x110,
+    NRF_SAADC_EVENT_STOPPED = 0x114
+} nrf_saadc_event_t;
+
+typedef enum {
+    NRF_SAADC_INT_STARTED = 1 << 0,
+    NRF_SAADC_INT_END = 1 << 1,
+    NRF_SAADC_INT_CALIBRATEDONE = 1 << 4,
+    NRF_SAADC_INT_STOPPED = 1 << 5
+} nrf_saadc_int_mask_t;
+
+void nrf_saadc_task_trigger(NRF_SAADC_Type* p_reg, nrf_saadc_task_t task);
+uint32_t nrf_saadc_task_address_get(NRF_SAADC_Type const* p_reg, nrf_saadc_task_t task);
+bool nrf_saadc_event_check(NRF_SAADC_Type const* p_reg, nrf_saadc_event_t event);
+void nrf_saadc_event_clear(NRF_SAADC_Type* p_reg, nrf_saadc_event_t event);
+uint32_t nrf_saadc_event_address_get(NRF_SAADC_Type const* p_reg, nrf_saadc_event_t event);
+void nrf_saadc_int_enable(NRF_SAADC_Type* p_reg, uint32_t saadc_int_mask);
+void nrf_saadc_int_disable(NRF_SAADC_Type* p_reg, uint32_t saadc_int_mask);
+void nrf_saadc_enable(NRF_SAADC_Type* p_reg);
+void nrf_saadc_disable(NRF_SAADC_Type* p_reg);
+void nrf_saadc_resolution_set(NRF_SAADC_Type* p_reg, nrf_saadc_resolution_t resolution);
+void nrf_saadc_oversample_set(NRF_SAADC_Type* p_reg, nrf_saadc_oversample_t oversample);
+void nrf_saadc_channel_pos_input_set(NRF_SAADC_Type* p_reg, uint8_t channel, nrf_saadc_input_t pselp);
+void nrf_saadc_buffer_init(NRF_SAADC_Type* p_reg, nrf_saadc_value_t* p_buffer, uint32_t size);
+uint16_t nrf_saadc_amount_get(NRF_SAADC_Type const* p_reg);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef STUB_INIT_H
+#define STUB_INIT_H
+
+#include <device.h>
+
+// Init functions run during static initialization, before main() as on target
+#define SYS_INIT(fn, level, prio) \
+    static const int sys_init_##fn = (fn)(nullptr)
+
+#endif
@@ -0,0 +1,229 @@
+#ifndef STUB_KERNEL_H
+#define STUB_KERNEL_H
+
+// Host stand-in for the part of the Zephyr kernel API the app headers use
+//
+// Timers and work items run on a virtual clock: nothing fires until a test advances time
+// with k_sleep() or stub::run_until(), and then every due item runs on the calling thread
+// in deadline order. Threads, semaphores, mutexes and message queues are real host
+// primitives and their timeouts are wall clock.
+
+#include <autoconf.h>
+#include <sys/util.h>
+#include <sys/atomic.h>
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <sys/types.h>
+
+typedef struct {
+    int64_t us;
+} k_timeout_t;
+
+#define K_NO_WAIT (k_timeout_t{ 0 })
+#define K_FOREVER (k_timeout_t{ -1 })
+#define K_USEC(t) (k_timeout_t{ static_cast<int64_t>(t) })
+#define K_MSEC(ms) K_USEC(static_cast<int64_t>(ms) * 1000)
+#define K_SECONDS(s) K_MSEC(static_cast<int64_t>(s) * 1000)
+#define K_MINUTES(m) K_SECONDS(static_cast<int64_t>(m) * 60)
+#define K_TIMEOUT_EQ(a, b) ((a).us == (b).us)
+
+#define K_PRIO_COOP(x) (-((x) + 1))
+#define K_PRIO_PREEMPT(x) (x)
+#define K_ESSENTIAL 1
+
+int64_t k_uptime_get(void);
+uint32_t k_uptime_get_32(void);
+int64_t k_uptime_delta(int64_t* reftime);
+uint32_t k_cycle_get_32(void);
+int32_t k_sleep(k_timeout_t timeout);
+int32_t k_msleep(int32_t ms);
+int32_t k_usleep(int32_t us);
+void k_busy_wait(uint32_t usec_to_wait);
+void k_yield(void);
+
+static inline uint32_t sys_clock_hw_cycles_per_sec(void) {
+    return CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC;
+}
+
+static inline uint32_t k_cyc_to_us_floor32(uint32_t cycles) {
+    return static_cast<uint32_t>(static_cast<uint64_t>(cycles) * 1000000 / CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC);
+}
+
+static inline uint64_t k_cyc_to_us_floor64(uint64_t cycles) {
+    return cycles * 1000000 / CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC;
+}
+
+static inline unsigned int irq_lock(void) {
+    return 0;
+}
+
+static inline void irq_unlock(unsigned int) {}
+
+// Interrupts of the simulated nRF peripherals, see nrfx.h. An ISR runs on the thread that
+// raised its event, right after the PPI tasks the event triggers.
+void stub_irq_connect(unsigned int irq, void (*isr)(const void* arg), const void* arg);
+void irq_enable(unsigned int irq);
+void irq_disable(unsigned int irq);
+int irq_is_enabled(unsigned int irq);
+
+#define IRQ_CONNECT(irq_p, priority_p, isr_p, isr_param_p, flags_p) \
+    stub_irq_connect((irq_p), (isr_p), (isr_param_p))
+
+// Threads
+
+typedef void (*k_thread_entry_t)(void* p1, void* p2, void* p3);
+typedef char k_thread_stack_t;
+
+struct k_thread {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool running = false;
+    const char* name = nullptr;
+};
+typedef k_thread* k_tid_t;
+
+#define K_THREAD_STACK_DEFINE(name, size) k_thread_stack_t name[size]
+#define K_THREAD_STACK_SIZEOF(stack) sizeof(stack)
+
+k_tid_t k_thread_create(k_thread* thread, k_thread_stack_t* stack, size_t stack_size, k_thread_entry_t entry,
+        void* p1, void* p2, void* p3, int prio, uint32_t options, k_timeout_t delay);
+int k_thread_join(k_thread* thread, k_timeout_t timeout);
+int k_thread_name_set(k_tid_t thread, const char* name);
+
+// Synchronization
+
+struct k_mutex {
+    std::recursive_timed_mutex mutex;
+};
+
+#define K_MUTEX_DEFINE(name) k_mutex name
+
+int k_mutex_init(k_mutex* mutex);
+int k_mutex_lock(k_mutex* mutex, k_timeout_t timeout);
+int k_mutex_unlock(k_mutex* mutex);
+
+struct k_sem {
+    std::mutex mutex;
+    std::condition_variable cv;
+    unsigned int count = 0;
+    unsigned int limit = 0;
+
+    k_sem() = default;
+    k_sem(unsigned int initial, unsigned int max) : count(initial), limit(max) {}
+};
+
+#define K_SEM_DEFINE(name, initial, max) k_sem name(initial, max)
+
+int k_sem_init(k_sem* sem, unsigned int initial_count, unsigned int limit);
+void k_sem_give(k_sem* sem);
+int k_sem_take(k_sem* sem, k_timeout_t timeout);
+unsigned int k_sem_count_get(k_sem* sem);
+void k_sem_reset(k_sem* sem);
+
+struct k_msgq {
+    std::mutex mutex;
+    std::condition_variable cv;
+    char* buffer = nullptr;
+    size_t msg_size = 0;
+    uint32_t max_msgs = 0;
+    uint32_t used = 0;
+    uint32_t read = 0;
+
+    k_msgq() = default;
+    k_msgq(char* buf, size_t size, uint32_t max) : buffer(buf), msg_size(size), max_msgs(max) {}
+};
+
+#define K_MSGQ_DEFINE(name, size, max, align) \
+    static char __aligned(align) _k_msgq_buf_##name[(size) * (max)]; \
+    k_msgq name(_k_msgq_buf_##name, size, max)
+
+void k_msgq_init(k_msgq* msgq, char* buffer, size_t msg_size, uint32_t max_msgs);
+int k_msgq_put(k_msgq* msgq, const void* data, k_timeout_t timeout);
+int k_msgq_get(k_msgq* msgq, void* data, k_timeout_t timeout);
+void k_msgq_purge(k_msgq* msgq);
+uint32_t k_msgq_num_used_get(k_msgq* msgq);
+uint32_t k_msgq_num_free_get(k_msgq* msgq);
+
+struct k_poll_signal {
+    atomic_t signaled;
+    atomic_t result;
+};
+
+void k_poll_signal_init(k_poll_signal* signal);
+void k_poll_signal_reset(k_poll_signal* signal);
+void k_poll_signal_check(k_poll_signal* signal, unsigned int* signaled, int* result);
+int k_poll_signal_raise(k_poll_signal* signal, int result);
+
+// Work queues
+
+struct k_work;
+typedef void (*k_work_handler_t)(k_work* work);
+
+struct k_work_q {
+    k_thread thread;
+};
+
+struct k_work {
+    k_work_handler_t handler = nullptr;
+    k_work_q* queue = nullptr;
+    int64_t due_us = 0;
+    uint64_t order = 0;
+    bool queued = false;
+};
+
+struct k_delayed_work {
+    k_work work;
+};
+
+extern k_work_q k_sys_work_q;
+
+void k_work_q_start(k_work_q* work_q, k_thread_stack_t* stack, size_t stack_size, int prio);
+void k_work_init(k_work* work, k_work_handler_t handler);
+void k_work_submit_to_queue(k_work_q* work_q, k_work* work);
+void k_work_submit(k_work* work);
+bool k_work_pending(k_work* work);
+void k_delayed_work_init(k_delayed_work* work, k_work_handler_t handler);
+int k_delayed_work_submit_to_queue(k_work_q* work_q, k_delayed_work* work, k_timeout_t delay);
+int k_delayed_work_submit(k_delayed_work* work, k_timeout_t delay);
+int k_delayed_work_cancel(k_delayed_work* work);
+int32_t k_delayed_work_remaining_get(k_delayed_work* work);
+
+// Timers
+
+struct k_timer;
+typedef void (*k_timer_expiry_t)(k_timer* timer);
+typedef void (*k_timer_stop_t)(k_timer* timer);
+
+struct k_timer {
+    k_timer_expiry_t expiry_fn = nullptr;
+    k_timer_stop_t stop_fn = nullptr;
+    void* user_data = nullptr;
+    int64_t due_us = 0;
+    int64_t period_us = 0;
+    uint64_t order = 0;
+    uint32_t status = 0;
+    bool active = false;
+};
+
+#define K_TIMER_DEFINE(name, expiry, stop) k_timer name = { expiry, stop }
+
+void k_timer_init(k_timer* timer, k_timer_expiry_t expiry_fn, k_timer_stop_t stop_fn);
+void k_timer_start(k_timer* timer, k_timeout_t duration, k_timeout_t period);
+void k_timer_stop(k_timer* timer);
+uint32_t k_timer_status_get(k_timer* timer);
+uint32_t k_timer_remaining_get(k_timer* timer);
+
+static inline void k_timer_user_data_set(k_timer* timer, void* user_data) {
+    timer->user_data = user_data;
+}
+
+static inline void* k_timer_user_data_get(k_timer* timer) {
+    return timer->user_data;
+}
+
+#endif
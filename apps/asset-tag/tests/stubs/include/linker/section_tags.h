@@ -0,0 +1,7 @@
+#ifndef STUB_LINKER_SECTION_TAGS_H
+#define STUB_LINKER_SECTION_TAGS_H
+
+// __noinit lives in sys/util.h with the other attribute stand-ins
+#include <sys/util.h>
+
+#endif
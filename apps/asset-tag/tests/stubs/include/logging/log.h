@@ -0,0 +1,25 @@
+#ifndef STUB_LOGGING_LOG_H
+#define STUB_LOGGING_LOG_H
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERR 1
+#define LOG_LEVEL_WRN 2
+#define LOG_LEVEL_INF 3
+#define LOG_LEVEL_DBG 4
+
+// Messages go to stderr when their level is at or below STUB_LOG_LEVEL, errors by default
+void stub_log(int level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define LOG_ERR(...) stub_log(LOG_LEVEL_ERR, __VA_ARGS__)
+#define LOG_WRN(...) stub_log(LOG_LEVEL_WRN, __VA_ARGS__)
+#define LOG_INF(...) stub_log(LOG_LEVEL_INF, __VA_ARGS__)
+#define LOG_DBG(...) stub_log(LOG_LEVEL_DBG, __VA_ARGS__)
+#define LOG_HEXDUMP_DBG(data, len, what) do { (void) (data); (void) (len); } while(0)
+#define LOG_MODULE_REGISTER(...)
+#define LOG_MODULE_DECLARE(...)
+
+static inline const char* log_strdup(const char* str) {
+    return str;
+}
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef STUB_LOGGING_LOG_CTRL_H
+#define STUB_LOGGING_LOG_CTRL_H
+
+#include <logging/log.h>
+
+static inline void log_panic(void) {}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef STUB_NRFX_H
+#define STUB_NRFX_H
+
+// nRF52832 peripherals the app drives through PPI, simulated on the virtual clock by
+// stubs/src/nrf.cpp. Register addresses are the datasheet ones, see stub.hpp for the inputs
+// the SAADC converts and its counters.
+
+#include <cstdint>
+
+enum IRQn_Type {
+    SAADC_IRQn = 7,
+    RTC2_IRQn = 36,
+    SWI3_EGU3_IRQn = 23
+};
+
+typedef enum {
+    NRFX_SUCCESS = 0x0BAD0000,
+    NRFX_ERROR_NO_MEM = 0x0BAD0002,
+    NRFX_ERROR_INVALID_PARAM = 0x0BAD0004,
+    NRFX_ERROR_INVALID_STATE = 0x0BAD0005
+} nrfx_err_t;
+
+struct NRF_SAADC_Type;
+struct NRF_RTC_Type;
+struct NRF_EGU_Type;
+
+extern NRF_SAADC_Type stub_nrf_saadc;
+extern NRF_RTC_Type stub_nrf_rtc2;
+extern NRF_EGU_Type stub_nrf_egu3;
+
+#define NRF_SAADC (&stub_nrf_saadc)
+#define NRF_RTC2 (&stub_nrf_rtc2)
+#define NRF_EGU3 (&stub_nrf_egu3)
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef STUB_NRFX_PPI_H
+#define STUB_NRFX_PPI_H
+
+// nrfx 2.3 PPI allocator over the 20 programmable channels of the nRF52832
+
+#include <nrfx.h>
+
+typedef enum {
+    NRF_PPI_CHANNEL0 = 0
+} nrf_ppi_channel_t;
+
+nrfx_err_t nrfx_ppi_channel_alloc(nrf_ppi_channel_t* p_channel);
+nrfx_err_t nrfx_ppi_channel_free(nrf_ppi_channel_t channel);
+nrfx_err_t nrfx_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep, uint32_t tep);
+nrfx_err_t nrfx_ppi_channel_fork_assign(nrf_ppi_channel_t channel, uint32_t fork_tep);
+nrfx_err_t nrfx_ppi_channel_enable(nrf_ppi_channel_t channel);
+nrfx_err_t nrfx_ppi_channel_disable(nrf_ppi_channel_t channel);
+
+#endif
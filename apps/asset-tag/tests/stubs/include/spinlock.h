@@ -0,0 +1,25 @@
+#ifndef STUB_SPINLOCK_H
+#define STUB_SPINLOCK_H
+
+#include <atomic>
+
+// Host threads stand in for ISRs and preemption, so the lock really spins
+struct k_spinlock {
+    std::atomic<bool> locked{false};
+};
+
+struct k_spinlock_key_t {
+    int key;
+};
+
+static inline k_spinlock_key_t k_spin_lock(k_spinlock* lock) {
+    while(lock->locked.exchange(true, std::memory_order_acquire)) {
+    }
+    return k_spinlock_key_t{ 0 };
+}
+
+static inline void k_spin_unlock(k_spinlock* lock, k_spinlock_key_t) {
+    lock->locked.store(false, std::memory_order_release);
+}
+
+#endif
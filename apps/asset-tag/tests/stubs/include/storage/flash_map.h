@@ -0,0 +1,40 @@
+#ifndef STUB_STORAGE_FLASH_MAP_H
+#define STUB_STORAGE_FLASH_MAP_H
+
+// Flash areas backed by RAM with NOR semantics, see stub.hpp for the layout and counters
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#define FLASH_AREA_ID(label) STUB_FLASH_AREA_##label
+
+enum {
+    STUB_FLASH_AREA_image_0 = 1,
+    STUB_FLASH_AREA_image_1 = 2,
+    STUB_FLASH_AREA_storage = 3,
+};
+
+struct flash_area {
+    uint8_t fa_id;
+    uint8_t fa_device_id;
+    uint16_t pad16;
+    off_t fa_off;
+    size_t fa_size;
+    const char* fa_dev_name;
+};
+
+struct flash_sector {
+    off_t fs_off;
+    size_t fs_size;
+};
+
+int flash_area_open(uint8_t id, const flash_area** fa);
+void flash_area_close(const flash_area* fa);
+int flash_area_read(const flash_area* fa, off_t off, void* dst, size_t len);
+int flash_area_write(const flash_area* fa, off_t off, const void* src, size_t len);
+int flash_area_erase(const flash_area* fa, off_t off, size_t len);
+uint8_t flash_area_align(const flash_area* fa);
+int flash_area_get_sectors(int fa_id, uint32_t* count, flash_sector* sectors);
+
+#endif
@@ -0,0 +1,285 @@
+#ifndef STUB_STUB_HPP
+#define STUB_STUB_HPP
+
+// Controls and counters of the host stand-ins, for tests and benchmarks only
+
+#include <zephyr.h>
+#include <bluetooth/conn.h>
+#include <storage/flash_map.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace stub {
+
+// Stand-ins allocate through malloc, so the benchmark's operator new only counts the code under test
+template<typename T>
+struct malloc_allocator_t {
+    using value_type = T;
+
+    malloc_allocator_t() = default;
+    template<typename U>
+    malloc_allocator_t(const malloc_allocator_t<U>&) {}
+
+    T* allocate(size_t n) {
+        if(void* ptr = std::malloc(n * sizeof(T))) {
+            return static_cast<T*>(ptr);
+        }
+        throw std::bad_alloc();
+    }
+
+    void deallocate(T* ptr, size_t) {
+        std::free(ptr);
+    }
+
+    template<typename U>
+    bool operator==(const malloc_allocator_t<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const malloc_allocator_t<U>&) const { return false; }
+};
+
+using bytes_t = std::vector<uint8_t, malloc_allocator_t<uint8_t>>;
+
+// Virtual clock, see kernel.h
+
+int64_t now_us();
+
+// Runs every timer and work item due at or before us in deadline order, then sets the clock to us
+void run_until(int64_t us);
+
+// Runs what is due now, e.g. work submitted with K_NO_WAIT
+void drain();
+
+// Moves the clock without running anything, the CPU was busy for us
+void stall(int64_t us);
+
+size_t pending();
+
+// Forgets every timer and work item and restarts the clock at 0
+void reset_kernel();
+
+// Log
+
+size_t log_count(int level);
+void log_reset();
+
+// File system, see fs/fs.h
+
+struct fs_stats_t {
+    uint32_t opens;
+    uint32_t syncs;
+    uint32_t writes;
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+};
+
+void fs_reset();
+
+// Drops every unsynced change and invalidates every open file, as a reset would
+void fs_power_cut();
+
+// Stored contents of path, null when it does not exist
+bytes_t* fs_stored(const char* path);
+
+fs_stats_t& fs_stats();
+
+// Fails the next times fs_write() calls on path with err, until fs_reset()
+void fs_fail(const char* path, int err, uint32_t times = 1);
+
+// A change made durable, for models of the flash under the file system
+struct fs_change_t {
+    enum kind_e { COMMIT, RENAME, UNLINK } kind;
+    const char* path;
+    // RENAME: the new path
+    const char* to;
+    // COMMIT: the synced size and [lo, hi), the bytes written or truncated since the last commit
+    size_t size;
+    size_t lo;
+    size_t hi;
+};
+
+// Calls hook(change, ctx) on every change until fs_reset(), null stops it
+void fs_observe(void (*hook)(const fs_change_t& change, void* ctx), void* ctx);
+
+// Flash, laid out as the nRF52 DK MCUboot partitions with 4 KiB pages
+
+static constexpr size_t FLASH_PAGE_SIZE = 4096;
+static constexpr size_t FLASH_IMAGE_SIZE = 0x32000;
+static constexpr size_t FLASH_STORAGE_SIZE = 0x8000;
+
+// Time the CPU stalls per operation, nRF52832 datasheet maximums by default
+struct flash_timing_t {
+    uint32_t erase_page_us = 85000;
+    uint32_t write_word_us = 41;
+};
+
+struct flash_stats_t {
+    uint32_t erases;
+    uint32_t bytes_written;
+    uint32_t bytes_read;
+    uint64_t busy_us;
+    std::vector<uint32_t, malloc_allocator_t<uint32_t>> page_erases;
+};
+
+// Erases every area and clears the counters
+void flash_reset();
+
+void flash_set_timing(const flash_timing_t& timing);
+
+bytes_t& flash_contents(uint8_t id);
+
+flash_stats_t& flash_stats(uint8_t id);
+
+// GPIO, the controllers GPIO_0 and GPIO_1 with raw levels in out
+
+static constexpr size_t GPIO_NUM_PORTS = 2;
+
+struct gpio_port_t {
+    uint32_t out;
+    uint32_t outputs;
+    uint32_t flags[32];
+    // Calls into the driver's function table, the register writes on target
+    uint32_t writes;
+    uint32_t configures;
+};
+
+// Clears every port and the binding count
+void gpio_reset();
+
+gpio_port_t& gpio_port(size_t index);
+
+// Calls to device_get_binding()
+uint32_t device_lookups();
+
+// SAADC, RTC2, EGU3 and PPI, see nrfx.h, and the ADC driver over them, see drivers/adc.h
+
+// Value the SAADC converts from input, an nrf_saadc_input_t, as the nth conversion overall
+using saadc_input_t = int16_t (*)(uint8_t input, uint32_t n);
+
+struct saadc_stats_t {
+    // SAMPLE tasks that converted, each covers every connected channel
+    uint32_t samplings;
+    uint32_t starts;
+    uint32_t reads;
+    uint32_t channel_setups;
+    // END events with the driver's interrupt enabled, its ISR would have stopped the SAADC
+    uint32_t driver_irqs;
+    // adc_read() calls while the SAADC or its pacing RTC was running for someone else
+    uint32_t collisions;
+};
+
+// Clears the peripherals, PPI channels, interrupts and counters, converting 0 until set
+void saadc_reset();
+
+void saadc_set_input(saadc_input_t fn);
+
+saadc_stats_t& saadc_stats();
+
+bool saadc_enabled();
+
+uint32_t saadc_int_enabled();
+
+size_t ppi_channels_enabled();
+
+size_t ppi_channels_allocated();
+
+bool rtc_running();
+
+// Bluetooth, a controller and its peers on the virtual clock, see bluetooth/bluetooth.h
+
+struct bt_timing_t {
+    // bt_enable() calls back once the controller is up after this long, at once when 0
+    uint32_t enable_us = 0;
+    // Parameter, PHY and data length procedures complete after this long
+    uint32_t update_us = 30000;
+    // Notifications acknowledged per connection event
+    uint32_t notify_per_event = 4;
+    // Link settings a peer connects with, the peer picks interval_max from a parameter request
+    uint16_t connect_interval = 24;
+    uint16_t connect_latency = 0;
+    uint16_t connect_timeout = 400;
+    // Links the controller accepts before connectable advertising fails with -ENOMEM
+    size_t max_links = CONFIG_BT_MAX_CONN;
+};
+
+// Event counts integrate the time spent in each state up to the last stub::bt_stats() call
+struct bt_stats_t {
+    uint32_t adv_starts;
+    uint32_t adv_updates;
+    uint32_t adv_stops;
+    uint32_t adv_param_updates;
+    uint64_t adv_us;
+    // One per interval plus the 0-10 ms advDelay, 5 ms on average
+    uint64_t adv_events;
+    uint32_t connections;
+    uint32_t disconnections;
+    // Summed over links
+    uint64_t connected_us;
+    // Events the peripheral listens to, every interval * (latency + 1) on an idle link
+    uint64_t conn_events;
+    uint32_t param_requests;
+    uint32_t phy_requests;
+    uint32_t data_len_requests;
+    uint32_t notifications;
+    uint32_t name_sets;
+    uint32_t battery_sets;
+};
+
+enum class bt_op_e : uint8_t {
+    ADV_START,
+    ADV_UPDATE,
+    PARAM_UPDATE,
+    PHY_UPDATE,
+    DATA_LEN_UPDATE,
+    NOTIFY,
+    NUM_OPS
+};
+
+struct bt_link_t {
+    bool connected;
+    uint16_t interval;
+    uint16_t latency;
+    uint16_t timeout;
+    uint8_t tx_phy;
+    uint16_t tx_max_len;
+    bool subscribed;
+};
+
+// Disables the stack and clears the links, counters and name, registered callbacks stay
+void bt_reset();
+
+void bt_set_timing(const bt_timing_t& timing);
+
+bt_stats_t& bt_stats();
+
+// The next times calls of op return err instead of running
+void bt_fail(bt_op_e op, int err, uint32_t times = 1);
+
+bool bt_advertising();
+
+// Interval of the running advertising set, 0.625 ms units
+uint32_t bt_adv_interval();
+
+// Field of type from the advertising or scan response data last handed to the controller
+bool bt_adv_field(uint8_t type, bytes_t& out);
+
+// A peer connects to connectable advertising and the connected callbacks run, null when the
+// tag is not connectable. The returned reference belongs to the peer until bt_disconnect().
+bt_conn* bt_connect();
+
+void bt_disconnect(bt_conn* conn, uint8_t reason = BT_HCI_ERR_REMOTE_USER_TERM_CONN);
+
+void bt_subscribe(bt_conn* conn, bool on);
+
+bt_link_t bt_link(const bt_conn* conn);
+
+size_t bt_links();
+
+uint8_t bt_battery_level();
+
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef STUB_SYS_ASSERT_H
+#define STUB_SYS_ASSERT_H
+
+#include <cstdio>
+#include <cstdlib>
+
+#define __ASSERT(test, fmt, ...) \
+    do { \
+        if(!(test)) { \
+            std::fprintf(stderr, "ASSERTION FAIL [%s] @ %s:%d\n", #test, __FILE__, __LINE__); \
+            std::abort(); \
+        } \
+    } while(0)
+
+#define __ASSERT_NO_MSG(test) __ASSERT(test, "")
+
+#endif
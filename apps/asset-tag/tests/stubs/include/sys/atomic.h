@@ -0,0 +1,86 @@
+#ifndef STUB_SYS_ATOMIC_H
+#define STUB_SYS_ATOMIC_H
+
+#include <sys/util.h>
+
+#include <cstddef>
+
+typedef long atomic_t;
+typedef atomic_t atomic_val_t;
+
+#define ATOMIC_INIT(i) (i)
+#define ATOMIC_BITS (sizeof(atomic_val_t) * 8)
+#define ATOMIC_BITMAP_SIZE(num_bits) (1 + ((num_bits) - 1) / ATOMIC_BITS)
+#define ATOMIC_DEFINE(name, num_bits) atomic_t name[ATOMIC_BITMAP_SIZE(num_bits)]
+
+static inline bool atomic_cas(atomic_t* target, atomic_val_t old_value, atomic_val_t new_value) {
+    return __atomic_compare_exchange_n(target, &old_value, new_value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_add(atomic_t* target, atomic_val_t value) {
+    return __atomic_fetch_add(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_sub(atomic_t* target, atomic_val_t value) {
+    return __atomic_fetch_sub(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_inc(atomic_t* target) {
+    return atomic_add(target, 1);
+}
+
+static inline atomic_val_t atomic_dec(atomic_t* target) {
+    return atomic_sub(target, 1);
+}
+
+static inline atomic_val_t atomic_get(const atomic_t* target) {
+    return __atomic_load_n(target, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_set(atomic_t* target, atomic_val_t value) {
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_clear(atomic_t* target) {
+    return atomic_set(target, 0);
+}
+
+static inline atomic_val_t atomic_or(atomic_t* target, atomic_val_t value) {
+    return __atomic_fetch_or(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline atomic_val_t atomic_and(atomic_t* target, atomic_val_t value) {
+    return __atomic_fetch_and(target, value, __ATOMIC_SEQ_CST);
+}
+
+static inline bool atomic_test_bit(const atomic_t* target, int bit) {
+    return (atomic_get(&target[bit / ATOMIC_BITS]) >> (bit % ATOMIC_BITS)) & 1;
+}
+
+static inline bool atomic_test_and_set_bit(atomic_t* target, int bit) {
+    const atomic_val_t mask = 1L << (bit % ATOMIC_BITS);
+    return atomic_or(&target[bit / ATOMIC_BITS], mask) & mask;
+}
+
+static inline bool atomic_test_and_clear_bit(atomic_t* target, int bit) {
+    const atomic_val_t mask = 1L << (bit % ATOMIC_BITS);
+    return atomic_and(&target[bit / ATOMIC_BITS], ~mask) & mask;
+}
+
+static inline void atomic_set_bit(atomic_t* target, int bit) {
+    (void) atomic_test_and_set_bit(target, bit);
+}
+
+static inline void atomic_clear_bit(atomic_t* target, int bit) {
+    (void) atomic_test_and_clear_bit(target, bit);
+}
+
+static inline void atomic_set_bit_to(atomic_t* target, int bit, bool value) {
+    if(value) {
+        atomic_set_bit(target, bit);
+    } else {
+        atomic_clear_bit(target, bit);
+    }
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef STUB_SYS_BYTEORDER_H
+#define STUB_SYS_BYTEORDER_H
+
+#include <cstdint>
+
+static inline uint16_t sys_get_le16(const uint8_t* src) {
+    return static_cast<uint16_t>(src[0] | (src[1] << 8));
+}
+
+static inline uint32_t sys_get_le32(const uint8_t* src) {
+    return sys_get_le16(src) | (static_cast<uint32_t>(sys_get_le16(src + 2)) << 16);
+}
+
+static inline uint64_t sys_get_le64(const uint8_t* src) {
+    return sys_get_le32(src) | (static_cast<uint64_t>(sys_get_le32(src + 4)) << 32);
+}
+
+static inline uint16_t sys_get_be16(const uint8_t* src) {
+    return static_cast<uint16_t>((src[0] << 8) | src[1]);
+}
+
+static inline uint32_t sys_get_be32(const uint8_t* src) {
+    return (static_cast<uint32_t>(sys_get_be16(src)) << 16) | sys_get_be16(src + 2);
+}
+
+static inline void sys_put_le16(uint16_t value, uint8_t* dst) {
+    dst[0] = static_cast<uint8_t>(value);
+    dst[1] = static_cast<uint8_t>(value >> 8);
+}
+
+static inline void sys_put_le32(uint32_t value, uint8_t* dst) {
+    sys_put_le16(static_cast<uint16_t>(value), dst);
+    sys_put_le16(static_cast<uint16_t>(value >> 16), dst + 2);
+}
+
+static inline void sys_put_le64(uint64_t value, uint8_t* dst) {
+    sys_put_le32(static_cast<uint32_t>(value), dst);
+    sys_put_le32(static_cast<uint32_t>(value >> 32), dst + 4);
+}
+
+static inline void sys_put_be16(uint16_t value, uint8_t* dst) {
+    dst[0] = static_cast<uint8_t>(value >> 8);
+    dst[1] = static_cast<uint8_t>(value);
+}
+
+static inline void sys_put_be32(uint32_t value, uint8_t* dst) {
+    sys_put_be16(static_cast<uint16_t>(value >> 16), dst);
+    sys_put_be16(static_cast<uint16_t>(value), dst + 2);
+}
+
+#define sys_cpu_to_le16(x) (x)
+#define sys_cpu_to_le32(x) (x)
+#define sys_le16_to_cpu(x) (x)
+#define sys_le32_to_cpu(x) (x)
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef STUB_SYS_CRC_H
+#define STUB_SYS_CRC_H
+
+#include <cstddef>
+#include <cstdint>
+
+uint32_t crc32_ieee(const uint8_t* data, size_t len);
+uint32_t crc32_ieee_update(uint32_t crc, const uint8_t* data, size_t len);
+uint16_t crc16_ccitt(uint16_t seed, const uint8_t* src, size_t len);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef STUB_SYS_RING_BUFFER_H
+#define STUB_SYS_RING_BUFFER_H
+
+// Zephyr 2.4 byte mode ring buffer, one producer and one consumer
+
+#include <sys/atomic.h>
+
+#include <algorithm>
+#include <cstdint>
+
+struct ring_buf {
+    atomic_t head;
+    atomic_t tail;
+    uint32_t size;
+    uint8_t* data;
+};
+
+static inline void ring_buf_init(ring_buf* buf, uint32_t size, void* data) {
+    buf->head = 0;
+    buf->tail = 0;
+    buf->size = size;
+    buf->data = static_cast<uint8_t*>(data);
+}
+
+static inline uint32_t ring_buf_space_get(ring_buf* buf) {
+    return buf->size - static_cast<uint32_t>(atomic_get(&buf->tail) - atomic_get(&buf->head));
+}
+
+static inline uint32_t ring_buf_put(ring_buf* buf, const uint8_t* data, uint32_t size) {
+    size = std::min(size, ring_buf_space_get(buf));
+    const atomic_val_t tail = atomic_get(&buf->tail);
+    for(uint32_t i = 0; i < size; i++) {
+        buf->data[(tail + i) % buf->size] = data[i];
+    }
+    atomic_set(&buf->tail, tail + size);
+    return size;
+}
+
+static inline uint32_t ring_buf_get(ring_buf* buf, uint8_t* data, uint32_t size) {
+    const atomic_val_t head = atomic_get(&buf->head);
+    size = std::min(size, static_cast<uint32_t>(atomic_get(&buf->tail) - head));
+    for(uint32_t i = 0; i < size; i++) {
+        data[i] = buf->data[(head + i) % buf->size];
+    }
+    atomic_set(&buf->head, head + size);
+    return size;
+}
+
+#endif
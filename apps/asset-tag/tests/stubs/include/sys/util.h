@@ -0,0 +1,31 @@
+#ifndef STUB_SYS_UTIL_H
+#define STUB_SYS_UTIL_H
+
+#include <cstddef>
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+#define CONTAINER_OF(ptr, type, field) ((type*) (((char*) (ptr)) - offsetof(type, field)))
+#define BIT(n) (1UL << (n))
+#define ROUND_UP(x, align) ((((x) + (align) - 1) / (align)) * (align))
+#define ROUND_DOWN(x, align) (((x) / (align)) * (align))
+
+// 1 when config_macro is defined to 1, 0 when it is undefined, as Kconfig options are
+#define IS_ENABLED(config_macro) Z_IS_ENABLED1(config_macro)
+#define Z_IS_ENABLED1(config_macro) Z_IS_ENABLED2(_XXXX##config_macro)
+#define _XXXX1 _YYYY,
+#define Z_IS_ENABLED2(one_or_two_args) Z_IS_ENABLED3(one_or_two_args 1, 0)
+#define Z_IS_ENABLED3(ignore_this, val, ...) val
+
+#define ARG_UNUSED(x) (void) (x)
+#define __noinit
+#define __packed __attribute__((__packed__))
+#define __aligned(x) __attribute__((__aligned__(x)))
+
+#endif
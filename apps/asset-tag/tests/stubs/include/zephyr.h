@@ -0,0 +1,6 @@
+#ifndef STUB_ZEPHYR_H
+#define STUB_ZEPHYR_H
+
+#include <kernel.h>
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef STUB_ZEPHYR_TYPES_H
+#define STUB_ZEPHYR_TYPES_H
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef STUB_ZTEST_H
+#define STUB_ZTEST_H
+
+// The ztest API subset the unit tests use, so they also build as a native_posix ztest suite
+
+#include <zephyr.h>
+
+#include <cstddef>
+#include <cstring>
+
+struct unit_test {
+    const char* name;
+    void (*test)(void);
+    void (*setup)(void);
+    void (*teardown)(void);
+};
+
+static inline void unit_test_noop(void) {}
+
+void test_main(void);
+void z_ztest_run_test_suite(const char* name, const unit_test* suite);
+void z_zassert(bool cond, const char* default_msg, const char* file, int line, const char* func,
+        const char* msg, ...);
+
+#define ztest_unit_test_setup_teardown(fn, setup, teardown) { #fn, fn, setup, teardown }
+#define ztest_unit_test(fn) ztest_unit_test_setup_teardown(fn, unit_test_noop, unit_test_noop)
+#define ztest_test_suite(suite, ...) static const unit_test _##suite[] = { __VA_ARGS__, { nullptr } }
+#define ztest_run_test_suite(suite) z_ztest_run_test_suite(#suite, _##suite)
+
+#define zassert(cond, default_msg, msg, ...) \
+    z_zassert(cond, default_msg, __FILE__, __LINE__, __func__, msg, ##__VA_ARGS__)
+
+#define zassert_unreachable(msg, ...) zassert(false, "Reached unreachable code", msg, ##__VA_ARGS__)
+#define zassert_true(cond, msg, ...) zassert(cond, #cond " is false", msg, ##__VA_ARGS__)
+#define zassert_false(cond, msg, ...) zassert(!(cond), #cond " is true", msg, ##__VA_ARGS__)
+#define zassert_ok(cond, msg, ...) zassert(!(cond), #cond " is non-zero", msg, ##__VA_ARGS__)
+#define zassert_is_null(ptr, msg, ...) zassert((ptr) == NULL, #ptr " is not NULL", msg, ##__VA_ARGS__)
+#define zassert_not_null(ptr, msg, ...) zassert((ptr) != NULL, #ptr " is NULL", msg, ##__VA_ARGS__)
+#define zassert_equal(a, b, msg, ...) zassert((a) == (b), #a " not equal to " #b, msg, ##__VA_ARGS__)
+#define zassert_not_equal(a, b, msg, ...) zassert((a) != (b), #a " equal to " #b, msg, ##__VA_ARGS__)
+#define zassert_within(a, b, d, msg, ...) \
+    zassert(((a) >= ((b) - (d))) && ((a) <= ((b) + (d))), #a " not within " #b " +/- " #d, msg, ##__VA_ARGS__)
+#define zassert_mem_equal(buf, exp, size, msg, ...) \
+    zassert(std::memcmp(buf, exp, size) == 0, #buf " not equal to " #exp, msg, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,656 @@
+#include <stub.hpp>
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+#include <bluetooth/services/bas.h>
+#include <sys/__assert.h>
+
+#include <algorithm>
+#include <cstring>
+
+// Driven from the thread running the virtual clock, like the BT RX thread on target
+
+const bt_conn_le_phy_param stub_bt_phy_param_2m = { 0, BT_GAP_LE_PHY_2M, BT_GAP_LE_PHY_2M };
+const bt_conn_le_data_len_param stub_bt_data_len_param_max = { BT_GAP_DATA_LEN_MAX, BT_GAP_DATA_TIME_MAX };
+
+struct bt_conn {
+    uint32_t refs;
+    bool connected;
+    stub::bt_link_t link;
+    uint16_t rx_phy;
+    uint16_t rx_max_len;
+    int64_t phase_us;
+
+    bt_le_conn_param requested_param;
+    bt_conn_le_phy_param requested_phy;
+    bt_conn_le_data_len_param requested_len;
+    k_timer param_timer;
+    k_timer phy_timer;
+    k_timer len_timer;
+
+    struct notify_t {
+        bt_gatt_complete_func_t func;
+        void* user_data;
+    };
+    notify_t in_flight[24];
+    size_t num_in_flight;
+    k_timer tx_timer;
+};
+
+struct bt_le_ext_adv {
+    bool created;
+    bt_le_adv_param param;
+};
+
+namespace {
+
+constexpr size_t MAX_CONNS = 4;
+constexpr uint16_t ATT_MTU = 247;
+
+struct controller_t {
+    bool enabled;
+    bt_ready_cb_t ready_cb;
+    k_timer enable_timer;
+    char name[CONFIG_BT_DEVICE_NAME_MAX + 1];
+    uint8_t battery_level;
+
+    bool advertising;
+    bool connectable;
+    uint32_t interval;
+    int64_t adv_phase_us;
+    stub::bytes_t ad;
+    stub::bytes_t sd;
+
+    int64_t settled_us;
+    stub::bt_timing_t timing;
+    stub::bt_stats_t stats;
+    int fail_err[static_cast<size_t>(stub::bt_op_e::NUM_OPS)];
+    uint32_t fail_times[static_cast<size_t>(stub::bt_op_e::NUM_OPS)];
+
+    bt_conn_cb* callbacks;
+    bt_conn conns[MAX_CONNS];
+    bt_le_ext_adv set;
+};
+
+controller_t ctlr;
+
+void reset_name() {
+    std::strncpy(ctlr.name, CONFIG_BT_DEVICE_NAME, sizeof(ctlr.name) - 1);
+    ctlr.name[sizeof(ctlr.name) - 1] = '\0';
+}
+
+const bool name_initialized = (reset_name(), true);
+
+int injected(stub::bt_op_e op) {
+    const size_t index = static_cast<size_t>(op);
+    if(ctlr.fail_times[index] == 0) {
+        return 0;
+    }
+    ctlr.fail_times[index]--;
+    return ctlr.fail_err[index];
+}
+
+int64_t adv_period_us() {
+    return int64_t{ctlr.interval} * 625 + 5000;
+}
+
+int64_t conn_period_us(const bt_conn& conn) {
+    return int64_t{conn.link.interval} * 1250 * (conn.link.latency + 1);
+}
+
+// Integrates advertising and connection events up to now, before any of their rates change
+void settle() {
+    const int64_t now = stub::now_us();
+    const int64_t elapsed = now - ctlr.settled_us;
+    ctlr.settled_us = now;
+    if(elapsed <= 0) {
+        return;
+    }
+
+    if(ctlr.advertising) {
+        ctlr.stats.adv_us += elapsed;
+        ctlr.adv_phase_us += elapsed;
+        ctlr.stats.adv_events += ctlr.adv_phase_us / adv_period_us();
+        ctlr.adv_phase_us %= adv_period_us();
+    }
+    for(bt_conn& conn : ctlr.conns) {
+        if(conn.connected) {
+            ctlr.stats.connected_us += elapsed;
+            conn.phase_us += elapsed;
+            ctlr.stats.conn_events += conn.phase_us / conn_period_us(conn);
+            conn.phase_us %= conn_period_us(conn);
+        }
+    }
+}
+
+void store(stub::bytes_t& out, const bt_data* data, size_t len) {
+    out.clear();
+    for(size_t i = 0; i < len; i++) {
+        out.push_back(data[i].data_len + 1);
+        out.push_back(data[i].type);
+        out.insert(out.end(), data[i].data, data[i].data + data[i].data_len);
+    }
+}
+
+size_t encoded_size(const bt_data* data, size_t len) {
+    size_t size = 0;
+    for(size_t i = 0; i < len; i++) {
+        size += 2 + data[i].data_len;
+    }
+    return size;
+}
+
+bool find_field(const stub::bytes_t& data, uint8_t type, stub::bytes_t& out) {
+    for(size_t i = 0; i + 1 < data.size(); i += 1 + data[i]) {
+        if(data[i + 1] == type) {
+            out.assign(data.begin() + i + 2, data.begin() + i + 1 + data[i]);
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t count_links() {
+    return std::count_if(std::begin(ctlr.conns), std::end(ctlr.conns), [](const bt_conn& conn) {
+        return conn.connected;
+    });
+}
+
+template<typename TFN>
+void for_each_callback(TFN&& fn) {
+    for(bt_conn_cb* cb = ctlr.callbacks; cb; cb = cb->_next) {
+        fn(*cb);
+    }
+}
+
+void param_done(k_timer* timer) {
+    bt_conn* conn = CONTAINER_OF(timer, bt_conn, param_timer);
+    if(!conn->connected) {
+        return;
+    }
+    settle();
+    conn->link.interval = conn->requested_param.interval_max;
+    conn->link.latency = conn->requested_param.latency;
+    conn->link.timeout = conn->requested_param.timeout;
+    for_each_callback([&](bt_conn_cb& cb) {
+        if(cb.le_param_updated) {
+            cb.le_param_updated(conn, conn->link.interval, conn->link.latency, conn->link.timeout);
+        }
+    });
+}
+
+void phy_done(k_timer* timer) {
+    bt_conn* conn = CONTAINER_OF(timer, bt_conn, phy_timer);
+    if(!conn->connected) {
+        return;
+    }
+    conn->link.tx_phy = conn->requested_phy.pref_tx_phy;
+    conn->rx_phy = conn->requested_phy.pref_rx_phy;
+    bt_conn_le_phy_info info = { conn->link.tx_phy, static_cast<uint8_t>(conn->rx_phy) };
+    for_each_callback([&](bt_conn_cb& cb) {
+        if(cb.le_phy_updated) {
+            cb.le_phy_updated(conn, &info);
+        }
+    });
+}
+
+void len_done(k_timer* timer) {
+    bt_conn* conn = CONTAINER_OF(timer, bt_conn, len_timer);
+    if(!conn->connected) {
+        return;
+    }
+    conn->link.tx_max_len = conn->requested_len.tx_max_len;
+    conn->rx_max_len = BT_GAP_DATA_LEN_MAX;
+    bt_conn_le_data_len_info info = {
+        conn->link.tx_max_len, conn->requested_len.tx_max_time, conn->rx_max_len, BT_GAP_DATA_TIME_MAX
+    };
+    for_each_callback([&](bt_conn_cb& cb) {
+        if(cb.le_data_len_updated) {
+            cb.le_data_len_updated(conn, &info);
+        }
+    });
+}
+
+// One connection event acknowledges the oldest notifications
+void tx_event(k_timer* timer) {
+    bt_conn* conn = CONTAINER_OF(timer, bt_conn, tx_timer);
+    const size_t count = std::min<size_t>(conn->num_in_flight, ctlr.timing.notify_per_event);
+    bt_conn::notify_t done[ARRAY_SIZE(conn->in_flight)];
+    std::copy(conn->in_flight, conn->in_flight + count, done);
+    std::copy(conn->in_flight + count, conn->in_flight + conn->num_in_flight, conn->in_flight);
+    conn->num_in_flight -= count;
+    if(conn->num_in_flight == 0) {
+        k_timer_stop(&conn->tx_timer);
+    }
+    for(size_t i = 0; i < count; i++) {
+        if(done[i].func) {
+            done[i].func(conn, done[i].user_data);
+        }
+    }
+}
+
+// Starts the one set the legacy and extended calls share
+int start_advertising(const bt_le_adv_param& param) {
+    const bool connectable = param.options & BT_LE_ADV_OPT_CONNECTABLE;
+    if(connectable && count_links() >= ctlr.timing.max_links) {
+        return -ENOMEM;
+    }
+    if(const int err = injected(stub::bt_op_e::ADV_START)) {
+        return err;
+    }
+
+    settle();
+    ctlr.advertising = true;
+    ctlr.connectable = connectable;
+    ctlr.interval = param.interval_min;
+    ctlr.adv_phase_us = 0;
+    ctlr.stats.adv_starts++;
+    // The first event goes out right away
+    ctlr.stats.adv_events++;
+    return 0;
+}
+
+void release(bt_conn* conn) {
+    k_timer_stop(&conn->param_timer);
+    k_timer_stop(&conn->phy_timer);
+    k_timer_stop(&conn->len_timer);
+    k_timer_stop(&conn->tx_timer);
+    conn->num_in_flight = 0;
+}
+
+void enable_done(k_timer*) {
+    ctlr.ready_cb(0);
+}
+
+}
+
+int bt_enable(bt_ready_cb_t cb) {
+    if(ctlr.enabled) {
+        return -EALREADY;
+    }
+    ctlr.enabled = true;
+    if(cb && ctlr.timing.enable_us) {
+        ctlr.ready_cb = cb;
+        k_timer_init(&ctlr.enable_timer, enable_done, nullptr);
+        k_timer_start(&ctlr.enable_timer, K_USEC(ctlr.timing.enable_us), K_NO_WAIT);
+    } else if(cb) {
+        cb(0);
+    }
+    return 0;
+}
+
+int bt_set_name(const char* name) {
+    if(std::strlen(name) > CONFIG_BT_DEVICE_NAME_MAX) {
+        return -ENOMEM;
+    }
+    std::strcpy(ctlr.name, name);
+    ctlr.stats.name_sets++;
+    return 0;
+}
+
+const char* bt_get_name(void) {
+    return ctlr.name;
+}
+
+int bt_le_adv_start(const bt_le_adv_param* param, const bt_data* ad, size_t ad_len,
+        const bt_data* sd, size_t sd_len) {
+    if(!ctlr.enabled) {
+        return -EAGAIN;
+    }
+    if(ctlr.advertising) {
+        return -EALREADY;
+    }
+    if(encoded_size(ad, ad_len) > BT_GAP_ADV_MAX_ADV_DATA_LEN || encoded_size(sd, sd_len) > BT_GAP_ADV_MAX_ADV_DATA_LEN) {
+        return -EINVAL;
+    }
+    if(const int err = start_advertising(*param)) {
+        return err;
+    }
+    store(ctlr.ad, ad, ad_len);
+    store(ctlr.sd, sd, sd_len);
+    return 0;
+}
+int bt_le_adv_update_data(const bt_data* ad, size_t ad_len, const bt_data* sd, size_t sd_len) {
+    if(!ctlr.advertising) {
+        return -EAGAIN;
+    }
+    if(encoded_size(ad, ad_len) > BT_GAP_ADV_MAX_ADV_DATA_LEN || encoded_size(sd, sd_len) > BT_GAP_ADV_MAX_ADV_DATA_LEN) {
+        return -EINVAL;
+    }
+    if(const int err = injected(stub::bt_op_e::ADV_UPDATE)) {
+        return err;
+    }
+    store(ctlr.ad, ad, ad_len);
+    store(ctlr.sd, sd, sd_len);
+    ctlr.stats.adv_updates++;
+    return 0;
+}
+
+int bt_le_adv_stop(void) {
+    if(ctlr.advertising) {
+        settle();
+        ctlr.advertising = false;
+        ctlr.stats.adv_stops++;
+    }
+    return 0;
+}
+
+int bt_le_ext_adv_create(const bt_le_adv_param* param, const bt_le_ext_adv_cb* cb, bt_le_ext_adv** adv) {
+    if(!ctlr.enabled) {
+        return -EAGAIN;
+    }
+    if(ctlr.set.created) {
+        return -ENOMEM;
+    }
+    ctlr.set.created = true;
+    ctlr.set.param = *param;
+    *adv = &ctlr.set;
+    return 0;
+}
+
+int bt_le_ext_adv_start(bt_le_ext_adv* adv, bt_le_ext_adv_start_param* param) {
+    if(!adv->created) {
+        return -EINVAL;
+    }
+    if(ctlr.advertising) {
+        return -EALREADY;
+    }
+    return start_advertising(adv->param);
+}
+
+int bt_le_ext_adv_stop(bt_le_ext_adv* adv) {
+    if(!adv->created) {
+        return -EINVAL;
+    }
+    return bt_le_adv_stop();
+}
+
+int bt_le_ext_adv_set_data(bt_le_ext_adv* adv, const bt_data* ad, size_t ad_len,
+        const bt_data* sd, size_t sd_len) {
+    if(!adv->created) {
+        return -EINVAL;
+    }
+    if(encoded_size(ad, ad_len) > BT_GAP_ADV_MAX_ADV_DATA_LEN || encoded_size(sd, sd_len) > BT_GAP_ADV_MAX_ADV_DATA_LEN) {
+        return -EINVAL;
+    }
+    if(const int err = injected(stub::bt_op_e::ADV_UPDATE)) {
+        return err;
+    }
+    store(ctlr.ad, ad, ad_len);
+    store(ctlr.sd, sd, sd_len);
+    ctlr.stats.adv_updates++;
+    return 0;
+}
+
+int bt_le_ext_adv_update_param(bt_le_ext_adv* adv, const bt_le_adv_param* param) {
+    if(!adv->created || ctlr.advertising) {
+        return -EINVAL;
+    }
+    adv->param = *param;
+    ctlr.stats.adv_param_updates++;
+    return 0;
+}
+
+// Registrations outlive stub::bt_reset() as they outlive the stack on target, so a test
+// registering the same callbacks again is a no-op
+void bt_conn_cb_register(bt_conn_cb* cb) {
+    for(bt_conn_cb* registered = ctlr.callbacks; registered; registered = registered->_next) {
+        if(registered == cb) {
+            return;
+        }
+    }
+    cb->_next = ctlr.callbacks;
+    ctlr.callbacks = cb;
+}
+
+bt_conn* bt_conn_ref(bt_conn* conn) {
+    conn->refs++;
+    return conn;
+}
+
+void bt_conn_unref(bt_conn* conn) {
+    __ASSERT(conn->refs > 0, "unbalanced bt_conn_unref");
+    conn->refs--;
+}
+
+int bt_conn_get_info(const bt_conn* conn, bt_conn_info* info) {
+    *info = bt_conn_info{};
+    info->type = BT_CONN_TYPE_LE;
+    info->role = BT_CONN_ROLE_SLAVE;
+    info->le.interval = conn->link.interval;
+    info->le.latency = conn->link.latency;
+    info->le.timeout = conn->link.timeout;
+    return 0;
+}
+
+int bt_conn_disconnect(bt_conn* conn, uint8_t reason) {
+    if(!conn->connected) {
+        return -ENOTCONN;
+    }
+    stub::bt_disconnect(conn, BT_HCI_ERR_LOCALHOST_TERM_CONN);
+    return 0;
+}
+
+int bt_conn_le_param_update(bt_conn* conn, const bt_le_conn_param* param) {
+    if(!conn->connected) {
+        return -ENOTCONN;
+    }
+    if(const int err = injected(stub::bt_op_e::PARAM_UPDATE)) {
+        return err;
+    }
+    ctlr.stats.param_requests++;
+    if(conn->link.interval >= param->interval_min && conn->link.interval <= param->interval_max
+            && conn->link.latency == param->latency && conn->link.timeout == param->timeout) {
+        return -EALREADY;
+    }
+    conn->requested_param = *param;
+    k_timer_start(&conn->param_timer, K_USEC(ctlr.timing.update_us), K_NO_WAIT);
+    return 0;
+}
+
+int bt_conn_le_phy_update(bt_conn* conn, const bt_conn_le_phy_param* param) {
+    if(!conn->connected) {
+        return -ENOTCONN;
+    }
+    if(const int err = injected(stub::bt_op_e::PHY_UPDATE)) {
+        return err;
+    }
+    ctlr.stats.phy_requests++;
+    conn->requested_phy = *param;
+    k_timer_start(&conn->phy_timer, K_USEC(ctlr.timing.update_us), K_NO_WAIT);
+    return 0;
+}
+
+int bt_conn_le_data_len_update(bt_conn* conn, const bt_conn_le_data_len_param* param) {
+    if(!conn->connected) {
+        return -ENOTCONN;
+    }
+    if(const int err = injected(stub::bt_op_e::DATA_LEN_UPDATE)) {
+        return err;
+    }
+    ctlr.stats.data_len_requests++;
+    conn->requested_len = *param;
+    k_timer_start(&conn->len_timer, K_USEC(ctlr.timing.update_us), K_NO_WAIT);
+    return 0;
+}
+
+ssize_t bt_gatt_attr_read(bt_conn* conn, const bt_gatt_attr* attr, void* buf, uint16_t buf_len,
+        uint16_t offset, const void* value, uint16_t value_len) {
+    if(offset > value_len) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+    }
+    const uint16_t len = std::min<uint16_t>(buf_len, value_len - offset);
+    std::memcpy(buf, static_cast<const uint8_t*>(value) + offset, len);
+    return len;
+}
+
+int bt_gatt_notify_cb(bt_conn* conn, bt_gatt_notify_params* params) {
+    if(!conn || !conn->connected) {
+        return -ENOTCONN;
+    }
+    if(!conn->link.subscribed) {
+        return -EINVAL;
+    }
+    if(const int err = injected(stub::bt_op_e::NOTIFY)) {
+        return err;
+    }
+    if(conn->num_in_flight == ARRAY_SIZE(conn->in_flight)) {
+        return -ENOMEM;
+    }
+    conn->in_flight[conn->num_in_flight++] = { params->func, params->user_data };
+    ctlr.stats.notifications++;
+    if(conn->num_in_flight == 1) {
+        const k_timeout_t interval = K_USEC(int64_t{conn->link.interval} * 1250);
+        k_timer_start(&conn->tx_timer, interval, interval);
+    }
+    return 0;
+}
+
+uint16_t bt_gatt_get_mtu(bt_conn* conn) {
+    return conn && conn->connected ? ATT_MTU : 0;
+}
+
+bool bt_gatt_is_subscribed(bt_conn* conn, const bt_gatt_attr* attr, uint16_t ccc_value) {
+    return conn && conn->connected && conn->link.subscribed;
+}
+
+uint8_t bt_bas_get_battery_level(void) {
+    return ctlr.battery_level;
+}
+
+int bt_bas_set_battery_level(uint8_t level) {
+    if(level > 100) {
+        return -EINVAL;
+    }
+    ctlr.battery_level = level;
+    ctlr.stats.battery_sets++;
+    return 0;
+}
+
+namespace stub {
+
+void bt_reset() {
+    k_timer_stop(&ctlr.enable_timer);
+    for(bt_conn& conn : ctlr.conns) {
+        release(&conn);
+    }
+    ctlr.enabled = false;
+    reset_name();
+    ctlr.battery_level = 100;
+    ctlr.advertising = false;
+    ctlr.connectable = false;
+    ctlr.interval = 0;
+    ctlr.adv_phase_us = 0;
+    ctlr.ad.clear();
+    ctlr.sd.clear();
+    ctlr.set = bt_le_ext_adv{};
+    ctlr.settled_us = now_us();
+    ctlr.timing = bt_timing_t{};
+    ctlr.stats = bt_stats_t{};
+    std::fill(std::begin(ctlr.fail_times), std::end(ctlr.fail_times), 0);
+    for(bt_conn& conn : ctlr.conns) {
+        conn = bt_conn{};
+    }
+}
+
+void bt_set_timing(const bt_timing_t& timing) {
+    ctlr.timing = timing;
+}
+
+bt_stats_t& bt_stats() {
+    settle();
+    return ctlr.stats;
+}
+
+void bt_fail(bt_op_e op, int err, uint32_t times) {
+    ctlr.fail_err[static_cast<size_t>(op)] = err;
+    ctlr.fail_times[static_cast<size_t>(op)] = times;
+}
+
+bool bt_advertising() {
+    return ctlr.advertising;
+}
+
+uint32_t bt_adv_interval() {
+    return ctlr.advertising ? ctlr.interval : 0;
+}
+
+bool bt_adv_field(uint8_t type, bytes_t& out) {
+    return find_field(ctlr.ad, type, out) || find_field(ctlr.sd, type, out);
+}
+
+bt_conn* bt_connect() {
+    if(!ctlr.advertising || !ctlr.connectable) {
+        return nullptr;
+    }
+    bt_conn* conn = std::find_if(std::begin(ctlr.conns), std::end(ctlr.conns), [](const bt_conn& c) {
+        return !c.connected && c.refs == 0;
+    });
+    if(conn == std::end(ctlr.conns)) {
+        return nullptr;
+    }
+
+    // Connectable advertising ends with the connection
+    settle();
+    ctlr.advertising = false;
+    *conn = bt_conn{};
+    conn->refs = 1;
+    conn->connected = true;
+    conn->link.connected = true;
+    conn->link.interval = ctlr.timing.connect_interval;
+    conn->link.latency = ctlr.timing.connect_latency;
+    conn->link.timeout = ctlr.timing.connect_timeout;
+    conn->link.tx_phy = BT_GAP_LE_PHY_1M;
+    conn->link.tx_max_len = BT_GAP_DATA_LEN_DEFAULT;
+    conn->rx_phy = BT_GAP_LE_PHY_1M;
+    conn->rx_max_len = BT_GAP_DATA_LEN_DEFAULT;
+    k_timer_init(&conn->param_timer, param_done, nullptr);
+    k_timer_init(&conn->phy_timer, phy_done, nullptr);
+    k_timer_init(&conn->len_timer, len_done, nullptr);
+    k_timer_init(&conn->tx_timer, tx_event, nullptr);
+    ctlr.stats.connections++;
+
+    for_each_callback([&](bt_conn_cb& cb) {
+        if(cb.connected) {
+            cb.connected(conn, 0);
+        }
+    });
+    return conn;
+}
+
+void bt_disconnect(bt_conn* conn, uint8_t reason) {
+    if(!conn->connected) {
+        return;
+    }
+    settle();
+    release(conn);
+    conn->connected = false;
+    conn->link.connected = false;
+    ctlr.stats.disconnections++;
+
+    for_each_callback([&](bt_conn_cb& cb) {
+        if(cb.disconnected) {
+            cb.disconnected(conn, reason);
+        }
+    });
+    bt_conn_unref(conn);
+}
+
+void bt_subscribe(bt_conn* conn, bool on) {
+    conn->link.subscribed = on;
+}
+
+bt_link_t bt_link(const bt_conn* conn) {
+    return conn->link;
+}
+
+size_t bt_links() {
+    return count_links();
+}
+
+uint8_t bt_battery_level() {
+    return ctlr.battery_level;
+}
+
+}
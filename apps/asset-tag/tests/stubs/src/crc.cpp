@@ -0,0 +1,25 @@
+#include <sys/crc.h>
+
+uint32_t crc32_ieee_update(uint32_t crc, const uint8_t* data, size_t len) {
+    crc = ~crc;
+    for(size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        for(int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+uint32_t crc32_ieee(const uint8_t* data, size_t len) {
+    return crc32_ieee_update(0, data, len);
+}
+
+uint16_t crc16_ccitt(uint16_t seed, const uint8_t* src, size_t len) {
+    for(; len > 0; len--) {
+        const uint8_t e = static_cast<uint8_t>(seed ^ *src++);
+        const uint8_t f = static_cast<uint8_t>(e ^ (e << 4));
+        seed = static_cast<uint16_t>((seed >> 8) ^ (f << 8) ^ (f << 3) ^ (f >> 4));
+    }
+    return seed;
+}
@@ -0,0 +1,155 @@
+#include <storage/flash_map.h>
+#include <stub.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+namespace {
+
+struct area_t {
+    flash_area area;
+    stub::bytes_t data;
+    stub::flash_stats_t stats;
+};
+
+std::recursive_mutex lock;
+stub::flash_timing_t timing;
+
+area_t areas[] = {
+    { { 0, 0, 0, 0, 0, nullptr }, {}, {} },
+    { { FLASH_AREA_ID(image_0), 0, 0, 0xc000, stub::FLASH_IMAGE_SIZE, "NRF_FLASH_DRV_NAME" }, {}, {} },
+    { { FLASH_AREA_ID(image_1), 0, 0, 0x3e000, stub::FLASH_IMAGE_SIZE, "NRF_FLASH_DRV_NAME" }, {}, {} },
+    { { FLASH_AREA_ID(storage), 0, 0, 0x78000, stub::FLASH_STORAGE_SIZE, "NRF_FLASH_DRV_NAME" }, {}, {} },
+};
+
+area_t* find(uint8_t id) {
+    if(id == 0 || id >= ARRAY_SIZE(areas)) {
+        return nullptr;
+    }
+    area_t& a = areas[id];
+    if(a.data.empty()) {
+        a.data.assign(a.area.fa_size, 0xff);
+        a.stats.page_erases.assign(a.area.fa_size / stub::FLASH_PAGE_SIZE, 0);
+    }
+    return &a;
+}
+
+area_t* find(const flash_area* fa, off_t off, size_t len) {
+    area_t* a = fa ? find(fa->fa_id) : nullptr;
+    if(!a || off < 0 || static_cast<size_t>(off) + len > a->area.fa_size) {
+        return nullptr;
+    }
+    return a;
+}
+
+void busy(area_t* a, uint64_t us) {
+    a->stats.busy_us += us;
+    stub::stall(static_cast<int64_t>(us));
+}
+
+}
+
+namespace stub {
+
+void flash_reset() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    for(area_t& a : areas) {
+        a.data.clear();
+        a.stats = {};
+    }
+    timing = {};
+}
+
+void flash_set_timing(const flash_timing_t& value) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    timing = value;
+}
+
+bytes_t& flash_contents(uint8_t id) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return find(id)->data;
+}
+
+flash_stats_t& flash_stats(uint8_t id) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return find(id)->stats;
+}
+
+}
+
+int flash_area_open(uint8_t id, const flash_area** fa) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    area_t* a = find(id);
+    if(!a) {
+        return -ENOENT;
+    }
+    *fa = &a->area;
+    return 0;
+}
+
+void flash_area_close(const flash_area*) {}
+
+int flash_area_read(const flash_area* fa, off_t off, void* dst, size_t len) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    area_t* a = find(fa, off, len);
+    if(!a) {
+        return -EINVAL;
+    }
+    std::memcpy(dst, a->data.data() + off, len);
+    a->stats.bytes_read += len;
+    return 0;
+}
+
+// NOR flash only clears bits, a write over unerased bytes corrupts them like the real part
+int flash_area_write(const flash_area* fa, off_t off, const void* src, size_t len) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    area_t* a = find(fa, off, len);
+    if(!a || off % 4 || len % 4) {
+        return -EINVAL;
+    }
+    const auto* bytes = static_cast<const uint8_t*>(src);
+    for(size_t i = 0; i < len; i++) {
+        a->data[off + i] &= bytes[i];
+    }
+    a->stats.bytes_written += len;
+    busy(a, uint64_t{timing.write_word_us} * (len / 4));
+    return 0;
+}
+
+int flash_area_erase(const flash_area* fa, off_t off, size_t len) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    area_t* a = find(fa, off, len);
+    if(!a || off % stub::FLASH_PAGE_SIZE || len % stub::FLASH_PAGE_SIZE) {
+        return -EINVAL;
+    }
+    std::fill(a->data.begin() + off, a->data.begin() + off + len, 0xff);
+    for(size_t page = off / stub::FLASH_PAGE_SIZE; page < (off + len) / stub::FLASH_PAGE_SIZE; page++) {
+        a->stats.page_erases[page]++;
+        a->stats.erases++;
+    }
+    busy(a, uint64_t{timing.erase_page_us} * (len / stub::FLASH_PAGE_SIZE));
+    return 0;
+}
+
+uint8_t flash_area_align(const flash_area*) {
+    return 4;
+}
+
+int flash_area_get_sectors(int fa_id, uint32_t* count, flash_sector* sectors) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    area_t* a = find(static_cast<uint8_t>(fa_id));
+    if(!a) {
+        return -ENOENT;
+    }
+    const uint32_t pages = a->area.fa_size / stub::FLASH_PAGE_SIZE;
+    if(*count < pages) {
+        return -ENOMEM;
+    }
+    for(uint32_t i = 0; i < pages; i++) {
+        sectors[i] = { static_cast<off_t>(i * stub::FLASH_PAGE_SIZE), stub::FLASH_PAGE_SIZE };
+    }
+    *count = pages;
+    return 0;
+}
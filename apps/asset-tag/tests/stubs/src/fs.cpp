@@ -0,0 +1,373 @@
+#include <fs/fs.h>
+#include <stub.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+using string_t = std::basic_string<char, std::char_traits<char>, stub::malloc_allocator_t<char>>;
+
+struct node_t {
+    stub::bytes_t data;
+    bool dir = false;
+};
+
+struct handle_t {
+    std::shared_ptr<node_t> node;
+    string_t path;
+    stub::bytes_t data;
+    off_t position = 0;
+    bool dirty = false;
+    bool dead = false;
+    // Range changed since the last commit
+    size_t lo = SIZE_MAX;
+    size_t hi = 0;
+};
+
+struct dir_t {
+    std::vector<fs_dirent, stub::malloc_allocator_t<fs_dirent>> entries;
+    size_t next = 0;
+};
+
+std::recursive_mutex lock;
+std::map<string_t, std::shared_ptr<node_t>, std::less<string_t>,
+    stub::malloc_allocator_t<std::pair<const string_t, std::shared_ptr<node_t>>>> nodes;
+std::set<handle_t*, std::less<handle_t*>, stub::malloc_allocator_t<handle_t*>> handles;
+
+template<typename T, typename ... TARGS>
+T* create(TARGS&& ... args) {
+    return new (stub::malloc_allocator_t<T>().allocate(1)) T(std::forward<TARGS>(args)...);
+}
+
+template<typename T>
+void destroy(T* ptr) {
+    ptr->~T();
+    stub::malloc_allocator_t<T>().deallocate(ptr, 1);
+}
+
+std::shared_ptr<node_t> make_node() {
+    return std::allocate_shared<node_t>(stub::malloc_allocator_t<node_t>());
+}
+stub::fs_stats_t stats = {};
+void (*observer)(const stub::fs_change_t&, void*) = nullptr;
+void* observer_ctx = nullptr;
+
+string_t fail_path;
+int fail_err = 0;
+uint32_t fail_times = 0;
+
+void notify(const stub::fs_change_t& change) {
+    if(observer) {
+        observer(change, observer_ctx);
+    }
+}
+
+handle_t* handle(fs_file_t* zfp) {
+    return static_cast<handle_t*>(zfp->filep);
+}
+
+void commit(handle_t* h) {
+    h->node->data = h->data;
+    h->dirty = false;
+    stats.syncs++;
+    notify({ stub::fs_change_t::COMMIT, h->path.c_str(), nullptr, h->data.size(), std::min(h->lo, h->hi), h->hi });
+    h->lo = SIZE_MAX;
+    h->hi = 0;
+}
+
+void touch(handle_t* h, size_t lo, size_t hi) {
+    h->lo = std::min(h->lo, lo);
+    h->hi = std::max(h->hi, hi);
+    h->dirty = true;
+}
+
+const char* basename(const string_t& path) {
+    const size_t slash = path.rfind('/');
+    return path.c_str() + (slash == std::string::npos ? 0 : slash + 1);
+}
+
+}
+
+namespace stub {
+
+void fs_reset() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    for(handle_t* h : handles) {
+        h->dead = true;
+    }
+    handles.clear();
+    nodes.clear();
+    stats = {};
+    observer = nullptr;
+    fail_times = 0;
+}
+
+void fs_power_cut() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    for(handle_t* h : handles) {
+        h->dead = true;
+    }
+    handles.clear();
+}
+
+bytes_t* fs_stored(const char* path) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    auto it = nodes.find(path);
+    return it == nodes.end() ? nullptr : &it->second->data;
+}
+
+fs_stats_t& fs_stats() {
+    return stats;
+}
+
+void fs_fail(const char* path, int err, uint32_t times) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    fail_path = path;
+    fail_err = err;
+    fail_times = times;
+}
+
+void fs_observe(void (*hook)(const fs_change_t& change, void* ctx), void* ctx) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    observer = hook;
+    observer_ctx = ctx;
+}
+
+}
+
+int fs_mount(fs_mount_t*) {
+    return 0;
+}
+
+int fs_unmount(fs_mount_t*) {
+    return 0;
+}
+
+int fs_open(fs_file_t* zfp, const char* file_name, fs_mode_t flags) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    auto it = nodes.find(file_name);
+    if(it == nodes.end()) {
+        if(!(flags & FS_O_CREATE)) {
+            return -ENOENT;
+        }
+        it = nodes.emplace(file_name, make_node()).first;
+    } else if(it->second->dir) {
+        return -EISDIR;
+    }
+
+    auto* h = create<handle_t>();
+    h->node = it->second;
+    h->path = it->first;
+    h->data = h->node->data;
+    if(flags & FS_O_APPEND) {
+        h->position = static_cast<off_t>(h->data.size());
+    }
+    handles.insert(h);
+    zfp->filep = h;
+    stats.opens++;
+    return 0;
+}
+
+int fs_close(fs_file_t* zfp) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    handle_t* h = handle(zfp);
+    if(!h) {
+        return -EINVAL;
+    }
+    if(!h->dead && h->dirty) {
+        commit(h);
+    }
+    handles.erase(h);
+    destroy(h);
+    zfp->filep = nullptr;
+    return 0;
+}
+
+ssize_t fs_read(fs_file_t* zfp, void* ptr, size_t size) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    handle_t* h = handle(zfp);
+    if(!h || h->dead) {
+        return -EIO;
+    }
+    const size_t end = h->data.size();
+    const size_t start = std::min(static_cast<size_t>(h->position), end);
+    const size_t count = std::min(size, end - start);
+    std::memcpy(ptr, h->data.data() + start, count);
+    h->position = static_cast<off_t>(start + count);
+    stats.bytes_read += count;
+    return static_cast<ssize_t>(count);
+}
+
+ssize_t fs_write(fs_file_t* zfp, const void* ptr, size_t size) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    handle_t* h = handle(zfp);
+    if(!h || h->dead) {
+        return -EIO;
+    }
+    if(fail_times > 0 && h->path == fail_path) {
+        fail_times--;
+        return fail_err;
+    }
+    const size_t start = static_cast<size_t>(h->position);
+    if(h->data.size() < start + size) {
+        h->data.resize(start + size, 0);
+    }
+    std::memcpy(h->data.data() + start, ptr, size);
+    h->position = static_cast<off_t>(start + size);
+    touch(h, start, start + size);
+    stats.writes++;
+    stats.bytes_written += size;
+    return static_cast<ssize_t>(size);
+}
+
+int fs_seek(fs_file_t* zfp, off_t offset, int whence) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    handle_t* h = handle(zfp);
+    if(!h || h->dead) {
+        return -EIO;
+    }
+    off_t base = 0;
+    if(whence == FS_SEEK_CUR) {
+        base = h->position;
+    } else if(whence == FS_SEEK_END) {
+        base = static_cast<off_t>(h->data.size());
+    } else if(whence != FS_SEEK_SET) {
+        return -EINVAL;
+    }
+    if(base + offset < 0) {
+        return -EINVAL;
+    }
+    h->position = base + offset;
+    return 0;
+}
+
+off_t fs_tell(fs_file_t* zfp) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    handle_t* h = handle(zfp);
+    if(!h || h->dead) {
+        return -EIO;
+    }
+    return h->position;
+}
+
+int fs_truncate(fs_file_t* zfp, off_t length) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    handle_t* h = handle(zfp);
+    if(!h || h->dead) {
+        return -EIO;
+    }
+    const size_t size = h->data.size();
+    h->data.resize(static_cast<size_t>(length), 0);
+    touch(h, std::min(size, h->data.size()), std::max(size, h->data.size()));
+    return 0;
+}
+
+int fs_sync(fs_file_t* zfp) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    handle_t* h = handle(zfp);
+    if(!h || h->dead) {
+        return -EIO;
+    }
+    if(h->dirty) {
+        commit(h);
+    }
+    return 0;
+}
+
+int fs_stat(const char* path, fs_dirent* entry) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    auto it = nodes.find(path);
+    if(it == nodes.end()) {
+        return -ENOENT;
+    }
+    entry->type = it->second->dir ? FS_DIR_ENTRY_DIR : FS_DIR_ENTRY_FILE;
+    snprintf(entry->name, sizeof(entry->name), "%s", basename(it->first));
+    entry->size = it->second->data.size();
+    return 0;
+}
+
+int fs_unlink(const char* path) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if(!nodes.erase(path)) {
+        return -ENOENT;
+    }
+    notify({ stub::fs_change_t::UNLINK, path, nullptr, 0, 0, 0 });
+    return 0;
+}
+
+int fs_rename(const char* from, const char* to) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    auto it = nodes.find(from);
+    if(it == nodes.end()) {
+        return -ENOENT;
+    }
+    nodes[to] = it->second;
+    nodes.erase(from);
+    notify({ stub::fs_change_t::RENAME, from, to, 0, 0, 0 });
+    return 0;
+}
+
+int fs_mkdir(const char* path) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if(nodes.count(path)) {
+        return -EEXIST;
+    }
+    auto node = make_node();
+    node->dir = true;
+    nodes.emplace(path, node);
+    return 0;
+}
+
+int fs_statvfs(const char*, struct fs_statvfs* stat) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    size_t used = 0;
+    for(const auto& node : nodes) {
+        used += (node.second->data.size() + stub::FLASH_PAGE_SIZE - 1) / stub::FLASH_PAGE_SIZE + 1;
+    }
+    stat->f_bsize = stub::FLASH_PAGE_SIZE;
+    stat->f_frsize = stub::FLASH_PAGE_SIZE;
+    stat->f_blocks = stub::FLASH_STORAGE_SIZE / stub::FLASH_PAGE_SIZE;
+    stat->f_bfree = used > stat->f_blocks ? 0 : stat->f_blocks - used;
+    return 0;
+}
+
+int fs_opendir(fs_dir_t* zdp, const char* path) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    const string_t prefix = string_t(path) + "/";
+    auto* dir = create<dir_t>();
+    for(const auto& node : nodes) {
+        if(node.first.compare(0, prefix.size(), prefix) == 0 && node.first.find('/', prefix.size()) == string_t::npos) {
+            fs_dirent entry = {};
+            fs_stat(node.first.c_str(), &entry);
+            dir->entries.push_back(entry);
+        }
+    }
+    zdp->dirp = dir;
+    return 0;
+}
+
+int fs_readdir(fs_dir_t* zdp, fs_dirent* entry) {
+    auto* dir = static_cast<dir_t*>(zdp->dirp);
+    if(dir->next < dir->entries.size()) {
+        *entry = dir->entries[dir->next++];
+    } else {
+        entry->name[0] = '\0';
+    }
+    return 0;
+}
+
+int fs_closedir(fs_dir_t* zdp) {
+    destroy(static_cast<dir_t*>(zdp->dirp));
+    zdp->dirp = nullptr;
+    return 0;
+}
@@ -0,0 +1,119 @@
+#include <stub.hpp>
+
+#include <device.h>
+#include <drivers/gpio.h>
+
+#include <cstring>
+
+// The SAADC of stubs/src/nrf.cpp
+extern const device stub_adc_device;
+
+namespace {
+
+stub::gpio_port_t ports[stub::GPIO_NUM_PORTS];
+gpio_driver_data port_data[stub::GPIO_NUM_PORTS];
+uint32_t lookups;
+
+stub::gpio_port_t& port_of(const device* port) {
+    return *static_cast<stub::gpio_port_t*>(const_cast<void*>(port->config));
+}
+
+int pin_configure(const device* dev, gpio_pin_t pin, gpio_flags_t flags) {
+    if(pin >= 32) {
+        return -EINVAL;
+    }
+    stub::gpio_port_t& port = port_of(dev);
+    port.configures++;
+    port.flags[pin] = flags;
+    if(flags & GPIO_OUTPUT) {
+        port.outputs |= BIT(pin);
+        if(flags & GPIO_OUTPUT_INIT_HIGH) {
+            port.out |= BIT(pin);
+        } else if(flags & GPIO_OUTPUT_INIT_LOW) {
+            port.out &= ~BIT(pin);
+        }
+    } else {
+        port.outputs &= ~BIT(pin);
+    }
+    return 0;
+}
+
+int port_get_raw(const device* dev, gpio_port_value_t* value) {
+    *value = port_of(dev).out;
+    return 0;
+}
+
+int port_set_masked_raw(const device* dev, gpio_port_pins_t mask, gpio_port_value_t value) {
+    stub::gpio_port_t& port = port_of(dev);
+    port.writes++;
+    port.out = (port.out & ~mask) | (value & mask);
+    return 0;
+}
+
+int port_set_bits_raw(const device* dev, gpio_port_pins_t pins) {
+    stub::gpio_port_t& port = port_of(dev);
+    port.writes++;
+    port.out |= pins;
+    return 0;
+}
+
+int port_clear_bits_raw(const device* dev, gpio_port_pins_t pins) {
+    stub::gpio_port_t& port = port_of(dev);
+    port.writes++;
+    port.out &= ~pins;
+    return 0;
+}
+
+int port_toggle_bits(const device* dev, gpio_port_pins_t pins) {
+    stub::gpio_port_t& port = port_of(dev);
+    port.writes++;
+    port.out ^= pins;
+    return 0;
+}
+
+const gpio_driver_api api = {
+    pin_configure,
+    port_get_raw,
+    port_set_masked_raw,
+    port_set_bits_raw,
+    port_clear_bits_raw,
+    port_toggle_bits,
+};
+
+const device devices[stub::GPIO_NUM_PORTS] = {
+    { "GPIO_0", &ports[0], &api, &port_data[0] },
+    { "GPIO_1", &ports[1], &api, &port_data[1] },
+};
+
+}
+
+const device* device_get_binding(const char* name) {
+    lookups++;
+    for(const device& dev : devices) {
+        if(std::strcmp(dev.name, name) == 0) {
+            return &dev;
+        }
+    }
+    if(std::strcmp(stub_adc_device.name, name) == 0) {
+        return &stub_adc_device;
+    }
+    return nullptr;
+}
+
+namespace stub {
+
+void gpio_reset() {
+    std::memset(ports, 0, sizeof(ports));
+    std::memset(port_data, 0, sizeof(port_data));
+    lookups = 0;
+}
+
+gpio_port_t& gpio_port(size_t index) {
+    return ports[index];
+}
+
+uint32_t device_lookups() {
+    return lookups;
+}
+
+}
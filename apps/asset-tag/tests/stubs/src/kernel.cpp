@@ -0,0 +1,449 @@
+#include <zephyr.h>
+#include <stub.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+k_work_q k_sys_work_q;
+
+namespace {
+
+std::recursive_mutex lock;
+int64_t clock_us = 0;
+uint64_t next_order = 0;
+std::vector<k_work*, stub::malloc_allocator_t<k_work*>> works;
+std::vector<k_timer*, stub::malloc_allocator_t<k_timer*>> timers;
+
+template<typename TITEMS, typename T>
+void remove(TITEMS& items, T* item) {
+    items.erase(std::remove(items.begin(), items.end(), item), items.end());
+}
+
+template<typename TITEMS>
+auto earliest(const TITEMS& items, int64_t until) {
+    typename TITEMS::value_type found = nullptr;
+    for(auto* item : items) {
+        if(item->due_us <= until && (!found || item->due_us < found->due_us
+                || (item->due_us == found->due_us && item->order < found->order))) {
+            found = item;
+        }
+    }
+    return found;
+}
+
+template<typename TLOCK, typename TWAIT>
+int wait(TLOCK& guard, std::condition_variable& cv, k_timeout_t timeout, TWAIT&& ready, int busy) {
+    if(ready()) {
+        return 0;
+    }
+    if(K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+        return busy;
+    }
+    if(K_TIMEOUT_EQ(timeout, K_FOREVER)) {
+        cv.wait(guard, ready);
+        return 0;
+    }
+    return cv.wait_for(guard, std::chrono::microseconds(timeout.us), ready) ? 0 : -EAGAIN;
+}
+
+}
+
+namespace stub {
+
+int64_t now_us() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return clock_us;
+}
+
+void run_until(int64_t us) {
+    while(true) {
+        std::unique_lock<std::recursive_mutex> guard(lock);
+        k_work* work = earliest(works, us);
+        k_timer* timer = earliest(timers, us);
+        if(work && timer) {
+            if(timer->due_us < work->due_us || (timer->due_us == work->due_us && timer->order < work->order)) {
+                work = nullptr;
+            } else {
+                timer = nullptr;
+            }
+        }
+
+        if(work) {
+            clock_us = std::max(clock_us, work->due_us);
+            remove(works, work);
+            work->queued = false;
+            const k_work_handler_t handler = work->handler;
+            guard.unlock();
+            handler(work);
+        } else if(timer) {
+            clock_us = std::max(clock_us, timer->due_us);
+            timer->status++;
+            if(timer->period_us > 0) {
+                timer->due_us += timer->period_us;
+                timer->order = next_order++;
+            } else {
+                timer->active = false;
+                remove(timers, timer);
+            }
+            const k_timer_expiry_t expiry = timer->expiry_fn;
+            guard.unlock();
+            if(expiry) {
+                expiry(timer);
+            }
+        } else {
+            clock_us = std::max(clock_us, us);
+            return;
+        }
+    }
+}
+
+void drain() {
+    run_until(now_us());
+}
+
+void stall(int64_t us) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    clock_us += us;
+}
+
+size_t pending() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return works.size() + timers.size();
+}
+
+void reset_kernel() {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    for(k_work* work : works) {
+        work->queued = false;
+    }
+    for(k_timer* timer : timers) {
+        timer->active = false;
+    }
+    works.clear();
+    timers.clear();
+    clock_us = 0;
+}
+
+}
+
+int64_t k_uptime_get(void) {
+    return stub::now_us() / 1000;
+}
+
+uint32_t k_uptime_get_32(void) {
+    return static_cast<uint32_t>(k_uptime_get());
+}
+
+int64_t k_uptime_delta(int64_t* reftime) {
+    const int64_t now = k_uptime_get();
+    const int64_t delta = now - *reftime;
+    *reftime = now;
+    return delta;
+}
+
+uint32_t k_cycle_get_32(void) {
+    return static_cast<uint32_t>(stub::now_us() * (CONFIG_SYS_CLOCK_HW_CYCLES_PER_SEC / 1000000));
+}
+
+int32_t k_sleep(k_timeout_t timeout) {
+    if(K_TIMEOUT_EQ(timeout, K_FOREVER)) {
+        std::fprintf(stderr, "k_sleep(K_FOREVER) would never return\n");
+        std::abort();
+    }
+    stub::run_until(stub::now_us() + timeout.us);
+    return 0;
+}
+
+int32_t k_msleep(int32_t ms) {
+    return k_sleep(K_MSEC(ms));
+}
+
+int32_t k_usleep(int32_t us) {
+    return k_sleep(K_USEC(us));
+}
+
+void k_busy_wait(uint32_t usec_to_wait) {
+    stub::stall(usec_to_wait);
+}
+
+void k_yield(void) {
+    std::this_thread::yield();
+}
+
+k_tid_t k_thread_create(k_thread* thread, k_thread_stack_t*, size_t, k_thread_entry_t entry,
+        void* p1, void* p2, void* p3, int, uint32_t, k_timeout_t delay) {
+    {
+        std::lock_guard<std::mutex> guard(thread->mutex);
+        thread->running = true;
+    }
+    std::thread([=]() {
+        if(delay.us > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(delay.us));
+        }
+        entry(p1, p2, p3);
+        std::lock_guard<std::mutex> guard(thread->mutex);
+        thread->running = false;
+        thread->cv.notify_all();
+    }).detach();
+    return thread;
+}
+
+int k_thread_join(k_thread* thread, k_timeout_t timeout) {
+    std::unique_lock<std::mutex> guard(thread->mutex);
+    return wait(guard, thread->cv, timeout, [&]() { return !thread->running; }, -EBUSY);
+}
+
+int k_thread_name_set(k_tid_t thread, const char* name) {
+    thread->name = name;
+    return 0;
+}
+
+int k_mutex_init(k_mutex*) {
+    return 0;
+}
+
+int k_mutex_lock(k_mutex* mutex, k_timeout_t timeout) {
+    if(K_TIMEOUT_EQ(timeout, K_FOREVER)) {
+        mutex->mutex.lock();
+        return 0;
+    }
+    if(K_TIMEOUT_EQ(timeout, K_NO_WAIT)) {
+        return mutex->mutex.try_lock() ? 0 : -EBUSY;
+    }
+    return mutex->mutex.try_lock_for(std::chrono::microseconds(timeout.us)) ? 0 : -EAGAIN;
+}
+
+int k_mutex_unlock(k_mutex* mutex) {
+    mutex->mutex.unlock();
+    return 0;
+}
+
+int k_sem_init(k_sem* sem, unsigned int initial_count, unsigned int limit) {
+    std::lock_guard<std::mutex> guard(sem->mutex);
+    sem->count = initial_count;
+    sem->limit = limit;
+    return 0;
+}
+
+void k_sem_give(k_sem* sem) {
+    std::lock_guard<std::mutex> guard(sem->mutex);
+    if(sem->count < sem->limit) {
+        sem->count++;
+    }
+    sem->cv.notify_one();
+}
+
+int k_sem_take(k_sem* sem, k_timeout_t timeout) {
+    std::unique_lock<std::mutex> guard(sem->mutex);
+    const int rc = wait(guard, sem->cv, timeout, [&]() { return sem->count > 0; }, -EBUSY);
+    if(rc == 0) {
+        sem->count--;
+    }
+    return rc;
+}
+
+unsigned int k_sem_count_get(k_sem* sem) {
+    std::lock_guard<std::mutex> guard(sem->mutex);
+    return sem->count;
+}
+
+void k_sem_reset(k_sem* sem) {
+    std::lock_guard<std::mutex> guard(sem->mutex);
+    sem->count = 0;
+}
+
+void k_msgq_init(k_msgq* msgq, char* buffer, size_t msg_size, uint32_t max_msgs) {
+    std::lock_guard<std::mutex> guard(msgq->mutex);
+    msgq->buffer = buffer;
+    msgq->msg_size = msg_size;
+    msgq->max_msgs = max_msgs;
+    msgq->used = 0;
+    msgq->read = 0;
+}
+
+int k_msgq_put(k_msgq* msgq, const void* data, k_timeout_t timeout) {
+    std::unique_lock<std::mutex> guard(msgq->mutex);
+    const int rc = wait(guard, msgq->cv, timeout, [&]() { return msgq->used < msgq->max_msgs; }, -ENOMSG);
+    if(rc == 0) {
+        const uint32_t slot = (msgq->read + msgq->used) % msgq->max_msgs;
+        std::memcpy(msgq->buffer + slot * msgq->msg_size, data, msgq->msg_size);
+        msgq->used++;
+        msgq->cv.notify_all();
+    }
+    return rc;
+}
+
+int k_msgq_get(k_msgq* msgq, void* data, k_timeout_t timeout) {
+    std::unique_lock<std::mutex> guard(msgq->mutex);
+    const int rc = wait(guard, msgq->cv, timeout, [&]() { return msgq->used > 0; }, -ENOMSG);
+    if(rc == 0) {
+        std::memcpy(data, msgq->buffer + msgq->read * msgq->msg_size, msgq->msg_size);
+        msgq->read = (msgq->read + 1) % msgq->max_msgs;
+        msgq->used--;
+        msgq->cv.notify_all();
+    }
+    return rc;
+}
+
+void k_msgq_purge(k_msgq* msgq) {
+    std::lock_guard<std::mutex> guard(msgq->mutex);
+    msgq->used = 0;
+    msgq->cv.notify_all();
+}
+
+uint32_t k_msgq_num_used_get(k_msgq* msgq) {
+    std::lock_guard<std::mutex> guard(msgq->mutex);
+    return msgq->used;
+}
+
+uint32_t k_msgq_num_free_get(k_msgq* msgq) {
+    std::lock_guard<std::mutex> guard(msgq->mutex);
+    return msgq->max_msgs - msgq->used;
+}
+
+void k_poll_signal_init(k_poll_signal* signal) {
+    atomic_clear(&signal->signaled);
+    atomic_clear(&signal->result);
+}
+
+void k_poll_signal_reset(k_poll_signal* signal) {
+    atomic_clear(&signal->signaled);
+}
+
+void k_poll_signal_check(k_poll_signal* signal, unsigned int* signaled, int* result) {
+    *signaled = static_cast<unsigned int>(atomic_get(&signal->signaled));
+    *result = static_cast<int>(atomic_get(&signal->result));
+}
+
+int k_poll_signal_raise(k_poll_signal* signal, int result) {
+    atomic_set(&signal->result, result);
+    atomic_set(&signal->signaled, 1);
+    return 0;
+}
+
+void k_work_q_start(k_work_q*, k_thread_stack_t*, size_t, int) {}
+
+void k_work_init(k_work* work, k_work_handler_t handler) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    *work = k_work{};
+    work->handler = handler;
+}
+
+void k_work_submit_to_queue(k_work_q* work_q, k_work* work) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if(work->queued) {
+        return;
+    }
+    work->queue = work_q;
+    work->due_us = clock_us;
+    work->order = next_order++;
+    work->queued = true;
+    works.push_back(work);
+}
+
+void k_work_submit(k_work* work) {
+    k_work_submit_to_queue(&k_sys_work_q, work);
+}
+
+bool k_work_pending(k_work* work) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    return work->queued && work->due_us <= clock_us;
+}
+
+void k_delayed_work_init(k_delayed_work* work, k_work_handler_t handler) {
+    k_work_init(&work->work, handler);
+}
+
+int k_delayed_work_submit_to_queue(k_work_q* work_q, k_delayed_work* work, k_timeout_t delay) {
+    if(K_TIMEOUT_EQ(delay, K_FOREVER)) {
+        return 0;
+    }
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if(work->work.queued) {
+        remove(works, &work->work);
+    }
+    work->work.queue = work_q;
+    work->work.due_us = clock_us + delay.us;
+    work->work.order = next_order++;
+    work->work.queued = true;
+    works.push_back(&work->work);
+    return 0;
+}
+
+int k_delayed_work_submit(k_delayed_work* work, k_timeout_t delay) {
+    return k_delayed_work_submit_to_queue(&k_sys_work_q, work, delay);
+}
+
+int k_delayed_work_cancel(k_delayed_work* work) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if(!work->work.queued) {
+        return -EINVAL;
+    }
+    remove(works, &work->work);
+    work->work.queued = false;
+    return 0;
+}
+
+int32_t k_delayed_work_remaining_get(k_delayed_work* work) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if(!work->work.queued || work->work.due_us <= clock_us) {
+        return 0;
+    }
+    return static_cast<int32_t>((work->work.due_us - clock_us + 999) / 1000);
+}
+
+void k_timer_init(k_timer* timer, k_timer_expiry_t expiry_fn, k_timer_stop_t stop_fn) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    *timer = k_timer{};
+    timer->expiry_fn = expiry_fn;
+    timer->stop_fn = stop_fn;
+}
+
+void k_timer_start(k_timer* timer, k_timeout_t duration, k_timeout_t period) {
+    if(K_TIMEOUT_EQ(duration, K_FOREVER)) {
+        return;
+    }
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if(timer->active) {
+        remove(timers, timer);
+    }
+    timer->due_us = clock_us + duration.us;
+    timer->period_us = K_TIMEOUT_EQ(period, K_FOREVER) ? 0 : period.us;
+    timer->order = next_order++;
+    timer->status = 0;
+    timer->active = true;
+    timers.push_back(timer);
+}
+
+void k_timer_stop(k_timer* timer) {
+    {
+        std::lock_guard<std::recursive_mutex> guard(lock);
+        if(!timer->active) {
+            return;
+        }
+        remove(timers, timer);
+        timer->active = false;
+    }
+    if(timer->stop_fn) {
+        timer->stop_fn(timer);
+    }
+}
+
+uint32_t k_timer_status_get(k_timer* timer) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    const uint32_t status = timer->status;
+    timer->status = 0;
+    return status;
+}
+
+uint32_t k_timer_remaining_get(k_timer* timer) {
+    std::lock_guard<std::recursive_mutex> guard(lock);
+    if(!timer->active || timer->due_us <= clock_us) {
+        return 0;
+    }
+    return static_cast<uint32_t>((timer->due_us - clock_us + 999) / 1000);
+}
@@ -0,0 +1,50 @@
+#include <logging/log.h>
+#include <stub.hpp>
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+std::atomic<size_t> counts[LOG_LEVEL_DBG + 1];
+
+int threshold() {
+    static const int level = [] {
+        const char* env = std::getenv("STUB_LOG_LEVEL");
+        return env ? std::atoi(env) : LOG_LEVEL_ERR;
+    }();
+    return level;
+}
+
+}
+
+void stub_log(int level, const char* fmt, ...) {
+    counts[level]++;
+    if(level > threshold()) {
+        return;
+    }
+
+    static const char* const names[] = { "", "err", "wrn", "inf", "dbg" };
+    std::fprintf(stderr, "<%s> ", names[level]);
+    va_list args;
+    va_start(args, fmt);
+    std::vfprintf(stderr, fmt, args);
+    va_end(args);
+    std::fputc('\n', stderr);
+}
+
+namespace stub {
+
+size_t log_count(int level) {
+    return counts[level];
+}
+
+void log_reset() {
+    for(auto& count : counts) {
+        count = 0;
+    }
+}
+
+}
@@ -0,0 +1,520 @@
+#include <stub.hpp>
+
+#include <device.h>
+#include <drivers/adc.h>
+#include <hal/nrf_egu.h>
+#include <hal/nrf_rtc.h>
+#include <hal/nrf_saadc.h>
+#include <nrfx_ppi.h>
+
+#include <algorithm>
+#include <cstring>
+
+// Driven from the thread running the virtual clock, events trigger the PPI tasks they are
+// wired to before the interrupt they raise runs
+
+struct NRF_SAADC_Type {
+    bool enabled;
+    bool running;
+    uint32_t events;
+    uint32_t inten;
+    nrf_saadc_resolution_t resolution;
+    nrf_saadc_input_t pselp[NRF_SAADC_CHANNEL_COUNT];
+    // Latched by START, PTR and MAXCNT are double buffered
+    nrf_saadc_value_t* ptr;
+    uint32_t maxcnt;
+    nrf_saadc_value_t* active_ptr;
+    uint32_t active_maxcnt;
+    uint32_t amount;
+};
+
+struct NRF_RTC_Type {
+    bool running;
+    uint32_t prescaler;
+    uint32_t cc;
+    uint32_t evten;
+    // The counter was counter_at ticks at origin_us, CLEAR makes it -1 until the next tick
+    int64_t origin_us;
+    int64_t counter_at;
+    k_timer compare_timer;
+};
+
+struct NRF_EGU_Type {
+    uint32_t events;
+    uint32_t inten;
+};
+
+NRF_SAADC_Type stub_nrf_saadc;
+NRF_RTC_Type stub_nrf_rtc2;
+NRF_EGU_Type stub_nrf_egu3;
+
+namespace {
+
+constexpr uint32_t SAADC_BASE = 0x40007000;
+constexpr uint32_t RTC2_BASE = 0x40024000;
+constexpr uint32_t EGU3_BASE = 0x40017000;
+constexpr int64_t LFCLK_HZ = 32768;
+constexpr size_t NUM_PPI = 20;
+constexpr size_t NUM_IRQS = 40;
+
+struct ppi_t {
+    bool allocated;
+    bool enabled;
+    uint32_t eep;
+    uint32_t tep;
+    uint32_t fork;
+};
+
+struct irq_t {
+    void (*isr)(const void* arg);
+    const void* arg;
+    bool enabled;
+};
+
+ppi_t ppi[NUM_PPI];
+irq_t irqs[NUM_IRQS];
+adc_channel_cfg channel_cfgs[NRF_SAADC_CHANNEL_COUNT];
+uint8_t channels_set_up;
+stub::saadc_input_t input;
+uint32_t conversions;
+stub::saadc_stats_t stats;
+
+// Virtual time of tick n after origin, ticks are 30.52 us apart
+int64_t tick_us(const NRF_RTC_Type& rtc, int64_t ticks) {
+    return rtc.origin_us + (ticks * 1'000'000 + LFCLK_HZ - 1) / LFCLK_HZ;
+}
+
+int64_t rtc_counter(const NRF_RTC_Type& rtc) {
+    return rtc.counter_at + (stub::now_us() - rtc.origin_us) * LFCLK_HZ / 1'000'000;
+}
+
+void raise(unsigned int irq) {
+    if(irq < NUM_IRQS && irqs[irq].enabled && irqs[irq].isr) {
+        irqs[irq].isr(irqs[irq].arg);
+    }
+}
+
+void task(uint32_t address);
+
+// Sets the event, runs the PPI tasks wired to it, then the interrupt if it is enabled
+void event(uint32_t address) {
+    const uint32_t base = address & ~0xfffu;
+    const uint32_t offset = address & 0xfffu;
+    if(base == SAADC_BASE) {
+        stub_nrf_saadc.events |= BIT((offset - 0x100) / 4);
+    } else if(base == EGU3_BASE) {
+        stub_nrf_egu3.events |= BIT((offset - 0x100) / 4);
+    }
+
+    for(const ppi_t& channel : ppi) {
+        if(channel.enabled && channel.eep == address) {
+            task(channel.tep);
+            if(channel.fork) {
+                task(channel.fork);
+            }
+        }
+    }
+
+    if(base == SAADC_BASE && offset == NRF_SAADC_EVENT_END && (stub_nrf_saadc.inten & NRF_SAADC_INT_END)) {
+        // The Zephyr driver's ISR would take the SAADC back
+        stats.driver_irqs++;
+    } else if(base == EGU3_BASE && (stub_nrf_egu3.inten & BIT((offset - 0x100) / 4))) {
+        raise(SWI3_EGU3_IRQn);
+    }
+}
+
+void schedule_compare(NRF_RTC_Type& rtc) {
+    if(!rtc.running) {
+        k_timer_stop(&rtc.compare_timer);
+        return;
+    }
+    const int64_t counter = rtc_counter(rtc);
+    int64_t ticks = (int64_t{rtc.cc} - counter) & 0xffffff;
+    if(ticks == 0) {
+        ticks = 0x1000000;
+    }
+    const int64_t at = tick_us(rtc, counter + ticks - rtc.counter_at);
+    k_timer_start(&rtc.compare_timer, K_USEC(at - stub::now_us()), K_NO_WAIT);
+}
+
+void rtc_compare(k_timer* timer) {
+    NRF_RTC_Type& rtc = *CONTAINER_OF(timer, NRF_RTC_Type, compare_timer);
+    // Counts on from CC unless the event clears it
+    rtc.counter_at = rtc.cc;
+    rtc.origin_us = stub::now_us();
+    if(rtc.evten & NRF_RTC_INT_COMPARE0_MASK) {
+        event(RTC2_BASE + NRF_RTC_EVENT_COMPARE_0);
+    }
+    schedule_compare(rtc);
+}
+
+void saadc_sample() {
+    NRF_SAADC_Type& saadc = stub_nrf_saadc;
+    if(!saadc.enabled || !saadc.running) {
+        return;
+    }
+    stats.samplings++;
+    for(uint8_t channel = 0; channel < NRF_SAADC_CHANNEL_COUNT; channel++) {
+        if(saadc.pselp[channel] == NRF_SAADC_INPUT_DISABLED || saadc.amount >= saadc.active_maxcnt) {
+            continue;
+        }
+        saadc.active_ptr[saadc.amount++] = input ? input(saadc.pselp[channel], conversions) : 0;
+        conversions++;
+    }
+    if(saadc.amount >= saadc.active_maxcnt) {
+        saadc.running = false;
+        event(SAADC_BASE + NRF_SAADC_EVENT_END);
+    }
+}
+
+void task(uint32_t address) {
+    const uint32_t base = address & ~0xfffu;
+    const uint32_t offset = address & 0xfffu;
+    if(base == SAADC_BASE) {
+        nrf_saadc_task_trigger(&stub_nrf_saadc, static_cast<nrf_saadc_task_t>(offset));
+    } else if(base == RTC2_BASE) {
+        nrf_rtc_task_trigger(&stub_nrf_rtc2, static_cast<nrf_rtc_task_t>(offset));
+    } else if(base == EGU3_BASE) {
+        event(EGU3_BASE + 0x100 + offset);
+    }
+}
+
+bool valid(nrf_ppi_channel_t channel) {
+    return static_cast<size_t>(channel) < NUM_PPI && ppi[channel].allocated;
+}
+
+int adc_setup(const device* dev, const adc_channel_cfg* cfg) {
+    if(cfg->channel_id >= NRF_SAADC_CHANNEL_COUNT || cfg->gain > ADC_GAIN_4
+            || (cfg->reference != ADC_REF_INTERNAL && cfg->reference != ADC_REF_VDD_1_4)
+            || cfg->input_positive > NRF_SAADC_INPUT_VDD) {
+        return -EINVAL;
+    }
+    channel_cfgs[cfg->channel_id] = *cfg;
+    channels_set_up |= BIT(cfg->channel_id);
+    stats.channel_setups++;
+    return 0;
+}
+
+}
+
+// Found by device_get_binding(), see gpio.cpp
+extern const device stub_adc_device;
+const device stub_adc_device = { "ADC_0", nullptr, nullptr, nullptr };
+
+// SAADC
+
+void nrf_saadc_task_trigger(NRF_SAADC_Type* p_reg, nrf_saadc_task_t task) {
+    switch(task) {
+        case NRF_SAADC_TASK_START:
+            if(!p_reg->enabled) {
+                return;
+            }
+            p_reg->active_ptr = p_reg->ptr;
+            p_reg->active_maxcnt = p_reg->maxcnt;
+            p_reg->amount = 0;
+            p_reg->running = true;
+            stats.starts++;
+            event(SAADC_BASE + NRF_SAADC_EVENT_STARTED);
+            break;
+
+        case NRF_SAADC_TASK_SAMPLE:
+            saadc_sample();
+            break;
+
+        case NRF_SAADC_TASK_STOP:
+            if(p_reg->running) {
+                p_reg->running = false;
+                event(SAADC_BASE + NRF_SAADC_EVENT_END);
+            }
+            event(SAADC_BASE + NRF_SAADC_EVENT_STOPPED);
+            break;
+    }
+}
+
+uint32_t nrf_saadc_task_address_get(NRF_SAADC_Type const* p_reg, nrf_saadc_task_t task) {
+    return SAADC_BASE + task;
+}
+
+bool nrf_saadc_event_check(NRF_SAADC_Type const* p_reg, nrf_saadc_event_t event) {
+    return p_reg->events & BIT((event - 0x100) / 4);
+}
+
+void nrf_saadc_event_clear(NRF_SAADC_Type* p_reg, nrf_saadc_event_t event) {
+    p_reg->events &= ~BIT((event - 0x100) / 4);
+}
+
+uint32_t nrf_saadc_event_address_get(NRF_SAADC_Type const* p_reg, nrf_saadc_event_t event) {
+    return SAADC_BASE + event;
+}
+
+void nrf_saadc_int_enable(NRF_SAADC_Type* p_reg, uint32_t saadc_int_mask) {
+    p_reg->inten |= saadc_int_mask;
+}
+
+void nrf_saadc_int_disable(NRF_SAADC_Type* p_reg, uint32_t saadc_int_mask) {
+    p_reg->inten &= ~saadc_int_mask;
+}
+
+void nrf_saadc_enable(NRF_SAADC_Type* p_reg) {
+    p_reg->enabled = true;
+}
+
+void nrf_saadc_disable(NRF_SAADC_Type* p_reg) {
+    p_reg->enabled = false;
+    p_reg->running = false;
+}
+
+void nrf_saadc_resolution_set(NRF_SAADC_Type* p_reg, nrf_saadc_resolution_t resolution) {
+    p_reg->resolution = resolution;
+}
+
+void nrf_saadc_oversample_set(NRF_SAADC_Type* p_reg, nrf_saadc_oversample_t oversample) {}
+
+void nrf_saadc_channel_pos_input_set(NRF_SAADC_Type* p_reg, uint8_t channel, nrf_saadc_input_t pselp) {
+    p_reg->pselp[channel] = pselp;
+}
+
+void nrf_saadc_buffer_init(NRF_SAADC_Type* p_reg, nrf_saadc_value_t* p_buffer, uint32_t size) {
+    p_reg->ptr = p_buffer;
+    p_reg->maxcnt = size;
+}
+
+uint16_t nrf_saadc_amount_get(NRF_SAADC_Type const* p_reg) {
+    return static_cast<uint16_t>(p_reg->amount);
+}
+
+// RTC
+
+void nrf_rtc_prescaler_set(NRF_RTC_Type* p_reg, uint32_t val) {
+    p_reg->prescaler = val;
+}
+
+void nrf_rtc_cc_set(NRF_RTC_Type* p_reg, uint32_t ch, uint32_t cc_val) {
+    if(ch == 0) {
+        p_reg->cc = cc_val & 0xffffff;
+        schedule_compare(*p_reg);
+    }
+}
+
+void nrf_rtc_event_enable(NRF_RTC_Type* p_reg, uint32_t mask) {
+    p_reg->evten |= mask;
+}
+
+void nrf_rtc_event_disable(NRF_RTC_Type* p_reg, uint32_t mask) {
+    p_reg->evten &= ~mask;
+}
+
+void nrf_rtc_task_trigger(NRF_RTC_Type* p_reg, nrf_rtc_task_t task) {
+    switch(task) {
+        case NRF_RTC_TASK_START:
+            if(!p_reg->running) {
+                p_reg->running = true;
+                p_reg->origin_us = stub::now_us();
+            }
+            break;
+
+        case NRF_RTC_TASK_STOP:
+            if(p_reg->running) {
+                p_reg->counter_at = rtc_counter(*p_reg);
+                p_reg->running = false;
+            }
+            break;
+
+        case NRF_RTC_TASK_CLEAR:
+            p_reg->origin_us = stub::now_us();
+            p_reg->counter_at = p_reg->running ? -1 : 0;
+            break;
+    }
+    schedule_compare(*p_reg);
+}
+
+uint32_t nrf_rtc_task_address_get(NRF_RTC_Type const* p_reg, nrf_rtc_task_t task) {
+    return RTC2_BASE + task;
+}
+
+uint32_t nrf_rtc_event_address_get(NRF_RTC_Type const* p_reg, nrf_rtc_event_t event) {
+    return RTC2_BASE + event;
+}
+
+// EGU
+
+uint32_t nrf_egu_task_address_get(NRF_EGU_Type const* p_reg, nrf_egu_task_t task) {
+    return EGU3_BASE + task;
+}
+
+bool nrf_egu_event_check(NRF_EGU_Type const* p_reg, nrf_egu_event_t event) {
+    return p_reg->events & BIT((event - 0x100) / 4);
+}
+
+void nrf_egu_event_clear(NRF_EGU_Type* p_reg, nrf_egu_event_t event) {
+    p_reg->events &= ~BIT((event - 0x100) / 4);
+}
+
+void nrf_egu_int_enable(NRF_EGU_Type* p_reg, uint32_t mask) {
+    p_reg->inten |= mask;
+}
+
+void nrf_egu_int_disable(NRF_EGU_Type* p_reg, uint32_t mask) {
+    p_reg->inten &= ~mask;
+}
+
+// PPI
+
+nrfx_err_t nrfx_ppi_channel_alloc(nrf_ppi_channel_t* p_channel) {
+    for(size_t i = 0; i < NUM_PPI; i++) {
+        if(!ppi[i].allocated) {
+            ppi[i] = ppi_t{ true };
+            *p_channel = static_cast<nrf_ppi_channel_t>(i);
+            return NRFX_SUCCESS;
+        }
+    }
+    return NRFX_ERROR_NO_MEM;
+}
+
+nrfx_err_t nrfx_ppi_channel_free(nrf_ppi_channel_t channel) {
+    if(!valid(channel)) {
+        return NRFX_ERROR_INVALID_STATE;
+    }
+    ppi[channel] = ppi_t{};
+    return NRFX_SUCCESS;
+}
+
+nrfx_err_t nrfx_ppi_channel_assign(nrf_ppi_channel_t channel, uint32_t eep, uint32_t tep) {
+    if(!valid(channel)) {
+        return NRFX_ERROR_INVALID_STATE;
+    }
+    ppi[channel].eep = eep;
+    ppi[channel].tep = tep;
+    return NRFX_SUCCESS;
+}
+
+nrfx_err_t nrfx_ppi_channel_fork_assign(nrf_ppi_channel_t channel, uint32_t fork_tep) {
+    if(!valid(channel)) {
+        return NRFX_ERROR_INVALID_STATE;
+    }
+    ppi[channel].fork = fork_tep;
+    return NRFX_SUCCESS;
+}
+
+nrfx_err_t nrfx_ppi_channel_enable(nrf_ppi_channel_t channel) {
+    if(!valid(channel)) {
+        return NRFX_ERROR_INVALID_STATE;
+    }
+    ppi[channel].enabled = true;
+    return NRFX_SUCCESS;
+}
+
+nrfx_err_t nrfx_ppi_channel_disable(nrf_ppi_channel_t channel) {
+    if(!valid(channel)) {
+        return NRFX_ERROR_INVALID_STATE;
+    }
+    ppi[channel].enabled = false;
+    return NRFX_SUCCESS;
+}
+
+// Interrupts
+
+void stub_irq_connect(unsigned int irq, void (*isr)(const void* arg), const void* arg) {
+    irqs[irq].isr = isr;
+    irqs[irq].arg = arg;
+}
+
+void irq_enable(unsigned int irq) {
+    irqs[irq].enabled = true;
+}
+
+void irq_disable(unsigned int irq) {
+    irqs[irq].enabled = false;
+}
+
+int irq_is_enabled(unsigned int irq) {
+    return irqs[irq].enabled;
+}
+
+// ADC driver
+
+int adc_channel_setup(const device* dev, const adc_channel_cfg* channel_cfg) {
+    return adc_setup(dev, channel_cfg);
+}
+
+int adc_read(const device* dev, const adc_sequence* sequence) {
+    NRF_SAADC_Type& saadc = stub_nrf_saadc;
+    if(saadc.running || stub_nrf_rtc2.running) {
+        stats.collisions++;
+    }
+    if((sequence->channels & ~channels_set_up) || !sequence->channels) {
+        return -EINVAL;
+    }
+
+    // Connects only the channels of the sequence, as the driver does before each read
+    for(uint8_t channel = 0; channel < NRF_SAADC_CHANNEL_COUNT; channel++) {
+        saadc.pselp[channel] = (sequence->channels & BIT(channel))
+            ? static_cast<nrf_saadc_input_t>(channel_cfgs[channel].input_positive)
+            : NRF_SAADC_INPUT_DISABLED;
+    }
+    const size_t count = __builtin_popcount(sequence->channels);
+    if(sequence->buffer_size < count * sizeof(nrf_saadc_value_t)) {
+        return -ENOMEM;
+    }
+    nrf_saadc_value_t* out = static_cast<nrf_saadc_value_t*>(sequence->buffer);
+    for(uint8_t channel = 0; channel < NRF_SAADC_CHANNEL_COUNT; channel++) {
+        if(saadc.pselp[channel] != NRF_SAADC_INPUT_DISABLED) {
+            *out++ = input ? input(saadc.pselp[channel], conversions) : 0;
+            conversions++;
+        }
+    }
+    stats.reads++;
+    return 0;
+}
+
+namespace stub {
+
+void saadc_reset() {
+    stub_nrf_saadc = NRF_SAADC_Type{};
+    // The driver's init enables these once
+    stub_nrf_saadc.inten = NRF_SAADC_INT_END | NRF_SAADC_INT_CALIBRATEDONE;
+    stub_nrf_rtc2 = NRF_RTC_Type{};
+    k_timer_init(&stub_nrf_rtc2.compare_timer, rtc_compare, nullptr);
+    stub_nrf_egu3 = NRF_EGU_Type{};
+    std::fill(std::begin(ppi), std::end(ppi), ppi_t{});
+    std::fill(std::begin(irqs), std::end(irqs), irq_t{});
+    std::memset(channel_cfgs, 0, sizeof(channel_cfgs));
+    channels_set_up = 0;
+    input = nullptr;
+    conversions = 0;
+    stats = saadc_stats_t{};
+}
+
+void saadc_set_input(saadc_input_t fn) {
+    input = fn;
+}
+
+saadc_stats_t& saadc_stats() {
+    return stats;
+}
+
+bool saadc_enabled() {
+    return stub_nrf_saadc.enabled;
+}
+
+uint32_t saadc_int_enabled() {
+    return stub_nrf_saadc.inten;
+}
+
+size_t ppi_channels_enabled() {
+    return std::count_if(std::begin(ppi), std::end(ppi), [](const ppi_t& channel) {
+        return channel.enabled;
+    });
+}
+
+size_t ppi_channels_allocated() {
+    return std::count_if(std::begin(ppi), std::end(ppi), [](const ppi_t& channel) {
+        return channel.allocated;
+    });
+}
+
+bool rtc_running() {
+    return stub_nrf_rtc2.running;
+}
+
+}
@@ -0,0 +1,57 @@
+#include <ztest.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+namespace {
+
+struct failure_t {};
+
+int failed_tests = 0;
+
+}
+
+void z_zassert(bool cond, const char* default_msg, const char* file, int line, const char* func,
+        const char* msg, ...) {
+    if(cond) {
+        return;
+    }
+
+    std::printf("\n    Assertion failed at %s:%d: %s: %s\n", file, line, func, default_msg);
+    if(msg) {
+        std::printf("    ");
+        va_list args;
+        va_start(args, msg);
+        std::vprintf(msg, args);
+        va_end(args);
+        std::printf("\n");
+    }
+    throw failure_t{};
+}
+
+void z_ztest_run_test_suite(const char* name, const unit_test* suite) {
+    std::printf("Running test suite %s\n", name);
+    for(; suite->name; suite++) {
+        std::printf("START - %s\n", suite->name);
+        bool passed = true;
+        try {
+            suite->setup();
+            suite->test();
+        } catch(const failure_t&) {
+            passed = false;
+        }
+        suite->teardown();
+        std::printf(" %s - %s\n", passed ? "PASS" : "FAIL", suite->name);
+        failed_tests += passed ? 0 : 1;
+    }
+    std::printf("Test suite %s %s\n", name, failed_tests ? "failed" : "succeeded");
+}
+
+int main() {
+    test_main();
+    std::printf("PROJECT EXECUTION %s\n", failed_tests ? "FAILED" : "SUCCESSFUL");
+    // Worker threads of the code under test may still block on kernel objects, skip their teardown
+    std::fflush(stdout);
+    std::_Exit(failed_tests ? 1 : 0);
+}
@@ -0,0 +1,79 @@
+#include <ztest.h>
+
+#include <app_battery.hpp>
+
+namespace {
+
+template<const auto& CURVE>
+void check_lut() {
+    using lut = battery_lut_t<CURVE>;
+    static_assert(lut::monotonic() && lut::accurate(), "curve table");
+
+    for(unsigned int mV = lut::MIN_mV; mV <= lut::MAX_mV; mV++) {
+        const unsigned int bucket = mV - (mV - lut::MIN_mV) % 10;
+        zassert_equal(lut::lookup(mV), battery_interpolate(CURVE, bucket), "%u mV", mV);
+    }
+    for(const auto& point : CURVE) {
+        zassert_equal(lut::lookup(point.lvl_mV), point.lvl_pct, "curve point %u mV", point.lvl_mV);
+    }
+    zassert_equal(lut::lookup(lut::MAX_mV + 500), 100u, NULL);
+    zassert_equal(lut::lookup(lut::MIN_mV - 500), 0u, NULL);
+    zassert_equal(lut::lookup(0), 0u, NULL);
+}
+
+constexpr auto cr2032_loaded = battery_compensate(cr2032_levels, 500, 15000);
+
+}
+
+static void test_lut_matches_curves() {
+    check_lut<bench_levels>();
+    check_lut<cr2032_levels>();
+    check_lut<cr2032_loaded>();
+    check_lut<li_ion_levels>();
+}
+
+static void test_interpolate_between_points() {
+    zassert_equal(battery_interpolate(li_ion_levels, 4200), 100u, NULL);
+    zassert_equal(battery_interpolate(li_ion_levels, 3730), 30u, "halfway from 20%% to 40%%");
+    zassert_equal(battery_interpolate(li_ion_levels, 2900), 0u, NULL);
+    zassert_equal(battery_interpolate(bench_levels, 3250), 75u, NULL);
+}
+
+static void test_compensate_shifts_curve() {
+    // 500 uA through 15 ohm is 7.5 mV, truncated to 7, plus 10 C below 25 C at 2 mV per degree
+    constexpr auto shifted = battery_compensate(cr2032_levels, 500, 15000, 15, 2);
+    for(size_t i = 0; i < cr2032_levels.size(); i++) {
+        zassert_equal(shifted[i].lvl_mV, cr2032_levels[i].lvl_mV - 27, NULL);
+        zassert_equal(shifted[i].lvl_pct, cr2032_levels[i].lvl_pct, NULL);
+    }
+}
+
+static void test_filter_hysteresis() {
+    battery_filter_t<2> filter;
+    zassert_true(filter.update(3255), "first sample reports");
+    const uint8_t first = filter.pct();
+    zassert_equal(first, battery_level_pct(3255), NULL);
+
+    // Jitter that keeps the average inside its bucket does not move the level
+    for(int i = 0; i < 20; i++) {
+        zassert_false(filter.update(i % 2 ? 3258 : 3252), "sample %d", i);
+    }
+    zassert_equal(filter.pct(), first, NULL);
+
+    // A sustained drop does, once the average crosses the hysteresis
+    bool changed = false;
+    for(int i = 0; i < 20 && !changed; i++) {
+        changed = filter.update(3200);
+    }
+    zassert_true(changed, NULL);
+    zassert_true(filter.pct() < first, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(battery,
+        ztest_unit_test(test_lut_matches_curves),
+        ztest_unit_test(test_interpolate_between_points),
+        ztest_unit_test(test_compensate_shifts_curve),
+        ztest_unit_test(test_filter_hysteresis));
+    ztest_run_test_suite(battery);
+}
@@ -0,0 +1,149 @@
+#include <ztest.h>
+
+#include <app_ble.hpp>
+
+#include <stub.hpp>
+
+#include <vector>
+
+namespace {
+
+constexpr int64_t MS = 1000;
+constexpr uint32_t BLOCK_SIZE = 128;
+constexpr uint32_t RING_BLOCKS = 32;
+
+// A ring of the last RING_BLOCKS blocks addressed by block sequence, as main.cpp serves the
+// history, every byte holds the low bits of its offset
+struct ring_source_t : app::bulk_source_t {
+    uint32_t head = 0;
+    std::vector<uint32_t> reads;
+
+    uint32_t stored() const {
+        return std::min(head, RING_BLOCKS);
+    }
+
+    void spill() {
+        head++;
+    }
+
+    uint32_t size() override {
+        return (head + 1) * BLOCK_SIZE;
+    }
+
+    uint32_t first() override {
+        return (head - stored()) * BLOCK_SIZE;
+    }
+
+    ssize_t read(uint32_t offset, uint8_t* dst, size_t len) override {
+        if(offset < first()) {
+            return -ERANGE;
+        }
+        reads.push_back(offset);
+        const size_t count = std::min<size_t>(len, size() - offset);
+        for(size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<uint8_t>(offset + i);
+        }
+        return static_cast<ssize_t>(count);
+    }
+};
+
+app_ble::manager_t ble;
+const bt_gatt_attr attr = {};
+
+void setup() {
+    stub::reset_kernel();
+    stub::bt_reset();
+    ble.stop();
+    zassert_true(ble.init().has_value(), NULL);
+    zassert_true(ble.ready().has_value(), NULL);
+    zassert_true(ble.start(app_ble::adv_mode_e::FAST).has_value(), NULL);
+}
+
+bt_conn* subscribed() {
+    bt_conn* conn = stub::bt_connect();
+    zassert_not_null(conn, NULL);
+    stub::bt_subscribe(conn, true);
+    return conn;
+}
+
+}
+
+static void test_resume_after_spills() {
+    app::bulk_transfer_t<> bulk;
+    ring_source_t source;
+    source.head = RING_BLOCKS;
+    bulk.set_source(&source);
+
+    bt_conn* conn = subscribed();
+    zassert_equal(bulk.request(conn, &attr, 0, UINT32_MAX), 0, NULL);
+    stub::drain();
+    bulk.disconnected(conn);
+    stub::bt_disconnect(conn);
+    stub::run_until(100 * MS);
+
+    const auto stopped = bulk.cursor();
+    zassert_true(stopped.offset > 0 && stopped.offset < stopped.end, "stopped mid transfer");
+
+    // Two blocks spill while the client is away, the cursor still names the same bytes
+    source.spill();
+    source.spill();
+    zassert_equal(bulk.cursor().first, 2 * BLOCK_SIZE, NULL);
+    zassert_true(stopped.offset >= bulk.cursor().first, NULL);
+
+    source.reads.clear();
+    zassert_true(ble.start(app_ble::adv_mode_e::FAST).has_value(), NULL);
+    conn = subscribed();
+    zassert_equal(bulk.request(conn, &attr, stopped.offset, UINT32_MAX), 0, NULL);
+    stub::run_until(1000 * MS);
+    zassert_equal(source.reads.front(), stopped.offset, "resumed where it stopped");
+    zassert_equal(bulk.cursor().offset, source.size(), NULL);
+    bulk.disconnected(conn);
+    stub::bt_disconnect(conn);
+}
+
+static void test_refuses_dropped_offset() {
+    app::bulk_transfer_t<> bulk;
+    ring_source_t source;
+    source.head = RING_BLOCKS + 3;
+    bulk.set_source(&source);
+
+    bt_conn* conn = subscribed();
+    zassert_equal(bulk.request(conn, &attr, 2 * BLOCK_SIZE, UINT32_MAX), -ERANGE, NULL);
+    zassert_equal(bulk.request(conn, &attr, 3 * BLOCK_SIZE, BLOCK_SIZE), 0, NULL);
+    stub::run_until(1000 * MS);
+    zassert_equal(bulk.cursor().offset, 4 * BLOCK_SIZE, NULL);
+    bulk.disconnected(conn);
+    stub::bt_disconnect(conn);
+}
+
+static void test_stops_when_dropped_under_cursor() {
+    app::bulk_transfer_t<> bulk;
+    ring_source_t source;
+    source.head = RING_BLOCKS;
+    bulk.set_source(&source);
+
+    bt_conn* conn = subscribed();
+    zassert_equal(bulk.request(conn, &attr, 0, UINT32_MAX), 0, NULL);
+    stub::drain();
+    const uint32_t offset = bulk.cursor().offset;
+    zassert_true(offset > 0 && offset < bulk.cursor().end, NULL);
+
+    // The block being sent spills over, nothing from another block goes out in its place
+    for(uint32_t dropped = 0; dropped <= offset / BLOCK_SIZE; dropped++) {
+        source.spill();
+    }
+    stub::run_until(1000 * MS);
+    const auto cursor = bulk.cursor();
+    zassert_equal(cursor.offset, offset, NULL);
+    zassert_equal(cursor.end, offset, "transfer ended");
+    bulk.disconnected(conn);
+    stub::bt_disconnect(conn);
+}
+
+void test_main(void) {
+    ztest_test_suite(bulk,
+        ztest_unit_test_setup_teardown(test_resume_after_spills, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_dropped_offset, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_stops_when_dropped_under_cursor, setup, unit_test_noop));
+    ztest_run_test_suite(bulk);
+}
@@ -0,0 +1,320 @@
+#include <ztest.h>
+#include <stub.hpp>
+
+#include <app/delta.hpp>
+
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+using bytes_t = std::vector<uint8_t>;
+
+constexpr size_t SOURCE_SIZE = 24 * 1024;
+
+bytes_t source;
+bytes_t target;
+
+void put_u32(bytes_t& out, uint32_t value) {
+    uint8_t raw[4];
+    sys_put_le32(value, raw);
+    out.insert(out.end(), raw, raw + 4);
+}
+
+// Writes the stream delta_image.py would, from explicit operations
+struct stream_t {
+    bytes_t ops;
+    bool lz4 = false;
+
+    stream_t& copy(uint32_t offset, uint32_t len) {
+        ops.push_back(app::delta_patcher_t::OP_COPY);
+        put_u32(ops, offset);
+        put_u32(ops, len);
+        return *this;
+    }
+
+    stream_t& insert(const bytes_t& literal) {
+        ops.push_back(app::delta_patcher_t::OP_INSERT);
+        put_u32(ops, static_cast<uint32_t>(literal.size()));
+        ops.insert(ops.end(), literal.begin(), literal.end());
+        return *this;
+    }
+
+    stream_t& insert_lz4(const bytes_t& block) {
+        lz4 = true;
+        ops.push_back(app::delta_patcher_t::OP_INSERT_LZ4);
+        put_u32(ops, static_cast<uint32_t>(block.size()));
+        ops.insert(ops.end(), block.begin(), block.end());
+        return *this;
+    }
+
+    bytes_t build(const bytes_t& to, uint32_t source_crc = 0, bool wrong_target_crc = false) const {
+        bytes_t out;
+        put_u32(out, lz4 ? app::delta_patcher_t::MAGIC_LZ4 : app::delta_patcher_t::MAGIC);
+        put_u32(out, static_cast<uint32_t>(source.size()));
+        put_u32(out, source_crc ? source_crc : crc32_ieee(source.data(), source.size()));
+        put_u32(out, static_cast<uint32_t>(to.size()));
+        put_u32(out, crc32_ieee(to.data(), to.size()) ^ (wrong_target_crc ? 1 : 0));
+        out.insert(out.end(), ops.begin(), ops.end());
+        return out;
+    }
+};
+
+// Sequences of an LZ4 block, lengths past the token nibble continue in 255 steps
+struct lz4_t {
+    bytes_t block;
+
+    void length(uint32_t n) {
+        for(; n >= 255; n -= 255) {
+            block.push_back(255);
+        }
+        block.push_back(static_cast<uint8_t>(n));
+    }
+
+    lz4_t& sequence(const bytes_t& literal, uint16_t distance = 0, uint32_t match_len = 0) {
+        const uint32_t lit = static_cast<uint32_t>(literal.size());
+        const uint32_t extra = distance ? match_len - 4 : 0;
+        block.push_back(static_cast<uint8_t>(std::min<uint32_t>(lit, 15) << 4 | std::min<uint32_t>(extra, 15)));
+        if(lit >= 15) {
+            length(lit - 15);
+        }
+        block.insert(block.end(), literal.begin(), literal.end());
+        if(distance) {
+            block.push_back(static_cast<uint8_t>(distance));
+            block.push_back(static_cast<uint8_t>(distance >> 8));
+            if(extra >= 15) {
+                length(extra - 15);
+            }
+        }
+        return *this;
+    }
+};
+
+// The new image: a patched header, the source shifted by a small insert, a new tail
+stream_t operations() {
+    stream_t s;
+    s.insert(bytes_t(32, 0xa5))
+        .copy(32, 1000)
+        .insert({ 1, 2, 3 })
+        .copy(1032, SOURCE_SIZE - 1032)
+        .insert(bytes_t(700, 0x3c));
+    return s;
+}
+
+void setup() {
+    stub::reset_kernel();
+    stub::flash_reset();
+    stub::log_reset();
+
+    std::mt19937 rng(42);
+    source.resize(SOURCE_SIZE);
+    for(auto& b : source) {
+        b = static_cast<uint8_t>(rng());
+    }
+    std::copy(source.begin(), source.end(), stub::flash_contents(FLASH_AREA_ID(image_0)).begin());
+
+    target.assign(32, 0xa5);
+    target.insert(target.end(), source.begin() + 32, source.begin() + 1032);
+    target.insert(target.end(), { 1, 2, 3 });
+    target.insert(target.end(), source.begin() + 1032, source.end());
+    target.insert(target.end(), 700, 0x3c);
+}
+
+int feed(app::delta_patcher_t& patcher, const bytes_t& stream, size_t chunk) {
+    for(size_t offset = 0; offset < stream.size(); offset += chunk) {
+        const auto written = patcher.write(stream.data() + offset, std::min(chunk, stream.size() - offset));
+        if(!written) {
+            return written.error();
+        }
+    }
+    return 0;
+}
+
+bool slot_holds_target() {
+    const auto& slot = stub::flash_contents(FLASH_AREA_ID(image_1));
+    return std::equal(target.begin(), target.end(), slot.begin());
+}
+
+}
+
+static void test_rebuilds_target_in_any_chunking() {
+    const bytes_t stream = operations().build(target);
+    for(size_t chunk : { size_t{1}, size_t{7}, size_t{512}, stream.size() }) {
+        stub::flash_reset();
+        std::copy(source.begin(), source.end(), stub::flash_contents(FLASH_AREA_ID(image_0)).begin());
+
+        app::slot_writer_t slot;
+        app::delta_patcher_t patcher(slot);
+        patcher.begin();
+        zassert_true(patcher.active(), NULL);
+        zassert_ok(feed(patcher, stream, chunk), "chunk %zu", chunk);
+        zassert_true(patcher.done(), "chunk %zu", chunk);
+        zassert_false(patcher.active(), NULL);
+        zassert_equal(patcher.offset(), stream.size(), NULL);
+        zassert_true(slot_holds_target(), "chunk %zu", chunk);
+        zassert_equal(patcher.stats().copied, SOURCE_SIZE - 32, NULL);
+        zassert_equal(patcher.stats().inserted, 32u + 3 + 700, NULL);
+    }
+}
+
+static void test_inflates_lz4_literals() {
+    // A run from distance 1, a long literal, a long match overlapping what it produces and a
+    // match back into bytes copied from the source
+    const bytes_t text = { 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't' };
+    lz4_t block;
+    block.sequence({ 0x11 }, 1, 40)
+        .sequence(text, 20, 300)
+        .sequence({ 9 }, 400, 8)
+        .sequence({ 7, 7 });
+    bytes_t tail(41, 0x11);
+    for(size_t i = 0; i < 16; i++) {
+        tail.insert(tail.end(), text.begin(), text.end());
+    }
+    tail.push_back(9);
+    const size_t back = SOURCE_SIZE - 64 + tail.size() - 400;
+    target.assign(source.begin(), source.end() - 64);
+    target.insert(target.end(), tail.begin(), tail.end());
+    target.insert(target.end(), target.begin() + back, target.begin() + back + 8);
+    target.insert(target.end(), { 7, 7 });
+
+    stream_t s;
+    s.copy(0, SOURCE_SIZE - 64).insert_lz4(block.block);
+    const bytes_t stream = s.build(target);
+    for(size_t chunk : { size_t{1}, size_t{3}, size_t{512} }) {
+        stub::flash_reset();
+        std::copy(source.begin(), source.end(), stub::flash_contents(FLASH_AREA_ID(image_0)).begin());
+
+        app::slot_writer_t slot;
+        app::delta_patcher_t patcher(slot);
+        patcher.begin();
+        zassert_ok(feed(patcher, stream, chunk), "chunk %zu", chunk);
+        zassert_true(patcher.done(), "chunk %zu", chunk);
+        zassert_true(slot_holds_target(), "chunk %zu", chunk);
+        zassert_equal(patcher.stats().inflated, target.size() - (SOURCE_SIZE - 64), NULL);
+        zassert_equal(patcher.stats().block_bytes, block.block.size(), NULL);
+    }
+}
+
+static void test_refuses_lz4_outside_window() {
+    lz4_t block;
+    block.sequence({ 1, 2, 3, 4 }, 5, 4).sequence({});
+    stream_t s;
+    s.insert_lz4(block.block);
+    const bytes_t stream = s.build(bytes_t(8, 0));
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    patcher.begin();
+    zassert_equal(feed(patcher, stream, 64), -EINVAL, NULL);
+}
+
+static void test_refuses_truncated_lz4_block() {
+    lz4_t block;
+    block.sequence({ 1, 2, 3, 4 }, 4, 4);
+    stream_t s;
+    s.insert_lz4(block.block).insert(bytes_t(4, 0));
+    const bytes_t stream = s.build(bytes_t(12, 0));
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    patcher.begin();
+    zassert_equal(feed(patcher, stream, 64), -EINVAL, NULL);
+}
+
+static void test_refuses_lz4_in_plain_stream() {
+    lz4_t block;
+    block.sequence({ 1, 2, 3, 4 });
+    stream_t s;
+    s.insert_lz4(block.block);
+    s.lz4 = false;
+    const bytes_t stream = s.build({ 1, 2, 3, 4 });
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    patcher.begin();
+    zassert_equal(feed(patcher, stream, 64), -EINVAL, NULL);
+}
+
+static void test_refuses_unknown_format() {
+    bytes_t stream = operations().build(target);
+    stream[3] = '3';
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    patcher.begin();
+    zassert_equal(feed(patcher, stream, 64), -ENOTSUP, NULL);
+}
+
+static void test_offset_resumes_interrupted_stream() {
+    const bytes_t stream = operations().build(target);
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    patcher.begin();
+
+    // Cut inside the trailing literal
+    const size_t cut = stream.size() - 300;
+    zassert_true(patcher.write(stream.data(), cut).has_value(), NULL);
+    zassert_equal(patcher.offset(), cut, NULL);
+    zassert_true(patcher.write(stream.data() + patcher.offset(), stream.size() - cut).has_value(), NULL);
+    zassert_true(patcher.done(), NULL);
+    zassert_true(slot_holds_target(), NULL);
+}
+
+static void test_refuses_other_source() {
+    const bytes_t stream = operations().build(target, 0x12345678);
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    patcher.begin();
+    zassert_equal(feed(patcher, stream, 64), -ESRCH, NULL);
+    zassert_false(patcher.active(), NULL);
+    zassert_equal(stub::flash_stats(FLASH_AREA_ID(image_1)).bytes_written, 0u, "slot touched before the check");
+}
+
+static void test_refuses_wrong_target() {
+    const bytes_t stream = operations().build(target, 0, true);
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    patcher.begin();
+    zassert_equal(feed(patcher, stream, 256), -EBADMSG, NULL);
+    zassert_false(patcher.done(), NULL);
+}
+
+static void test_refuses_copy_outside_source() {
+    stream_t s;
+    s.copy(SOURCE_SIZE - 10, 20);
+    const bytes_t stream = s.build(bytes_t(20, 0));
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    patcher.begin();
+    zassert_equal(feed(patcher, stream, 64), -EINVAL, NULL);
+}
+
+static void test_refuses_trailing_data() {
+    bytes_t stream = operations().build(target);
+    stream.push_back(0);
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    patcher.begin();
+    zassert_equal(feed(patcher, stream, stream.size()), -EINVAL, NULL);
+}
+
+static void test_refuses_without_session() {
+    const uint8_t byte = 0;
+    app::slot_writer_t slot;
+    app::delta_patcher_t patcher(slot);
+    zassert_equal(patcher.write(&byte, 1).error(), -EALREADY, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(delta,
+        ztest_unit_test_setup_teardown(test_rebuilds_target_in_any_chunking, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_inflates_lz4_literals, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_lz4_outside_window, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_truncated_lz4_block, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_lz4_in_plain_stream, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_unknown_format, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_offset_resumes_interrupted_stream, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_other_source, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_wrong_target, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_copy_outside_source, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_trailing_data, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_without_session, setup, unit_test_noop));
+    ztest_run_test_suite(delta);
+}
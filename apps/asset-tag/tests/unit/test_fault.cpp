@@ -0,0 +1,149 @@
+#include <ztest.h>
+
+#include <app_fault.hpp>
+
+#include <stub.hpp>
+
+#include <cstring>
+#include <optional>
+
+namespace {
+
+// A boot up to the fault manager as main() runs it, storage survives in the stub file system
+struct boot_t {
+    app_lfs::manager_t lfs;
+    std::optional<app_fault::manager_t> fault;
+
+    boot_t() {
+        zassert_true(lfs.init().has_value(), NULL);
+        fault.emplace(lfs);
+    }
+};
+
+// What the fatal error handler leaves in noinit RAM before the reset
+void plant(uint32_t pc) {
+    app::fault_capture(app::FAULT_REASON_EXCEPTION, pc, pc + 4, "wake");
+}
+
+void setup() {
+    stub::reset_kernel();
+    stub::fs_reset();
+    stub::flash_reset();
+    stub::log_reset();
+    app::fault_pending.magic = 0;
+    ass_error.assign("", 0);
+}
+
+}
+
+static void test_stores_planted_crash() {
+    {
+        boot_t boot;
+        zassert_equal(boot.lfs.fault_count(), 0u, NULL);
+        plant(0x1234);
+    }
+
+    boot_t boot;
+    zassert_equal(boot.lfs.fault_count(), 1u, NULL);
+    app::fault_record_t record;
+    zassert_true(boot.lfs.read_fault(0, &record, sizeof(record)), NULL);
+    zassert_equal(record.reason, app::FAULT_REASON_EXCEPTION, NULL);
+    zassert_equal(record.pc, 0x1234u, NULL);
+    zassert_equal(record.lr, 0x1238u, NULL);
+    zassert_equal(record.boot_count, 1u, "the boot that faulted");
+    zassert_equal(std::strcmp(record.message, "wake"), 0, NULL);
+
+    char error[ass_buffer_t::size() + 1];
+    ass_error.copy_string(error);
+    zassert_not_null(std::strstr(error, "pc 00001234"), "summary served over BLE");
+
+    // The record is taken once, a clean boot adds nothing
+    zassert_false(app::fault_take(&record), NULL);
+}
+
+static void test_ring_wraps() {
+    const uint32_t total = app_lfs::FAULT_SLOTS + 3;
+    for(uint32_t i = 0; i < total; i++) {
+        plant(0x1000 + i);
+        boot_t boot;
+        boot.fault->clear_boot_streak();
+    }
+
+    boot_t boot;
+    zassert_equal(boot.lfs.fault_head, total, NULL);
+    zassert_equal(boot.lfs.fault_count(), app_lfs::FAULT_SLOTS, NULL);
+    app::fault_record_t record;
+    for(uint32_t age = 0; age < app_lfs::FAULT_SLOTS; age++) {
+        zassert_true(boot.lfs.read_fault(age, &record, sizeof(record)), NULL);
+        zassert_equal(record.pc, 0x1000 + total - 1 - age, "most recent first");
+    }
+    zassert_false(boot.lfs.read_fault(app_lfs::FAULT_SLOTS, &record, sizeof(record)), "the oldest were overwritten");
+
+    const stub::bytes_t* faults = stub::fs_stored("/lfs/faults");
+    zassert_not_null(faults, NULL);
+    zassert_equal(faults->size(), app_lfs::FAULT_SLOTS * app_lfs::FAULT_SLOT_SIZE, "the file stays one ring");
+}
+
+static void test_boot_loop_backs_off() {
+    for(uint32_t i = 1; i < app_fault::BOOT_LOOP_LIMIT; i++) {
+        plant(0x2000 + i);
+        boot_t boot;
+        zassert_equal(boot.fault->streak, i, NULL);
+        zassert_false(boot.fault->boot_loop(), NULL);
+    }
+
+    {
+        plant(0x3000);
+        boot_t boot;
+        zassert_true(boot.fault->boot_loop(), NULL);
+        // main() clears the streak on entering safe mode so its reset retries a normal boot
+        boot.fault->clear_boot_streak();
+    }
+
+    {
+        boot_t boot;
+        zassert_equal(boot.fault->streak, 1u, NULL);
+        zassert_false(boot.fault->boot_loop(), NULL);
+        // A completed wake ends the streak
+        boot.fault->clear_boot_streak();
+    }
+
+    boot_t boot;
+    zassert_equal(boot.fault->streak, 1u, NULL);
+    zassert_equal(boot.lfs.fault_count(), app_fault::BOOT_LOOP_LIMIT, NULL);
+}
+
+static void test_failed_append_keeps_head() {
+    {
+        boot_t boot;
+        plant(0x4000);
+    }
+
+    // The slot is written but its head never journaled, the record must not count
+    {
+        app_lfs::manager_t lfs;
+        zassert_true(lfs.init().has_value(), NULL);
+        stub::log_reset();
+        stub::fs_fail("/lfs/journal", -ENOSPC);
+        app_fault::manager_t fault(lfs);
+        zassert_equal(lfs.fault_head, 0u, NULL);
+        zassert_equal(lfs.fault_count(), 0u, NULL);
+        zassert_true(stub::log_count(LOG_LEVEL_ERR) > 0, "store failure logged");
+        plant(0x5000);
+    }
+
+    boot_t boot;
+    zassert_equal(boot.lfs.fault_head, 1u, NULL);
+    app::fault_record_t record;
+    zassert_true(boot.lfs.read_fault(0, &record, sizeof(record)), NULL);
+    zassert_equal(record.pc, 0x5000u, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(fault,
+        ztest_unit_test_setup_teardown(test_stores_planted_crash, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_ring_wraps, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_boot_loop_backs_off, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_failed_append_keeps_head, setup, unit_test_noop));
+    ztest_run_test_suite(fault);
+}
@@ -0,0 +1,356 @@
+#include <ztest.h>
+#include <stub.hpp>
+
+#include <app/upload.hpp>
+#include <sys/crc.h>
+
+#include <fleet_dfu/fleet.hpp>
+#include <fleet_dfu/udp.hpp>
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <memory>
+#include <random>
+#include <sstream>
+
+namespace {
+
+using bytes_t = fleet::bytes_t;
+
+constexpr size_t BODY_SIZE = 20 * 1024;
+constexpr size_t HEADER_SIZE = 32;
+
+void put_u16(bytes_t& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+void put_u32(bytes_t& out, uint32_t value) {
+    put_u16(out, static_cast<uint16_t>(value));
+    put_u16(out, static_cast<uint16_t>(value >> 16));
+}
+
+// A signed image as imgtool lays it out, the hash TLV is random instead of the SHA256
+bytes_t make_image(uint32_t seed, const bytes_t& body) {
+    std::mt19937 rng(seed);
+    bytes_t image;
+    put_u32(image, fleet::IMAGE_MAGIC);
+    put_u32(image, 0);
+    put_u16(image, HEADER_SIZE);
+    put_u16(image, 0);
+    put_u32(image, static_cast<uint32_t>(body.size()));
+    put_u32(image, 0);
+    // Version, what the delta test changes in the header
+    put_u32(image, seed);
+    image.resize(HEADER_SIZE, 0);
+    image.insert(image.end(), body.begin(), body.end());
+    put_u16(image, fleet::TLV_INFO_MAGIC);
+    put_u16(image, 4 + 4 + 32);
+    put_u16(image, fleet::TLV_SHA256);
+    put_u16(image, 32);
+    for(int i = 0; i < 32; i++) {
+        image.push_back(static_cast<uint8_t>(rng()));
+    }
+    return image;
+}
+
+bytes_t body(uint32_t seed) {
+    std::mt19937 rng(seed);
+    bytes_t data(BODY_SIZE);
+    for(auto& b : data) {
+        b = static_cast<uint8_t>(rng());
+    }
+    return data;
+}
+
+// The delta delta_image.py writes from base to target when only the version and the TLVs differ
+bytes_t make_delta(const bytes_t& base, const bytes_t& target) {
+    const uint32_t version = 20;
+    const uint32_t tail = HEADER_SIZE + BODY_SIZE;
+    bytes_t out;
+    put_u32(out, app::delta_patcher_t::MAGIC);
+    put_u32(out, static_cast<uint32_t>(base.size()));
+    put_u32(out, crc32_ieee(base.data(), base.size()));
+    put_u32(out, static_cast<uint32_t>(target.size()));
+    put_u32(out, crc32_ieee(target.data(), target.size()));
+    out.push_back(app::delta_patcher_t::OP_COPY);
+    put_u32(out, 0);
+    put_u32(out, version);
+    out.push_back(app::delta_patcher_t::OP_INSERT);
+    put_u32(out, 4);
+    out.insert(out.end(), target.begin() + version, target.begin() + version + 4);
+    out.push_back(app::delta_patcher_t::OP_COPY);
+    put_u32(out, version + 4);
+    put_u32(out, tail - version - 4);
+    out.push_back(app::delta_patcher_t::OP_INSERT);
+    put_u32(out, static_cast<uint32_t>(target.size() - tail));
+    out.insert(out.end(), target.begin() + tail, target.end());
+    return out;
+}
+
+// A tag as an SMP server over UDP, in a child process with its own flash:
+// img_mgmt state and the upload and DFU groups of app_dfu through app::upload_t
+struct tag_server_t {
+    int fd;
+    // Stops answering uploads once this much is staged, until the client reads the DFU state
+    uint32_t cut_at;
+    std::unique_ptr<app::upload_t> upload = std::make_unique<app::upload_t>();
+    bool confirmed = true;
+    bool pending = false;
+    bool cut = false;
+
+    static std::optional<bytes_t> hash(uint8_t area) {
+        const auto& flash = stub::flash_contents(area);
+        return fleet::image_hash(bytes_t(flash.begin(), flash.end()));
+    }
+
+    static int mgmt_rc(int err) {
+        return err == 0 ? 0 : err == -ESRCH ? fleet::smp::RC_EBADSTATE
+            : err == -ENOTSUP ? fleet::smp::RC_ENOTSUP : 3;
+    }
+
+    void encode_images(fleet::encoder_t& out) {
+        const auto primary = hash(FLASH_AREA_ID(image_0));
+        const auto secondary = hash(FLASH_AREA_ID(image_1));
+        out.text("images").array(secondary ? 2 : 1);
+        out.map(5).text("slot").uint(0).text("hash").bytes(primary->data(), primary->size());
+        out.text("active").boolean(true).text("confirmed").boolean(confirmed).text("pending").boolean(false);
+        if(secondary) {
+            out.map(5).text("slot").uint(1).text("hash").bytes(secondary->data(), secondary->size());
+            out.text("active").boolean(false).text("confirmed").boolean(false).text("pending").boolean(pending);
+        }
+    }
+
+    // MCUboot test swap, the images trade places
+    void reset() {
+        if(pending) {
+            auto& primary = stub::flash_contents(FLASH_AREA_ID(image_0));
+            auto& secondary = stub::flash_contents(FLASH_AREA_ID(image_1));
+            std::swap_ranges(primary.begin(), primary.end(), secondary.begin());
+            confirmed = false;
+            pending = false;
+        }
+        upload = std::make_unique<app::upload_t>();
+        cut = false;
+    }
+
+    void offer(app::upload_t::kind_e kind, const fleet::value_t& request, fleet::encoder_t& out) {
+        const bytes_t data = request.bytes("data");
+        auto reply = upload->offer(kind, static_cast<uint32_t>(request.integer("off")), data.data(), data.size(),
+            static_cast<uint32_t>(request.integer("len")));
+        if(upload->settling()) {
+            // The handler waits for the upload thread to finish the image
+            while(upload->settling() && upload->service(K_NO_WAIT)) {
+            }
+            reply = upload->status();
+        }
+        out.map(3).text("rc").uint(mgmt_rc(reply.rc)).text("off").uint(reply.off).text("done").boolean(reply.done);
+    }
+
+    // Response payload to a request, false to leave it unanswered
+    bool handle(const fleet::smp::header_t& header, const fleet::value_t& request, fleet::encoder_t& out) {
+        const bool write = header.op == fleet::smp::OP_WRITE;
+        if(header.group == fleet::smp::GROUP_IMAGE && header.id == fleet::smp::ID_IMAGE_STATE) {
+            if(write && request.boolean("confirm")) {
+                confirmed = true;
+            } else if(write) {
+                pending = request.bytes("hash") == hash(FLASH_AREA_ID(image_1));
+            }
+            out.map(1);
+            encode_images(out);
+        } else if(header.group == fleet::smp::GROUP_IMAGE && header.id == fleet::smp::ID_IMAGE_UPLOAD && write) {
+            if(cut || (cut_at && upload->staged() >= cut_at)) {
+                cut = true;
+                return false;
+            }
+            offer(app::upload_t::kind_e::IMAGE, request, out);
+        } else if(header.group == fleet::smp::GROUP_DFU && header.id == fleet::smp::ID_DFU_DELTA) {
+            if(write) {
+                offer(app::upload_t::kind_e::DELTA, request, out);
+                return true;
+            }
+            // The link is back
+            cut_at = cut ? 0 : cut_at;
+            cut = false;
+            const auto reply = upload->status();
+            out.map(6).text("rc").uint(mgmt_rc(reply.rc)).text("off").uint(reply.off);
+            out.text("staged").uint(upload->staged()).text("len").uint(upload->total());
+            out.text("delta").boolean(upload->kind() == app::upload_t::kind_e::DELTA).text("done").boolean(reply.done);
+        } else if(header.group == fleet::smp::GROUP_OS && header.id == fleet::smp::ID_OS_RESET && write) {
+            reset();
+            out.map(0);
+        } else {
+            out.map(1).text("rc").uint(fleet::smp::RC_ENOTSUP);
+        }
+        return true;
+    }
+
+    [[noreturn]] void serve() {
+        bool idle = true;
+        while(true) {
+            pollfd pfd = { fd, POLLIN, 0 };
+            if(poll(&pfd, 1, idle ? 5 : 0) > 0) {
+                receive();
+            }
+            // The upload thread gets its turn between requests, as between connection events
+            idle = !upload->service(K_NO_WAIT);
+        }
+    }
+
+    void receive() {
+        uint8_t buffer[2048];
+        sockaddr_storage from;
+        socklen_t from_len = sizeof(from);
+        const ssize_t n = recvfrom(fd, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &from_len);
+        if(n < static_cast<ssize_t>(fleet::smp::HEADER_SIZE)) {
+            return;
+        }
+        const auto header = fleet::smp::header_t::read(buffer);
+        fleet::value_t request;
+        fleet::decode(buffer + fleet::smp::HEADER_SIZE, n - fleet::smp::HEADER_SIZE, request);
+        fleet::encoder_t body;
+        if(!handle(header, request, body)) {
+            return;
+        }
+        bytes_t packet;
+        fleet::smp::header_t{ static_cast<uint8_t>(header.op + 1), 0, static_cast<uint16_t>(body.out.size()),
+            header.group, header.seq, header.id }.write(packet);
+        packet.insert(packet.end(), body.out.begin(), body.out.end());
+        sendto(fd, packet.data(), packet.size(), 0, reinterpret_cast<sockaddr*>(&from), from_len);
+    }
+};
+
+// A simulated tag on 127.0.0.1, stopped when this goes out of scope
+struct tag_t {
+    pid_t pid = -1;
+    std::string address;
+
+    tag_t(const bytes_t& running, uint32_t cut_at = 0) {
+        const int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len);
+        address = "127.0.0.1:" + std::to_string(ntohs(addr.sin_port));
+
+        pid = fork();
+        if(pid == 0) {
+            stub::reset_kernel();
+            stub::flash_reset();
+            std::copy(running.begin(), running.end(), stub::flash_contents(FLASH_AREA_ID(image_0)).begin());
+            tag_server_t{ fd, cut_at }.serve();
+        }
+        close(fd);
+    }
+
+    ~tag_t() {
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+    }
+};
+
+fleet::options_t options;
+bytes_t old_image;
+bytes_t new_image;
+
+void setup() {
+    old_image = make_image(1, body(1));
+    new_image = make_image(2, body(2));
+    options = {};
+    options.image = new_image;
+    options.target = *fleet::image_hash(new_image);
+    options.retries = 2;
+    options.poll_interval_ms = 20;
+    options.boot_timeout_ms = 5000;
+    options.request_timeout_ms = 500;
+}
+
+std::vector<fleet::connect_t> lanes(size_t n) {
+    return std::vector<fleet::connect_t>(n, [](const std::string& address) -> std::unique_ptr<fleet::transport_t> {
+        return std::make_unique<fleet::udp_transport_t>(address);
+    });
+}
+
+}
+
+static void test_updates_tags_concurrently() {
+    tag_t tags[] = { tag_t(old_image), tag_t(old_image), tag_t(old_image) };
+    const std::vector<std::string> devices = { tags[0].address, tags[1].address, tags[2].address };
+
+    const auto results = fleet::update_fleet(devices, lanes(3), options);
+    for(const auto& result : results) {
+        zassert_equal(result.status, "updated", "%s: %s", result.device.c_str(), result.error.c_str());
+        zassert_equal(result.attempts, 1, NULL);
+        zassert_equal(result.mode, "full", NULL);
+        zassert_true(result.bytes >= new_image.size(), NULL);
+        zassert_equal(result.resumed_from, 0u, NULL);
+    }
+
+    // A second run finds every tag running the image confirmed
+    for(const auto& result : fleet::update_fleet(devices, lanes(2), options)) {
+        zassert_equal(result.status, "current", "%s: %s", result.device.c_str(), result.error.c_str());
+        zassert_equal(result.bytes, 0u, NULL);
+    }
+}
+
+static void test_reports_unreachable_tag() {
+    options.retries = 1;
+    tag_t tag(old_image);
+    // Nothing listens on the port of a stopped tag
+    std::string gone;
+    {
+        tag_t stopped(old_image);
+        gone = stopped.address;
+    }
+    const auto results = fleet::update_fleet({ tag.address, gone }, lanes(2), options);
+    zassert_equal(results[0].status, "updated", "%s", results[0].error.c_str());
+    zassert_equal(results[1].status, "failed", NULL);
+    zassert_equal(results[1].attempts, 2, NULL);
+    zassert_false(results[1].error.empty(), NULL);
+
+    std::ostringstream table;
+    zassert_true(fleet::report(table, results), NULL);
+    zassert_true(table.str().find("failed") != std::string::npos, NULL);
+}
+
+static void test_sends_delta_to_tags_running_its_base() {
+    const bytes_t base = make_image(3, body(2));
+    options.delta = make_delta(base, new_image);
+    options.delta_base = *fleet::image_hash(base);
+    zassert_true(fleet::delta_matches(options.delta, base, new_image), NULL);
+    zassert_false(fleet::delta_matches(options.delta, old_image, new_image), NULL);
+    tag_t on_base(base);
+    tag_t on_other(old_image);
+
+    const auto results = fleet::update_fleet({ on_base.address, on_other.address }, lanes(2), options);
+    zassert_equal(results[0].status, "updated", "%s", results[0].error.c_str());
+    zassert_equal(results[0].mode, "delta", NULL);
+    zassert_true(results[0].bytes < new_image.size() / 10, "only the differences are sent");
+    zassert_equal(results[1].status, "updated", "%s", results[1].error.c_str());
+    zassert_equal(results[1].mode, "full", NULL);
+}
+
+static void test_resumes_upload_at_reported_offset() {
+    const uint32_t cut_at = 8 * 1024;
+    tag_t tag(old_image, cut_at);
+
+    const auto results = fleet::update_fleet({ tag.address }, lanes(1), options);
+    zassert_equal(results[0].status, "updated", "%s", results[0].error.c_str());
+    zassert_equal(results[0].attempts, 2, "the first attempt stalls");
+    zassert_true(results[0].resumed_from >= cut_at, NULL);
+    zassert_true(results[0].resumed_from < new_image.size(), NULL);
+    zassert_true(results[0].bytes < 2 * new_image.size(), "not sent again from the start");
+}
+
+void test_main(void) {
+    ztest_test_suite(fleet,
+        ztest_unit_test_setup_teardown(test_updates_tags_concurrently, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_reports_unreachable_tag, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_sends_delta_to_tags_running_its_base, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_resumes_upload_at_reported_offset, setup, unit_test_noop));
+    ztest_run_test_suite(fleet);
+}
@@ -0,0 +1,112 @@
+#include <ztest.h>
+
+#include <app_gpio.hpp>
+
+#include <stub.hpp>
+
+PREPARE_GPIO(led0)
+PREPARE_GPIO(led1)
+PREPARE_GPIO(led3)
+PREPARE_GPIO(stub1)
+
+namespace {
+
+// nRF52 DK LEDs are active low on GPIO_0, stub1 is active high on GPIO_1
+using leds_t = app_gpio::group_t<led0_binding_t, led1_binding_t, led3_binding_t>;
+using mixed_t = app_gpio::group_t<led0_binding_t, stub1_binding_t, led3_binding_t>;
+
+constexpr uint32_t LED0 = BIT(17);
+constexpr uint32_t LED1 = BIT(18);
+constexpr uint32_t LED3 = BIT(20);
+constexpr uint32_t STUB1 = BIT(3);
+
+void setup() {
+    stub::reset_kernel();
+    stub::gpio_reset();
+}
+
+}
+
+static void test_bindings_from_devicetree() {
+    zassert_true(led0_binding_t::controller == "GPIO_0", NULL);
+    zassert_equal(led0_binding_t::pin, 17, NULL);
+    zassert_equal(led0_binding_t::flags, int32_t{GPIO_ACTIVE_LOW}, NULL);
+    zassert_true(stub1_binding_t::controller == "GPIO_1", NULL);
+    zassert_equal(led3_gpio.pin, 20, NULL);
+
+    static_assert(leds_t::NUM_PORTS == 1, "one controller");
+    static_assert(mixed_t::NUM_PORTS == 2, "two controllers");
+}
+
+static void test_init_binds_each_port_once() {
+    mixed_t group;
+    zassert_true(group.init().has_value(), NULL);
+    zassert_equal(stub::device_lookups(), 2u, NULL);
+
+    // Inactive is high on the active low LEDs
+    zassert_equal(stub::gpio_port(0).outputs, LED0 | LED3, NULL);
+    zassert_equal(stub::gpio_port(0).out, LED0 | LED3, NULL);
+    zassert_equal(stub::gpio_port(1).outputs, STUB1, NULL);
+    zassert_equal(stub::gpio_port(1).out, 0u, NULL);
+}
+
+static void test_write_one_call_per_port() {
+    leds_t leds;
+    zassert_true(leds.init().has_value(), NULL);
+    const uint32_t before = stub::gpio_port(0).writes;
+
+    leds.write(0b101);
+    zassert_equal(stub::gpio_port(0).writes - before, 1u, NULL);
+    zassert_equal(stub::gpio_port(0).out, LED1, "led0 and led3 on, low");
+
+    leds.all(true);
+    zassert_equal(stub::gpio_port(0).out, 0u, NULL);
+    leds.all(false);
+    zassert_equal(stub::gpio_port(0).out, LED0 | LED1 | LED3, NULL);
+    zassert_equal(stub::gpio_port(0).writes - before, 3u, NULL);
+}
+
+static void test_write_leaves_other_pins() {
+    mixed_t group;
+    zassert_true(group.init().has_value(), NULL);
+    stub::gpio_port(0).out |= BIT(2);
+    stub::gpio_port(1).out |= BIT(7);
+
+    group.write(0b010);
+    zassert_equal(stub::gpio_port(0).out, LED0 | LED3 | BIT(2), NULL);
+    zassert_equal(stub::gpio_port(1).out, STUB1 | BIT(7), NULL);
+
+    group.write(0b001);
+    zassert_equal(stub::gpio_port(0).out, LED3 | BIT(2), NULL);
+    zassert_equal(stub::gpio_port(1).out, BIT(7), NULL);
+}
+
+static void test_pattern_steps_and_clears() {
+    leds_t leds;
+    zassert_true(leds.init().has_value(), NULL);
+    {
+        app_gpio::pattern_t<leds_t, app::hz_t<10>, 3> pattern(leds, { 0b001, 0b010, 0b100 });
+        zassert_true(pattern.valid(), NULL);
+
+        stub::run_until(100'000);
+        zassert_equal(stub::gpio_port(0).out, LED1 | LED3, NULL);
+        stub::run_until(200'000);
+        zassert_equal(stub::gpio_port(0).out, LED0 | LED3, NULL);
+        stub::run_until(300'000);
+        zassert_equal(stub::gpio_port(0).out, LED0 | LED1, NULL);
+        stub::run_until(400'000);
+        zassert_equal(stub::gpio_port(0).out, LED1 | LED3, "loops");
+    }
+    zassert_equal(stub::gpio_port(0).out, LED0 | LED1 | LED3, NULL);
+    zassert_equal(stub::pending(), 0u, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(gpio,
+        ztest_unit_test(test_bindings_from_devicetree),
+        ztest_unit_test_setup_teardown(test_init_binds_each_port_once, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_write_one_call_per_port, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_write_leaves_other_pins, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_pattern_steps_and_clears, setup, unit_test_noop));
+    ztest_run_test_suite(gpio);
+}
@@ -0,0 +1,224 @@
+#include <ztest.h>
+
+#include <app/history.hpp>
+
+#include <sys/byteorder.h>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+using history = app::history_t<64, 4, 100>;
+using header_t = history::block_header_t;
+
+struct sample_t {
+    uint32_t t;
+    int32_t v;
+};
+
+// Collects spilled blocks and decodes everything, the RAM block last
+struct recorder_t {
+    std::vector<std::vector<uint8_t>> blocks;
+
+    void operator()(const uint8_t* block, size_t len) {
+        blocks.emplace_back(block, block + len);
+    }
+
+    std::vector<sample_t> decode(const history& h) const {
+        std::vector<sample_t> samples;
+        auto add = [&](const uint8_t* block, size_t len) {
+            uint32_t times[history::MAX_BLOCK_SAMPLES];
+            int32_t values[history::MAX_BLOCK_SAMPLES];
+            const size_t count = history::decode(block, len, times, values, history::MAX_BLOCK_SAMPLES);
+            for(size_t i = 0; i < count; i++) {
+                samples.push_back({ times[i], values[i] });
+            }
+        };
+        for(const auto& block : blocks) {
+            add(block.data(), block.size());
+        }
+        add(h.block(), h.block_size());
+        return samples;
+    }
+};
+
+// Nothing spilled, only the RAM block counts
+auto no_spilled = [](auto&&) {};
+
+}
+
+static void test_varint_round_trip() {
+    // Deltas that need one to five varint bytes, both signs for the values
+    const std::vector<sample_t> input = {
+        { 0, 0 }, { 1, 1 }, { 2, -1 }, { 130, 63 }, { 131, -64 }, { 20000, 8191 }, { 20001, -8192 },
+        { 3000000, 1048575 }, { 3000001, -1048576 }, { 0xfffffff0u, 0x3fffffff }, { 0xfffffff1u, -0x3fffffff },
+    };
+
+    history h(3);
+    recorder_t spill;
+    for(const auto& s : input) {
+        h.insert(s.t, s.v, spill);
+    }
+
+    const auto output = spill.decode(h);
+    zassert_equal(output.size(), input.size(), NULL);
+    for(size_t i = 0; i < input.size(); i++) {
+        zassert_equal(output[i].t, input[i].t, "time %zu", i);
+        zassert_equal(output[i].v, input[i].v, "value %zu", i);
+    }
+}
+
+static void test_steady_samples_pack_two_bytes() {
+    history h(1);
+    recorder_t spill;
+    for(uint32_t i = 0; i < 10; i++) {
+        h.insert(i * 20, 3000 + static_cast<int32_t>(i % 3) - 1, spill);
+    }
+    zassert_true(spill.blocks.empty(), NULL);
+    zassert_equal(h.block_size(), sizeof(header_t) + 9 * 2, NULL);
+
+    header_t header;
+    std::memcpy(&header, h.block(), sizeof(header));
+    zassert_equal(header.boot, 1u, NULL);
+    zassert_equal(header.count, 10, NULL);
+    zassert_equal(header.t0, 0u, NULL);
+    zassert_equal(header.v0, 2999, NULL);
+}
+
+static void test_full_block_spills_in_order() {
+    history h(2);
+    recorder_t spill;
+    std::vector<sample_t> input;
+    for(uint32_t i = 0; i < 200; i++) {
+        input.push_back({ i * 20, static_cast<int32_t>(i * 37 % 500) - 250 });
+        h.insert(input.back().t, input.back().v, spill);
+    }
+
+    zassert_true(spill.blocks.size() > 1, NULL);
+    zassert_equal(h.stats().blocks, spill.blocks.size(), NULL);
+    zassert_equal(h.stats().samples, 200u, NULL);
+    for(const auto& block : spill.blocks) {
+        zassert_true(block.size() <= 64, "spilled block larger than BLOCK_SIZE");
+    }
+
+    const auto output = spill.decode(h);
+    zassert_equal(output.size(), input.size(), NULL);
+    for(size_t i = 0; i < input.size(); i++) {
+        zassert_equal(output[i].t, input[i].t, "time %zu", i);
+        zassert_equal(output[i].v, input[i].v, "value %zu", i);
+    }
+}
+
+static void test_decode_rejects_truncated_block() {
+    history h(1);
+    recorder_t spill;
+    h.insert(0, 0, spill);
+    h.insert(1000, 100000, spill);
+
+    uint32_t times[4];
+    int32_t values[4];
+    zassert_equal(history::decode(h.block(), sizeof(header_t) - 1, times, values, 4), 0u, "short header");
+    zassert_equal(history::decode(h.block(), h.block_size() - 1, times, values, 4), 1u, "cut varint");
+    zassert_equal(history::decode(h.block(), h.block_size(), times, values, 1), 1u, "max_samples");
+    zassert_equal(history::decode(h.block(), h.block_size(), times, values, 4), 2u, NULL);
+}
+
+static void test_aggregate_over_windows() {
+    history h(1);
+    recorder_t spill;
+    // Windows of 100 s: [0, 100) holds 10 and 20, [100, 200) holds -5, [300, 400) holds 40
+    h.insert(10, 10, spill);
+    h.insert(50, 20, spill);
+    h.insert(150, -5, spill);
+    h.insert(350, 40, spill);
+
+    const auto last = h.aggregate(1);
+    zassert_equal(last.count, 1u, NULL);
+    zassert_equal(last.mean(), 40, NULL);
+
+    const auto all = h.aggregate(4);
+    zassert_equal(all.count, 4u, NULL);
+    zassert_equal(all.min, -5, NULL);
+    zassert_equal(all.max, 40, NULL);
+    zassert_equal(all.sum, 65, NULL);
+
+    // Window 0 is reused by window 4 and drops out
+    h.insert(420, 1, spill);
+    zassert_equal(h.aggregate(4).count, 3u, NULL);
+}
+
+static void test_percentile_of_ram_block() {
+    history h(1);
+    recorder_t spill;
+    for(int32_t v = 1; v <= 20; v++) {
+        h.insert(static_cast<uint32_t>(v), 21 - v, spill);
+    }
+    zassert_equal(h.percentile(0, no_spilled), 1, NULL);
+    zassert_equal(h.percentile(50, no_spilled), 11, NULL);
+    zassert_equal(h.percentile(100, no_spilled), 20, NULL);
+}
+
+static void test_percentile_over_spilled_blocks() {
+    history h(1);
+    recorder_t spill;
+    // A noisy discharge across several spilled blocks, values far apart so bins split often
+    std::vector<int32_t> all;
+    for(uint32_t i = 0; i < 400; i++) {
+        const int32_t v = 3000 - static_cast<int32_t>(i) * 3 + static_cast<int32_t>((i * 7919) % 200) - 100;
+        h.insert(i * 20, v, spill);
+        all.push_back(v);
+    }
+    zassert_true(spill.blocks.size() > 2, NULL);
+
+    auto spilled = [&](auto&& visit) {
+        for(const auto& block : spill.blocks) {
+            visit(block.data(), block.size());
+        }
+    };
+    std::sort(all.begin(), all.end());
+    for(const uint8_t pct : { 0, 10, 50, 90, 99, 100 }) {
+        const size_t index = std::min(all.size() - 1, all.size() * pct / 100);
+        zassert_equal(h.percentile(pct, spilled), all[index], "percentile %d", (int) pct);
+    }
+}
+
+static void test_summary_layout() {
+    history h(1);
+    recorder_t spill;
+    h.insert(10, 10, spill);
+    h.insert(50, 20, spill);
+    h.insert(350, 40, spill);
+
+    uint8_t summary[history::SUMMARY_SIZE];
+    h.summary(summary, no_spilled);
+    zassert_equal(summary[0], history::SUMMARY_VERSION, NULL);
+    zassert_equal(summary[1], 4, NULL);
+    zassert_equal(sys_get_le32(summary + 4), 100u, NULL);
+    // Last window
+    zassert_equal((int32_t) sys_get_le32(summary + 8), 40, NULL);
+    zassert_equal(sys_get_le32(summary + 20), 1u, NULL);
+    // All windows
+    zassert_equal((int32_t) sys_get_le32(summary + 24), 10, NULL);
+    zassert_equal((int32_t) sys_get_le32(summary + 28), 40, NULL);
+    zassert_equal((int32_t) sys_get_le32(summary + 32), 23, NULL);
+    zassert_equal(sys_get_le32(summary + 36), 3u, NULL);
+    // 10th, 50th and 90th percentile
+    zassert_equal((int32_t) sys_get_le32(summary + 40), 10, NULL);
+    zassert_equal((int32_t) sys_get_le32(summary + 44), 20, NULL);
+    zassert_equal((int32_t) sys_get_le32(summary + 48), 40, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(history,
+        ztest_unit_test(test_varint_round_trip),
+        ztest_unit_test(test_steady_samples_pack_two_bytes),
+        ztest_unit_test(test_full_block_spills_in_order),
+        ztest_unit_test(test_decode_rejects_truncated_block),
+        ztest_unit_test(test_aggregate_over_windows),
+        ztest_unit_test(test_percentile_of_ram_block),
+        ztest_unit_test(test_percentile_over_spilled_blocks),
+        ztest_unit_test(test_summary_layout));
+    ztest_run_test_suite(history);
+}
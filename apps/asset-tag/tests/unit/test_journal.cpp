@@ -0,0 +1,292 @@
+#include <ztest.h>
+#include <stub.hpp>
+
+#include <app/journal.hpp>
+
+#include <cstring>
+#include <memory>
+
+namespace {
+
+constexpr const char* PATH = "/lfs/journal";
+
+using journal = app::journal_t<4, 32, 512>;
+using header_t = journal::header_t;
+
+std::unique_ptr<journal> open_journal() {
+    auto j = std::make_unique<journal>();
+    zassert_true(j->open(PATH), "open failed");
+    return j;
+}
+
+void setup() {
+    stub::reset_kernel();
+    stub::fs_reset();
+    stub::log_reset();
+}
+
+uint32_t read_u32(const journal& j, uint8_t key) {
+    uint32_t value = 0;
+    zassert_equal(j.read(key, &value, sizeof(value)), (ssize_t) sizeof(value), "key %d missing", key);
+    return value;
+}
+
+}
+
+static void test_append_survives_reopen() {
+    auto j = open_journal();
+    const uint32_t a = 0x11223344, b = 0xaabbccdd;
+    zassert_true(j->append(0, &a, sizeof(a)), NULL);
+    zassert_true(j->append(2, &b, sizeof(b)), NULL);
+    zassert_false(j->contains(1), NULL);
+    uint32_t missing;
+    zassert_equal(j->read(1, &missing, sizeof(missing)), -ENOENT, NULL);
+    j.reset();
+
+    j = open_journal();
+    zassert_equal(read_u32(*j, 0), a, NULL);
+    zassert_equal(read_u32(*j, 2), b, NULL);
+    zassert_equal(j->stats().replayed, 2u, NULL);
+    zassert_equal(j->stats().truncated, 0u, NULL);
+}
+
+static void test_patch_writes_changed_bytes_only() {
+    auto j = open_journal();
+    uint8_t value[16] = {};
+    zassert_true(j->append(1, value, sizeof(value)), NULL);
+    const uint32_t written = j->stats().bytes_written;
+
+    // Same bytes again costs nothing
+    zassert_true(j->append(1, value, sizeof(value)), NULL);
+    zassert_equal(j->stats().skipped, 1u, NULL);
+    zassert_equal(j->stats().bytes_written, written, NULL);
+
+    // One changed byte in the middle is a one byte record
+    value[7] = 0x5a;
+    zassert_true(j->append(1, value, sizeof(value)), NULL);
+    zassert_equal(j->stats().bytes_written, written + sizeof(header_t) + 1, NULL);
+
+    // A shorter size zeroes the tail
+    zassert_true(j->patch(1, 0, value, 4, 4), NULL);
+    uint8_t read[16];
+    zassert_equal(j->read(1, read, sizeof(read)), 4, NULL);
+    j.reset();
+
+    j = open_journal();
+    zassert_equal(j->read(1, read, sizeof(read)), 4, NULL);
+    value[7] = 0x5a;
+    zassert_true(j->append(1, value, sizeof(value)), NULL);
+    zassert_equal(j->read(1, read, sizeof(read)), 16, NULL);
+    zassert_mem_equal(read, value, sizeof(value), NULL);
+}
+
+static void test_patch_rejects_out_of_range() {
+    auto j = open_journal();
+    uint8_t value[33] = {};
+    zassert_false(j->append(4, value, 4), "key past NUM_KEYS");
+    zassert_false(j->append(0, value, sizeof(value)), "value past MAX_RECORD_SIZE");
+    zassert_false(j->patch(0, 30, value, 4, 32), "patch past its size");
+}
+
+static void test_crc_mismatch_drops_tail() {
+    auto j = open_journal();
+    const uint32_t a = 1, b = 2;
+    zassert_true(j->append(0, &a, sizeof(a)), NULL);
+    zassert_true(j->append(0, &b, sizeof(b)), NULL);
+    const off_t first = sizeof(header_t) + sizeof(a);
+    j.reset();
+
+    // Flip a payload bit of the second record, its CRC no longer matches
+    stub::bytes_t* stored = stub::fs_stored(PATH);
+    zassert_not_null(stored, NULL);
+    (*stored)[first + sizeof(header_t)] ^= 0x01;
+
+    j = open_journal();
+    zassert_equal(read_u32(*j, 0), a, "replay should stop before the corrupt record");
+    zassert_equal(j->stats().truncated, 1u, NULL);
+    zassert_equal(j->size(), first, NULL);
+    j.reset();
+    zassert_equal(stub::fs_stored(PATH)->size(), (size_t) first, "tail was not truncated");
+}
+
+static void test_torn_tail_is_truncated() {
+    auto j = open_journal();
+    const uint32_t a = 7;
+    zassert_true(j->append(3, &a, sizeof(a)), NULL);
+    const off_t end = j->size();
+    j.reset();
+
+    // Half a header left by a reset mid-append
+    stub::fs_stored(PATH)->resize(end + sizeof(header_t) / 2, 0x4a);
+
+    j = open_journal();
+    zassert_equal(read_u32(*j, 3), a, NULL);
+    zassert_equal(j->stats().truncated, 1u, NULL);
+    zassert_true(j->append(3, &end, sizeof(end)), "append after truncation");
+    j.reset();
+
+    j = open_journal();
+    zassert_equal(read_u32(*j, 3), (uint32_t) end, NULL);
+}
+
+static void test_batch_applies_all_or_nothing() {
+    auto j = open_journal();
+    const uint32_t a0 = 1, a1 = 2;
+    zassert_true(j->append(0, &a0, sizeof(a0)), NULL);
+    zassert_true(j->append(1, &a1, sizeof(a1)), NULL);
+    const uint32_t syncs = j->stats().syncs;
+
+    // Power is lost before the commit marker, neither record may survive
+    const uint32_t b0 = 10, b1 = 20;
+    zassert_true(j->begin(), NULL);
+    zassert_false(j->begin(), "nested batch");
+    zassert_true(j->append(0, &b0, sizeof(b0)), NULL);
+    zassert_true(j->append(1, &b1, sizeof(b1)), NULL);
+    zassert_equal(j->stats().syncs, syncs, "batch records must not sync");
+    stub::fs_power_cut();
+    j.reset();
+
+    j = open_journal();
+    zassert_equal(read_u32(*j, 0), a0, NULL);
+    zassert_equal(read_u32(*j, 1), a1, NULL);
+
+    // Committed, both survive with a single sync
+    zassert_true(j->begin(), NULL);
+    zassert_true(j->append(0, &b0, sizeof(b0)), NULL);
+    zassert_true(j->append(1, &b1, sizeof(b1)), NULL);
+    const uint32_t before = j->stats().syncs;
+    zassert_true(j->commit(), NULL);
+    zassert_equal(j->stats().syncs, before + 1, NULL);
+    zassert_equal(j->stats().batches, 1u, NULL);
+    stub::fs_power_cut();
+    j.reset();
+
+    j = open_journal();
+    zassert_equal(read_u32(*j, 0), b0, NULL);
+    zassert_equal(read_u32(*j, 1), b1, NULL);
+}
+
+static void test_batch_without_marker_is_ignored() {
+    auto j = open_journal();
+    const uint32_t a = 1, b = 2;
+    zassert_true(j->append(0, &a, sizeof(a)), NULL);
+    zassert_true(j->begin(), NULL);
+    zassert_true(j->append(0, &b, sizeof(b)), NULL);
+    zassert_true(j->commit(), NULL);
+    j.reset();
+
+    // Drop the commit marker, the batch record before it is now unclosed
+    stub::bytes_t* stored = stub::fs_stored(PATH);
+    stored->resize(stored->size() - sizeof(header_t));
+
+    j = open_journal();
+    zassert_equal(read_u32(*j, 0), a, "unclosed batch was applied");
+    zassert_equal(j->stats().truncated, 1u, NULL);
+}
+
+static void test_abort_restores_values() {
+    auto j = open_journal();
+    const uint32_t a = 5, b = 6;
+    zassert_true(j->append(2, &a, sizeof(a)), NULL);
+    zassert_true(j->begin(), NULL);
+    zassert_true(j->append(2, &b, sizeof(b)), NULL);
+    zassert_equal(read_u32(*j, 2), b, "cache reflects the open batch");
+    j->abort();
+    zassert_equal(read_u32(*j, 2), a, NULL);
+    zassert_true(j->commit() == false, "commit after abort");
+}
+
+static void test_abort_truncates_unsynced_records() {
+    auto j = open_journal();
+    const uint8_t a = 1;
+    zassert_true(j->append(0, &a, sizeof(a)), NULL);
+    const off_t end = j->size();
+
+    // The aborted records were never synced, only the open file still holds them
+    uint8_t large[32];
+    std::memset(large, 0x77, sizeof(large));
+    zassert_true(j->begin(), NULL);
+    zassert_true(j->append(1, large, sizeof(large)), NULL);
+    j->abort();
+    zassert_equal(j->stats().truncated, 1u, "unsynced tail was kept");
+    zassert_equal(j->size(), end, NULL);
+
+    // A later short record is synced alone, without the aborted bytes behind it
+    const uint8_t b = 2;
+    zassert_true(j->append(2, &b, sizeof(b)), NULL);
+    zassert_equal(stub::fs_stored(PATH)->size(), (size_t) j->size(), NULL);
+    j.reset();
+
+    j = open_journal();
+    zassert_equal(j->stats().truncated, 0u, NULL);
+    zassert_false(j->contains(1), NULL);
+}
+
+static void test_compaction_keeps_latest_values() {
+    auto j = open_journal();
+    uint8_t value[32];
+    for(uint32_t i = 0; i < 200; i++) {
+        std::memset(value, static_cast<int>(i), sizeof(value));
+        zassert_true(j->append(i % 4, value, sizeof(value)), "append %u", i);
+        zassert_true(j->size() <= 512, "log grew past COMPACT_SIZE");
+    }
+    zassert_true(j->stats().compactions > 0, NULL);
+    zassert_true(stub::fs_stored("/lfs/journal.tmp") == nullptr, "temporary file left behind");
+    j.reset();
+
+    j = open_journal();
+    for(uint8_t key = 0; key < 4; key++) {
+        const uint8_t expected = static_cast<uint8_t>(196 + key);
+        zassert_equal(j->read(key, value, sizeof(value)), 32, NULL);
+        zassert_equal(value[0], expected, "key %d", key);
+        zassert_equal(value[31], expected, "key %d", key);
+    }
+}
+
+static void test_interrupted_compaction_is_discarded() {
+    auto j = open_journal();
+    const uint32_t a = 9;
+    zassert_true(j->append(0, &a, sizeof(a)), NULL);
+    j.reset();
+
+    fs_file_t tmp = {};
+    zassert_ok(fs_open(&tmp, "/lfs/journal.tmp", FS_O_CREATE | FS_O_RDWR), NULL);
+    zassert_equal(fs_write(&tmp, "partial", 7), 7, NULL);
+    zassert_ok(fs_close(&tmp), NULL);
+
+    j = open_journal();
+    zassert_true(stub::fs_stored("/lfs/journal.tmp") == nullptr, NULL);
+    zassert_equal(read_u32(*j, 0), a, NULL);
+}
+
+static void test_for_each_visits_valid_keys() {
+    auto j = open_journal();
+    const uint8_t a = 1, b = 2;
+    zassert_true(j->append(0, &a, 1), NULL);
+    zassert_true(j->append(3, &b, 1), NULL);
+
+    uint8_t seen = 0;
+    j->for_each([&](uint8_t key, const uint8_t* data, size_t len) {
+        zassert_equal(len, 1u, NULL);
+        zassert_equal(data[0], key == 0 ? a : b, NULL);
+        seen |= 1 << key;
+    });
+    zassert_equal(seen, 0x09, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(journal,
+        ztest_unit_test_setup_teardown(test_append_survives_reopen, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_patch_writes_changed_bytes_only, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_patch_rejects_out_of_range, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_crc_mismatch_drops_tail, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_torn_tail_is_truncated, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_batch_applies_all_or_nothing, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_batch_without_marker_is_ignored, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_abort_restores_values, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_abort_truncates_unsynced_records, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_compaction_keeps_latest_values, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_interrupted_compaction_is_discarded, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_for_each_visits_valid_keys, setup, unit_test_noop));
+    ztest_run_test_suite(journal);
+}
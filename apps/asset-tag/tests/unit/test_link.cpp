@@ -0,0 +1,136 @@
+#include <ztest.h>
+
+#include <app_ble.hpp>
+
+#include <stub.hpp>
+
+#include <sys/byteorder.h>
+
+namespace {
+
+constexpr int64_t S = 1'000'000;
+
+using link_stats_t = decltype(app::link_manager)::stats_t;
+
+app_ble::manager_t ble;
+
+void setup() {
+    stub::reset_kernel();
+    stub::bt_reset();
+    ble.stop();
+    zassert_true(ble.init().has_value(), NULL);
+    zassert_true(ble.ready().has_value(), NULL);
+    zassert_true(ble.start(app_ble::adv_mode_e::FAST).has_value(), NULL);
+}
+
+uint16_t fast_interval() {
+    return app::link_params[static_cast<size_t>(app::link_mode_e::FAST)].interval_max;
+}
+
+uint16_t idle_interval() {
+    return app::link_params[static_cast<size_t>(app::link_mode_e::IDLE)].interval_max;
+}
+
+}
+
+static void test_fast_then_idle() {
+    const link_stats_t before = app::link_manager.stats();
+    bt_conn* conn = stub::bt_connect();
+    zassert_not_null(conn, NULL);
+
+    stub::run_until(1 * S);
+    zassert_equal(app::link_manager.state(conn).mode, app::link_mode_e::FAST, NULL);
+    zassert_equal(stub::bt_link(conn).interval, fast_interval(), NULL);
+
+    stub::run_until(10 * S);
+    const auto link = app::link_manager.state(conn);
+    zassert_equal(link.mode, app::link_mode_e::IDLE, NULL);
+    zassert_equal(link.interval, idle_interval(), NULL);
+    zassert_equal(link.renegotiations, 2u, NULL);
+
+    const link_stats_t after = app::link_manager.stats();
+    zassert_equal(after.renegotiations - before.renegotiations, 2u, NULL);
+    zassert_equal(after.param_updates - before.param_updates, 2u, NULL);
+    zassert_equal(after.request_failures, before.request_failures, NULL);
+    zassert_equal(after.interval, idle_interval(), NULL);
+    stub::bt_disconnect(conn);
+}
+
+static void test_refused_request_keeps_mode() {
+    const link_stats_t before = app::link_manager.stats();
+    stub::bt_fail(stub::bt_op_e::PARAM_UPDATE, -EBUSY);
+    bt_conn* conn = stub::bt_connect();
+    zassert_not_null(conn, NULL);
+
+    // Still on the parameters the peer connected with
+    stub::drain();
+    auto link = app::link_manager.state(conn);
+    zassert_equal(link.mode, app::link_mode_e::IDLE, NULL);
+    zassert_equal(link.renegotiations, 0u, NULL);
+    zassert_equal(link.request_failures, 1u, NULL);
+    zassert_equal(app::link_manager.stats().request_failures - before.request_failures, 1u, NULL);
+
+    // Retried after RETRY_MS
+    stub::run_until(2 * S);
+    link = app::link_manager.state(conn);
+    zassert_equal(link.mode, app::link_mode_e::FAST, NULL);
+    zassert_equal(link.renegotiations, 1u, NULL);
+    zassert_equal(stub::bt_link(conn).interval, fast_interval(), NULL);
+    stub::bt_disconnect(conn);
+}
+
+static void test_profile_reports_link_counters() {
+    app::profile.counters(app::counter_group_e::LINK, &app::link_manager);
+    bt_conn* conn = stub::bt_connect();
+    stub::run_until(1 * S);
+    const link_stats_t stats = app::link_manager.stats();
+
+    uint8_t dump[decltype(app::profile)::DUMP_SIZE];
+    const size_t len = app::profile.dump(dump);
+    zassert_equal(dump[0], 2, "version");
+    zassert_equal(dump[3], 1, "groups");
+
+    // The group follows the stages
+    const uint8_t* group = dump + 8 + static_cast<size_t>(app::stage_e::NUM_STAGES) * decltype(app::profile)::STAGE_DUMP_SIZE;
+    zassert_equal(group[0], static_cast<uint8_t>(app::counter_group_e::LINK), NULL);
+    zassert_equal(group[1], 12, NULL);
+    zassert_equal(len, static_cast<size_t>(group + 2 + 12 * 4 - dump), NULL);
+    zassert_equal(sys_get_le32(group + 2), stats.renegotiations, NULL);
+    zassert_equal(sys_get_le32(group + 2 + 5 * 4), fast_interval(), "interval");
+
+    app::profile.counters(app::counter_group_e::LINK, nullptr);
+    zassert_equal(app::profile.dump(dump), len - 2 - 12 * 4, NULL);
+    stub::bt_disconnect(conn);
+}
+
+static void test_profile_reports_work_counters() {
+    app::profile.counters(app::counter_group_e::WORK, &app::work_stats);
+    const uint32_t submitted = atomic_get(&app::work_stats.submitted);
+    const uint32_t executed = atomic_get(&app::work_stats.executed);
+
+    // Negotiation runs on a work item, counted with every other item
+    bt_conn* conn = stub::bt_connect();
+    stub::run_until(1 * S);
+
+    uint8_t dump[decltype(app::profile)::DUMP_SIZE];
+    const size_t len = app::profile.dump(dump);
+    zassert_equal(dump[3], 1, "groups");
+    const uint8_t* group = dump + 8 + static_cast<size_t>(app::stage_e::NUM_STAGES) * decltype(app::profile)::STAGE_DUMP_SIZE;
+    zassert_equal(group[0], static_cast<uint8_t>(app::counter_group_e::WORK), NULL);
+    zassert_equal(group[1], 3, NULL);
+    zassert_equal(len, static_cast<size_t>(group + 2 + 3 * 4 - dump), NULL);
+    zassert_true(sys_get_le32(group + 2) > submitted, "submitted");
+    zassert_true(sys_get_le32(group + 2 + 2 * 4) > executed, "executed");
+
+    app::profile.counters(app::counter_group_e::WORK, nullptr);
+    stub::bt_disconnect(conn);
+}
+
+void test_main(void) {
+    ztest_test_suite(link,
+        ztest_unit_test_setup_teardown(test_fast_then_idle, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refused_request_keeps_mode, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_profile_reports_link_counters, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_profile_reports_work_counters, setup, unit_test_noop));
+    ztest_run_test_suite(link);
+}
@@ -0,0 +1,162 @@
+#include <ztest.h>
+#include <stub.hpp>
+
+#include <app/journal.hpp>
+#include <app/persist.hpp>
+#include <app/shared_buffer.hpp>
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace {
+
+constexpr int64_t MS = 1000;
+constexpr int64_t WINDOW_MS = 500;
+
+using buffer_t = app::shared_buffer_t<32>;
+using persist_t = app::persist_t<2, buffer_t>;
+using journal = app::journal_t<2, buffer_t::size()>;
+
+struct range_t {
+    size_t region;
+    size_t offset;
+    std::vector<uint8_t> data;
+};
+
+buffer_t value;
+buffer_t data;
+
+// The wake flush of main.cpp: ranges patched into one journal batch
+size_t flush(persist_t& persist, journal& j, std::vector<range_t>* ranges = nullptr, bool force = false) {
+    j.begin();
+    const size_t flushed = persist.flush([&](size_t region, size_t offset, const uint8_t* src, size_t len, size_t size) {
+        if(ranges) {
+            ranges->push_back({ region, offset, std::vector<uint8_t>(src, src + len) });
+        }
+        const uint32_t skipped = j.stats().skipped;
+        if(!j.patch(static_cast<uint8_t>(region), offset, src, len, size)) {
+            return app::flush_e::FAILED;
+        }
+        return j.stats().skipped != skipped ? app::flush_e::SKIPPED : app::flush_e::WRITTEN;
+    }, [&]() { return j.commit(); }, force);
+    j.abort();
+    return flushed;
+}
+
+std::unique_ptr<journal> open_journal() {
+    auto j = std::make_unique<journal>();
+    zassert_true(j->open("/lfs/journal"), NULL);
+    return j;
+}
+
+void setup() {
+    stub::reset_kernel();
+    stub::fs_reset();
+    stub::log_reset();
+    value.assign("", 0);
+    data.assign("", 0);
+}
+
+}
+
+static void test_burst_coalesces_into_one_flush() {
+    persist_t persist({ &value, &data }, WINDOW_MS);
+    auto j = open_journal();
+
+    zassert_true(persist.write(0, "hello", 0, 5), NULL);
+    stub::run_until(100 * MS);
+    zassert_true(persist.write(0, "world", 10, 5), NULL);
+    stub::run_until(200 * MS);
+    zassert_true(persist.write(0, "HE", 0, 2), NULL);
+    zassert_equal(persist.stats().writes_received, 3u, NULL);
+    zassert_equal(persist.stats().writes_coalesced, 2u, NULL);
+
+    // Inside the window of the last write nothing is handed over
+    stub::run_until(600 * MS);
+    zassert_equal(flush(persist, *j), 0u, NULL);
+    zassert_true(persist.dirty(), NULL);
+
+    std::vector<range_t> ranges;
+    stub::run_until(700 * MS);
+    zassert_equal(flush(persist, *j, &ranges), 1u, NULL);
+    zassert_equal(ranges.size(), 1u, NULL);
+    zassert_equal(ranges[0].offset, 0u, NULL);
+    zassert_equal(ranges[0].data.size(), 15u, "the union of the burst");
+    zassert_equal(std::memcmp(ranges[0].data.data(), "HEllo", 5), 0, "the latest bytes");
+    zassert_false(persist.dirty(), NULL);
+    zassert_equal(persist.stats().flushes, 1u, NULL);
+    zassert_equal(j->stats().batches, 1u, "one journal commit");
+}
+
+static void test_flushes_written_range() {
+    persist_t persist({ &value, &data }, WINDOW_MS);
+    auto j = open_journal();
+
+    zassert_true(persist.write(1, "abc", 4, 3), NULL);
+    zassert_true(persist.write(1, "xy", 9, 2), NULL);
+    zassert_false(persist.write(1, "overflow", buffer_t::size() - 4, 8), "past the end");
+    stub::run_until(1000 * MS);
+
+    std::vector<range_t> ranges;
+    zassert_equal(flush(persist, *j, &ranges), 1u, NULL);
+    zassert_equal(ranges.size(), 1u, NULL);
+    zassert_equal(ranges[0].region, 1u, NULL);
+    zassert_equal(ranges[0].offset, 4u, "from the lowest byte written");
+    zassert_equal(ranges[0].data.size(), 7u, "to the highest, gap included");
+    zassert_equal(std::memcmp(ranges[0].data.data(), "abc", 3), 0, NULL);
+    zassert_equal(std::memcmp(ranges[0].data.data() + 5, "xy", 2), 0, NULL);
+
+    uint8_t stored[buffer_t::size()];
+    zassert_equal(j->read(1, stored, sizeof(stored)), (ssize_t) buffer_t::size(), NULL);
+    zassert_equal(std::memcmp(stored + 4, "abc", 3), 0, NULL);
+}
+
+static void test_identical_content_skipped() {
+    persist_t persist({ &value, &data }, WINDOW_MS);
+    auto j = open_journal();
+
+    zassert_true(persist.write(0, "same", 0, 4), NULL);
+    zassert_equal(flush(persist, *j, nullptr, true), 1u, NULL);
+    const uint32_t appends = j->stats().appends;
+    const uint32_t written = stub::fs_stats().bytes_written;
+
+    // A phone writing back what is stored dirties the range but reaches no flash
+    zassert_true(persist.write(0, "same", 0, 4), NULL);
+    zassert_equal(flush(persist, *j, nullptr, true), 1u, NULL);
+    zassert_false(persist.dirty(), NULL);
+    zassert_equal(j->stats().appends, appends, NULL);
+    zassert_equal(stub::fs_stats().bytes_written, written, NULL);
+    zassert_equal(persist.stats().flushes, 1u, "only the first flush wrote");
+    zassert_equal(persist.stats().skipped, 1u, NULL);
+
+    uint32_t counters[app::MAX_GROUP_COUNTERS];
+    zassert_equal(persist.read(counters), 4u, NULL);
+    zassert_equal(counters[2], 1u, "flushes");
+    zassert_equal(counters[3], 1u, "skipped");
+}
+
+static void test_failed_commit_keeps_range_dirty() {
+    persist_t persist({ &value, &data }, WINDOW_MS);
+    auto j = open_journal();
+
+    zassert_true(persist.write(0, "one", 0, 3), NULL);
+    zassert_true(persist.write(1, "two", 0, 3), NULL);
+    stub::fs_fail("/lfs/journal", -ENOSPC);
+    zassert_equal(flush(persist, *j, nullptr, true), 0u, NULL);
+    zassert_true(persist.dirty(), "both regions retried");
+    zassert_equal(persist.stats().flushes, 0u, NULL);
+
+    zassert_equal(flush(persist, *j, nullptr, true), 2u, NULL);
+    zassert_false(persist.dirty(), NULL);
+    zassert_equal(persist.stats().flushes, 2u, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(persist,
+        ztest_unit_test_setup_teardown(test_burst_coalesces_into_one_flush, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_flushes_written_range, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_identical_content_skipped, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_failed_commit_keeps_range_dirty, setup, unit_test_noop));
+    ztest_run_test_suite(persist);
+}
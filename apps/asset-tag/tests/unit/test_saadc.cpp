@@ -0,0 +1,194 @@
+#include <ztest.h>
+
+#include <app_saadc.hpp>
+
+#include <stub.hpp>
+
+#include <cstring>
+
+namespace {
+
+constexpr int64_t MS = 1000;
+
+using stream_t = app_saadc::stream_t<2>;
+
+// The input in the thousands, the conversion count below
+int16_t tagged(uint8_t input, uint32_t n) {
+    return static_cast<int16_t>(input * 1000 + n % 1000);
+}
+
+adc_channel_cfg channel(uint8_t id, uint8_t input) {
+    adc_channel_cfg cfg = {
+        .gain             = ADC_GAIN_1_6,
+        .reference        = ADC_REF_INTERNAL,
+        .acquisition_time = ADC_ACQ_TIME(ADC_ACQ_TIME_MICROSECONDS, 10),
+        .channel_id       = id,
+        .differential     = 0,
+        .input_positive   = input
+    };
+    return cfg;
+}
+
+const adc_channel_cfg low = channel(1, NRF_SAADC_INPUT_AIN2);
+const adc_channel_cfg vdd = channel(3, NRF_SAADC_INPUT_VDD);
+
+void setup() {
+    stub::reset_kernel();
+    stub::saadc_reset();
+    stub::saadc_set_input(tagged);
+    app_saadc::channels = app_saadc::channels_t{};
+}
+
+}
+
+static void test_stream_blocks_at_interval() {
+    stream_t stream({ &low, &vdd }, 1000);
+    // 1000 us rounds to 33 ticks of the 32768 Hz RTC
+    zassert_equal(stream.ticks(), 33u, NULL);
+    zassert_true(stream.start().has_value(), NULL);
+    zassert_true(stub::rtc_running(), NULL);
+    zassert_equal(stub::ppi_channels_enabled(), 2u, NULL);
+
+    // A block of 16 samples every 16 * 1007 us
+    stub::run_until(50 * MS);
+    zassert_equal(stream.stats().blocks, 3u, NULL);
+    zassert_equal(stream.stats().samples, 48u, NULL);
+    zassert_equal(stub::saadc_stats().samplings, 49u, NULL);
+
+    int16_t samples[3 * stream_t::BLOCK_SIZE];
+    zassert_equal(stream.read(samples, 3 * stream_t::BLOCK_SIZE), 3 * stream_t::BLOCK_SIZE, NULL);
+    for(size_t i = 0; i < 3 * stream_t::BLOCK_SIZE; i++) {
+        const int expected = (i % 2 ? NRF_SAADC_INPUT_VDD : NRF_SAADC_INPUT_AIN2) * 1000 + (int) i;
+        zassert_equal(samples[i], expected, "sample %d", (int) i);
+    }
+    zassert_equal(stream.read(samples, 1), 0u, NULL);
+
+    // Paced in hardware, the driver's ISR stays out
+    zassert_equal(stub::saadc_stats().driver_irqs, 0u, NULL);
+    stream.stop();
+}
+
+static void test_stream_overrun() {
+    stream_t stream({ &low, &vdd }, 1000);
+    zassert_true(stream.start().has_value(), NULL);
+
+    // The ring holds 4 blocks, the rest are dropped until read
+    stub::run_until(6 * 16 * 1008);
+    zassert_equal(stream.stats().blocks, 4u, NULL);
+    zassert_equal(stream.stats().overruns, 2u, NULL);
+
+    int16_t samples[stream_t::BLOCK_SIZE];
+    zassert_equal(stream.read(samples, stream_t::BLOCK_SIZE), stream_t::BLOCK_SIZE, NULL);
+    stub::run_until(7 * 16 * 1008);
+    zassert_equal(stream.stats().blocks, 5u, NULL);
+    stream.stop();
+}
+
+static void test_measure_waits_for_stream() {
+    app_saadc::manager_t<2> manager;
+    stream_t stream({ &low, &vdd }, 1000);
+    zassert_true(stream.start().has_value(), NULL);
+
+    const auto busy = manager.measure(std::array{ &low, &vdd });
+    zassert_false(busy.has_value(), NULL);
+    zassert_equal(busy.error(), -EBUSY, NULL);
+    zassert_equal(stub::saadc_stats().reads, 0u, NULL);
+
+    stream.stop();
+    zassert_false(stub::rtc_running(), NULL);
+    zassert_false(stub::saadc_enabled(), NULL);
+    zassert_equal(stub::ppi_channels_enabled(), 0u, NULL);
+    zassert_true(stub::saadc_int_enabled() & NRF_SAADC_INT_END, NULL);
+
+    const auto measured = manager.measure(std::array{ &low, &vdd });
+    zassert_true(measured.has_value(), NULL);
+    zassert_equal(stub::saadc_stats().reads, 1u, NULL);
+    zassert_equal(stub::saadc_stats().collisions, 0u, NULL);
+}
+
+static void test_stream_restarts() {
+    stream_t stream({ &low, &vdd }, 1000);
+    zassert_true(stream.start().has_value(), NULL);
+    stub::run_until(20 * MS);
+    stream.stop();
+    zassert_equal(stream.stats().blocks, 1u, NULL);
+
+    // The half filled at stop is dropped, the restart fills from the first half again
+    stub::run_until(100 * MS);
+    zassert_equal(stream.stats().blocks, 1u, NULL);
+    zassert_true(stream.start().has_value(), NULL);
+    stub::run_until(120 * MS);
+    zassert_equal(stream.stats().blocks, 2u, NULL);
+    stream.stop();
+    zassert_equal(stub::saadc_stats().driver_irqs, 0u, NULL);
+}
+
+static void test_stream_bad_config() {
+    adc_channel_cfg bad = channel(2, NRF_SAADC_INPUT_AIN0);
+    bad.reference = ADC_REF_VDD_1;
+    stream_t stream({ &low, &bad }, 1000);
+
+    const auto started = stream.start();
+    zassert_false(started.has_value(), NULL);
+    zassert_equal(started.error(), -EINVAL, NULL);
+    zassert_false(stub::saadc_enabled(), NULL);
+    zassert_equal(stub::ppi_channels_allocated(), 0u, NULL);
+
+    // Still not held, one-shot measurements go ahead
+    app_saadc::manager_t<1> manager;
+    zassert_true(manager.measure(std::array{ &vdd }).has_value(), NULL);
+}
+
+static void test_stream_frees_ppi() {
+    {
+        stream_t stream({ &low, &vdd }, 1000);
+        zassert_equal(stub::ppi_channels_allocated(), 2u, NULL);
+        zassert_true(stream.start().has_value(), NULL);
+    }
+    zassert_equal(stub::ppi_channels_allocated(), 0u, NULL);
+    zassert_false(stub::rtc_running(), NULL);
+
+    stream_t other({ &low, &vdd }, 1000);
+    zassert_true(other.start().has_value(), NULL);
+    other.stop();
+}
+
+static void test_channels_compare_fields() {
+    // Same fields, different padding, set up once
+    adc_channel_cfg first;
+    std::memset(&first, 0x00, sizeof(first));
+    first = channel(4, NRF_SAADC_INPUT_AIN1);
+    adc_channel_cfg second;
+    std::memset(&second, 0xff, sizeof(second));
+    second.gain = first.gain;
+    second.reference = first.reference;
+    second.acquisition_time = first.acquisition_time;
+    second.channel_id = first.channel_id;
+    second.differential = first.differential;
+    second.input_positive = first.input_positive;
+    second.input_negative = first.input_negative;
+
+    const device* adc = app_saadc::adc_binding();
+    zassert_true(app_saadc::channels.setup(adc, &first).has_value(), NULL);
+    zassert_true(app_saadc::channels.setup(adc, &second).has_value(), NULL);
+    zassert_equal(stub::saadc_stats().channel_setups, 1u, NULL);
+
+    second.input_positive = NRF_SAADC_INPUT_AIN3;
+    zassert_true(app_saadc::channels.setup(adc, &second).has_value(), NULL);
+    zassert_equal(stub::saadc_stats().channel_setups, 2u, NULL);
+
+    const adc_channel_cfg missing = channel(9, NRF_SAADC_INPUT_AIN1);
+    zassert_false(app_saadc::channels.setup(adc, &missing).has_value(), NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(saadc,
+        ztest_unit_test_setup_teardown(test_stream_blocks_at_interval, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_stream_overrun, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_measure_waits_for_stream, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_stream_restarts, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_stream_bad_config, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_stream_frees_ppi, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_channels_compare_fields, setup, unit_test_noop));
+    ztest_run_test_suite(saadc);
+}
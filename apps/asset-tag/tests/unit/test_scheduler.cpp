@@ -0,0 +1,174 @@
+#include <ztest.h>
+
+#include <app_scheduler.hpp>
+
+#include <stub.hpp>
+
+#include <string>
+
+namespace {
+
+constexpr int64_t S = 1'000'000;
+
+// Counts wakes and reports level through BAS as do_wake does
+struct wake_t {
+    uint32_t* count;
+    uint8_t level;
+
+    app::expected_t<uint8_t> operator()() {
+        (*count)++;
+        bt_bas_set_battery_level(level);
+        return level;
+    }
+};
+
+using scheduler_t = app_scheduler::manager_t<wake_t>;
+
+app_ble::manager_t ble;
+
+void setup() {
+    stub::reset_kernel();
+    stub::bt_reset();
+    ble.stop();
+    zassert_true(ble.init().has_value(), NULL);
+    zassert_true(ble.ready().has_value(), NULL);
+}
+
+uint32_t fast_interval() {
+    return app_ble::adv_interval_min[static_cast<size_t>(app_ble::adv_mode_e::FAST)];
+}
+
+uint32_t slow_interval() {
+    return app_ble::adv_interval_min[static_cast<size_t>(app_ble::adv_mode_e::SLOW)];
+}
+
+}
+
+static void test_cycle_fast_slow_idle() {
+    uint32_t wakes = 0;
+    scheduler_t scheduler(ble, wake_t{ &wakes, 80 }, &k_sys_work_q);
+    scheduler.start();
+
+    stub::drain();
+    zassert_equal(wakes, 1u, NULL);
+    zassert_equal(scheduler.state(), app_scheduler::state_e::FAST, NULL);
+    zassert_equal(stub::bt_adv_interval(), fast_interval(), NULL);
+
+    stub::run_until(4 * S);
+    zassert_equal(scheduler.state(), app_scheduler::state_e::SLOW, NULL);
+    zassert_equal(stub::bt_adv_interval(), slow_interval(), NULL);
+
+    stub::run_until(16 * S);
+    zassert_equal(scheduler.state(), app_scheduler::state_e::IDLE, NULL);
+    zassert_false(stub::bt_advertising(), NULL);
+
+    stub::run_until(20 * S - 1);
+    zassert_equal(wakes, 1u, NULL);
+    stub::run_until(20 * S);
+    zassert_equal(wakes, 2u, NULL);
+    zassert_equal(scheduler.stats().period_ms, 20'000u, NULL);
+}
+
+static void test_slow_keeps_advertising_data() {
+    uint32_t wakes = 0;
+    scheduler_t scheduler(ble, wake_t{ &wakes, 80 }, &k_sys_work_q);
+    scheduler.start();
+    stub::drain();
+    const stub::bt_stats_t before = stub::bt_stats();
+
+    // Only the parameters of the set change, the data and name it holds stay
+    stub::run_until(4 * S);
+    zassert_equal(scheduler.state(), app_scheduler::state_e::SLOW, NULL);
+    zassert_equal(stub::bt_adv_interval(), slow_interval(), NULL);
+    const stub::bt_stats_t& after = stub::bt_stats();
+    zassert_equal(after.adv_param_updates - before.adv_param_updates, 1u, NULL);
+    zassert_equal(after.adv_updates, before.adv_updates, NULL);
+    zassert_equal(after.name_sets, before.name_sets, NULL);
+
+    stub::bytes_t name;
+    zassert_true(stub::bt_adv_field(BT_DATA_NAME_COMPLETE, name), NULL);
+    zassert_equal(std::string(name.begin(), name.end()), std::string(CONFIG_BT_DEVICE_NAME), NULL);
+}
+
+static void test_low_battery_stretches_period() {
+    uint32_t wakes = 0;
+    scheduler_t scheduler(ble, wake_t{ &wakes, 10 }, &k_sys_work_q);
+    scheduler.start();
+
+    stub::run_until(59 * S);
+    zassert_equal(wakes, 1u, NULL);
+    stub::run_until(60 * S);
+    zassert_equal(wakes, 2u, NULL);
+    zassert_equal(scheduler.stats().period_ms, 60'000u, NULL);
+}
+
+static void test_connected_keeps_waking() {
+    uint32_t wakes = 0;
+    scheduler_t scheduler(ble, wake_t{ &wakes, 80 }, &k_sys_work_q);
+    scheduler.start();
+    stub::run_until(1 * S);
+
+    bt_conn* conn = stub::bt_connect();
+    zassert_not_null(conn, NULL);
+    stub::drain();
+    zassert_equal(scheduler.state(), app_scheduler::state_e::CONNECTED, NULL);
+    zassert_equal(scheduler.stats().connections, 1u, NULL);
+
+    // Every halved period after the last wake, with BAS following each measurement
+    const uint32_t bas_before = stub::bt_stats().battery_sets;
+    stub::run_until(10 * S);
+    zassert_equal(wakes, 2u, NULL);
+    stub::run_until(60 * S);
+    zassert_equal(wakes, 7u, NULL);
+    zassert_equal(stub::bt_stats().battery_sets - bas_before, 6u, NULL);
+    zassert_equal(scheduler.state(), app_scheduler::state_e::CONNECTED, NULL);
+    zassert_false(stub::bt_advertising(), NULL);
+
+    stub::bt_disconnect(conn);
+    stub::drain();
+    zassert_equal(scheduler.state(), app_scheduler::state_e::FAST, NULL);
+    zassert_true(stub::bt_advertising(), NULL);
+}
+
+static void test_disconnect_with_links_left_stays_connected() {
+    stub::bt_timing_t timing;
+    timing.max_links = 2;
+    stub::bt_set_timing(timing);
+
+    uint32_t wakes = 0;
+    scheduler_t scheduler(ble, wake_t{ &wakes, 80 }, &k_sys_work_q);
+    scheduler.start();
+    stub::drain();
+
+    bt_conn* first = stub::bt_connect();
+    zassert_not_null(first, NULL);
+    stub::drain();
+    zassert_true(ble.start(app_ble::adv_mode_e::FAST).has_value(), "room for a second link");
+    bt_conn* second = stub::bt_connect();
+    zassert_not_null(second, NULL);
+    stub::run_until(1 * S);
+    zassert_equal(scheduler.stats().connections, 2u, NULL);
+
+    stub::bt_disconnect(first);
+    stub::run_until(2 * S);
+    zassert_equal(scheduler.state(), app_scheduler::state_e::CONNECTED, NULL);
+    zassert_false(stub::bt_advertising(), NULL);
+
+    // The callbacks did not push the wake timer back
+    stub::run_until(10 * S);
+    zassert_equal(wakes, 2u, NULL);
+
+    stub::bt_disconnect(second);
+    stub::drain();
+    zassert_equal(scheduler.state(), app_scheduler::state_e::FAST, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(scheduler,
+        ztest_unit_test_setup_teardown(test_cycle_fast_slow_idle, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_slow_keeps_advertising_data, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_low_battery_stretches_period, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_connected_keeps_waking, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_disconnect_with_links_left_stays_connected, setup, unit_test_noop));
+    ztest_run_test_suite(scheduler);
+}
@@ -0,0 +1,132 @@
+#include <ztest.h>
+
+#include <app/shared_buffer.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+namespace {
+
+constexpr size_t SIZE = 128;
+constexpr uint32_t WRITES = 200000;
+
+using buffer_t = app::shared_buffer_t<SIZE>;
+
+// Every write leaves one byte value across a length derived from it, so any mix of two
+// writes shows up as a byte or length that does not match
+uint8_t fill_of(uint32_t generation) {
+    return static_cast<uint8_t>('!' + generation % 90);
+}
+
+size_t length_of(uint8_t fill) {
+    return 1 + (fill * 7u) % SIZE;
+}
+
+struct reader_t {
+    const buffer_t* buffer;
+    const std::atomic<bool>* done;
+    uint32_t reads = 0;
+    uint32_t torn = 0;
+
+    void operator()() {
+        while(!done->load()) {
+            const bool ok = buffer->read([](const uint8_t* data, size_t len) {
+                if(len == 0) {
+                    return true;
+                }
+                if(len != length_of(data[0])) {
+                    return false;
+                }
+                for(size_t i = 1; i < len; i++) {
+                    if(data[i] != data[0]) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+            reads++;
+            torn += ok ? 0 : 1;
+        }
+    }
+};
+
+}
+
+static void test_assign_never_torn() {
+    buffer_t buffer;
+    std::atomic<bool> done{false};
+    reader_t reader{ &buffer, &done };
+    std::thread thread([&]() { reader(); });
+
+    uint8_t value[SIZE];
+    for(uint32_t generation = 0; generation < WRITES; generation++) {
+        const uint8_t fill = fill_of(generation);
+        std::memset(value, fill, sizeof(value));
+        buffer.assign(value, length_of(fill));
+    }
+    done = true;
+    thread.join();
+
+    printf("assign: %u writes, %u reads, %u torn\n", WRITES, reader.reads, reader.torn);
+    zassert_true(reader.reads > 0, NULL);
+    zassert_equal(reader.torn, 0u, "a read saw parts of two writes");
+}
+
+static void test_patch_never_torn() {
+    buffer_t buffer;
+    uint8_t value[SIZE];
+    std::memset(value, fill_of(0), sizeof(value));
+    buffer.assign(value, SIZE);
+
+    // Patches every byte per generation while copy() reads the raw bytes, as a read-blob does
+    std::atomic<bool> done{false};
+    std::atomic<uint32_t> reads{0};
+    std::atomic<uint32_t> torn{0};
+    std::thread thread([&]() {
+        uint8_t copy[SIZE];
+        while(!done.load()) {
+            const size_t len = buffer.copy(0, copy, SIZE);
+            reads++;
+            for(size_t i = 1; i < len; i++) {
+                if(copy[i] != copy[0]) {
+                    torn++;
+                    break;
+                }
+            }
+        }
+    });
+
+    for(uint32_t generation = 1; generation < WRITES; generation++) {
+        std::memset(value, fill_of(generation), sizeof(value));
+        zassert_true(buffer.write(0, value, SIZE), NULL);
+    }
+    done = true;
+    thread.join();
+
+    printf("write: %u writes, %u reads, %u torn\n", WRITES, reads.load(), torn.load());
+    zassert_true(reads.load() > 0, NULL);
+    zassert_equal(torn.load(), 0u, "a copy saw parts of two writes");
+}
+
+static void test_length_cached() {
+    buffer_t buffer;
+    zassert_equal(buffer.length(), 0u, NULL);
+    buffer.assign("hello", 5);
+    zassert_equal(buffer.length(), 5u, NULL);
+    zassert_true(buffer.write(5, " world", 6), NULL);
+    zassert_equal(buffer.length(), 11u, NULL);
+    zassert_false(buffer.write(SIZE - 2, "abc", 3), "past the end");
+
+    char copy[SIZE + 1];
+    zassert_equal(buffer.copy_string(copy), 11u, NULL);
+    zassert_equal(std::strcmp(copy, "hello world"), 0, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(shared_buffer,
+        ztest_unit_test(test_assign_never_torn),
+        ztest_unit_test(test_patch_never_torn),
+        ztest_unit_test(test_length_cached));
+    ztest_run_test_suite(shared_buffer);
+}
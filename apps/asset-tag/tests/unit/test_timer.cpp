@@ -0,0 +1,111 @@
+#include <ztest.h>
+#include <stub.hpp>
+
+#include <app/timer.hpp>
+
+#include <memory>
+#include <optional>
+
+namespace {
+
+constexpr int64_t MS = 1000;
+
+// Work stand-in counting the submissions the timer makes from its expiry
+struct counter_work_t {
+    uint32_t* count;
+    void submit() { (*count)++; }
+};
+
+using periodic_t = app::timer_t<app::hz_t<10>>;
+using one_shot_t = app::one_shot_timer_t<app::msec_delay_t<50>>;
+
+void setup() {
+    stub::reset_kernel();
+    stub::log_reset();
+}
+
+}
+
+static void test_periodic_submits_every_period() {
+    uint32_t count = 0;
+    periodic_t timer(counter_work_t{ &count });
+    zassert_true(timer.valid(), NULL);
+
+    stub::run_until(1000 * MS);
+    zassert_equal(count, 10u, NULL);
+
+    timer.stop();
+    stub::run_until(2000 * MS);
+    zassert_equal(count, 10u, "stopped");
+}
+
+static void test_one_shot_submits_once() {
+    uint32_t count = 0;
+    one_shot_t timer(counter_work_t{ &count });
+    stub::run_until(49 * MS);
+    zassert_equal(count, 0u, NULL);
+    stub::run_until(1000 * MS);
+    zassert_equal(count, 1u, NULL);
+}
+
+static void test_slots_are_bounded_and_released() {
+    uint32_t count = 0;
+    std::optional<periodic_t> timers[app::NUM_TIMERS];
+    for(auto& timer : timers) {
+        timer.emplace(counter_work_t{ &count });
+        zassert_true(timer->valid(), NULL);
+    }
+    zassert_equal(atomic_get(&app::timers_registered), app::NUM_TIMERS, NULL);
+
+    // Past the bound the timer is left invalid and never fires
+    uint32_t extra_count = 0;
+    {
+        periodic_t extra(counter_work_t{ &extra_count });
+        zassert_false(extra.valid(), NULL);
+        zassert_equal(stub::log_count(LOG_LEVEL_ERR), 1u, NULL);
+        stub::run_until(500 * MS);
+        zassert_equal(extra_count, 0u, NULL);
+    }
+    zassert_equal(atomic_get(&app::timers_registered), app::NUM_TIMERS, "an invalid timer holds no slot");
+
+    // Destroying one stops it and hands its slot to the next
+    timers[0].reset();
+    zassert_equal(atomic_get(&app::timers_registered), app::NUM_TIMERS - 1, NULL);
+    const uint32_t before = count;
+    stub::run_until(1000 * MS);
+    zassert_equal(count - before, 5u * (app::NUM_TIMERS - 1), "the destroyed timer no longer fires");
+
+    periodic_t replacement(counter_work_t{ &extra_count });
+    zassert_true(replacement.valid(), NULL);
+    stub::run_until(1500 * MS);
+    zassert_equal(extra_count, 5u, NULL);
+
+    for(auto& timer : timers) {
+        timer.reset();
+    }
+}
+
+static void test_work_destroyed_with_timer() {
+    auto alive = std::make_shared<int>(0);
+    struct owning_work_t {
+        std::shared_ptr<int> value;
+        void submit() { (*value)++; }
+    };
+    {
+        periodic_t timer(owning_work_t{ alive });
+        stub::run_until(100 * MS);
+        zassert_equal(*alive, 1, NULL);
+        zassert_equal(alive.use_count(), 2, "work held inline");
+    }
+    zassert_equal(alive.use_count(), 1, "work destroyed with the timer");
+    zassert_equal(atomic_get(&app::timers_registered), 0, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(timer,
+        ztest_unit_test_setup_teardown(test_periodic_submits_every_period, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_one_shot_submits_once, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_slots_are_bounded_and_released, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_work_destroyed_with_timer, setup, unit_test_noop));
+    ztest_run_test_suite(timer);
+}
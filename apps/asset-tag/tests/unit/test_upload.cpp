@@ -0,0 +1,212 @@
+#include <ztest.h>
+#include <stub.hpp>
+
+#include <app/upload.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+
+using bytes_t = std::vector<uint8_t>;
+using kind_e = app::upload_t::kind_e;
+
+constexpr size_t CHUNK = 256;
+
+bytes_t image;
+
+void setup() {
+    stub::reset_kernel();
+    stub::flash_reset();
+    stub::log_reset();
+
+    std::mt19937 rng(7);
+    image.resize(10 * 1024 + 100);
+    for(auto& b : image) {
+        b = static_cast<uint8_t>(rng());
+    }
+    sys_put_le32(app::upload_t::IMAGE_MAGIC, image.data());
+}
+
+app::upload_t::reply_t offer(app::upload_t& upload, const bytes_t& data, uint32_t off, kind_e kind = kind_e::IMAGE) {
+    const size_t len = std::min(CHUNK, data.size() - off);
+    return upload.offer(kind, off, data.data() + off, len, static_cast<uint32_t>(data.size()));
+}
+
+// Runs the upload thread until it has nothing left to do
+void settle(app::upload_t& upload) {
+    while(upload.service(K_NO_WAIT)) {
+    }
+}
+
+bool slot_holds(const bytes_t& data) {
+    const auto& slot = stub::flash_contents(FLASH_AREA_ID(image_1));
+    return std::equal(data.begin(), data.end(), slot.begin());
+}
+
+}
+
+static void test_full_queue_answers_busy_without_waiting() {
+    static app::upload_t upload;
+    for(uint32_t i = 0; i < app::upload_t::QUEUE_DEPTH; i++) {
+        const auto reply = offer(upload, image, i * CHUNK);
+        zassert_equal(reply.rc, 0, NULL);
+        zassert_equal(reply.off, (i + 1) * CHUNK, "chunk %u acknowledged once queued", i);
+    }
+
+    // The queue is full, the same offset comes back and the client sends it again
+    const uint32_t off = app::upload_t::QUEUE_DEPTH * CHUNK;
+    zassert_equal(offer(upload, image, off).off, off, NULL);
+    zassert_equal(upload.stats().busy, 1u, NULL);
+    zassert_equal(stub::now_us(), 0, "the SMP side never touched flash");
+
+    // Chunks past the expected offset are answered with it, so the client can seek
+    zassert_equal(offer(upload, image, off + CHUNK).off, off, NULL);
+
+    zassert_true(upload.service(K_NO_WAIT), NULL);
+    zassert_equal(offer(upload, image, off).off, off + CHUNK, NULL);
+}
+
+static void test_last_chunk_reports_completion() {
+    static app::upload_t upload;
+    const uint32_t last = ROUND_DOWN(image.size() - 1, CHUNK);
+    for(uint32_t off = 0; off < last; off += CHUNK) {
+        zassert_equal(offer(upload, image, off).off, off + CHUNK, NULL);
+        settle(upload);
+    }
+
+    // Until the upload thread flushed the last page, the reply holds back the last chunk
+    const auto pending = offer(upload, image, last);
+    zassert_equal(pending.rc, 0, NULL);
+    zassert_equal(pending.off, last, NULL);
+    zassert_false(pending.done, NULL);
+    zassert_equal(upload.staged(), image.size(), NULL);
+    zassert_true(upload.settling(), NULL);
+
+    settle(upload);
+    zassert_false(upload.settling(), NULL);
+    zassert_equal(upload.wait(K_NO_WAIT), 0, "settled");
+    const auto reply = offer(upload, image, last);
+    zassert_equal(reply.rc, 0, NULL);
+    zassert_equal(reply.off, image.size(), NULL);
+    zassert_true(reply.done, NULL);
+    zassert_true(slot_holds(image), NULL);
+}
+
+static void test_erases_ahead_while_idle() {
+    static app::upload_t upload;
+    zassert_equal(offer(upload, image, 0).off, CHUNK, NULL);
+    settle(upload);
+
+    // The trailer and every page of the image were erased before the writes reached them
+    const auto& flash = stub::flash_stats(FLASH_AREA_ID(image_1));
+    const uint32_t pages = ROUND_UP(image.size(), app::slot_writer_t::PAGE_SIZE) / app::slot_writer_t::PAGE_SIZE;
+    zassert_equal(flash.erases, pages + 1, NULL);
+    zassert_equal(flash.bytes_written, 0u, "nothing programmed before a page is full");
+
+    for(uint32_t off = CHUNK; off < image.size(); off += CHUNK) {
+        zassert_equal(offer(upload, image, off).rc, 0, NULL);
+        settle(upload);
+    }
+    zassert_true(upload.status().done, NULL);
+    zassert_equal(upload.slot().stats().erased_ahead, pages + 1, NULL);
+    zassert_equal(upload.slot().stats().erased_inline, 0u, NULL);
+    zassert_equal(upload.slot().stats().pages_written, pages, "one write per page");
+    zassert_equal(flash.erases, pages + 1, "no page erased twice");
+    zassert_true(slot_holds(image), NULL);
+}
+
+static void test_writes_erase_when_caught_up() {
+    static app::upload_t upload;
+    // Never idle: chunks are queued before the upload thread runs
+    for(uint32_t off = 0; off < image.size(); off += CHUNK) {
+        while(offer(upload, image, off).off == off) {
+            zassert_true(upload.service(K_NO_WAIT), NULL);
+        }
+    }
+    settle(upload);
+    zassert_true(upload.status().done, NULL);
+    zassert_true(slot_holds(image), NULL);
+    zassert_equal(stub::flash_stats(FLASH_AREA_ID(image_1)).erases,
+        upload.slot().stats().erased_ahead + upload.slot().stats().erased_inline, NULL);
+}
+
+static void test_background_failure_restarts_client() {
+    static app::upload_t upload;
+    // A delta stream with a bad magic fails once the upload thread reads its header
+    bytes_t delta(3 * CHUNK, 0);
+    zassert_equal(offer(upload, delta, 0, kind_e::DELTA).off, CHUNK, NULL);
+    settle(upload);
+
+    const auto reply = offer(upload, delta, CHUNK, kind_e::DELTA);
+    zassert_equal(reply.rc, -ENOTSUP, NULL);
+    zassert_equal(reply.off, 0u, "the client starts over");
+    zassert_false(upload.settling(), NULL);
+
+    // A new session clears it
+    zassert_equal(offer(upload, image, 0).rc, 0, NULL);
+    zassert_equal(upload.status().rc, 0, NULL);
+}
+
+static void test_refuses_what_is_not_an_image() {
+    static app::upload_t upload;
+    bytes_t data = image;
+    data[0] ^= 0xff;
+    zassert_equal(offer(upload, data, 0).rc, -EINVAL, NULL);
+    zassert_equal(upload.stats().accepted, 0u, NULL);
+
+    // Without a session the client is sent back to offset 0
+    const auto reply = offer(upload, image, CHUNK);
+    zassert_equal(reply.rc, 0, NULL);
+    zassert_equal(reply.off, 0u, NULL);
+}
+
+static void test_erase_runs_in_background() {
+    static app::upload_t upload;
+    zassert_equal(upload.erase(), 0, NULL);
+    zassert_equal(stub::now_us(), 0, NULL);
+    settle(upload);
+    zassert_equal(stub::flash_stats(FLASH_AREA_ID(image_1)).erases, stub::FLASH_IMAGE_SIZE / stub::FLASH_PAGE_SIZE, NULL);
+
+    // The erased slot is not erased again by the upload that follows
+    for(uint32_t off = 0; off < image.size(); off += CHUNK) {
+        zassert_equal(offer(upload, image, off).rc, 0, NULL);
+        settle(upload);
+    }
+    zassert_true(upload.status().done, NULL);
+    zassert_equal(stub::flash_stats(FLASH_AREA_ID(image_1)).erases, stub::FLASH_IMAGE_SIZE / stub::FLASH_PAGE_SIZE, NULL);
+    zassert_true(slot_holds(image), NULL);
+}
+
+static void test_upload_erases_trailer() {
+    // Magic and image-ok left by an earlier image that was tested and confirmed
+    auto& slot = stub::flash_contents(FLASH_AREA_ID(image_1));
+    const size_t trailer = slot.size() - stub::FLASH_PAGE_SIZE;
+    std::fill(slot.begin() + trailer, slot.end(), 0x00);
+
+    static app::upload_t upload;
+    for(uint32_t off = 0; off < image.size(); off += CHUNK) {
+        while(offer(upload, image, off).off == off) {
+            zassert_true(upload.service(K_NO_WAIT), NULL);
+        }
+    }
+    settle(upload);
+    zassert_true(upload.status().done, NULL);
+    zassert_true(slot_holds(image), NULL);
+    zassert_true(std::all_of(slot.begin() + trailer, slot.end(), [](uint8_t b) { return b == 0xff; }),
+        "trailer reads as erased");
+}
+
+void test_main(void) {
+    ztest_test_suite(upload,
+        ztest_unit_test_setup_teardown(test_full_queue_answers_busy_without_waiting, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_last_chunk_reports_completion, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_erases_ahead_while_idle, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_writes_erase_when_caught_up, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_background_failure_restarts_client, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_refuses_what_is_not_an_image, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_erase_runs_in_background, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_upload_erases_trailer, setup, unit_test_noop));
+    ztest_run_test_suite(upload);
+}
@@ -0,0 +1,141 @@
+#include <ztest.h>
+#include <stub.hpp>
+
+#include <app/work.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+constexpr int64_t MS = 1000;
+constexpr int64_t RUN_US = 2 * MS;
+
+// What the timers submitted and what the work item ran, checked against each other
+struct flood_t {
+    uint32_t sequence = 0;
+    bool outstanding = false;
+    int64_t first_submit_us = 0;
+
+    uint32_t runs = 0;
+    uint32_t duplicates = 0;
+    uint32_t stale = 0;
+    int64_t latency_max_us = 0;
+    int64_t latency_sum_us = 0;
+};
+
+using flood_work_t = app::work_t<uint32_t>;
+
+// Submits from the timer expiry as the ISR would, one sequence number per submission. The
+// stub fires a timer that fell due during a run once the run returns, where the ISR would
+// have preempted it, so latency counts from the time the timer was due.
+struct flood_submit_t {
+    flood_t* flood;
+    flood_work_t* work;
+    int64_t period_us;
+    int64_t due_us;
+
+    flood_submit_t(flood_t* flood, flood_work_t* work, size_t hz)
+        : flood(flood), work(work), period_us(1'000'000 / hz), due_us(period_us) {}
+
+    void submit() {
+        if(!flood->outstanding) {
+            flood->outstanding = true;
+            flood->first_submit_us = due_us;
+        }
+        due_us += period_us;
+        work->submit(++flood->sequence);
+    }
+};
+
+void setup() {
+    stub::reset_kernel();
+}
+
+}
+
+static void test_flood_from_timers() {
+    flood_t flood;
+    // Every run takes RUN_US, longer than the fastest timer period
+    flood_work_t work([&flood](const uint32_t& sequence) {
+        if(!flood.outstanding) {
+            flood.duplicates++;
+        } else {
+            const int64_t latency = stub::now_us() - flood.first_submit_us;
+            flood.latency_max_us = std::max(flood.latency_max_us, latency);
+            flood.latency_sum_us += latency;
+        }
+        if(sequence != flood.sequence) {
+            flood.stale++;
+        }
+        flood.outstanding = false;
+        flood.runs++;
+        stub::stall(RUN_US);
+    });
+
+    const uint32_t submitted = atomic_get(&app::work_stats.submitted);
+    const uint32_t executed = atomic_get(&app::work_stats.executed);
+    {
+        app::timer_t<app::hz_t<1000>> fast(flood_submit_t(&flood, &work, 1000));
+        app::timer_t<app::hz_t<300>> medium(flood_submit_t(&flood, &work, 300));
+        app::timer_t<app::hz_t<125>> slow(flood_submit_t(&flood, &work, 125));
+        stub::run_until(1000 * MS);
+    }
+    stub::drain();
+
+    const uint32_t dropped = flood.outstanding ? 1 : 0;
+    printf("flood: %u submissions, %u runs, %u dropped, %u duplicate, latency mean %lld us max %lld us\n",
+        flood.sequence, flood.runs, dropped, flood.duplicates,
+        static_cast<long long>(flood.latency_sum_us / std::max<uint32_t>(flood.runs, 1)),
+        static_cast<long long>(flood.latency_max_us));
+
+    zassert_true(flood.sequence > flood.runs, "submissions coalesced");
+    zassert_equal(dropped, 0u, "every submission is followed by a run");
+    zassert_equal(flood.duplicates, 0u, "no run without a submission since the last");
+    zassert_equal(flood.stale, 0u, "each run sees the latest payload");
+    zassert_true(flood.latency_max_us <= RUN_US, "a submission waits for at most the run in progress");
+    zassert_equal(atomic_get(&app::work_stats.submitted) - submitted, flood.sequence, NULL);
+    zassert_equal(atomic_get(&app::work_stats.executed) - executed, flood.runs, NULL);
+}
+
+static void test_submit_moves_schedule_forward() {
+    uint32_t runs = 0;
+    app::work_t<> work([&runs]() { runs++; });
+
+    work.schedule(K_MSEC(100));
+    stub::run_until(10 * MS);
+    work.submit();
+    stub::drain();
+    zassert_equal(runs, 1u, "submit() does not wait out the schedule() delay");
+    stub::run_until(200 * MS);
+    zassert_equal(runs, 1u, "the scheduled run joined the submitted one");
+}
+
+static void test_schedule_keeps_due_run() {
+    uint32_t runs = 0;
+    app::work_t<> work([&runs]() { runs++; });
+
+    work.submit();
+    work.schedule(K_MSEC(100));
+    stub::drain();
+    zassert_equal(runs, 1u, "schedule() does not postpone a run that is due");
+    stub::run_until(200 * MS);
+    zassert_equal(runs, 1u, NULL);
+
+    // A run still waiting on its delay is pushed back as before
+    work.schedule(K_MSEC(100));
+    stub::run_until(250 * MS);
+    work.schedule(K_MSEC(100));
+    stub::run_until(320 * MS);
+    zassert_equal(runs, 1u, NULL);
+    stub::run_until(350 * MS);
+    zassert_equal(runs, 2u, NULL);
+}
+
+void test_main(void) {
+    ztest_test_suite(work,
+        ztest_unit_test_setup_teardown(test_flood_from_timers, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_submit_moves_schedule_forward, setup, unit_test_noop),
+        ztest_unit_test_setup_teardown(test_schedule_keeps_due_run, setup, unit_test_noop));
+    ztest_run_test_suite(work);
+}
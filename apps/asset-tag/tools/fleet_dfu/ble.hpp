@@ -0,0 +1,448 @@
+#ifndef FLEET_DFU_BLE_HPP
+#define FLEET_DFU_BLE_HPP
+
+// SMP over GATT through the Linux Bluetooth sockets, without BlueZ libraries
+//
+// A raw HCI socket finds a tag by its advertised name, then an L2CAP socket on the ATT
+// channel connects to it. Requests are written without response to the SMP characteristic
+// and responses come back as notifications, reassembled by the SMP header. The kernel keeps
+// several LE connections per controller, only scanning and connecting take turns, under
+// the controller's lock. Needs CAP_NET_RAW and CAP_NET_ADMIN, or root.
+
+#include "smp.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <string>
+
+namespace fleet::ble {
+
+// linux/bluetooth.h, hci.h and l2cap.h
+static constexpr int AF_BLUETOOTH_ = 31;
+static constexpr int BTPROTO_L2CAP_ = 0;
+static constexpr int BTPROTO_HCI_ = 1;
+static constexpr int SOL_HCI_ = 0;
+static constexpr int HCI_FILTER_ = 2;
+static constexpr uint16_t HCI_CHANNEL_RAW_ = 0;
+static constexpr uint8_t BDADDR_LE_PUBLIC_ = 1;
+static constexpr uint8_t BDADDR_LE_RANDOM_ = 2;
+static constexpr uint16_t ATT_CID = 4;
+
+struct __attribute__((packed)) bdaddr_t {
+    uint8_t b[6];
+};
+
+struct sockaddr_hci_t {
+    sa_family_t hci_family;
+    unsigned short hci_dev;
+    unsigned short hci_channel;
+};
+
+struct sockaddr_l2_t {
+    sa_family_t l2_family;
+    unsigned short l2_psm;
+    bdaddr_t l2_bdaddr;
+    unsigned short l2_cid;
+    uint8_t l2_bdaddr_type;
+};
+
+struct hci_filter_t {
+    uint32_t type_mask;
+    uint32_t event_mask[2];
+    uint16_t opcode;
+};
+
+// SMP service and characteristic, little endian as they go over the air
+static constexpr std::array<uint8_t, 16> SMP_SERVICE = {
+    0x84, 0xaa, 0x60, 0x74, 0x52, 0x8a, 0x8b, 0x86, 0xd3, 0x4c, 0xb7, 0x1d, 0x1d, 0xdc, 0x53, 0x8d
+};
+static constexpr std::array<uint8_t, 16> SMP_CHARACTERISTIC = {
+    0x48, 0x7c, 0x99, 0x74, 0x11, 0x26, 0x9e, 0xae, 0x01, 0x4e, 0xce, 0xfb, 0x28, 0x78, 0x2e, 0xda
+};
+
+// ATT MTU asked for, the tag answers with its CONFIG_BT_L2CAP_RX_MTU
+static constexpr uint16_t ATT_MTU = 517;
+
+struct fd_t {
+    int fd = -1;
+
+    explicit fd_t(int fd = -1) : fd(fd) {}
+    ~fd_t() {
+        if(fd >= 0) {
+            close(fd);
+        }
+    }
+    fd_t(const fd_t&) = delete;
+    fd_t(fd_t&& other) : fd(other.fd) {
+        other.fd = -1;
+    }
+    fd_t& operator=(fd_t&& other) {
+        std::swap(fd, other.fd);
+        return *this;
+    }
+};
+
+inline uint16_t get_le16(const uint8_t* p) {
+    return static_cast<uint16_t>(p[0] | p[1] << 8);
+}
+
+inline void put_le16(bytes_t& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+}
+
+inline int remaining_ms(std::chrono::steady_clock::time_point deadline) {
+    const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    return left.count() > 0 ? static_cast<int>(left.count()) : 0;
+}
+
+// One HCI controller, hciN
+struct controller_t {
+    struct peer_t {
+        bdaddr_t address;
+        uint8_t type;
+    };
+
+    const std::string name;
+    // Scanning and connection setup of this controller, one tag at a time
+    std::mutex lock;
+
+    explicit controller_t(const std::string& name) : name(name) {
+        if(name.rfind("hci", 0) != 0) {
+            throw step_error(name + ": expected hciN");
+        }
+        m_dev = static_cast<uint16_t>(std::stoi(name.substr(3)));
+    }
+
+    // Address of the controller, what the L2CAP socket binds to
+    bdaddr_t address() {
+        fd_t hci = open_hci();
+        bytes_t params;
+        const bytes_t rsp = command(hci, 0x04, 0x0009, params);
+        if(rsp.size() < 7 || rsp[0] != 0) {
+            throw step_error(name + ": read address failed");
+        }
+        bdaddr_t address;
+        std::memcpy(address.b, rsp.data() + 1, 6);
+        return address;
+    }
+
+    // Scans actively until a tag advertises name, the caller holds the lock
+    peer_t scan(const std::string& wanted, int timeout_ms) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        fd_t hci = open_hci();
+
+        // Active, 10 ms interval and window, public own address, accept all
+        command(hci, 0x08, 0x000c, { 0x00, 0x00 });
+        check(command(hci, 0x08, 0x000b, { 0x01, 0x10, 0x00, 0x10, 0x00, 0x00, 0x00 }), "scan parameters");
+        check(command(hci, 0x08, 0x000c, { 0x01, 0x00 }), "scan enable");
+
+        peer_t found = {};
+        bool seen = false;
+        uint8_t buffer[260];
+        while(!seen) {
+            const int left = remaining_ms(deadline);
+            pollfd fd = { hci.fd, POLLIN, 0 };
+            if(left == 0 || poll(&fd, 1, left) <= 0) {
+                break;
+            }
+            const ssize_t n = read(hci.fd, buffer, sizeof(buffer));
+            // Event packet, LE meta event, advertising report
+            if(n < 5 || buffer[0] != 0x04 || buffer[1] != 0x3e || buffer[3] != 0x02) {
+                continue;
+            }
+            const uint8_t* p = buffer + 5;
+            const uint8_t* end = buffer + n;
+            for(uint8_t i = 0; i < buffer[4] && p + 9 <= end && !seen; i++) {
+                const uint8_t type = p[1];
+                bdaddr_t address;
+                std::memcpy(address.b, p + 2, 6);
+                const uint8_t len = p[8];
+                const uint8_t* data = p + 9;
+                if(data + len + 1 > end) {
+                    break;
+                }
+                if(advertised_name(data, len) == wanted) {
+                    found = { address, type == 0 ? BDADDR_LE_PUBLIC_ : BDADDR_LE_RANDOM_ };
+                    seen = true;
+                }
+                p = data + len + 1;
+            }
+        }
+
+        command(hci, 0x08, 0x000c, { 0x00, 0x00 });
+        if(!seen) {
+            throw step_error(wanted + " not found on " + name);
+        }
+        return found;
+    }
+
+private:
+    uint16_t m_dev = 0;
+
+    fd_t open_hci() {
+        fd_t hci(socket(AF_BLUETOOTH_, SOCK_RAW | SOCK_CLOEXEC, BTPROTO_HCI_));
+        sockaddr_hci_t addr = { AF_BLUETOOTH_, m_dev, HCI_CHANNEL_RAW_ };
+        if(hci.fd < 0 || bind(hci.fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            throw step_error(name + ": " + std::strerror(errno));
+        }
+        // Event packets: command complete, command status and LE meta
+        hci_filter_t filter = {};
+        filter.type_mask = 1u << 0x04;
+        filter.event_mask[0] = (1u << 0x0e) | (1u << 0x0f);
+        filter.event_mask[1] = 1u << (0x3e - 32);
+        if(setsockopt(hci.fd, SOL_HCI_, HCI_FILTER_, &filter, sizeof(filter)) != 0) {
+            throw step_error(name + ": " + std::strerror(errno));
+        }
+        return hci;
+    }
+
+    static void check(const bytes_t& rsp, const char* what) {
+        if(rsp.empty() || rsp[0] != 0) {
+            throw step_error(std::string(what) + " failed");
+        }
+    }
+
+    // Return parameters of the command's completion, status first
+    bytes_t command(fd_t& hci, uint16_t ogf, uint16_t ocf, const bytes_t& params) {
+        const uint16_t opcode = static_cast<uint16_t>(ogf << 10 | ocf);
+        bytes_t packet = { 0x01 };
+        put_le16(packet, opcode);
+        packet.push_back(static_cast<uint8_t>(params.size()));
+        packet.insert(packet.end(), params.begin(), params.end());
+        if(write(hci.fd, packet.data(), packet.size()) != static_cast<ssize_t>(packet.size())) {
+            throw step_error(name + ": " + std::strerror(errno));
+        }
+
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+        uint8_t buffer[260];
+        while(int left = remaining_ms(deadline)) {
+            pollfd fd = { hci.fd, POLLIN, 0 };
+            if(poll(&fd, 1, left) <= 0) {
+                break;
+            }
+            const ssize_t n = read(hci.fd, buffer, sizeof(buffer));
+            if(n >= 7 && buffer[1] == 0x0e && get_le16(buffer + 4) == opcode) {
+                return bytes_t(buffer + 6, buffer + n);
+            }
+            if(n >= 7 && buffer[1] == 0x0f && get_le16(buffer + 5) == opcode && buffer[3] != 0) {
+                return { buffer[3] };
+            }
+        }
+        throw step_error(name + ": command timed out");
+    }
+
+    static std::string advertised_name(const uint8_t* data, uint8_t len) {
+        for(uint8_t i = 0; i + 1 < len && data[i]; i += data[i] + 1) {
+            const uint8_t field = data[i];
+            // Shortened or complete local name
+            if(i + field < len && (data[i + 1] == 0x08 || data[i + 1] == 0x09)) {
+                return std::string(reinterpret_cast<const char*>(data + i + 2), field - 1);
+            }
+        }
+        return {};
+    }
+};
+
+struct gatt_transport_t : transport_t {
+    gatt_transport_t(controller_t& controller, const std::string& name, int scan_ms, int timeout_ms)
+        : m_timeout_ms(timeout_ms) {
+        {
+            std::lock_guard<std::mutex> guard(controller.lock);
+            const auto peer = controller.scan(name, scan_ms);
+            connect(controller.address(), peer, name);
+        }
+        exchange_mtu();
+        discover();
+    }
+
+    void send(const bytes_t& packet) override {
+        bytes_t pdu = { 0x52 };
+        put_le16(pdu, m_value_handle);
+        pdu.insert(pdu.end(), packet.begin(), packet.end());
+        if(::send(m_socket.fd, pdu.data(), pdu.size(), MSG_NOSIGNAL) < 0) {
+            throw step_error(std::string("disconnected: ") + std::strerror(errno));
+        }
+    }
+
+    bool receive(bytes_t& packet, int timeout_ms) override {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while(true) {
+            const size_t size = smp::packet_size(m_stream);
+            if(size && m_stream.size() >= size) {
+                packet.assign(m_stream.begin(), m_stream.begin() + size);
+                m_stream.erase(m_stream.begin(), m_stream.begin() + size);
+                return true;
+            }
+            bytes_t pdu;
+            if(!read_pdu(pdu, remaining_ms(deadline))) {
+                return false;
+            }
+            if(pdu[0] == 0x1b && pdu.size() >= 3 && get_le16(pdu.data() + 1) == m_value_handle) {
+                m_stream.insert(m_stream.end(), pdu.begin() + 3, pdu.end());
+            }
+        }
+    }
+
+    // Requests fit one write, the tag does not reassemble them
+    size_t mtu() const override {
+        return m_mtu - 3;
+    }
+
+private:
+    fd_t m_socket;
+    int m_timeout_ms;
+    uint16_t m_mtu = 23;
+    uint16_t m_value_handle = 0;
+    bytes_t m_stream;
+
+    void connect(const bdaddr_t& local, const controller_t::peer_t& peer, const std::string& name) {
+        m_socket = fd_t(socket(AF_BLUETOOTH_, SOCK_SEQPACKET | SOCK_CLOEXEC, BTPROTO_L2CAP_));
+        sockaddr_l2_t own = { AF_BLUETOOTH_, 0, local, ATT_CID, BDADDR_LE_PUBLIC_ };
+        if(m_socket.fd < 0 || bind(m_socket.fd, reinterpret_cast<sockaddr*>(&own), sizeof(own)) != 0) {
+            throw step_error(name + ": " + std::strerror(errno));
+        }
+        sockaddr_l2_t remote = { AF_BLUETOOTH_, 0, peer.address, ATT_CID, peer.type };
+        if(::connect(m_socket.fd, reinterpret_cast<sockaddr*>(&remote), sizeof(remote)) != 0) {
+            throw step_error(name + ": connect: " + std::strerror(errno));
+        }
+    }
+
+    // Next PDU, answering what the tag asks of us on the way
+    bool read_pdu(bytes_t& pdu, int timeout_ms) {
+        while(true) {
+            pollfd fd = { m_socket.fd, POLLIN, 0 };
+            const int ready = poll(&fd, 1, timeout_ms);
+            if(ready == 0) {
+                return false;
+            }
+            pdu.resize(ATT_MTU);
+            const ssize_t n = ready < 0 ? -1 : recv(m_socket.fd, pdu.data(), pdu.size(), 0);
+            if(n <= 0) {
+                throw step_error("disconnected");
+            }
+            pdu.resize(static_cast<size_t>(n));
+            if(pdu[0] == 0x02) {
+                // Exchange MTU request
+                bytes_t rsp = { 0x03 };
+                put_le16(rsp, ATT_MTU);
+                ::send(m_socket.fd, rsp.data(), rsp.size(), MSG_NOSIGNAL);
+            } else if(pdu[0] == 0x1d) {
+                // Indication
+                const uint8_t confirm = 0x1e;
+                ::send(m_socket.fd, &confirm, 1, MSG_NOSIGNAL);
+            } else if(pdu[0] != 0x1b && (pdu[0] & 0x01) == 0 && pdu[0] != 0x52) {
+                // Any other request: not supported
+                bytes_t rsp = { 0x01, pdu[0], 0x00, 0x00, 0x06 };
+                ::send(m_socket.fd, rsp.data(), rsp.size(), MSG_NOSIGNAL);
+            } else {
+                return true;
+            }
+        }
+    }
+
+    // Sends an ATT request and returns its response, or the error response
+    bytes_t transact(const bytes_t& request) {
+        if(::send(m_socket.fd, request.data(), request.size(), MSG_NOSIGNAL) < 0) {
+            throw step_error(std::string("disconnected: ") + std::strerror(errno));
+        }
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(m_timeout_ms);
+        bytes_t pdu;
+        while(read_pdu(pdu, remaining_ms(deadline))) {
+            if(pdu[0] == request[0] + 1 || (pdu[0] == 0x01 && pdu.size() >= 5 && pdu[1] == request[0])) {
+                return pdu;
+            }
+        }
+        throw step_error("GATT request timed out");
+    }
+
+    void exchange_mtu() {
+        bytes_t request = { 0x02 };
+        put_le16(request, ATT_MTU);
+        const bytes_t rsp = transact(request);
+        if(rsp[0] == 0x03 && rsp.size() >= 3) {
+            m_mtu = std::min<uint16_t>(ATT_MTU, get_le16(rsp.data() + 1));
+        }
+    }
+
+    void discover() {
+        // Find By Type Value: the primary service with the SMP UUID
+        bytes_t request = { 0x06 };
+        put_le16(request, 0x0001);
+        put_le16(request, 0xffff);
+        put_le16(request, 0x2800);
+        request.insert(request.end(), SMP_SERVICE.begin(), SMP_SERVICE.end());
+        const bytes_t service = transact(request);
+        if(service[0] != 0x07 || service.size() < 5) {
+            throw step_error("no SMP service");
+        }
+        const uint16_t service_end = get_le16(service.data() + 3);
+
+        // Read By Type: characteristic declarations of the service
+        uint16_t start = get_le16(service.data() + 1);
+        uint16_t value_end = service_end;
+        while(!m_value_handle && start <= service_end) {
+            bytes_t read = { 0x08 };
+            put_le16(read, start);
+            put_le16(read, service_end);
+            put_le16(read, 0x2803);
+            const bytes_t rsp = transact(read);
+            if(rsp[0] != 0x09 || rsp.size() < 2 || rsp[1] < 7) {
+                break;
+            }
+            const size_t len = rsp[1];
+            uint16_t last = start;
+            for(size_t i = 2; i + len <= rsp.size(); i += len) {
+                last = get_le16(rsp.data() + i);
+                const uint16_t value = get_le16(rsp.data() + i + 3);
+                if(m_value_handle) {
+                    // Declaration after ours ends its descriptors
+                    value_end = last - 1;
+                    break;
+                }
+                if(len == 21 && std::equal(SMP_CHARACTERISTIC.begin(), SMP_CHARACTERISTIC.end(), rsp.data() + i + 5)) {
+                    m_value_handle = value;
+                }
+            }
+            start = static_cast<uint16_t>(last + 1);
+        }
+        if(!m_value_handle) {
+            throw step_error("no SMP characteristic");
+        }
+
+        // Find Information: the client configuration descriptor after the value
+        bytes_t find = { 0x04 };
+        put_le16(find, static_cast<uint16_t>(m_value_handle + 1));
+        put_le16(find, value_end);
+        const bytes_t info = transact(find);
+        uint16_t cccd = 0;
+        if(info[0] == 0x05 && info.size() >= 2 && info[1] == 0x01) {
+            for(size_t i = 2; i + 4 <= info.size(); i += 4) {
+                if(get_le16(info.data() + i + 2) == 0x2902) {
+                    cccd = get_le16(info.data() + i);
+                    break;
+                }
+            }
+        }
+        if(!cccd) {
+            throw step_error("SMP characteristic does not notify");
+        }
+        bytes_t subscribe = { 0x12 };
+        put_le16(subscribe, cccd);
+        put_le16(subscribe, 0x0001);
+        if(transact(subscribe)[0] != 0x13) {
+            throw step_error("SMP notifications refused");
+        }
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef FLEET_DFU_CBOR_HPP
+#define FLEET_DFU_CBOR_HPP
+
+// The part of CBOR that SMP payloads use: maps keyed by text, integers, byte and text
+// strings, arrays and booleans. mcumgr encodes its maps with indefinite length.
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace fleet {
+
+using bytes_t = std::vector<uint8_t>;
+
+struct value_t {
+    enum class type_e : uint8_t {
+        NONE,
+        UINT,
+        NINT,
+        BYTES,
+        TEXT,
+        ARRAY,
+        MAP,
+        BOOL
+    };
+
+    type_e type = type_e::NONE;
+    // Magnitude for UINT, -1 - value for NINT, the value for BOOL
+    uint64_t number = 0;
+    std::string string;
+    std::vector<value_t> items;
+    std::vector<std::pair<value_t, value_t>> entries;
+
+    // Entry of a map under a text key, null when absent
+    const value_t* get(std::string_view key) const {
+        for(const auto& [k, v] : entries) {
+            if(k.type == type_e::TEXT && k.string == key) {
+                return &v;
+            }
+        }
+        return nullptr;
+    }
+
+    int64_t integer(std::string_view key, int64_t fallback = 0) const {
+        const value_t* v = get(key);
+        if(!v) {
+            return fallback;
+        }
+        switch(v->type) {
+            case type_e::UINT:
+                return static_cast<int64_t>(v->number);
+            case type_e::NINT:
+                return -1 - static_cast<int64_t>(v->number);
+            default:
+                return fallback;
+        }
+    }
+
+    bool boolean(std::string_view key, bool fallback = false) const {
+        const value_t* v = get(key);
+        return v && v->type == type_e::BOOL ? v->number != 0 : fallback;
+    }
+
+    bytes_t bytes(std::string_view key) const {
+        const value_t* v = get(key);
+        if(!v || v->type != type_e::BYTES) {
+            return {};
+        }
+        return bytes_t(v->string.begin(), v->string.end());
+    }
+};
+
+// Definite length encoder, every map and array is opened with its number of items
+struct encoder_t {
+    bytes_t out;
+
+    void head(uint8_t major, uint64_t value) {
+        const uint8_t type = static_cast<uint8_t>(major << 5);
+        if(value < 24) {
+            out.push_back(type | static_cast<uint8_t>(value));
+        } else if(value <= UINT8_MAX) {
+            out.push_back(type | 24);
+            out.push_back(static_cast<uint8_t>(value));
+        } else if(value <= UINT16_MAX) {
+            out.push_back(type | 25);
+            put(value, 2);
+        } else if(value <= UINT32_MAX) {
+            out.push_back(type | 26);
+            put(value, 4);
+        } else {
+            out.push_back(type | 27);
+            put(value, 8);
+        }
+    }
+
+    encoder_t& map(size_t entries) {
+        head(5, entries);
+        return *this;
+    }
+
+    encoder_t& array(size_t items) {
+        head(4, items);
+        return *this;
+    }
+
+    encoder_t& uint(uint64_t value) {
+        head(0, value);
+        return *this;
+    }
+
+    encoder_t& text(std::string_view value) {
+        head(3, value.size());
+        out.insert(out.end(), value.begin(), value.end());
+        return *this;
+    }
+
+    encoder_t& bytes(const uint8_t* data, size_t len) {
+        head(2, len);
+        out.insert(out.end(), data, data + len);
+        return *this;
+    }
+
+    encoder_t& boolean(bool value) {
+        out.push_back(value ? 0xf5 : 0xf4);
+        return *this;
+    }
+
+private:
+    void put(uint64_t value, size_t len) {
+        for(size_t i = len; i-- > 0;) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+};
+
+struct decoder_t {
+    const uint8_t* p;
+    const uint8_t* end;
+
+    static constexpr int MAX_DEPTH = 8;
+
+    bool decode(value_t& value, int depth = 0) {
+        if(depth > MAX_DEPTH || p >= end) {
+            return false;
+        }
+        const uint8_t initial = *p++;
+        const uint8_t major = initial >> 5;
+        const uint8_t info = initial & 0x1f;
+
+        if(major == 7) {
+            if(info == 20 || info == 21) {
+                value.type = value_t::type_e::BOOL;
+                value.number = info == 21;
+                return true;
+            }
+            // null and undefined
+            return info == 22 || info == 23;
+        }
+
+        uint64_t argument = 0;
+        const bool indefinite = info == 31;
+        if(!indefinite && !read_argument(info, argument)) {
+            return false;
+        }
+
+        switch(major) {
+            case 0:
+            case 1:
+                value.type = major == 0 ? value_t::type_e::UINT : value_t::type_e::NINT;
+                value.number = argument;
+                return !indefinite;
+
+            case 2:
+            case 3:
+                value.type = major == 2 ? value_t::type_e::BYTES : value_t::type_e::TEXT;
+                if(!indefinite) {
+                    return read_string(argument, value.string);
+                }
+                // Chunks of definite strings until the break
+                while(p < end && *p != 0xff) {
+                    value_t chunk;
+                    if(!decode(chunk, depth + 1) || chunk.type != value.type) {
+                        return false;
+                    }
+                    value.string += chunk.string;
+                }
+                return take_break();
+
+            case 4:
+                value.type = value_t::type_e::ARRAY;
+                for(uint64_t i = 0; indefinite ? (p < end && *p != 0xff) : i < argument; i++) {
+                    value.items.emplace_back();
+                    if(!decode(value.items.back(), depth + 1)) {
+                        return false;
+                    }
+                }
+                return !indefinite || take_break();
+
+            case 5:
+                value.type = value_t::type_e::MAP;
+                for(uint64_t i = 0; indefinite ? (p < end && *p != 0xff) : i < argument; i++) {
+                    value.entries.emplace_back();
+                    if(!decode(value.entries.back().first, depth + 1) || !decode(value.entries.back().second, depth + 1)) {
+                        return false;
+                    }
+                }
+                return !indefinite || take_break();
+
+            default:
+                // Tags are skipped, the tagged value stands for itself
+                return major == 6 && !indefinite && decode(value, depth + 1);
+        }
+    }
+
+private:
+    bool read_argument(uint8_t info, uint64_t& argument) {
+        if(info < 24) {
+            argument = info;
+            return true;
+        }
+        if(info > 27) {
+            return false;
+        }
+        const size_t len = size_t{1} << (info - 24);
+        if(static_cast<size_t>(end - p) < len) {
+            return false;
+        }
+        for(size_t i = 0; i < len; i++) {
+            argument = (argument << 8) | *p++;
+        }
+        return true;
+    }
+
+    bool read_string(uint64_t len, std::string& out) {
+        if(static_cast<uint64_t>(end - p) < len) {
+            return false;
+        }
+        out.append(reinterpret_cast<const char*>(p), static_cast<size_t>(len));
+        p += len;
+        return true;
+    }
+
+    bool take_break() {
+        if(p >= end || *p != 0xff) {
+            return false;
+        }
+        p++;
+        return true;
+    }
+};
+
+inline bool decode(const uint8_t* data, size_t len, value_t& value) {
+    decoder_t decoder{ data, data + len };
+    return decoder.decode(value);
+}
+
+}
+
+#endif
@@ -0,0 +1,520 @@
+#ifndef FLEET_DFU_FLEET_HPP
+#define FLEET_DFU_FLEET_HPP
+
+// Updates tags to one signed image: list, upload, test, reset and confirm
+//
+// Every step is gated on the state the tag reports rather than on fixed sleeps, so an
+// attempt that failed picks up where the tag left off. A tag already running the image
+// confirmed is skipped, an image already in the secondary slot is not uploaded again and
+// an upload that was cut off resumes from the offset the tag reports for it. When the tag
+// runs the image a delta was built against, the delta goes through the DFU group of
+// app_dfu.hpp instead of the full image.
+
+#include "image.hpp"
+#include "smp.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace fleet {
+
+enum step_e : uint8_t {
+    STEP_LIST,
+    STEP_UPLOAD,
+    STEP_TEST,
+    STEP_BOOT,
+    STEP_CONFIRM,
+    NUM_STEPS
+};
+
+static constexpr const char* STEP_NAMES[NUM_STEPS] = { "list", "upload", "test", "boot", "confirm" };
+
+struct options_t {
+    // The signed image and its hash
+    bytes_t image;
+    bytes_t target;
+    // A delta to the image and the hash of the image it applies to, empty without
+    bytes_t delta;
+    bytes_t delta_base;
+
+    int retries = 2;
+    int poll_interval_ms = 2000;
+    int boot_timeout_ms = 60000;
+    int request_timeout_ms = 5000;
+    // Sends of a request, and timeouts in a row during an upload, before the attempt fails
+    int request_tries = 3;
+    // Upload requests in flight, app::upload_t::QUEUE_DEPTH
+    size_t window = 4;
+    // Largest data field, app::upload_t::CHUNK_MAX, lowered to what the transport carries
+    size_t chunk = 512;
+};
+
+// Opens a transport to the tag advertising or listening as name
+using connect_t = std::function<std::unique_ptr<transport_t>(const std::string& name)>;
+
+struct result_t {
+    std::string device;
+    std::string status = "pending";
+    int attempts = 0;
+    // Seconds per step over every attempt, and in all
+    double times[NUM_STEPS] = {};
+    double total = 0;
+    // full or delta, empty when nothing was uploaded
+    std::string mode;
+    uint64_t bytes = 0;
+    uint32_t resumed_from = 0;
+    std::string error;
+
+    double kbps() const {
+        return times[STEP_UPLOAD] > 0 ? bytes / 1024.0 / times[STEP_UPLOAD] : 0;
+    }
+};
+
+inline void log(const std::string& message) {
+    static std::mutex lock;
+    const std::time_t now = std::time(nullptr);
+    char stamp[16];
+    std::strftime(stamp, sizeof(stamp), "%H:%M:%S", std::localtime(&now));
+    std::lock_guard<std::mutex> guard(lock);
+    std::cout << "[" << stamp << "] " << message << std::endl;
+}
+
+struct slot_t {
+    uint32_t image = 0;
+    uint32_t slot = 0;
+    bytes_t hash;
+    bool active = false;
+    bool confirmed = false;
+    bool pending = false;
+};
+
+using slots_t = std::vector<slot_t>;
+
+struct tag_t {
+    // name, or OLD=NEW when the tag advertises as NEW once the image boots
+    tag_t(const std::string& spec, const options_t& options) : m_options(options) {
+        const size_t equals = spec.find('=');
+        m_name = spec.substr(0, equals);
+        m_booted_name = equals == std::string::npos ? m_name : spec.substr(equals + 1);
+        m_result.device = m_name;
+    }
+
+    result_t run(const connect_t& connect) {
+        const auto start = clock_t::now();
+        while(m_result.attempts < m_options.retries + 1) {
+            m_result.attempts++;
+            try {
+                m_result.status = update(connect);
+                m_result.error.clear();
+                break;
+            } catch(const step_error& err) {
+                m_result.status = "failed";
+                m_result.error = err.what();
+                log(m_name + ": attempt " + std::to_string(m_result.attempts) + " failed: " + err.what());
+                if(m_result.attempts <= m_options.retries) {
+                    const int backoff = std::min(m_options.poll_interval_ms << m_result.attempts, 60000);
+                    std::this_thread::sleep_for(std::chrono::milliseconds(backoff));
+                }
+            }
+        }
+        m_result.total = seconds(clock_t::now() - start);
+        char line[64];
+        std::snprintf(line, sizeof(line), ": %s in %.1fs", m_result.status.c_str(), m_result.total);
+        log(m_name + line);
+        return m_result;
+    }
+
+private:
+    using clock_t = std::chrono::steady_clock;
+
+    struct link_t {
+        std::unique_ptr<transport_t> transport;
+        std::unique_ptr<client_t> client;
+    };
+
+    // Bytes of an upload request besides its data: SMP header and the map of off, data and len
+    static constexpr size_t REQUEST_OVERHEAD = 40;
+
+    const options_t& m_options;
+    std::string m_name;
+    std::string m_booted_name;
+    result_t m_result;
+    bool m_changed = false;
+
+    static double seconds(clock_t::duration d) {
+        return std::chrono::duration<double>(d).count();
+    }
+
+    template<typename F>
+    auto timed(step_e step, F&& fn) {
+        const auto start = clock_t::now();
+        struct stop_t {
+            double& time;
+            clock_t::time_point start;
+            ~stop_t() {
+                time += seconds(clock_t::now() - start);
+            }
+        } stop{ m_result.times[step], start };
+        return fn();
+    }
+
+    link_t open(const connect_t& connect, const std::string& name) {
+        link_t link;
+        link.transport = connect(name);
+        link.client = std::make_unique<client_t>(*link.transport, m_options.request_timeout_ms, m_options.request_tries);
+        return link;
+    }
+
+    static slots_t list(client_t& client) {
+        const value_t state = client.read(smp::GROUP_IMAGE, smp::ID_IMAGE_STATE, "image list");
+        slots_t slots;
+        if(const value_t* images = state.get("images")) {
+            for(const value_t& image : images->items) {
+                slot_t slot;
+                slot.image = static_cast<uint32_t>(image.integer("image"));
+                slot.slot = static_cast<uint32_t>(image.integer("slot"));
+                slot.hash = image.bytes("hash");
+                slot.active = image.boolean("active");
+                slot.confirmed = image.boolean("confirmed");
+                slot.pending = image.boolean("pending");
+                slots.push_back(slot);
+            }
+        }
+        return slots;
+    }
+
+    static const slot_t* find(const slots_t& slots, uint32_t index) {
+        for(const slot_t& slot : slots) {
+            if(slot.image == 0 && slot.slot == index) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    }
+
+    bool running_target(const slots_t& slots) const {
+        const slot_t* primary = find(slots, 0);
+        return primary && primary->active && primary->hash == m_options.target;
+    }
+
+    // Offset an earlier upload of the same data got to, 0 to start over
+    uint32_t resume_offset(client_t& client, bool delta, size_t total) {
+        value_t state;
+        try {
+            state = client.read(smp::GROUP_DFU, smp::ID_DFU_DELTA, "upload state");
+        } catch(const smp_error&) {
+            // Without the DFU group, or the upload failed on the tag
+            return 0;
+        }
+        if(state.boolean("done") || state.boolean("delta") != delta || state.integer("len") != static_cast<int64_t>(total)) {
+            return 0;
+        }
+        const int64_t off = state.integer("off");
+        return off > 0 && off < static_cast<int64_t>(total) ? static_cast<uint32_t>(off) : 0;
+    }
+
+    // Keeps window requests in flight from start until the tag reports all of data written.
+    // A reply with another offset than right after its chunk, when the tag was busy, holds
+    // back the last chunk or lost its session, sends from that offset on.
+    void upload(client_t& client, uint16_t group, uint8_t id, const bytes_t& data, uint32_t start) {
+        struct in_flight_t {
+            uint32_t off;
+            uint32_t len;
+            uint32_t epoch;
+        };
+
+        const uint32_t total = static_cast<uint32_t>(data.size());
+        const size_t mtu = client.transport.mtu();
+        const size_t chunk = std::min(m_options.chunk, mtu > REQUEST_OVERHEAD ? mtu - REQUEST_OVERHEAD : 1);
+        std::map<uint8_t, in_flight_t> in_flight;
+        uint32_t next = start;
+        uint32_t acked = start;
+        uint32_t epoch = 0;
+        int stalls = 0;
+
+        while(true) {
+            while(in_flight.size() < m_options.window && next < total) {
+                const uint32_t len = static_cast<uint32_t>(std::min<size_t>(chunk, total - next));
+                encoder_t request;
+                request.map(next == 0 ? 3 : 2);
+                request.text("off").uint(next);
+                request.text("data").bytes(data.data() + next, len);
+                if(next == 0) {
+                    request.text("len").uint(total);
+                }
+                const uint8_t seq = client.send(smp::OP_WRITE, group, id, request.out);
+                in_flight[seq] = { next, len, epoch };
+                next += len;
+                m_result.bytes += len;
+            }
+
+            response_t response;
+            if(!client.receive(response, m_options.request_timeout_ms)) {
+                if(++stalls >= m_options.request_tries) {
+                    throw step_error("upload stalled at " + std::to_string(acked));
+                }
+                // Nothing in flight will be answered, go back to what was acknowledged last
+                in_flight.clear();
+                epoch++;
+                next = acked;
+                continue;
+            }
+            const auto it = in_flight.find(response.header.seq);
+            if(it == in_flight.end() || response.header.group != group || response.header.id != id) {
+                continue;
+            }
+            const in_flight_t request = it->second;
+            in_flight.erase(it);
+            if(request.epoch != epoch) {
+                // Sent before the last seek, answered for the window only
+                continue;
+            }
+
+            const int rc = static_cast<int>(response.body.integer("rc", smp::RC_EOK));
+            if(rc != smp::RC_EOK) {
+                throw smp_error("upload at " + std::to_string(request.off), rc);
+            }
+            const int64_t off = response.body.integer("off", -1);
+            if(off < 0 || off > total) {
+                throw step_error("upload answered with offset " + std::to_string(off));
+            }
+            // Stock img_mgmt has no done and only reports the length once the image is in
+            if(off == total && response.body.boolean("done", true)) {
+                return;
+            }
+            if(static_cast<uint32_t>(off) != acked) {
+                stalls = 0;
+            }
+            acked = static_cast<uint32_t>(off);
+            if(acked != request.off + request.len) {
+                epoch++;
+                next = acked;
+            }
+        }
+    }
+
+    void upload_image(client_t& client, const slots_t& slots) {
+        const slot_t* primary = find(slots, 0);
+        const bool delta = !m_options.delta.empty() && primary && primary->hash == m_options.delta_base;
+        if(delta) {
+            try {
+                send_image(client, true, m_options.delta);
+                return;
+            } catch(const smp_error& err) {
+                // Not the image the delta was built against after all, or no delta support
+                if(err.rc != smp::RC_EBADSTATE && err.rc != smp::RC_ENOTSUP) {
+                    throw;
+                }
+                log(m_name + ": delta refused, " + err.what() + ", sending the full image");
+            }
+        }
+        send_image(client, false, m_options.image);
+    }
+
+    void send_image(client_t& client, bool delta, const bytes_t& data) {
+        const uint32_t start = resume_offset(client, delta, data.size());
+        if(start) {
+            log(m_name + ": resuming upload at " + std::to_string(start) + " of " + std::to_string(data.size()));
+            m_result.resumed_from = start;
+        }
+        m_result.mode = delta ? "delta" : "full";
+        m_changed = true;
+        upload(client, delta ? smp::GROUP_DFU : smp::GROUP_IMAGE, delta ? smp::ID_DFU_DELTA : smp::ID_IMAGE_UPLOAD,
+            data, start);
+    }
+
+    // Lists the tag until ready holds, it may still be rebooting meanwhile
+    slots_t poll(const connect_t& connect, link_t& link, const std::function<bool(const slots_t&)>& ready,
+            const char* what) {
+        const auto deadline = clock_t::now() + std::chrono::milliseconds(m_options.boot_timeout_ms);
+        while(true) {
+            try {
+                if(!link.client) {
+                    link = open(connect, m_booted_name);
+                }
+                slots_t slots = list(*link.client);
+                if(ready(slots)) {
+                    return slots;
+                }
+            } catch(const step_error&) {
+                link = {};
+            }
+            if(clock_t::now() > deadline) {
+                throw step_error(std::string(what) + " not seen within " + std::to_string(m_options.boot_timeout_ms / 1000) + "s");
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(m_options.poll_interval_ms));
+        }
+    }
+
+    // One attempt, resuming from whatever state the tag reports
+    std::string update(const connect_t& connect) {
+        link_t link;
+        slots_t slots;
+        try {
+            timed(STEP_LIST, [&] {
+                link = open(connect, m_name);
+                slots = list(*link.client);
+            });
+        } catch(const step_error&) {
+            if(m_booted_name == m_name) {
+                throw;
+            }
+            link = {};
+        }
+        if(!running_target(slots) && m_booted_name != m_name) {
+            // A previous attempt may have booted the image under its new name already
+            try {
+                timed(STEP_LIST, [&] {
+                    link_t renamed = open(connect, m_booted_name);
+                    slots_t booted = list(*renamed.client);
+                    if(running_target(booted)) {
+                        link = std::move(renamed);
+                        slots = std::move(booted);
+                    }
+                });
+            } catch(const step_error&) {
+                if(!link.client) {
+                    throw;
+                }
+            }
+            if(!link.client) {
+                throw step_error(m_name + " not found under either name");
+            }
+        }
+
+        if(!running_target(slots)) {
+            client_t& client = *link.client;
+            const slot_t* secondary = find(slots, 1);
+            if(!secondary || secondary->hash != m_options.target) {
+                timed(STEP_UPLOAD, [&] { upload_image(client, slots); });
+                slots = timed(STEP_LIST, [&] { return list(client); });
+                secondary = find(slots, 1);
+                if(!secondary || secondary->hash != m_options.target) {
+                    throw step_error("uploaded image not listed in the secondary slot");
+                }
+            }
+
+            timed(STEP_TEST, [&] {
+                if(!secondary->pending) {
+                    encoder_t test;
+                    test.map(2).text("hash").bytes(m_options.target.data(), m_options.target.size());
+                    test.text("confirm").boolean(false);
+                    client.write(smp::GROUP_IMAGE, smp::ID_IMAGE_STATE, test.out, "image test");
+                }
+                encoder_t empty;
+                empty.map(0);
+                try {
+                    client.write(smp::GROUP_OS, smp::ID_OS_RESET, empty.out, "reset");
+                } catch(const step_error&) {
+                    // The reply may be lost to the reset, booting is checked next
+                }
+            });
+            m_changed = true;
+            link = {};
+            slots = timed(STEP_BOOT, [&] {
+                return poll(connect, link, [this](const slots_t& s) { return running_target(s); }, "new image");
+            });
+        }
+
+        if(find(slots, 0)->confirmed) {
+            return m_changed ? "updated" : "current";
+        }
+
+        timed(STEP_CONFIRM, [&] {
+            encoder_t confirm;
+            confirm.map(1).text("confirm").boolean(true);
+            link.client->write(smp::GROUP_IMAGE, smp::ID_IMAGE_STATE, confirm.out, "image confirm");
+            poll(connect, link, [this](const slots_t& s) { return running_target(s) && find(s, 0)->confirmed; },
+                "confirmed image");
+        });
+        return "updated";
+    }
+};
+
+// Updates every device, each lane working on one tag at a time
+inline std::vector<result_t> update_fleet(const std::vector<std::string>& devices, const std::vector<connect_t>& lanes,
+        const options_t& options) {
+    std::vector<result_t> results(devices.size());
+    std::atomic<size_t> next{ 0 };
+    std::vector<std::thread> workers;
+    for(const connect_t& lane : lanes) {
+        workers.emplace_back([&, lane] {
+            for(size_t i; (i = next++) < devices.size();) {
+                results[i] = tag_t(devices[i], options).run(lane);
+            }
+        });
+    }
+    for(auto& worker : workers) {
+        worker.join();
+    }
+    return results;
+}
+
+// Timing report, a table on out and CSV at path when given
+inline bool report(std::ostream& out, const std::vector<result_t>& results, const std::string& path = {}) {
+    std::vector<std::vector<std::string>> rows;
+    rows.push_back({ "device", "status", "attempts" });
+    rows[0].insert(rows[0].end(), std::begin(STEP_NAMES), std::end(STEP_NAMES));
+    rows[0].insert(rows[0].end(), { "total", "mode", "bytes", "resumed_from", "KB/s", "error" });
+    for(const result_t& r : results) {
+        auto fixed = [](double value) {
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.1f", value);
+            return std::string(text);
+        };
+        std::vector<std::string> row = { r.device, r.status, std::to_string(r.attempts) };
+        for(double time : r.times) {
+            row.push_back(fixed(time));
+        }
+        row.insert(row.end(), { fixed(r.total), r.mode.empty() ? "-" : r.mode, std::to_string(r.bytes),
+            std::to_string(r.resumed_from), fixed(r.kbps()), r.error });
+        rows.push_back(row);
+    }
+
+    std::vector<size_t> widths(rows[0].size(), 0);
+    for(const auto& row : rows) {
+        for(size_t i = 0; i < row.size(); i++) {
+            widths[i] = std::max(widths[i], row[i].size());
+        }
+    }
+    for(const auto& row : rows) {
+        for(size_t i = 0; i < row.size(); i++) {
+            out << row[i];
+            if(i + 1 < row.size()) {
+                out << std::string(widths[i] - row[i].size() + 2, ' ');
+            }
+        }
+        out << "\n";
+    }
+
+    if(path.empty()) {
+        return true;
+    }
+    std::ofstream csv(path);
+    for(const auto& row : rows) {
+        for(size_t i = 0; i < row.size(); i++) {
+            const bool quote = row[i].find_first_of(",\"\n") != std::string::npos;
+            std::string field = row[i];
+            for(size_t at = 0; quote && (at = field.find('"', at)) != std::string::npos; at += 2) {
+                field.insert(at, 1, '"');
+            }
+            csv << (i ? "," : "") << (quote ? "\"" + field + "\"" : field);
+        }
+        csv << "\n";
+    }
+    return static_cast<bool>(csv);
+}
+
+}
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef FLEET_DFU_IMAGE_HPP
+#define FLEET_DFU_IMAGE_HPP
+
+// MCUboot image metadata, as scripts/delta_image.py reads it
+
+#include "cbor.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+
+namespace fleet {
+
+static constexpr uint32_t IMAGE_MAGIC = 0x96f3b83d;
+static constexpr uint16_t TLV_INFO_MAGIC = 0x6907;
+static constexpr uint16_t TLV_PROT_INFO_MAGIC = 0x6908;
+static constexpr uint8_t TLV_SHA256 = 0x10;
+
+inline uint32_t read_le(const bytes_t& data, size_t offset, size_t len) {
+    uint32_t value = 0;
+    for(size_t i = len; i-- > 0;) {
+        value = value << 8 | data[offset + i];
+    }
+    return value;
+}
+
+// SHA256 TLV of an image, the hash `image list` reports, nothing when data is not a signed image
+inline std::optional<bytes_t> image_hash(const bytes_t& image) {
+    if(image.size() < 32 || read_le(image, 0, 4) != IMAGE_MAGIC) {
+        return std::nullopt;
+    }
+    size_t offset = read_le(image, 8, 2) + size_t{read_le(image, 12, 4)};
+    while(offset + 4 <= image.size()) {
+        const uint32_t info_magic = read_le(image, offset, 2);
+        if(info_magic != TLV_INFO_MAGIC && info_magic != TLV_PROT_INFO_MAGIC) {
+            return std::nullopt;
+        }
+        const size_t end = offset + read_le(image, offset + 2, 2);
+        for(offset += 4; offset + 4 <= end && end <= image.size();) {
+            const uint32_t type = read_le(image, offset, 2);
+            const size_t len = read_le(image, offset + 2, 2);
+            if((type & 0xff) == TLV_SHA256 && offset + 4 + len <= image.size()) {
+                return bytes_t(image.begin() + offset + 4, image.begin() + offset + 4 + len);
+            }
+            offset += 4 + len;
+        }
+        offset = end;
+    }
+    return std::nullopt;
+}
+
+inline uint32_t crc32_ieee(const bytes_t& data) {
+    uint32_t crc = 0xffffffff;
+    for(uint8_t b : data) {
+        crc ^= b;
+        for(int i = 0; i < 8; i++) {
+            crc = crc >> 1 ^ (0xedb88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+// Whether delta turns base into image, from the sizes and CRCs in its header (app/delta.hpp)
+inline bool delta_matches(const bytes_t& delta, const bytes_t& base, const bytes_t& image) {
+    // DLT1, or DLT2 when it carries LZ4 compressed literals
+    static constexpr uint32_t DELTA_MAGIC = 0x31544c44;
+    static constexpr uint32_t DELTA_MAGIC_LZ4 = 0x32544c44;
+    const uint32_t magic = delta.size() >= 20 ? read_le(delta, 0, 4) : 0;
+    return (magic == DELTA_MAGIC || magic == DELTA_MAGIC_LZ4)
+        && read_le(delta, 4, 4) == base.size() && read_le(delta, 8, 4) == crc32_ieee(base)
+        && read_le(delta, 12, 4) == image.size() && read_le(delta, 16, 4) == crc32_ieee(image);
+}
+
+inline std::string hex(const bytes_t& data) {
+    static constexpr char digits[] = "0123456789abcdef";
+    std::string out;
+    for(uint8_t b : data) {
+        out += digits[b >> 4];
+        out += digits[b & 0xf];
+    }
+    return out;
+}
+
+inline std::optional<bytes_t> read_file(const std::string& path) {
+    std::ifstream file(path, std::ios::binary);
+    if(!file) {
+        return std::nullopt;
+    }
+    return bytes_t(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+}
+
+#endif
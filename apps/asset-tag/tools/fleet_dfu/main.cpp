@@ -0,0 +1,232 @@
+// Updates many tags to one signed image over SMP, several at once
+//
+//   fleet_dfu build_app/zephyr/zephyr.signed.bin ASS0 ASS1 MSD1=ASS2
+//   fleet_dfu --fleet tags.txt --controllers hci0,hci1 --per-controller 4 zephyr.signed.bin
+//   fleet_dfu --transport udp 127.0.0.1:1337 zephyr.signed.bin
+//
+// A device written OLD=NEW advertises as OLD until the new image boots and as NEW after.
+// Over BLE every controller keeps --per-controller tags connected at once, over UDP devices
+// are host:port and --jobs are updated at once, e.g. the simulated tags of tests/unit/test_fleet.cpp.
+
+#include "ble.hpp"
+#include "fleet.hpp"
+#include "udp.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+struct arguments_t {
+    std::string image;
+    std::vector<std::string> devices;
+    std::string transport = "ble";
+    std::string controllers = "hci0";
+    int per_controller = 3;
+    int jobs = 4;
+    int scan_timeout_ms = 10000;
+    std::string delta;
+    std::string delta_base;
+    std::string report;
+    fleet::options_t options;
+};
+
+[[noreturn]] void usage(const char* error = nullptr) {
+    if(error) {
+        std::cerr << "fleet_dfu: " << error << "\n";
+    }
+    std::cerr <<
+        "usage: fleet_dfu [options] IMAGE [DEVICE|OLD=NEW ...]\n"
+        "  --fleet FILE            one device per line, # starts a comment\n"
+        "  --transport ble|udp     ble by default, udp devices are host:port\n"
+        "  --controllers LIST      comma separated HCI controllers, hci0 by default\n"
+        "  --per-controller N      tags connected at once per controller, 3 by default\n"
+        "  --jobs N                tags updated at once over udp, 4 by default\n"
+        "  --delta FILE            delta from make delta, sent to tags running --delta-base\n"
+        "  --delta-base FILE       signed image the delta was built against\n"
+        "  --retries N             attempts after the first, 2 by default\n"
+        "  --poll-interval S       between lists while a tag reboots, 2 by default\n"
+        "  --boot-timeout S        60 by default\n"
+        "  --request-timeout S     per SMP request, 5 by default\n"
+        "  --scan-timeout S        to find a tag over BLE, 10 by default\n"
+        "  --window N              upload requests in flight, 4 by default\n"
+        "  --chunk N               largest data per upload request, 512 by default\n"
+        "  --report FILE           also write the timing report as CSV\n";
+    std::exit(2);
+}
+
+int number(const char* value) {
+    char* end = nullptr;
+    const long parsed = std::strtol(value, &end, 10);
+    if(!*value || *end || parsed < 0) {
+        usage("expected a number");
+    }
+    return static_cast<int>(parsed);
+}
+
+arguments_t parse(int argc, char** argv) {
+    arguments_t args;
+    std::vector<std::string> positional;
+    for(int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if(arg.rfind("--", 0) != 0) {
+            positional.push_back(arg);
+            continue;
+        }
+        if(arg == "--help") {
+            usage();
+        }
+        if(i + 1 >= argc) {
+            usage("missing value");
+        }
+        const char* value = argv[++i];
+        if(arg == "--fleet") {
+            std::ifstream file(value);
+            if(!file) {
+                usage("cannot read the fleet file");
+            }
+            for(std::string line; std::getline(file, line);) {
+                std::istringstream words(line.substr(0, line.find('#')));
+                std::string device;
+                if(words >> device) {
+                    args.devices.push_back(device);
+                }
+            }
+        } else if(arg == "--transport") {
+            args.transport = value;
+        } else if(arg == "--controllers") {
+            args.controllers = value;
+        } else if(arg == "--per-controller") {
+            args.per_controller = std::max(number(value), 1);
+        } else if(arg == "--jobs") {
+            args.jobs = std::max(number(value), 1);
+        } else if(arg == "--delta") {
+            args.delta = value;
+        } else if(arg == "--delta-base") {
+            args.delta_base = value;
+        } else if(arg == "--retries") {
+            args.options.retries = number(value);
+        } else if(arg == "--poll-interval") {
+            args.options.poll_interval_ms = number(value) * 1000;
+        } else if(arg == "--boot-timeout") {
+            args.options.boot_timeout_ms = number(value) * 1000;
+        } else if(arg == "--request-timeout") {
+            args.options.request_timeout_ms = number(value) * 1000;
+        } else if(arg == "--scan-timeout") {
+            args.scan_timeout_ms = number(value) * 1000;
+        } else if(arg == "--window") {
+            args.options.window = std::max(number(value), 1);
+        } else if(arg == "--chunk") {
+            args.options.chunk = std::max(number(value), 1);
+        } else if(arg == "--report") {
+            args.report = value;
+        } else {
+            usage(("unknown option " + arg).c_str());
+        }
+    }
+    if(positional.empty()) {
+        usage("no image given");
+    }
+    args.image = positional[0];
+    args.devices.insert(args.devices.begin(), positional.begin() + 1, positional.end());
+    if(args.devices.empty()) {
+        usage("no devices given");
+    }
+    if(args.transport != "ble" && args.transport != "udp") {
+        usage("transport is ble or udp");
+    }
+    if(args.delta.empty() != args.delta_base.empty()) {
+        usage("--delta and --delta-base go together");
+    }
+    return args;
+}
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    std::istringstream in(list);
+    for(std::string item; std::getline(in, item, ',');) {
+        if(!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+}
+
+int main(int argc, char** argv) {
+    arguments_t args = parse(argc, argv);
+    fleet::options_t& options = args.options;
+
+    const auto image = fleet::read_file(args.image);
+    const auto target = image ? fleet::image_hash(*image) : std::nullopt;
+    if(!target) {
+        std::cerr << args.image << " is not a signed MCUboot image\n";
+        return 1;
+    }
+    options.image = *image;
+    options.target = *target;
+
+    if(!args.delta.empty()) {
+        const auto delta = fleet::read_file(args.delta);
+        const auto base = fleet::read_file(args.delta_base);
+        const auto base_hash = base ? fleet::image_hash(*base) : std::nullopt;
+        if(!delta || !base_hash) {
+            std::cerr << "cannot read the delta or its signed base image\n";
+            return 1;
+        }
+        if(fleet::delta_matches(*delta, *base, *image)) {
+            options.delta = *delta;
+            options.delta_base = *base_hash;
+            fleet::log("Delta of " + std::to_string(delta->size()) + " bytes for tags running " + fleet::hex(*base_hash));
+        } else {
+            // Built for another image, e.g. before the last make app
+            fleet::log(args.delta + " does not turn " + args.delta_base + " into " + args.image + ", sending full images");
+        }
+    }
+
+    // Each lane updates one tag at a time
+    std::vector<fleet::connect_t> lanes;
+    std::vector<std::unique_ptr<fleet::ble::controller_t>> controllers;
+    if(args.transport == "ble") {
+        for(const std::string& name : split(args.controllers)) {
+            try {
+                controllers.push_back(std::make_unique<fleet::ble::controller_t>(name));
+            } catch(const std::exception& err) {
+                std::cerr << err.what() << "\n";
+                return 1;
+            }
+            fleet::ble::controller_t& controller = *controllers.back();
+            for(int i = 0; i < args.per_controller; i++) {
+                lanes.push_back([&controller, &args](const std::string& device) -> std::unique_ptr<fleet::transport_t> {
+                    return std::make_unique<fleet::ble::gatt_transport_t>(controller, device, args.scan_timeout_ms,
+                        args.options.request_timeout_ms);
+                });
+            }
+        }
+    } else {
+        for(int i = 0; i < args.jobs; i++) {
+            lanes.push_back([](const std::string& device) -> std::unique_ptr<fleet::transport_t> {
+                return std::make_unique<fleet::udp_transport_t>(device);
+            });
+        }
+    }
+    if(lanes.empty()) {
+        std::cerr << "no controllers given\n";
+        return 1;
+    }
+
+    fleet::log("Installing " + fleet::hex(options.target) + " on " + std::to_string(args.devices.size()) + " tags over "
+        + std::to_string(lanes.size()) + " lanes");
+    const auto results = fleet::update_fleet(args.devices, lanes, options);
+    if(!fleet::report(std::cout, results, args.report)) {
+        std::cerr << "cannot write " << args.report << "\n";
+    }
+    for(const auto& result : results) {
+        if(result.status == "failed") {
+            return 1;
+        }
+    }
+    return 0;
+}
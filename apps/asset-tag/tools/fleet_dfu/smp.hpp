@@ -0,0 +1,191 @@
+#ifndef FLEET_DFU_SMP_HPP
+#define FLEET_DFU_SMP_HPP
+
+// SMP framing and a client that matches responses to requests by sequence number
+
+#include "cbor.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+namespace fleet {
+
+// A step that did not complete, the tag is retried from the state it reports
+struct step_error : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// A response with a non-zero rc
+struct smp_error : step_error {
+    int rc;
+
+    smp_error(const std::string& what, int rc)
+        : step_error(what + ": rc " + std::to_string(rc)), rc(rc) {}
+};
+
+namespace smp {
+
+enum op_e : uint8_t {
+    OP_READ = 0,
+    OP_READ_RSP = 1,
+    OP_WRITE = 2,
+    OP_WRITE_RSP = 3
+};
+
+enum group_e : uint16_t {
+    GROUP_OS = 0,
+    GROUP_IMAGE = 1,
+    // app_dfu.hpp, MGMT_GROUP_ID_PERUSER + 1
+    GROUP_DFU = 65
+};
+
+enum id_e : uint8_t {
+    ID_OS_RESET = 5,
+    ID_IMAGE_STATE = 0,
+    ID_IMAGE_UPLOAD = 1,
+    ID_DFU_DELTA = 0
+};
+
+// mcumgr MGMT_ERR codes
+enum rc_e : int {
+    RC_EOK = 0,
+    RC_EBADSTATE = 6,
+    RC_ENOTSUP = 8
+};
+
+static constexpr size_t HEADER_SIZE = 8;
+
+struct header_t {
+    uint8_t op;
+    uint8_t flags;
+    uint16_t len;
+    uint16_t group;
+    uint8_t seq;
+    uint8_t id;
+
+    void write(bytes_t& out) const {
+        out.push_back(op);
+        out.push_back(flags);
+        out.push_back(static_cast<uint8_t>(len >> 8));
+        out.push_back(static_cast<uint8_t>(len));
+        out.push_back(static_cast<uint8_t>(group >> 8));
+        out.push_back(static_cast<uint8_t>(group));
+        out.push_back(seq);
+        out.push_back(id);
+    }
+
+    static header_t read(const uint8_t* p) {
+        return { static_cast<uint8_t>(p[0] & 0x07), p[1], static_cast<uint16_t>(p[2] << 8 | p[3]),
+            static_cast<uint16_t>(p[4] << 8 | p[5]), p[6], p[7] };
+    }
+};
+
+// Packet length from the header at the front of a stream, 0 until a header is there
+inline size_t packet_size(const bytes_t& stream) {
+    if(stream.size() < HEADER_SIZE) {
+        return 0;
+    }
+    return HEADER_SIZE + header_t::read(stream.data()).len;
+}
+
+}
+
+// Carries whole SMP packets to one tag
+struct transport_t {
+    virtual ~transport_t() = default;
+
+    virtual void send(const bytes_t& packet) = 0;
+    // Next packet from the tag, false when none arrived within timeout_ms
+    virtual bool receive(bytes_t& packet, int timeout_ms) = 0;
+    // Largest request the tag accepts in one piece
+    virtual size_t mtu() const = 0;
+};
+
+struct response_t {
+    smp::header_t header;
+    value_t body;
+};
+
+struct client_t {
+    transport_t& transport;
+    int timeout_ms;
+    // Attempts of a request before the step fails
+    int tries;
+
+    client_t(transport_t& transport, int timeout_ms, int tries = 3)
+        : transport(transport), timeout_ms(timeout_ms), tries(tries) {}
+
+    // Sends a request without waiting, returns its sequence number
+    uint8_t send(uint8_t op, uint16_t group, uint8_t id, const bytes_t& payload) {
+        const uint8_t seq = m_seq++;
+        bytes_t packet;
+        packet.reserve(smp::HEADER_SIZE + payload.size());
+        smp::header_t{ op, 0, static_cast<uint16_t>(payload.size()), group, seq, id }.write(packet);
+        packet.insert(packet.end(), payload.begin(), payload.end());
+        transport.send(packet);
+        return seq;
+    }
+
+    // Next well formed response, false after timeout_ms without one
+    bool receive(response_t& response, int timeout) {
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        bytes_t packet;
+        while(true) {
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            if(left < 0 || !transport.receive(packet, static_cast<int>(left))) {
+                return false;
+            }
+            if(packet.size() < smp::HEADER_SIZE) {
+                continue;
+            }
+            response.header = smp::header_t::read(packet.data());
+            response.body = {};
+            const bool reply = response.header.op == smp::OP_READ_RSP || response.header.op == smp::OP_WRITE_RSP;
+            if(reply && packet.size() == smp::packet_size(packet)
+                && decode(packet.data() + smp::HEADER_SIZE, response.header.len, response.body)
+                && response.body.type == value_t::type_e::MAP) {
+                return true;
+            }
+        }
+    }
+
+    // Sends until the matching response arrives, throws when it does not or its rc is set
+    value_t request(uint8_t op, uint16_t group, uint8_t id, const bytes_t& payload, const std::string& what) {
+        for(int attempt = 0; attempt < tries; attempt++) {
+            const uint8_t seq = send(op, group, id, payload);
+            response_t response;
+            while(receive(response, timeout_ms)) {
+                if(response.header.seq != seq || response.header.group != group || response.header.id != id) {
+                    // Late answer to an earlier request
+                    continue;
+                }
+                const int rc = static_cast<int>(response.body.integer("rc", smp::RC_EOK));
+                if(rc != smp::RC_EOK) {
+                    throw smp_error(what, rc);
+                }
+                return std::move(response.body);
+            }
+        }
+        throw step_error(what + " timed out");
+    }
+
+    value_t read(uint16_t group, uint8_t id, const std::string& what) {
+        encoder_t empty;
+        empty.map(0);
+        return request(smp::OP_READ, group, id, empty.out, what);
+    }
+
+    value_t write(uint16_t group, uint8_t id, const bytes_t& payload, const std::string& what) {
+        return request(smp::OP_WRITE, group, id, payload, what);
+    }
+
+private:
+    uint8_t m_seq = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef FLEET_DFU_UDP_HPP
+#define FLEET_DFU_UDP_HPP
+
+// SMP over UDP, one datagram per packet, as the Zephyr SMP UDP transport speaks it
+
+#include "smp.hpp"
+
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace fleet {
+
+struct udp_transport_t : transport_t {
+    // CONFIG_MCUMGR_SMP_UDP_MTU of the SMP server sample
+    static constexpr size_t MTU = 1024;
+
+    // address is host:port
+    explicit udp_transport_t(const std::string& address) {
+        const size_t colon = address.rfind(':');
+        if(colon == std::string::npos) {
+            throw step_error(address + ": expected host:port");
+        }
+        const std::string host = address.substr(0, colon);
+        const std::string port = address.substr(colon + 1);
+
+        addrinfo hints = {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* found = nullptr;
+        if(getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0 || !found) {
+            throw step_error(address + ": cannot resolve");
+        }
+        m_socket = socket(found->ai_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        const bool connected = m_socket >= 0 && connect(m_socket, found->ai_addr, found->ai_addrlen) == 0;
+        freeaddrinfo(found);
+        if(!connected) {
+            throw step_error(address + ": " + std::strerror(errno));
+        }
+    }
+
+    ~udp_transport_t() override {
+        if(m_socket >= 0) {
+            close(m_socket);
+        }
+    }
+
+    udp_transport_t(const udp_transport_t&) = delete;
+
+    void send(const bytes_t& packet) override {
+        // Nobody listening shows up as ECONNREFUSED on a later call, the request fails there
+        ::send(m_socket, packet.data(), packet.size(), MSG_NOSIGNAL);
+    }
+
+    bool receive(bytes_t& packet, int timeout_ms) override {
+        pollfd fd = { m_socket, POLLIN, 0 };
+        if(poll(&fd, 1, timeout_ms) <= 0) {
+            return false;
+        }
+        packet.resize(MTU + smp::HEADER_SIZE);
+        const ssize_t n = recv(m_socket, packet.data(), packet.size(), 0);
+        if(n < 0) {
+            // ECONNREFUSED, nobody listens on the port yet
+            return false;
+        }
+        packet.resize(static_cast<size_t>(n));
+        return true;
+    }
+
+    size_t mtu() const override {
+        return MTU;
+    }
+
+private:
+    int m_socket = -1;
+};
+
+}
+
+#endif